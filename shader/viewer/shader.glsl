@@ -4,6 +4,14 @@
 
 uniform vec4 minMaxBound;
 
+//compact patches only contain a normalized height, position is reconstructed from the vertex id
+uniform bool compactPatch;
+uniform vec3 patchMin;
+uniform vec3 patchMax;
+uniform float patchSize;
+uniform sampler2D normalMap;
+layout(location = 1) in float compactHeight;
+
 out vec3 viewVector;
 out vec3 lightVector;
 out vec3 normalVertex;
@@ -14,17 +22,27 @@ void main() {
   float xNorm = 1.0f / (minMaxBound.z - minMaxBound.x);
   float yNorm = 1.0f / (minMaxBound.w - minMaxBound.y);
 
+  vec4 vertex = gl_Vertex;
+  if (compactPatch) {
+    float rowSize = patchSize + 1.0;
+    vec2 grid     = vec2(mod(float(gl_VertexID), rowSize), floor(float(gl_VertexID) / rowSize));
+    vertex        = vec4(mix(patchMin, patchMax, vec3(grid / patchSize, compactHeight)), 1.0);
+  }
+
   //calculate texture coordinates through normalized coordinates
-  gl_TexCoord[0]  = vec4((gl_Vertex.x - minMaxBound.x) * xNorm, (gl_Vertex.y - minMaxBound.y) * yNorm, 0, 0);
+  gl_TexCoord[0]  = vec4((vertex.x - minMaxBound.x) * xNorm, (vertex.y - minMaxBound.y) * yNorm, 0, 0);
+
+  //compact patches take their normal from the normal map
+  vec3 normal = compactPatch ? textureLod(normalMap, gl_TexCoord[0].st, 0.0).xyz * 2.0 - 1.0 : gl_Normal;
 
   //calculate view vector
-  normalVertex   = normalize(gl_NormalMatrix * gl_Normal);
-  viewVector     = vec3(gl_ModelViewMatrix * gl_Vertex);
+  normalVertex   = normalize(gl_NormalMatrix * normal);
+  viewVector     = vec3(gl_ModelViewMatrix * vertex);
   lightVector    = normalize(gl_LightSource[0].position.xyz);
  
   frontColor     = gl_Color;
  
-  gl_Position    = gl_ModelViewProjectionMatrix * gl_Vertex;
+  gl_Position    = gl_ModelViewProjectionMatrix * vertex;
 }
 
 //Fragment Shader
@@ -62,6 +80,6 @@ void main()
   vec4 ISpecular = gl_LightSource[0].specular * specular * gl_FrontMaterial.specular;
   ISpecular = max(ISpecular, vec4(0.0,0.0,0.0,0.0));
   //gl_FragColor   = vec4((gl_FrontLightModelProduct.sceneColor + IAmbient + IDiffuse) + ISpecular);
-  gl_FragColor   = vec4( ((gl_FrontLightModelProduct.sceneColor + IAmbient + IDiffuse) * vec3(terrainTexel)) + ISpecular); 
+  gl_FragColor   = vec4( ((gl_FrontLightModelProduct.sceneColor + IAmbient + IDiffuse).rgb * terrainTexel.rgb) + ISpecular.rgb, 1.0); 
   //gl_FragColor   = terrainTexel;
 }
@@ -0,0 +1,132 @@
+//Vertex Shader
+#shader(vs, vsmain)
+//--------------------------------------------------------------------------------------
+
+uniform vec4 tessPatchInfo;     //patch size, vertices per tessellation patch edge, patch error, view term
+
+out vec3 vertexPosition;
+out vec2 vertexGrid;
+
+void main() {
+  //the index of the corner vertex gives its position in the (patch size + 1)^2 vertex grid
+  float rowSize  = tessPatchInfo.x + 1.0;
+  vertexGrid     = vec2(mod(float(gl_VertexID), rowSize), floor(float(gl_VertexID) / rowSize));
+  vertexPosition = gl_Vertex.xyz;
+}
+
+//Tessellation Control Shader
+#shader(cs, csmain)
+//--------------------------------------------------------------------------------------
+
+layout(vertices = 4) out;
+
+uniform vec4 tessPatchInfo;     //patch size, vertices per tessellation patch edge, patch error, view term
+uniform vec4 tessEdgeLevels;    //levels of the patch borders (south, east, north, west)
+uniform vec3 tessViewPosition;
+
+in vec3 vertexPosition[];
+in vec2 vertexGrid[];
+
+out vec2 controlGrid[];
+
+//power of two level, so that the screen space error of the edge stays below the tolerance
+float ScreenSpaceLevel(vec3 a, vec3 b) {
+  float dist  = max(distance(tessViewPosition, 0.5 * (a + b)), 0.001);
+  float level = clamp(tessPatchInfo.w * tessPatchInfo.z * tessPatchInfo.y / dist, 1.0, tessPatchInfo.y);
+  return exp2(ceil(log2(level)));
+}
+
+void main() {
+  controlGrid[gl_InvocationID] = vertexGrid[gl_InvocationID];
+
+  if (gl_InvocationID == 0) {
+    vec2 gridMin = vertexGrid[0];
+    vec2 gridMax = vertexGrid[2];
+
+    //edges on the patch border have to match the neighbor patches, inner edges are driven by the screen space error
+    gl_TessLevelOuter[0] = (gridMin.x == 0.0)             ? tessEdgeLevels.w : ScreenSpaceLevel(vertexPosition[0], vertexPosition[3]);
+    gl_TessLevelOuter[1] = (gridMin.y == 0.0)             ? tessEdgeLevels.x : ScreenSpaceLevel(vertexPosition[0], vertexPosition[1]);
+    gl_TessLevelOuter[2] = (gridMax.x == tessPatchInfo.x) ? tessEdgeLevels.y : ScreenSpaceLevel(vertexPosition[1], vertexPosition[2]);
+    gl_TessLevelOuter[3] = (gridMax.y == tessPatchInfo.x) ? tessEdgeLevels.z : ScreenSpaceLevel(vertexPosition[3], vertexPosition[2]);
+
+    gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+    gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+  }
+}
+
+//Tessellation Evaluation Shader
+#shader(es, esmain)
+//--------------------------------------------------------------------------------------
+
+layout(quads, equal_spacing, ccw) in;
+
+uniform vec4 tessPatchInfo;     //patch size, vertices per tessellation patch edge, patch error, view term
+uniform vec4 minMaxBound;
+uniform samplerBuffer patchVertices;  //interleaved position and normal of the patch vertices
+
+in vec2 controlGrid[];
+
+out vec3 viewVector;
+out vec3 lightVector;
+out vec3 normalVertex;
+out vec4 frontColor;
+
+void main() {
+  //levels are powers of two, so each generated vertex hits a vertex of the patch grid
+  vec2 grid  = controlGrid[0] + floor(gl_TessCoord.xy * tessPatchInfo.y + 0.5);
+  int index  = int(grid.y * (tessPatchInfo.x + 1.0) + grid.x);
+  vec4 vertex = vec4(texelFetch(patchVertices, 2 * index).xyz, 1.0);
+  vec3 normal = texelFetch(patchVertices, 2 * index + 1).xyz;
+
+  //norm texture coordinates to bounds of the terrain
+  float xNorm = 1.0f / (minMaxBound.z - minMaxBound.x);
+  float yNorm = 1.0f / (minMaxBound.w - minMaxBound.y);
+
+  //calculate texture coordinates through normalized coordinates
+  gl_TexCoord[0]  = vec4((vertex.x - minMaxBound.x) * xNorm, (vertex.y - minMaxBound.y) * yNorm, 0, 0);
+
+  //calculate view vector
+  normalVertex   = normalize(gl_NormalMatrix * normal);
+  viewVector     = vec3(gl_ModelViewMatrix * vertex);
+  lightVector    = normalize(gl_LightSource[0].position.xyz);
+
+  frontColor     = vec4(1.0);
+
+  gl_Position    = gl_ModelViewProjectionMatrix * vertex;
+}
+
+//Fragment Shader
+#shader(fs, fsmain)
+//--------------------------------------------------------------------------------------
+
+
+uniform sampler2D normalMap;
+uniform sampler2D aoMap;
+uniform sampler2D terrainTexture;
+
+in vec3 viewVector;
+in vec3 lightVector;
+in vec3 normalVertex;
+in vec4 frontColor;
+
+void main()
+{
+  //textures
+  vec4 normalTexel    = texture2D(normalMap,gl_TexCoord[0].st) * 2.0 - 1.0;
+  vec4 aoTexel        = texture2D(aoMap,gl_TexCoord[0].st) * 0.5;
+  vec4 terrainTexel   = texture2D(terrainTexture, gl_TexCoord[0].st);
+
+  vec3 texNormal      = normalize( vec3(normalTexel) );
+
+  vec3 eye       = normalize(-viewVector);
+  vec3 reflected = normalize(reflect( -lightVector, normalVertex));
+
+  float lambert  = max(dot(texNormal, lightVector), 0.0);
+  float specular = pow( clamp(dot(reflected, eye), 0.0, 1.0), gl_FrontMaterial.shininess );
+
+  vec4 IAmbient  = (gl_LightSource[0].ambient * gl_FrontMaterial.ambient) + (gl_LightSource[0].ambient * aoTexel);
+  vec4 IDiffuse  = gl_LightSource[0].diffuse * lambert * gl_FrontMaterial.diffuse;
+  vec4 ISpecular = gl_LightSource[0].specular * specular * gl_FrontMaterial.specular;
+  ISpecular = max(ISpecular, vec4(0.0,0.0,0.0,0.0));
+  gl_FragColor   = vec4( ((gl_FrontLightModelProduct.sceneColor + IAmbient + IDiffuse).rgb * terrainTexel.rgb) + ISpecular.rgb, 1.0);
+}
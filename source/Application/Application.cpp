@@ -4,6 +4,9 @@
 #include <string>
 #include <glm/glm.hpp>
 #include "RasterTerrainModel.h"
+#include "ChunkedTerrainModel.h"
+#include "ClipmapTerrainModel.h"
+#include "TerrainWorld.h"
 #include "OpenGLWindow.h"
 
 #include "GuiManager.h"
@@ -18,7 +21,7 @@ namespace Application {
     //starts application
     std::cout << "Loading terrain data-set..." << std::endl;
 
-    //loading terrain model
+    //loading terrain model in the background, the window shows it as soon as it is available
     if (LoadTerrainModel(mTerrainModelPath.c_str())) {
 
       //creating render window
@@ -34,11 +37,26 @@ namespace Application {
 
   bool CApplication::LoadTerrainModel(std::string const & path)
   {
-    mModel.reset(new Terrain::CRasterTerrainModel);
+    //select the terrain engine by the file extension
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    if (extension == "hfc") {
+      //the patch payloads are read on demand, so loading only reads the hierarchy
+      Terrain::CChunkedTerrainModel* model = new Terrain::CChunkedTerrainModel;
+      model->SetStreaming(true);
+      mModel.reset(model);
+    }
+    else if (extension == "world") {
+      mModel.reset(new Terrain::CTerrainWorld);
+    }
+    else if (extension == "png") {
+      mModel.reset(new Terrain::CClipmapTerrainModel);
+    }
+    else {
+      mModel.reset(new Terrain::CRasterTerrainModel);
+    }
 
-    std::cout << "Loading new terrain model..." << std::endl;
-    mModel->Init(path.c_str());
-    std::cout << "Finished loading terrain model." << std::endl;
+    std::cout << "Loading new terrain model in the background..." << std::endl;
+    mModel->InitAsync(path.c_str());
 
     return mModel.get() != nullptr;
   }
@@ -102,8 +102,14 @@ namespace Application {
 
 		//put out fps
 		if (time - GetViewStates().GetFPSTimeBase() > 1.0) {
-			char fpsString[100];
+			char fpsString[160];
 			sprintf_s(fpsString, "OpenGL Example - FPS: %4.2f - Triangles: %d", GetViewStates().GetFrame() / (time - GetViewStates().GetFPSTimeBase()), GetTerrain().GetNumberOfRenderedTriangles());
+			//show the progress while the terrain is loaded in the background
+			if (GetTerrain().IsLoading()) {
+				char loadingString[60];
+				sprintf_s(loadingString, " - Loading terrain: %3.0f%% (%.1fs)", GetTerrain().GetLoadingProgress() * 100.f, GetTerrain().GetLoadingTime());
+				strcat_s(fpsString, loadingString);
+			}
 			GetViewStates().SetFPSTimeBase(time);
 			GetViewStates().ResetFrame();
 
@@ -293,6 +299,14 @@ namespace Application {
 
 				printf("eye: [%f, %f, %f]\n lookAt: [%f, %f, %f] \n", eye.x, eye.y, eye.z, lookAt.x, lookAt.y, lookAt.z);
 				return true;
+
+			case 't':
+				ToggleHardwareTessellation();
+				return true;
+
+			case 'v':
+				ToggleCompactVertices();
+				return true;
 			default:
 				return false;
 			}
@@ -317,4 +331,54 @@ namespace Application {
 			}
 		}
 	}
+
+
+
+	void COpenGLWindow::ToggleHardwareTessellation(void)
+	{
+		Terrain::CRasterTerrainModel * rasterModel = dynamic_cast<Terrain::CRasterTerrainModel *>(&GetTerrain());
+		if (rasterModel == nullptr) {
+			std::cout << "hardware tessellation is only supported by raster terrain models!" << std::endl;
+			return;
+		}
+
+		//the tessellated effect is only registered, if the gpu supports tessellation shaders
+		std::string const & effectName = CViewEffects::GetEffectAliases(TessellatedTerrainEffect);
+		if (GetViewEffects().GetEffectManager().FindEffect(effectName) == nullptr) {
+			std::cout << "hardware tessellation is not supported!" << std::endl;
+			return;
+		}
+
+		if (rasterModel->GetRenderMode() == Terrain::CRasterTerrainModel::TriangleStrips) {
+			rasterModel->SetRenderMode(Terrain::CRasterTerrainModel::HardwareTessellation);
+			GetViewEffects().SetEffect(TessellatedTerrainEffect);
+			std::cout << "activated hardware tessellation!" << std::endl;
+		}
+		else {
+			rasterModel->SetRenderMode(Terrain::CRasterTerrainModel::TriangleStrips);
+			GetViewEffects().SetEffect(TexturedTerrainEffect);
+			std::cout << "deactivated hardware tessellation!" << std::endl;
+		}
+	}
+
+
+
+	void COpenGLWindow::ToggleCompactVertices(void)
+	{
+		Terrain::CRasterTerrainModel * rasterModel = dynamic_cast<Terrain::CRasterTerrainModel *>(&GetTerrain());
+		if (rasterModel == nullptr) {
+			std::cout << "compact vertices are only supported by raster terrain models!" << std::endl;
+			return;
+		}
+
+		if (rasterModel->GetVertexFormat() == Terrain::CRasterTerrainModel::FullVertex) {
+			if (rasterModel->SetVertexFormat(Terrain::CRasterTerrainModel::CompactHeight)) {
+				std::cout << "activated compact vertices!" << std::endl;
+			}
+		}
+		else {
+			rasterModel->SetVertexFormat(Terrain::CRasterTerrainModel::FullVertex);
+			std::cout << "deactivated compact vertices!" << std::endl;
+		}
+	}
 }
\ No newline at end of file
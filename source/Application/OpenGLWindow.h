@@ -14,6 +14,10 @@ namespace Application {
     virtual bool Initialize(int argc = 0, char **argv = nullptr) override;
     virtual bool EvaluateActionKey(unsigned char key, bool ctrl, bool alt) override;
   private:
+    //switches the raster terrain between stitched triangle strips and hardware tessellation
+    void ToggleHardwareTessellation(void);
+    //switches the raster terrain between full and height only gpu vertices
+    void ToggleCompactVertices(void);
 
     virtual void UpdateScene(double time) override;
     virtual void RenderScene(void) override;
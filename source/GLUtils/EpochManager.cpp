@@ -0,0 +1,107 @@
+#include "GLUtilsPrecompiled.h"
+#include "EpochManager.h"
+
+#include <thread>
+
+namespace GLUtils {
+
+
+
+CEpochManager::CEpochManager(void)
+  : mEpoch(0)
+{
+  mReaders[0] = 0;
+  mReaders[1] = 0;
+}
+
+
+
+CEpochManager::~CEpochManager(void)
+{
+  for (auto iter = mRetired.begin(); iter != mRetired.end(); ++iter)
+    iter->deleter();
+}
+
+
+
+unsigned long long CEpochManager::Enter(void)
+{
+  for (;;) {
+    unsigned long long epoch = mEpoch;
+    ++mReaders[epoch & 1];
+    //the epoch may have advanced before the reader was counted, the counter of the new one is used then
+    if (mEpoch == epoch)
+      return epoch;
+    --mReaders[epoch & 1];
+  }
+}
+
+
+
+void CEpochManager::Leave(unsigned long long epoch)
+{
+  --mReaders[epoch & 1];
+}
+
+
+
+void CEpochManager::Retire(std::function<void()> const & deleter)
+{
+  Retired retired;
+  retired.epoch = mEpoch;
+  retired.deleter = deleter;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  mRetired.push_back(retired);
+}
+
+
+
+void CEpochManager::Reclaim(void)
+{
+  std::vector<Retired> reclaimed;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    //the readers of the next epoch share the counter with the previous one, it is advanced when they left
+    unsigned long long epoch = mEpoch;
+    if (mReaders[(epoch + 1) & 1] == 0)
+      mEpoch.compare_exchange_strong(epoch, epoch + 1);
+
+    epoch = mEpoch;
+    std::vector<Retired> kept;
+    for (auto iter = mRetired.begin(); iter != mRetired.end(); ++iter) {
+      if (iter->epoch + 2 <= epoch)
+        reclaimed.push_back(*iter);
+      else
+        kept.push_back(*iter);
+    }
+    mRetired.swap(kept);
+  }
+
+  //the deleters may retire objects as well
+  for (auto iter = reclaimed.begin(); iter != reclaimed.end(); ++iter)
+    iter->deleter();
+}
+
+
+
+void CEpochManager::ReclaimAll(void)
+{
+  while (GetRetiredCount() > 0) {
+    Reclaim();
+    if (GetRetiredCount() > 0)
+      std::this_thread::yield();
+  }
+}
+
+
+
+size_t CEpochManager::GetRetiredCount(void) const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mRetired.size();
+}
+
+
+} //namespace GLUtils
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "GLUtilsDefines.h"
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+namespace GLUtils {
+
+
+  //epoch based reclamation of shared objects, which are read without locks.
+  //readers enter the current epoch while they use the objects. the writer unlinks an object (e.g. by publishing a new
+  //version through an atomic pointer) and retires it, the object is deleted once every reader, which could still see it,
+  //left its epoch. the epoch advances when the readers of the previous one left, so an object retired in epoch e can be
+  //deleted from epoch e + 2 on
+  class CEpochManager
+  {
+  public:
+    //keeps the epoch entered while it lives
+    class ReadGuard
+    {
+    public:
+      ReadGuard(CEpochManager & manager) : mManager(manager), mEpoch(manager.Enter()) {}
+      ~ReadGuard() {mManager.Leave(mEpoch);}
+
+    private:
+      ReadGuard(ReadGuard const & rhs);             //forbidden
+      ReadGuard & operator=(ReadGuard const & rhs); //forbidden
+
+      CEpochManager & mManager;
+      unsigned long long mEpoch;
+    };
+
+    GLUTILS_API CEpochManager(void);
+    //deletes the retired objects, the readers have to be gone
+    GLUTILS_API ~CEpochManager(void);
+
+    //enters the current epoch and gets it (lock free, can be called from any thread)
+    GLUTILS_API unsigned long long Enter(void);
+    //leaves the epoch got from Enter
+    GLUTILS_API void Leave(unsigned long long epoch);
+
+    //hands over an unlinked object, the deleter is called by a later Reclaim
+    GLUTILS_API void Retire(std::function<void()> const & deleter);
+    //advances the epoch if possible and deletes the objects, which no reader can see anymore. the deleters run on the
+    //calling thread, so objects with GL resources are reclaimed by the render thread
+    GLUTILS_API void Reclaim(void);
+    //blocks until the readers left and deletes all retired objects
+    GLUTILS_API void ReclaimAll(void);
+
+    GLUTILS_API unsigned long long GetEpoch(void) const {return mEpoch;}
+    GLUTILS_API size_t GetRetiredCount(void) const;
+
+  private:
+    CEpochManager(CEpochManager const & rhs);             //forbidden
+    CEpochManager & operator=(CEpochManager const & rhs); //forbidden
+
+    struct Retired {
+      unsigned long long epoch;
+      std::function<void()> deleter;
+    };
+
+    std::atomic<unsigned long long> mEpoch;
+    std::atomic<int> mReaders[2];       //readers of the even and odd epochs
+    std::vector<Retired> mRetired;
+    mutable std::mutex mMutex;
+  };
+
+
+} //namespace GLUtils
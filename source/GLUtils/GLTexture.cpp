@@ -7,7 +7,11 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <atomic>
 #include "Helper.h"
+#include "ThreadPool.h"
+#include "PngReader.h"
+#include "TextureCache.h"
 
 
 namespace GLUtils {
@@ -99,22 +103,20 @@ namespace GLUtils {
     GLint mipmapLevel = 0;
     //std::cout << "Loading Textures " << mTextureID << " to GPU: " << mWidth << " x " << mHeight << " (" << mData[mWidth]->mData.size() << ")" <<  std::endl;
     glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, mData.size() == 1 ? mUseMipMaps : true);
-    glTexImage2D(GL_TEXTURE_2D, mipmapLevel, internFormat, mWidth, mHeight, 0, dataFormat, dataType, mData[mWidth]->mData.data());
+    glTexImage2D(GL_TEXTURE_2D, mipmapLevel, internFormat, mWidth, mHeight, 0, dataFormat, dataType, mData[mWidth]->GetPixels());
     CHelper::CheckForError();
 
     
     glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, false);
 
-    //load mipmaps
-    if (mFile.size() > 1) {
+    //load mipmaps (from files or the texture cache), the levels keep their own height, which stops at 1 pixel
+    if (mData.size() > 1) {
       int width = mWidth;
-      int height = mHeight;
-      while(width > 1 && height > 0) {
+      while(width > 1) {
         width /= 2;
-        height /= 2;
         ++mipmapLevel;
         if (mData.find(width) != mData.end()) {
-          glTexImage2D(GL_TEXTURE_2D, mipmapLevel, internFormat, width, height, 0, dataFormat, dataType, mData[width]->mData.data());
+          glTexImage2D(GL_TEXTURE_2D, mipmapLevel, internFormat, width, mData[width]->mHeight, 0, dataFormat, dataType, mData[width]->GetPixels());
           CHelper::CheckForError();
         }
       }
@@ -309,6 +311,56 @@ namespace GLUtils {
       return true;
   }
 
+  //pixel format of a decoded png
+  struct DecodedPng {
+    Format format;
+    bool hasAlpha;
+
+    DecodedPng() : format(Format::RGB8), hasAlpha(false) {}
+  };
+
+  //decodes the png files on the thread pool, returns false if one of them fails
+  static bool DecodePngImages(std::vector<std::string> const & fileNames, std::vector<std::shared_ptr<CGLTexture::ImageData>> & images, std::vector<DecodedPng> & decoded)
+  {
+    images.resize(fileNames.size());
+    decoded.resize(fileNames.size());
+
+    //one task per file, the decoders of libpng are independent. the files are mapped and decoded straight into the image data
+    std::atomic<bool> success(true);
+    CThreadPool::GetDefaultPool().ParallelFor(0, fileNames.size(), [&](size_t i) {
+      std::shared_ptr<CGLTexture::ImageData> imageData(new CGLTexture::ImageData);
+      try {
+        CPngReader reader;
+        if (reader.Open(fileNames[i])) {
+          imageData->mWidth = reader.GetWidth();
+          imageData->mHeight = reader.GetHeight();
+          imageData->mData.resize(reader.GetImageSize());
+          decoded[i].format = reader.GetFormat();
+          decoded[i].hasAlpha = reader.GetHasAlpha();
+        }
+        if (reader.IsOpen() && reader.Decode(imageData->mData.data())) {
+          images[i] = imageData;
+        }
+        else {
+          std::cout << "failed to decode " << fileNames[i] << "!" << std::endl;
+          success = false;
+        }
+      }
+      catch (std::exception const & e) {
+        std::cout << "failed to decode " << fileNames[i] << ": " << e.what() << std::endl;
+        success = false;
+      }
+    });
+
+    if (!success) {
+      images.clear();
+      decoded.clear();
+    }
+    return success;
+  }
+
+
+
   void GetGLTextureType(Format format, GLenum & glInternalFormat, GLenum & glDataFormat, GLenum&  glDataType, unsigned int & numberOfComponents) {
     switch(format) {
       case Format::Gray8:
@@ -379,23 +431,37 @@ namespace GLUtils {
         if (mFile[i].find(".png") == std::string::npos) return false; //currently only png images can be loaded
       }
 
-      if (mData.empty()) { //data was not already loaded
+      if (mData.empty() && mFile.size() == 1 && mUseMipMaps) { //data was not already loaded
 
-        mWidth = mHeight = 0; //maximum dimension
-        for (size_t i = 0; i < mFile.size(); ++i) {
+        //a single mipmapped png is read from its texture cache, which holds the mip levels as well. textures without
+        //mipmaps (e.g. heightmaps) are decoded directly, so no cache is written next to them
+        if (!CTextureCache::Load(mFile[0], mFormat, mData)) {
+          std::cout << "failed." << std::endl;
+          return false;
+        }
 
-          std::shared_ptr<ImageData> imageData(new ImageData);
-          bool success = LoadPngImage(mFile[i].c_str(), imageData->mWidth, imageData->mHeight, mHasAlpha, mFormat, imageData->mData);
-          if (!success) {
-            mData.clear();
-            std::cout << "failed." << std::endl;
-            return false;
-          }
+        mWidth = mData.rbegin()->second->mWidth;
+        mHeight = mData.rbegin()->second->mHeight;
+        mHasAlpha = (mFormat == Format::GrayAlpha8 || mFormat == Format::GrayAlpha16 || mFormat == Format::RGBA8 || mFormat == Format::RGBA16);
+      }
+      else if (mData.empty()) {
 
-          mWidth = max(mWidth, imageData->mWidth);
-          mHeight = max(mHeight, imageData->mHeight);
+        //the mip files (or the png of a texture without mipmaps) are decoded in parallel
+        std::vector<std::shared_ptr<ImageData>> images;
+        std::vector<DecodedPng> decoded;
+        if (!DecodePngImages(mFile, images, decoded)) {
+          std::cout << "failed." << std::endl;
+          return false;
+        }
+
+        mWidth = mHeight = 0; //maximum dimension
+        for (size_t i = 0; i < images.size(); ++i) {
+          mHasAlpha = decoded[i].hasAlpha;
+          mFormat = decoded[i].format;
+          mWidth = max(mWidth, images[i]->mWidth);
+          mHeight = max(mHeight, images[i]->mHeight);
 
-          mData[imageData->mWidth] = imageData;
+          mData[images[i]->mWidth] = images[i];
         }
       }
 
@@ -429,6 +495,58 @@ namespace GLUtils {
   }
 
 
+  size_t GetBytesPerPixel(Format format)
+  {
+    switch(format) {
+      case Format::Gray8:       return 1;
+      case Format::Gray16:      return 2;
+      case Format::GrayAlpha8:  return 2;
+      case Format::GrayAlpha16: return 4;
+      case Format::RGB8:        return 3;
+      case Format::RGB16:       return 6;
+      case Format::RGBA8:       return 4;
+      case Format::RGBA16:      return 8;
+    }
+    return 0;
+  }
+
+
+
+  bool CGLTexture::LoadFromMemory(int width, int height, Format format, std::vector<unsigned char> const & data, bool loadToGPU)
+  {
+    {
+#ifdef USETHREADING
+      mLoadToCPUMutex.lock();
+      CMutexReleaser releaser(mLoadToCPUMutex);
+#endif
+
+      if (width <= 0 || height <= 0 || data.size() != static_cast<size_t>(width) * height * GetBytesPerPixel(format)) {
+        std::cout << "failed to set texture data of " << width << " x " << height << " pixels from " << data.size() << " bytes!" << std::endl;
+        return false;
+      }
+
+      std::shared_ptr<ImageData> imageData(new ImageData);
+      imageData->mData = data;
+      imageData->mWidth = width;
+      imageData->mHeight = height;
+
+      mFile.clear();
+      mData.clear();
+      mData[width] = imageData;
+      mWidth = width;
+      mHeight = height;
+      mFormat = format;
+      mHasAlpha = (format == Format::GrayAlpha8 || format == Format::GrayAlpha16 || format == Format::RGBA8 || format == Format::RGBA16);
+    }
+    if (loadToGPU) {
+      LoadToGPU();
+    }
+
+    if (!mCacheData) mData.clear();
+    return true;
+  }
+
+
   void CGLTexture::SetFileName(std::string const & fileName)
   {
 #ifdef USETHREADING
@@ -523,63 +641,72 @@ namespace GLUtils {
     }
     
 
-    int width = 0;
-    for (size_t imageIndex = 0; imageIndex < mFiles.size(); ++imageIndex) {
-
-      //create texture object that only stores data (no mipmapping, not on GPU)
-      CGLTexture texture(mFiles[imageIndex], false);
-
-      //load data to RAM (not to GPU)
-      bool success = texture.LoadFromFile(false);
-      if (!success) {
-        mData.clear();
-        std::cout << "Unable to load png file" << std::endl;
-        return false;
-      }
-
-      //set attributes
-      if (imageIndex == 0 ) {
-        //format should be equal for all textures!
-        mWidth = texture.GetWidth();
-        mHeight = texture.GetHeight();
-        mFormat = texture.GetFormat();
-        mHasAlpha = texture.GetHasAlpha();
-        
+    //the headers of all files are read first, so the array can be allocated and every file is decoded in parallel straight
+    //into its slice. the array takes about the time of the slowest file
+    std::vector<std::string> files;
+    for (size_t i = 0; i < mFiles.size(); ++i)
+      files.insert(files.end(), mFiles[i].begin(), mFiles[i].end());
+
+    std::vector<std::unique_ptr<CPngReader>> readers(files.size());
+    std::atomic<bool> success(true);
+    CThreadPool::GetDefaultPool().ParallelFor(0, files.size(), [&](size_t i) {
+      readers[i].reset(new CPngReader);
+      if (!readers[i]->Open(files[i])) {
+        std::cout << "failed to read the png header of " << files[i] << "!" << std::endl;
+        success = false;
       }
+    });
+    if (!success) {
+      mData.clear();
+      std::cout << "Unable to load png file" << std::endl;
+      return false;
+    }
 
-      //save data
-      width = 2 * mWidth;
+    //set attributes of the first slice, format should be equal for all textures!
+    mWidth = mHeight = 0;
+    for (size_t j = 0; j < mFiles[0].size(); ++j) {
+      mWidth = max(mWidth, readers[j]->GetWidth());
+      mHeight = max(mHeight, readers[j]->GetHeight());
+    }
+    mFormat = readers[0]->GetFormat();
+    mHasAlpha = readers[0]->GetHasAlpha();
+
+    //the slices are stored one after another in the mip level of their width
+    //note the data must be symmetric, meaning each texture of the array must have the same number of mip map levels
+    std::vector<size_t> offsets(files.size());
+    std::map<int, size_t> levelSizes;
+    for (size_t i = 0; i < files.size(); ++i) {
+      size_t & levelSize = levelSizes[readers[i]->GetWidth()];
+      offsets[i] = levelSize;
+      levelSize += readers[i]->GetImageSize();
+    }
 
-      while(width > 1) {
-        width /= 2;
+    mData.clear();
+    try 
+    {
+      for (auto iter = levelSizes.begin(); iter != levelSizes.end(); ++iter)
+        mData[iter->first].reset(new std::vector<unsigned char>(iter->second));
+    }
+    catch(std::bad_alloc& ba)
+    {
+      std::cout << "Not enough memory available - Using 64bit might solve this problem. Error: " << ba.what() << std::endl;
+      mData.clear();
+      return false;
+    }
 
-        //note the data must be symmetric, meaning each texture of the array must have the same number of mip map levels
-        
-         //construct element if not already there
-        if (texture.GetData().find(width) != texture.GetData().end()) {
-          if (mData[width].get() == nullptr) {
-            mData[width].reset(new std::vector<unsigned char>);
-          }
-
-          try 
-          {
-            mData[width]->insert(mData[width]->end(), texture.GetData().at(width)->mData.begin(),texture.GetData().at(width)->mData.end());
-          }
-          catch(std::bad_alloc& ba)
-          {
-            std::cout << "Not enough memory available - Using 64bit might solve this problem. Error: " << ba.what() << std::endl;
-            //assert(false);
-            mData.clear();
-            return false;
-          }
-          catch(...)
-          {
-            mData.clear();
-            return false;
-          }
-        }
+    CThreadPool::GetDefaultPool().ParallelFor(0, files.size(), [&](size_t i) {
+      std::vector<unsigned char> & level = *mData.at(readers[i]->GetWidth());
+      if (!readers[i]->Decode(level.data() + offsets[i])) {
+        std::cout << "failed to decode " << files[i] << "!" << std::endl;
+        success = false;
       }
-
+      //unmaps the file
+      readers[i]->Close();
+    });
+    if (!success) {
+      mData.clear();
+      std::cout << "Unable to load png file" << std::endl;
+      return false;
     }
     
     if (loadToGPU) {
@@ -14,6 +14,8 @@
 
 namespace GLUtils {
 
+class CMappedFile;
+
 
 static enum Format {
     Gray8,
@@ -52,6 +54,12 @@ public:
     std::vector<unsigned char> mData;
     int mWidth;
     int mHeight;
+    std::shared_ptr<CMappedFile> mMapping;  //texture cache holding the pixels instead of mData
+    unsigned char const * mMappedPixels;
+
+    ImageData() : mWidth(0), mHeight(0), mMappedPixels(nullptr) {}
+    //gets the pixels, owned or in the mapped texture cache
+    unsigned char const * GetPixels() const {return mMapping ? mMappedPixels : mData.data();}
   };
   typedef std::map<int, std::shared_ptr<ImageData>> ImageMap;
 
@@ -73,6 +81,9 @@ public:
   GLUTILS_API virtual bool LoadFromFile(std::string const & fileName, bool loadToGPU = true);
   GLUTILS_API virtual bool LoadFromFile(std::vector<std::string> const & fileNames, bool loadToGPU = true);
 
+  //sets the image data of a texture without a file (e.g. a generated overlay), the rows are tightly packed (also loads data to VRAM)
+  GLUTILS_API virtual bool LoadFromMemory(int width, int height, Format format, std::vector<unsigned char> const & data, bool loadToGPU = true);
+
   //sets the filename
   GLUTILS_API virtual void SetFileName(std::string const & fileName);
   GLUTILS_API virtual void SetFileName(std::vector<std::string> const & fileNames);
@@ -174,6 +185,9 @@ private:
 
 
 static void GetGLTextureType(Format format, GLenum & glInternalFormat, GLenum & glDataFormat, GLenum & glDataType, unsigned int & numberOfComponents);
-static bool LoadPngImage(std::string const & fileName, int &outWidth, int &outHeight, bool &outHasAlpha, Format& outFormat, std::vector<unsigned char>& outData);
+//gets the bytes of a pixel
+GLUTILS_API size_t GetBytesPerPixel(Format format);
+//decodes a png file read through a FILE stream (CPngReader decodes from the mapped file into given memory)
+GLUTILS_API bool LoadPngImage(std::string const & fileName, int &outWidth, int &outHeight, bool &outHasAlpha, Format& outFormat, std::vector<unsigned char>& outData);
 
 } //namespace Utils
\ No newline at end of file
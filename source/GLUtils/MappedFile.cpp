@@ -0,0 +1,73 @@
+#include "GLUtilsPrecompiled.h"
+#include "MappedFile.h"
+
+namespace GLUtils {
+
+
+
+CMappedFile::CMappedFile(void)
+  : mFile(nullptr)
+  , mMapping(nullptr)
+  , mData(nullptr)
+  , mSize(0)
+{
+}
+
+
+
+CMappedFile::~CMappedFile(void)
+{
+  Close();
+}
+
+
+
+bool CMappedFile::Open(std::string const & fileName)
+{
+  Close();
+
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || static_cast<unsigned long long>(size.QuadPart) > static_cast<size_t>(-1)) {
+    CloseHandle(file);
+    return false;
+  }
+  mFile = file;
+  mSize = static_cast<size_t>(size.QuadPart);
+
+  //a file of zero bytes can not be mapped
+  if (mSize == 0)
+    return true;
+
+  mMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mMapping != nullptr)
+    mData = static_cast<unsigned char const *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+  if (mData == nullptr) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+
+
+void CMappedFile::Close(void)
+{
+  if (mData != nullptr)
+    UnmapViewOfFile(mData);
+  if (mMapping != nullptr)
+    CloseHandle(mMapping);
+  if (mFile != nullptr)
+    CloseHandle(mFile);
+
+  mFile = nullptr;
+  mMapping = nullptr;
+  mData = nullptr;
+  mSize = 0;
+}
+
+
+} //namespace GLUtils
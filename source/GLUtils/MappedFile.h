@@ -0,0 +1,37 @@
+#pragma once
+
+#include "GLUtilsDefines.h"
+#include <string>
+
+namespace GLUtils {
+
+
+  //read only mapping of a whole file into the address space. the pages are read by the system when they are touched,
+  //so a decoder can read the file in place instead of copying it through a stream buffer
+  class CMappedFile
+  {
+  public:
+    GLUTILS_API CMappedFile(void);
+    GLUTILS_API ~CMappedFile(void);
+
+    //maps the file, returns false if it can not be opened or mapped (an empty file is opened without data)
+    GLUTILS_API bool Open(std::string const & fileName);
+    //unmaps the file, the data gets invalid
+    GLUTILS_API void Close(void);
+
+    GLUTILS_API bool IsOpen(void) const {return mFile != nullptr;}
+    GLUTILS_API unsigned char const * GetData(void) const {return mData;}
+    GLUTILS_API size_t GetSize(void) const {return mSize;}
+
+  private:
+    CMappedFile(CMappedFile const & rhs);             //forbidden
+    CMappedFile & operator=(CMappedFile const & rhs); //forbidden
+
+    void* mFile;        //file handle
+    void* mMapping;     //file mapping handle
+    unsigned char const * mData;
+    size_t mSize;
+  };
+
+
+} //namespace GLUtils
@@ -0,0 +1,190 @@
+#include "GLUtilsPrecompiled.h"
+#include "PngReader.h"
+
+#include <png.h>
+#include <cstring>
+
+namespace GLUtils {
+
+
+
+CPngReader::CPngReader(void)
+  : mInput(nullptr)
+  , mInputSize(0)
+  , mInputOffset(0)
+  , mPng(nullptr)
+  , mInfo(nullptr)
+  , mPasses(1)
+  , mDecoded(false)
+  , mWidth(0)
+  , mHeight(0)
+  , mFormat(Format::RGB8)
+  , mHasAlpha(false)
+  , mRowBytes(0)
+{
+}
+
+
+
+CPngReader::~CPngReader(void)
+{
+  Close();
+}
+
+
+
+bool CPngReader::Open(std::string const & fileName)
+{
+  Close();
+
+  if (!mFile.Open(fileName))
+    return false;
+  if (!ReadHeader(mFile.GetData(), mFile.GetSize())) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+
+
+bool CPngReader::Open(unsigned char const * data, size_t size)
+{
+  Close();
+
+  if (!ReadHeader(data, size)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+
+
+void CPngReader::ReadInput(png_structp png, png_bytep data, png_size_t length)
+{
+  CPngReader* reader = static_cast<CPngReader*>(png_get_io_ptr(png));
+  if (length > reader->mInputSize - reader->mInputOffset)
+    png_error(png, "unexpected end of the png data");
+
+  memcpy(data, reader->mInput + reader->mInputOffset, length);
+  reader->mInputOffset += length;
+}
+
+
+
+bool CPngReader::ReadHeader(unsigned char const * data, size_t size)
+{
+  if (data == nullptr || size < 8 || png_sig_cmp(data, 0, 8) != 0)
+    return false;
+
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (png == NULL)
+    return false;
+  mPng = png;
+  png_infop info = png_create_info_struct(png);
+  if (info == NULL)
+    return false;
+  mInfo = info;
+
+  //libpng jumps back here on errors, the structs are freed by Close
+  if (setjmp(png_jmpbuf(png)))
+    return false;
+
+  mInput = data;
+  mInputSize = size;
+  mInputOffset = 8;
+  png_set_read_fn(png, this, ReadInput);
+  png_set_sig_bytes(png, 8);
+  png_read_info(png, info);
+
+  png_uint_32 width, height;
+  int bitDepth, colorType, interlaceType;
+  png_get_IHDR(png, info, &width, &height, &bitDepth, &colorType, &interlaceType, NULL, NULL);
+
+  if (colorType == PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb(png);
+  if (colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
+    png_set_expand_gray_1_2_4_to_8(png);
+  if (png_get_valid(png, info, PNG_INFO_tRNS))
+    png_set_tRNS_to_alpha(png);
+  if (bitDepth == 16)
+    png_set_swap(png);
+  mPasses = png_set_interlace_handling(png);
+  png_read_update_info(png, info);
+
+  bool use16bit = png_get_bit_depth(png, info) == 16;
+  switch (png_get_color_type(png, info)) {
+  case PNG_COLOR_TYPE_GRAY:
+    mFormat = use16bit ? Format::Gray16 : Format::Gray8;
+    break;
+  case PNG_COLOR_TYPE_GRAY_ALPHA:
+    mFormat = use16bit ? Format::GrayAlpha16 : Format::GrayAlpha8;
+    break;
+  case PNG_COLOR_TYPE_RGB:
+    mFormat = use16bit ? Format::RGB16 : Format::RGB8;
+    break;
+  case PNG_COLOR_TYPE_RGBA:
+    mFormat = use16bit ? Format::RGBA16 : Format::RGBA8;
+    break;
+  default:
+    return false;
+  }
+
+  mWidth = static_cast<int>(width);
+  mHeight = static_cast<int>(height);
+  mHasAlpha = (png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA) != 0;
+  mRowBytes = png_get_rowbytes(png, info);
+  return true;
+}
+
+
+
+bool CPngReader::Decode(unsigned char* destination, size_t rowPitch)
+{
+  if (mPng == nullptr || mDecoded || destination == nullptr)
+    return false;
+  if (rowPitch == 0)
+    rowPitch = mRowBytes;
+  if (rowPitch < mRowBytes)
+    return false;
+  mDecoded = true;
+
+  png_structp png = static_cast<png_structp>(mPng);
+  if (setjmp(png_jmpbuf(png)))
+    return false;
+
+  //interlaced images are combined in the destination over all passes
+  for (int pass=0; pass < mPasses; ++pass) {
+    for (int y=0; y < mHeight; ++y)
+      png_read_row(png, destination + rowPitch * y, NULL);
+  }
+  return true;
+}
+
+
+
+void CPngReader::Close(void)
+{
+  if (mPng != nullptr) {
+    png_structp png = static_cast<png_structp>(mPng);
+    png_infop info = static_cast<png_infop>(mInfo);
+    png_destroy_read_struct(&png, mInfo != nullptr ? &info : NULL, NULL);
+  }
+  mFile.Close();
+
+  mInput = nullptr;
+  mInputSize = 0;
+  mInputOffset = 0;
+  mPng = nullptr;
+  mInfo = nullptr;
+  mPasses = 1;
+  mDecoded = false;
+  mWidth = 0;
+  mHeight = 0;
+  mHasAlpha = false;
+  mRowBytes = 0;
+}
+
+
+} //namespace GLUtils
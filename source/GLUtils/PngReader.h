@@ -0,0 +1,69 @@
+#pragma once
+
+#include "GLUtilsDefines.h"
+#include "GLTexture.h"
+#include "MappedFile.h"
+#include <string>
+
+struct png_struct_def;
+
+namespace GLUtils {
+
+
+  //png decoder reading the file from memory. the file is mapped instead of read through a stream, libpng gets its
+  //chunks straight from the mapped pages and the rows are decoded into memory given by the caller (e.g. the slice of a
+  //texture array), so the pixels are not copied after decoding.
+  //palette and gray images below 8 bit are expanded to 8 bit, transparency to an alpha channel. 16 bit samples are
+  //little endian like the ones of LoadPngImage
+  class CPngReader
+  {
+  public:
+    GLUTILS_API CPngReader(void);
+    GLUTILS_API ~CPngReader(void);
+
+    //maps the png file and reads its header, returns false if it can not be read
+    GLUTILS_API bool Open(std::string const & fileName);
+    //reads the header of a png in memory, the memory has to stay valid until the reader is closed
+    GLUTILS_API bool Open(unsigned char const * data, size_t size);
+    //decodes the image into the destination, whose rows are rowPitch bytes apart (GetRowBytes if 0). can be called once
+    //after Open, returns false if the data is corrupt
+    GLUTILS_API bool Decode(unsigned char* destination, size_t rowPitch = 0);
+    //frees the decoder and unmaps the file
+    GLUTILS_API void Close(void);
+
+    GLUTILS_API bool IsOpen(void) const {return mPng != nullptr;}
+    GLUTILS_API int GetWidth(void) const {return mWidth;}
+    GLUTILS_API int GetHeight(void) const {return mHeight;}
+    GLUTILS_API Format GetFormat(void) const {return mFormat;}
+    GLUTILS_API bool GetHasAlpha(void) const {return mHasAlpha;}
+    //get the bytes of a decoded row and of the whole image
+    GLUTILS_API size_t GetRowBytes(void) const {return mRowBytes;}
+    GLUTILS_API size_t GetImageSize(void) const {return mRowBytes * mHeight;}
+
+  private:
+    CPngReader(CPngReader const & rhs);             //forbidden
+    CPngReader & operator=(CPngReader const & rhs); //forbidden
+
+    //reads the signature and the header chunks, sets the transforms
+    bool ReadHeader(unsigned char const * data, size_t size);
+    //read function of libpng, copies the next bytes of the input
+    static void ReadInput(png_struct_def* png, unsigned char* data, size_t length);
+
+    CMappedFile mFile;
+    unsigned char const * mInput;
+    size_t mInputSize;
+    size_t mInputOffset;
+    void* mPng;             //png_structp
+    void* mInfo;            //png_infop
+    int mPasses;            //interlace passes
+    bool mDecoded;
+
+    int mWidth;
+    int mHeight;
+    Format mFormat;
+    bool mHasAlpha;
+    size_t mRowBytes;
+  };
+
+
+} //namespace GLUtils
@@ -0,0 +1,233 @@
+#include "GLUtilsPrecompiled.h"
+#include "TextureCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include "MappedFile.h"
+#include "PngReader.h"
+
+namespace GLUtils {
+
+  //file signature and version of texture caches
+  static const char CACHE_MAGIC[] = {'G','T','E','X'};
+  static const unsigned int CACHE_VERSION = 2;
+  //alignment of the level data in the file
+  static const unsigned long long CACHE_ALIGNMENT = 16;
+
+  //header of a cache file, followed by the level table and the level data
+  struct CacheHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned long long sourceHash;    //of the png content
+    unsigned long long sourceSize;    //bytes of the png file
+    unsigned int format;              //Format of the pixels
+    unsigned int levelCount;
+  };
+
+  //entry of the level table, the largest level comes first
+  struct CacheLevel {
+    int width;
+    int height;
+    unsigned long long offset;        //from the start of the file
+    unsigned long long size;          //bytes of tightly packed rows
+  };
+
+
+
+  unsigned long long CTextureCache::Hash(unsigned char const * data, size_t size)
+  {
+    static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+    static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+    unsigned long long hash = FNV_OFFSET;
+    for (size_t i = 0; i < size; ++i)
+      hash = (hash ^ data[i]) * FNV_PRIME;
+    return hash;
+  }
+
+
+
+  bool CTextureCache::Load(std::string const & fileName, Format & format, CGLTexture::ImageMap & levels)
+  {
+    levels.clear();
+
+    CMappedFile png;
+    if (!png.Open(fileName)) {
+      std::cout << "failed to open " << fileName << "!" << std::endl;
+      return false;
+    }
+    unsigned long long hash = Hash(png.GetData(), png.GetSize());
+    std::string cacheFileName = GetCacheFileName(fileName);
+    if (Read(cacheFileName, hash, png.GetSize(), format, levels))
+      return true;
+
+    //the png is decoded from the mapped file
+    CPngReader reader;
+    std::shared_ptr<CGLTexture::ImageData> image(new CGLTexture::ImageData);
+    if (reader.Open(png.GetData(), png.GetSize())) {
+      image->mWidth = reader.GetWidth();
+      image->mHeight = reader.GetHeight();
+      image->mData.resize(reader.GetImageSize());
+    }
+    if (!reader.IsOpen() || !reader.Decode(image->mData.data())) {
+      std::cout << "failed to decode " << fileName << "!" << std::endl;
+      return false;
+    }
+    format = reader.GetFormat();
+    levels[image->mWidth] = image;
+    BuildMipmaps(format, levels);
+
+    if (!Write(cacheFileName, hash, png.GetSize(), format, levels))
+      std::cout << "failed to write texture cache " << cacheFileName << "!" << std::endl;
+    return true;
+  }
+
+
+
+  bool CTextureCache::Read(std::string const & cacheFileName, unsigned long long sourceHash, unsigned long long sourceSize, Format & format, CGLTexture::ImageMap & levels)
+  {
+    std::shared_ptr<CMappedFile> mapping(new CMappedFile);
+    CMappedFile const & file = *mapping;
+    if (!mapping->Open(cacheFileName) || file.GetSize() < sizeof(CacheHeader))
+      return false;
+
+    CacheHeader header;
+    memcpy(&header, file.GetData(), sizeof(CacheHeader));
+    if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION || header.sourceHash != sourceHash || header.sourceSize != sourceSize)
+      return false;
+    if (header.format > Format::RGBA16 || header.levelCount == 0 || header.levelCount > (file.GetSize() - sizeof(CacheHeader)) / sizeof(CacheLevel))
+      return false;
+
+    //the whole table is checked before any level is used
+    std::vector<CacheLevel> table(header.levelCount);
+    memcpy(table.data(), file.GetData() + sizeof(CacheHeader), sizeof(CacheLevel) * header.levelCount);
+    size_t bytesPerPixel = GetBytesPerPixel(static_cast<Format>(header.format));
+    for (auto iter = table.begin(); iter != table.end(); ++iter) {
+      if (iter->width <= 0 || iter->height <= 0 || iter->size != static_cast<unsigned long long>(iter->width) * iter->height * bytesPerPixel)
+        return false;
+      if (iter->offset > file.GetSize() || iter->size > file.GetSize() - iter->offset)
+        return false;
+    }
+
+    //the levels point into the mapping, the pixels are read by the upload
+    levels.clear();
+    for (auto iter = table.begin(); iter != table.end(); ++iter) {
+      std::shared_ptr<CGLTexture::ImageData> image(new CGLTexture::ImageData);
+      image->mWidth = iter->width;
+      image->mHeight = iter->height;
+      image->mMapping = mapping;
+      image->mMappedPixels = file.GetData() + iter->offset;
+      levels[iter->width] = image;
+    }
+    format = static_cast<Format>(header.format);
+    return true;
+  }
+
+
+
+  bool CTextureCache::Write(std::string const & cacheFileName, unsigned long long sourceHash, unsigned long long sourceSize, Format format, CGLTexture::ImageMap const & levels)
+  {
+    if (levels.empty())
+      return false;
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.format = format;
+    header.levelCount = static_cast<unsigned int>(levels.size());
+
+    //largest level first, the data of every level starts aligned
+    size_t bytesPerPixel = GetBytesPerPixel(format);
+    std::vector<CacheLevel> table;
+    unsigned long long offset = sizeof(CacheHeader) + sizeof(CacheLevel) * levels.size();
+    for (auto iter = levels.rbegin(); iter != levels.rend(); ++iter) {
+      offset = (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+      CacheLevel level;
+      level.width = iter->second->mWidth;
+      level.height = iter->second->mHeight;
+      level.offset = offset;
+      level.size = static_cast<unsigned long long>(level.width) * level.height * bytesPerPixel;
+      table.push_back(level);
+      offset += level.size;
+    }
+
+    std::string tempFileName = cacheFileName + ".tmp";
+    FILE* fp = nullptr;
+    if (fopen_s(&fp, tempFileName.c_str(), "wb") != 0 || fp == nullptr)
+      return false;
+
+    static const unsigned char PADDING[CACHE_ALIGNMENT] = {0};
+    bool written = fwrite(&header, sizeof(CacheHeader), 1, fp) == 1 && fwrite(table.data(), sizeof(CacheLevel), table.size(), fp) == table.size();
+    unsigned long long position = sizeof(CacheHeader) + sizeof(CacheLevel) * table.size();
+    auto level = table.begin();
+    for (auto iter = levels.rbegin(); iter != levels.rend() && written; ++iter, ++level) {
+      size_t padding = static_cast<size_t>(level->offset - position);
+      size_t size = static_cast<size_t>(level->size);
+      written = fwrite(PADDING, 1, padding, fp) == padding && fwrite(iter->second->GetPixels(), 1, size, fp) == size;
+      position = level->offset + level->size;
+    }
+    written = (fclose(fp) == 0) && written;
+
+    if (!written || !MoveFileExA(tempFileName.c_str(), cacheFileName.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+      remove(tempFileName.c_str());
+      return false;
+    }
+    return true;
+  }
+
+
+
+  //averages the 2x2 pixels of the source level for every pixel of the next level
+  template<typename Sample>
+  static void DownsampleLevel(CGLTexture::ImageData const & source, CGLTexture::ImageData & level, size_t components)
+  {
+    Sample const * src = reinterpret_cast<Sample const *>(source.GetPixels());
+    Sample* dst = reinterpret_cast<Sample*>(level.mData.data());
+
+    for (int y = 0; y < level.mHeight; ++y) {
+      //odd sizes repeat the last row and column
+      size_t row0 = static_cast<size_t>(min(2 * y, source.mHeight - 1)) * source.mWidth;
+      size_t row1 = static_cast<size_t>(min(2 * y + 1, source.mHeight - 1)) * source.mWidth;
+      for (int x = 0; x < level.mWidth; ++x) {
+        size_t x0 = min(2 * x, source.mWidth - 1);
+        size_t x1 = min(2 * x + 1, source.mWidth - 1);
+        for (size_t c = 0; c < components; ++c) {
+          unsigned int sum = src[(row0 + x0) * components + c] + src[(row0 + x1) * components + c]
+                           + src[(row1 + x0) * components + c] + src[(row1 + x1) * components + c];
+          dst[(static_cast<size_t>(y) * level.mWidth + x) * components + c] = static_cast<Sample>((sum + 2) / 4);
+        }
+      }
+    }
+  }
+
+
+
+  void CTextureCache::BuildMipmaps(Format format, CGLTexture::ImageMap & levels)
+  {
+    if (levels.empty())
+      return;
+
+    bool use16bit = (format == Format::Gray16 || format == Format::GrayAlpha16 || format == Format::RGB16 || format == Format::RGBA16);
+    size_t bytesPerPixel = GetBytesPerPixel(format);
+    size_t components = bytesPerPixel / (use16bit ? 2 : 1);
+
+    std::shared_ptr<CGLTexture::ImageData> source = levels.rbegin()->second;
+    while (source->mWidth > 1) {
+      std::shared_ptr<CGLTexture::ImageData> level(new CGLTexture::ImageData);
+      level->mWidth = source->mWidth / 2;
+      level->mHeight = max(source->mHeight / 2, 1);
+      level->mData.resize(static_cast<size_t>(level->mWidth) * level->mHeight * bytesPerPixel);
+      if (use16bit)
+        DownsampleLevel<unsigned short>(*source, *level, components);
+      else
+        DownsampleLevel<unsigned char>(*source, *level, components);
+
+      levels[level->mWidth] = level;
+      source = level;
+    }
+  }
+
+
+} //namespace GLUtils
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "GLUtilsDefines.h"
+#include "GLTexture.h"
+#include <string>
+
+namespace GLUtils {
+
+
+  //binary cache of decoded png textures, stored next to the png as <file>.texcache. the cache holds the pixels of all mip
+  //levels in the upload format of the texture, so the levels are uploaded straight from the mapped file instead of
+  //inflating the png. the cache is keyed by a hash of the png content and built again when the png changed
+  class CTextureCache
+  {
+  public:
+    //gets the name of the cache file of a png file
+    GLUTILS_API static std::string GetCacheFileName(std::string const & fileName) {return fileName + ".texcache";}
+    //gets the 64 bit fnv-1a hash of the data
+    GLUTILS_API static unsigned long long Hash(unsigned char const * data, size_t size);
+
+    //loads the levels of a png file (keyed by their width), from its cache if it was made from the same png content.
+    //otherwise the png is decoded, its mip levels are built and the cache is written for the next run (a cache, which can
+    //not be written, is skipped). returns false if the png can not be read
+    GLUTILS_API static bool Load(std::string const & fileName, Format & format, CGLTexture::ImageMap & levels);
+
+    //maps the levels of a cache file, they keep the mapping open. returns false if it does not exist, is corrupt or was
+    //made from another png
+    GLUTILS_API static bool Read(std::string const & cacheFileName, unsigned long long sourceHash, unsigned long long sourceSize, Format & format, CGLTexture::ImageMap & levels);
+    //writes the levels to a cache file (through a temporary file, so no reader sees a partial cache)
+    GLUTILS_API static bool Write(std::string const & cacheFileName, unsigned long long sourceHash, unsigned long long sourceSize, Format format, CGLTexture::ImageMap const & levels);
+    //adds the mip levels below the largest level down to a width of 1 pixel (2x2 box filter, the height stops at 1 pixel)
+    GLUTILS_API static void BuildMipmaps(Format format, CGLTexture::ImageMap & levels);
+  };
+
+
+} //namespace GLUtils
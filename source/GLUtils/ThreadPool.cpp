@@ -0,0 +1,157 @@
+#include "GLUtilsPrecompiled.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+
+namespace GLUtils {
+
+
+
+//state of one ParallelFor call, shared with the helper tasks which may start after the call returned
+struct ParallelForState {
+  std::atomic<size_t> next;
+  size_t end;
+  size_t remaining;
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::function<void(size_t)> func;
+
+  //processes indices until the range is exhausted
+  void Run(void) {
+    size_t processed = 0;
+    for (size_t i = next++; i < end; i = next++) {
+      func(i);
+      ++processed;
+    }
+
+    if (processed > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      remaining -= processed;
+      if (remaining == 0)
+        finished.notify_all();
+    }
+  }
+};
+
+
+
+//----------------------------------------------------------------------------
+
+
+CThreadPool::CThreadPool(size_t numberOfThreads)
+  : mActiveTasks(0)
+  , mStop(false)
+{
+  if (numberOfThreads == 0) {
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    numberOfThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+  }
+
+  for (size_t i = 0; i < numberOfThreads; ++i) {
+    mWorkers.push_back(std::thread(&CThreadPool::WorkerLoop, this));
+  }
+}
+
+
+
+CThreadPool::~CThreadPool(void)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mTaskAvailable.notify_all();
+
+  for (auto iter = mWorkers.begin(); iter != mWorkers.end(); ++iter) {
+    iter->join();
+  }
+}
+
+
+
+void CThreadPool::Enqueue(std::function<void()> const & task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTasks.push_back(task);
+  }
+  mTaskAvailable.notify_one();
+}
+
+
+
+void CThreadPool::WaitForAll(void)
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mTasks.empty() || mActiveTasks > 0) {
+    mIdle.wait(lock);
+  }
+}
+
+
+
+void CThreadPool::ParallelFor(size_t begin, size_t end, std::function<void(size_t)> const & func)
+{
+  if (begin >= end)
+    return;
+
+  std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+  state->next = begin;
+  state->end = end;
+  state->remaining = end - begin;
+  state->func = func;
+
+  //one helper per worker at most, each helper grabs indices until none are left
+  size_t helpers = std::min(mWorkers.size(), end - begin - 1);
+  for (size_t i = 0; i < helpers; ++i) {
+    Enqueue([state]() { state->Run(); });
+  }
+
+  state->Run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (state->remaining > 0) {
+    state->finished.wait(lock);
+  }
+}
+
+
+
+CThreadPool & CThreadPool::GetDefaultPool(void)
+{
+  static CThreadPool pool;
+  return pool;
+}
+
+
+
+void CThreadPool::WorkerLoop(void)
+{
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      while (!mStop && mTasks.empty()) {
+        mTaskAvailable.wait(lock);
+      }
+      if (mStop && mTasks.empty())
+        return;
+
+      task = mTasks.front();
+      mTasks.pop_front();
+      ++mActiveTasks;
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      --mActiveTasks;
+      if (mTasks.empty() && mActiveTasks == 0)
+        mIdle.notify_all();
+    }
+  }
+}
+
+
+} //namespace GLUtils
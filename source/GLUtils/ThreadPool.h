@@ -0,0 +1,53 @@
+#pragma once
+
+#include "GLUtilsDefines.h"
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace GLUtils {
+
+
+  //fixed set of worker threads processing a shared task queue
+  class CThreadPool
+  {
+  public:
+    //numberOfThreads == 0 uses one worker less than the hardware threads (the caller keeps working as well)
+    GLUTILS_API CThreadPool(size_t numberOfThreads = 0);
+    GLUTILS_API ~CThreadPool(void);
+
+    //adds a task to the queue
+    GLUTILS_API void Enqueue(std::function<void()> const & task);
+
+    //blocks until the queue is empty and all workers are idle
+    GLUTILS_API void WaitForAll(void);
+
+    //calls func(i) for every i in [begin, end) and returns after all calls finished.
+    //the calling thread takes part in the work, so nested calls from a worker do not dead lock
+    GLUTILS_API void ParallelFor(size_t begin, size_t end, std::function<void(size_t)> const & func);
+
+    GLUTILS_API size_t GetNumberOfThreads(void) const {return mWorkers.size();}
+
+    //pool shared by the whole application (created on first use)
+    GLUTILS_API static CThreadPool & GetDefaultPool(void);
+
+  private:
+    CThreadPool(CThreadPool const & rhs);             //forbidden
+    CThreadPool & operator=(CThreadPool const & rhs); //forbidden
+
+    void WorkerLoop(void);
+
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mTaskAvailable;
+    std::condition_variable mIdle;
+    size_t mActiveTasks;
+    bool mStop;
+  };
+
+
+} //namespace GLUtils
@@ -49,6 +49,7 @@ namespace Gui {
   CPrimaryView::CPrimaryView(Terrain::CTerrainModel & terrain)
     : CView()
     , mTerrain(terrain)
+    , mTerrainLoaded(false)
   {
     mWidth = 1680;
     mHeight = 1020;
@@ -98,7 +99,7 @@ namespace Gui {
     //setup shader
 #ifdef USESHADER
     GetViewEffects().SetupEffects();
-    GetViewEffects().NewTerrainLoaded(mTerrain);
+    //the terrain is loaded in the background, its boundings and textures are applied when it is finished
     GetViewEffects().CheckCurrentEffect();
     GetViewEffects().DeactivateEffects();
 #endif
@@ -127,6 +128,19 @@ namespace Gui {
 
   void CPrimaryView::RenderTerrain(glm::dvec3 const & eye, glm::dvec3 const & lookAt, glm::dvec3 const & upVec)
   {
+    //nothing to render until the terrain (or its preview) is loaded
+    Terrain::LoadingState state = GetTerrain().GetLoadingState();
+    if (state == Terrain::Loading || state == Terrain::LoadingFailed)
+      return;
+
+    if (!mTerrainLoaded && state == Terrain::NotLoading) {
+#ifdef USESHADER
+      GetViewEffects().NewTerrainLoaded(mTerrain);
+      GetViewEffects().DeactivateEffects();
+#endif
+      mTerrainLoaded = true;
+    }
+
     GLUtils::CGLPushMatrix scopedMatrix(GL_MODELVIEW);
 
     //const glm::dvec3 eye = GetFirstPersonCamera().GetEyePt();
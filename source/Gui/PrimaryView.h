@@ -49,6 +49,7 @@ namespace Gui {
     GUI_API static void RenderTerrainWrapper(void);
 
     Terrain::CTerrainModel & mTerrain;
+    bool mTerrainLoaded;                  //the boundings and textures of the terrain are applied to the effects
     std::shared_ptr<CSkyDome> mSkyDome;
     std::shared_ptr<CModel> mPalm;
   };
@@ -10,8 +10,8 @@ namespace Gui {
   /* Terrain Textured + Normal + Ambient Occlusion Effect                                      */
   /************************************************************************/
 
-  CTexturedTerrainEffect::CTexturedTerrainEffect(GLUtils::CGLEffectManager & effectManager)
-    : CTerrainEffect(effectManager, "../../../shader/viewer/shader.glsl")
+  CTexturedTerrainEffect::CTexturedTerrainEffect(GLUtils::CGLEffectManager & effectManager, std::string const & shaderPath)
+    : CTerrainEffect(effectManager, shaderPath)
   {
     RegisterTextures(&mTerrainTexture);
   }
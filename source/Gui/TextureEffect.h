@@ -5,7 +5,7 @@ namespace Gui {
   class CTexturedTerrainEffect : public CTerrainEffect
   {
   public:
-    CTexturedTerrainEffect(GLUtils::CGLEffectManager & effectManager);
+    CTexturedTerrainEffect(GLUtils::CGLEffectManager & effectManager, std::string const & shaderPath = "../../../shader/viewer/shader.glsl");
     virtual ~CTexturedTerrainEffect(void);
 
     //setting boundaries of terrain.
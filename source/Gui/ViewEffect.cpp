@@ -17,7 +17,8 @@ namespace Gui {
 
     static std::string sEffectAlias[] = { "Normal AO Light Effect",
                                           "Cross Hatch Effect",
-                                          "Terrain Textured Effect"};
+                                          "Terrain Textured Effect",
+                                          "Terrain Tessellated Effect"};
 
 
   CViewEffects::CViewEffects(CView & parent) 
@@ -151,6 +152,13 @@ namespace Gui {
       texturedTerrain->Initialize(minBound, maxBound);
       mEffectManager.RegisterEffect(sEffectAlias[TexturedTerrainEffect], texturedTerrain);
 
+      //same shading, but the terrain is refined by the tessellation stages (needs gl 4.0)
+      if (glewIsSupported("GL_VERSION_4_0")) {
+        CTexturedTerrainEffect * tessellatedTerrain = new CTexturedTerrainEffect(mEffectManager, "../../../shader/viewer/tessellation.glsl");
+        tessellatedTerrain->Initialize(minBound, maxBound);
+        mEffectManager.RegisterEffect(sEffectAlias[TessellatedTerrainEffect], tessellatedTerrain);
+      }
+
       mEffectManager.CompileEffects();
 
       SetEffect(static_cast<EffectName>(0));
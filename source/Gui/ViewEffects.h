@@ -16,6 +16,7 @@ namespace Gui {
     NormalAOLightEffect = 0,
     CrossHatchEffect,
     TexturedTerrainEffect,
+    TessellatedTerrainEffect,
     NumberOfEffects
   };
 
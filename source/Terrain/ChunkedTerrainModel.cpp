@@ -1,18 +1,73 @@
 #include "TerrainPrecompiled.h"
 #include "ChunkedTerrainModel.h"
+#include "HfcFormat.h"
+#include "IndexOptimizer.h"
 #include <cstdio>
 #include <iostream>
+#include <atomic>
 #include <GL/glew.h>
+#include "ThreadPool.h"
+#include "PatchStreamer.h"
 
 
 namespace Terrain {
 
+  //streamed payloads are kept for this number of frames after they left the cut, so a cut moving back and forth does
+  //not read them again
+  static const glm::uint UNLOAD_DELAY = 120;
+
+
+
+  CChunkedTerrainModel::IndexBuffer::~IndexBuffer()
+  {
+    if (glbuf != 0)
+      glDeleteBuffers(1, &glbuf);
+  }
+
+
+
+  void CChunkedTerrainModel::IndexBuffer::Commit()
+  {
+    if (commits++ > 0)
+      return;
+
+    glGenBuffers(1, &glbuf);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glbuf);
+
+    //16 bit indices halve the index bandwidth, if the vertices of the patches allow it
+    std::vector<unsigned short> narrow;
+    if (CIndexOptimizer::NarrowIndices(indices, narrow)) {
+      itype = GL_UNSIGNED_SHORT;
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short)*narrow.size(), narrow.data(), GL_STATIC_DRAW);
+    }
+    else {
+      itype = GL_UNSIGNED_INT;
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::uint)*indices.size(), indices.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+
+
+
+  void CChunkedTerrainModel::IndexBuffer::Release()
+  {
+    if (commits > 0 && --commits == 0) {
+      glDeleteBuffers(1, &glbuf);
+      glbuf = 0;
+    }
+  }
+
+
+
   CChunkedTerrainModel::Patch::Patch(Patch* p) 
     : parent(p) 
   {
     child_count  = 0;
     childs[0] = childs[1] = childs[2] = childs[3] = 0;
     glbufs[0] = glbufs[1] = 0;
+    payloadOffset = 0;
+    vcount = icount = 0;
+    lastUsed = 0;
   }
 
 
@@ -38,15 +93,16 @@ namespace Terrain {
     }
 
     if (!IsCommited()) {
-      glGenBuffers(2, glbufs);
+      glGenBuffers(1, glbufs);
 
       //upload data
       glBindBuffer(GL_ARRAY_BUFFER, glbufs[0]);
       glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*vbuf.size(), vbuf.data(), GL_STATIC_DRAW);
       glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glbufs[1]);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::uint)*ibuf.size(), ibuf.data(), GL_STATIC_DRAW);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+      //the index buffer is only uploaded by the first patch using it
+      ibuf->Commit();
+      glbufs[1] = ibuf->glbuf;
     }
   }
 
@@ -55,9 +111,10 @@ namespace Terrain {
   void CChunkedTerrainModel::Patch::Release() 
   {
     if (IsCommited()) {
-      glDeleteBuffers(2, glbufs);
+      glDeleteBuffers(1, glbufs);
+      ibuf->Release();
       glbufs[0] = 0;
-      glbufs[1] = 1;
+      glbufs[1] = 0;
     }
   }
   
@@ -75,6 +132,28 @@ namespace Terrain {
 
 
 
+  bool CChunkedTerrainModel::Patch::UnloadChilds(glm::uint usedBefore) 
+  {
+    //childs are only loaded while their parent is loaded
+    bool unloaded = false;
+    for (glm::uint i=0; i < child_count; ++i) {
+      if (childs[i]->IsLoaded()) {
+        if (childs[i]->UnloadChilds(usedBefore))
+          unloaded = true;
+        if (childs[i]->lastUsed >= usedBefore)
+          continue;
+
+        childs[i]->Release();
+        std::vector<Vertex>().swap(childs[i]->vbuf);
+        childs[i]->ibuf.reset();
+        unloaded = true;
+      }
+    }
+    return unloaded;
+  }
+
+
+
   float CChunkedTerrainModel::Patch::DistanceTo(const glm::vec3& p) const 
   {
     glm::vec3 d= glm::vec3(
@@ -89,7 +168,11 @@ namespace Terrain {
 
   CChunkedTerrainModel::CChunkedTerrainModel()
     :mRoots()
-    
+    , mIndexOptimization(true)
+    , mIndexPrimitive(GL_TRIANGLE_STRIP)
+    , mStreaming(false)
+    , mPayloadsUnloaded(false)
+    , mFrame(0)
   {
     mTerrainMax = vec3(FLT_MIN);
     mTerrainMin = vec3(FLT_MAX);
@@ -100,6 +183,7 @@ namespace Terrain {
 
   CChunkedTerrainModel::~CChunkedTerrainModel() 
   {
+    CancelLoading();
     Clear();
   }
 
@@ -128,22 +212,97 @@ namespace Terrain {
     }
 
     //read number of root patches
-    glm::uint num_roots;
+    glm::uint num_roots = 0;
     fread(&num_roots, sizeof(glm::uint), 1, fp);
+
+    //the index-optimize tool marks files with triangle lists in the root count
+    bool triangleLists = (num_roots & Hfc::TriangleListFlag) != 0;
+    num_roots &= ~Hfc::TriangleListFlag;
+    mIndexPrimitive = (triangleLists || mIndexOptimization) ? GL_TRIANGLES : GL_TRIANGLE_STRIP;
     std::cout << "terrain has " << num_roots << " root nodes!" << std::endl;
 
-    //recursive read all patch hierarchy for all roots
-    mRoots.resize(num_roots);
-    for (std::vector<Patch*>::iterator itr = mRoots.begin(); itr != mRoots.end(); ++itr) {
-      Patch* root = new Patch(0);
+    //the root hierarchies start at the offsets of the sidecar written by the tools, without one they are found by skipping the payloads
+    long long headerSize = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_END);
+    long long fileSize = _ftelli64(fp);
+    _fseeki64(fp, headerSize, SEEK_SET);
+
+    std::vector<long long> offsets;
+    if (!Hfc::ReadRootIndex(hfcfile, fileSize, num_roots, offsets) && !Hfc::ScanRootOffsets(fp, num_roots, offsets)) {
+      fclose(fp);
+      return false;
+    }
+    fclose(fp);
+
+    //every root hierarchy is read through its own file handle, first the root patches, which are shown as a preview
+    //while their childs are read
+    bool optimizeStrips = !triangleLists && mIndexOptimization;
+    std::vector<char> loaded(num_roots, 0);
+    std::vector<long long> childOffsets(num_roots, 0);
+    std::atomic<glm::uint> finished(0);
+    mRoots.assign(num_roots, nullptr);
+    std::cout << "\treading patch hierarchies with " << GLUtils::CThreadPool::GetDefaultPool().GetNumberOfThreads() + 1 << " threads" << std::endl;
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, num_roots, [&](size_t i) {
+      FILE* rfp = nullptr;
+      if (IsLoadingCancelled() || fopen_s(&rfp, hfcfile, "rb") != 0 || rfp == nullptr)
+        return;
 
-      std::cout << "\treading patch hierarchy";
-      if (!LoadHierarchy(root, fp)) {
-        Clear();
+      mRoots[i] = new Patch(0);
+      loaded[i] = _fseeki64(rfp, offsets[i], SEEK_SET) == 0 && LoadPatch(mRoots[i], rfp, optimizeStrips);
+      childOffsets[i] = _ftelli64(rfp);
+      fclose(rfp);
+      SetLoadingProgress(0.1f * static_cast<float>(++finished) / static_cast<float>(num_roots));
+    });
+
+    //the index buffers of the roots are shared before the render thread commits them
+    for (glm::uint i=0; i < num_roots; ++i) {
+      if (!loaded[i]) {
+        std::cerr << "failed to load patch hierarchy " << i << " of " << hfcfile << "!" << std::endl;
+        ClearHierarchy();
+        return false;
+      }
+      if (mRoots[i]->IsLoaded())
+        mRoots[i]->ibuf = ShareIndexBuffer(mRoots[i]->ibuf);
+    }
+    PublishPreview();
+
+    finished = 0;
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, num_roots, [&](size_t i) {
+      FILE* rfp = nullptr;
+      loaded[i] = 0;
+      if (IsLoadingCancelled() || fopen_s(&rfp, hfcfile, "rb") != 0 || rfp == nullptr)
+        return;
+
+      loaded[i] = _fseeki64(rfp, childOffsets[i], SEEK_SET) == 0 && LoadChilds(mRoots[i], rfp, optimizeStrips);
+      fclose(rfp);
+      SetLoadingProgress(0.1f + 0.8f * static_cast<float>(++finished) / static_cast<float>(num_roots));
+    });
+
+    //bounds and shared index buffers are merged in file order, the render thread does not use the roots meanwhile
+    {
+      std::lock_guard<std::mutex> lock(mPreviewMutex);
+      for (glm::uint i=0; i < num_roots && loaded[i]; ++i)
+        AttachHierarchy(mRoots[i]);
+    }
+    for (glm::uint i=0; i < num_roots; ++i) {
+      if (!loaded[i]) {
+        std::cerr << "failed to load patch hierarchy " << i << " of " << hfcfile << "!" << std::endl;
+        ClearHierarchy();
+        return false;
+      }
+    }
+    std::cout << "terrain patches share " << GetIndexBufferCount() << " index buffers, " << GetSharedIndexBytes() << " bytes saved!" << std::endl;
+
+    //streamed payloads are not loaded yet, so there is no pyramid
+    BuildHeightPyramid();
+
+    //the payloads are read by the i/o threads of the streamer
+    if (mStreaming) {
+      mStreamer.reset(new CPatchStreamer());
+      if (!mStreamer->Open(hfcfile, optimizeStrips)) {
+        ClearHierarchy();
         return false;
       }
-      (*itr) = root;
-      std::cout << std::endl;
     }
 
     return true;
@@ -153,21 +312,171 @@ namespace Terrain {
 
   void CChunkedTerrainModel::Clear() 
   {
+    ClearHierarchy();
+    DeleteReleasedGLObjects();
+  }
+
+
+
+  //moves the names of the gl buffers of the committed patches to the list, so deleting the patches does not call gl
+  static void ReleaseGLNames(CChunkedTerrainModel::Patch* patch, std::vector<GLuint> & buffers)
+  {
+    if (patch->IsCommited()) {
+      buffers.push_back(patch->glbufs[0]);
+      if (patch->ibuf->glbuf != 0) {
+        buffers.push_back(patch->ibuf->glbuf);
+        patch->ibuf->glbuf = 0;
+        patch->ibuf->commits = 0;
+      }
+      patch->glbufs[0] = patch->glbufs[1] = 0;
+    }
+
+    for (glm::uint i=0; i < patch->child_count; ++i)
+      if (patch->childs[i] != 0)
+        ReleaseGLNames(patch->childs[i], buffers);
+  }
+
+
+
+  void CChunkedTerrainModel::ClearHierarchy() 
+  {
+    //the render thread must not use the preview anymore
+    std::lock_guard<std::mutex> lock(mPreviewMutex);
+    RevokePreview();
+
+    //the i/o threads are stopped before the patches are deleted
+    mStreamer.reset();
+    mActivePatches.clear();
 
     for (std::vector<Patch*>::iterator itr = mRoots.begin(); itr != mRoots.end(); ++itr)
-      if ((*itr) != 0)
+      if ((*itr) != 0) {
+        ReleaseGLNames(*itr, mReleasedBuffers);
         delete (*itr);
+      }
 
     mRoots.clear();
+    mIndexBuffers.clear();
+    SetHeightPyramid(nullptr);
+  }
+
+
+
+  void CChunkedTerrainModel::DeleteReleasedGLObjects() 
+  {
+    std::lock_guard<std::mutex> lock(mPreviewMutex);
+    if (!mReleasedBuffers.empty())
+      glDeleteBuffers(static_cast<GLsizei>(mReleasedBuffers.size()), mReleasedBuffers.data());
+    mReleasedBuffers.clear();
+  }
+
+
+
+  bool CChunkedTerrainModel::LockPreview(std::unique_lock<std::mutex> & lock) const 
+  {
+    LoadingState state = GetLoadingState();
+    if (state == PreviewLoading) {
+      lock = std::unique_lock<std::mutex>(mPreviewMutex);
+      state = GetLoadingState();
+    }
+    return (state == PreviewLoading || state == NotLoading) && !mRoots.empty();
   }
 
 
 
   void CChunkedTerrainModel::Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum) 
   {
+    //the gl buffers of a failed loading are deleted here
+    DeleteReleasedGLObjects();
+
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
+
+    if (preview.owns_lock() && GetLoadingState() == PreviewLoading) {
+      //the childs are still loaded, only the roots are shown
+      mActivePatches.clear();
+      for (std::vector<Patch*>::iterator itr = mRoots.begin(); itr != mRoots.end(); ++itr) {
+        Patch* p = *itr;
+        if (p->IsLoaded() && frustum.Intersects(p->bbmin, p->bbmax)) {
+          p->Commit();
+          mActivePatches.push_back(p);
+        }
+      }
+      return;
+    }
+
+    if (mStreamer)
+      AttachPayloads();
+
+    ++mFrame;
     mActivePatches.clear();
+    mPayloadRequests.clear();
     for (std::vector<Patch*>::iterator itr = mRoots.begin(); itr != mRoots.end(); ++itr)
       RecursiveUpdate(*itr, metric, frustum);
+
+    //requests of patches which dropped out of the cut are cancelled by the streamer
+    if (mStreamer) {
+      std::vector<CPatchStreamer::Request> requests;
+      requests.reserve(mPayloadRequests.size());
+      for (auto iter = mPayloadRequests.begin(); iter != mPayloadRequests.end(); ++iter)
+        requests.push_back(CPatchStreamer::Request(iter->first, iter->second));
+      mStreamer->Schedule(requests);
+
+      if (mPayloadsUnloaded) {
+        ReleaseUnusedIndexBuffers();
+        mPayloadsUnloaded = false;
+      }
+    }
+  }
+
+
+
+  void CChunkedTerrainModel::AttachPayloads() 
+  {
+    std::vector<CPatchStreamer::Payload> payloads;
+    mStreamer->Collect(payloads);
+
+    for (auto iter = payloads.begin(); iter != payloads.end(); ++iter) {
+      //the parent may have been unloaded while the payload was read
+      Patch* p = iter->patch;
+      if (p->IsLoaded() || (p->parent != nullptr && !p->parent->IsLoaded()))
+        continue;
+
+      std::shared_ptr<IndexBuffer> ibuf = std::make_shared<IndexBuffer>();
+      ibuf->indices.swap(iter->indices);
+      p->vbuf.swap(iter->vbuf);
+      p->ibuf = ShareIndexBuffer(ibuf);
+    }
+  }
+
+
+
+  void CChunkedTerrainModel::ReleaseUnusedIndexBuffers() 
+  {
+    for (auto iter = mIndexBuffers.begin(); iter != mIndexBuffers.end(); ) {
+      std::vector<std::shared_ptr<IndexBuffer> > & bucket = iter->second;
+      for (size_t i=0; i < bucket.size(); ) {
+        if (bucket[i].use_count() == 1) {
+          bucket[i] = bucket.back();
+          bucket.pop_back();
+        }
+        else {
+          ++i;
+        }
+      }
+
+      if (bucket.empty())
+        iter = mIndexBuffers.erase(iter);
+      else
+        ++iter;
+    }
+  }
+
+
+
+  size_t CChunkedTerrainModel::GetPendingPayloads() const
+  {
+    return mStreamer ? mStreamer->GetPendingCount() : 0;
   }
 
 
@@ -175,20 +484,43 @@ namespace Terrain {
   {
 
     if (frustum.Intersects(p->bbmin, p->bbmax)) {
-      if (metric.Evaluate(p->bbmin, p->bbmax, p->error) && p->child_count > 0) {
-
-        for (glm::uint i=0; i < p->child_count; ++i)
-          RecursiveUpdate(p->childs[i], metric, frustum);
+      //streamed root patches are drawn as soon as their payload arrived
+      if (!p->IsLoaded()) {
+        mPayloadRequests.push_back(std::make_pair(p, metric.ScreenSpaceError(p->bbmin, p->bbmax, p->error)));
+        return;
       }
-      else {
-        p->Commit();
-        p->ReleaseChilds();
-        mActivePatches.push_back(p);
+      p->lastUsed = mFrame;
+
+      bool refine = metric.Evaluate(p->bbmin, p->bbmax, p->error) && p->child_count > 0;
+      if (refine) {
+        //the patch is drawn until the payloads of all visible childs are loaded
+        bool childsLoaded = true;
+        for (glm::uint i=0; i < p->child_count; ++i) {
+          Patch* child = p->childs[i];
+          if (!child->IsLoaded() && frustum.Intersects(child->bbmin, child->bbmax)) {
+            mPayloadRequests.push_back(std::make_pair(child, metric.ScreenSpaceError(child->bbmin, child->bbmax, child->error)));
+            childsLoaded = false;
+          }
+        }
+
+        if (childsLoaded) {
+          for (glm::uint i=0; i < p->child_count; ++i)
+            RecursiveUpdate(p->childs[i], metric, frustum);
+          return;
+        }
       }
+
+      p->Commit();
+      p->ReleaseChilds();
+      mActivePatches.push_back(p);
+      if (mStreamer && !refine && p->UnloadChilds(mFrame > UNLOAD_DELAY ? mFrame - UNLOAD_DELAY : 0))
+        mPayloadsUnloaded = true;
     }
     else {
       p->Release();
       p->ReleaseChilds();
+      if (mStreamer && p->UnloadChilds(mFrame > UNLOAD_DELAY ? mFrame - UNLOAD_DELAY : 0))
+        mPayloadsUnloaded = true;
     }
   }
   
@@ -196,6 +528,10 @@ namespace Terrain {
 
   void CChunkedTerrainModel::Render() const 
   {
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
+
     if (glPrimitiveRestartIndex == nullptr)  {
       GLenum glew_err = glewInit();
       if (glew_err != GLEW_NO_ERROR) {
@@ -205,7 +541,6 @@ namespace Terrain {
     }
 
     glEnable(GL_PRIMITIVE_RESTART);
-    glPrimitiveRestartIndex(UINT_MAX);
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     
@@ -219,8 +554,12 @@ namespace Terrain {
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p->glbufs[1]);
       glVertexPointer(3, GL_FLOAT, sizeof(CChunkedTerrainModel::Vertex), 0);
       glNormalPointer(GL_FLOAT, sizeof(CChunkedTerrainModel::Vertex), (void*)12);
-      glDrawElements(GL_TRIANGLE_STRIP, static_cast<GLsizei>((*itr)->ibuf.size()), GL_UNSIGNED_INT, 0);
-      mNumberOfRenderedTriangles += static_cast<unsigned int>((*itr)->ibuf.size());
+      glPrimitiveRestartIndex((p->ibuf->itype == GL_UNSIGNED_SHORT) ? CIndexOptimizer::RESTART_INDEX16 : CIndexOptimizer::RESTART_INDEX);
+      glDrawElements(mIndexPrimitive, static_cast<GLsizei>(p->ibuf->indices.size()), p->ibuf->itype, 0);
+      if (mIndexPrimitive == GL_TRIANGLES)
+        mNumberOfRenderedTriangles += static_cast<unsigned int>(p->ibuf->indices.size() / 3);
+      else
+        mNumberOfRenderedTriangles += static_cast<unsigned int>(p->ibuf->indices.size());
     }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -278,6 +617,9 @@ namespace Terrain {
 
   void CChunkedTerrainModel::RenderBounds() const 
   {
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
 
     glDisable(GL_LIGHTING);
   
@@ -291,48 +633,188 @@ namespace Terrain {
 
 
 
-  bool CChunkedTerrainModel::LoadHierarchy(Patch* node, FILE* fp) {
+  size_t CChunkedTerrainModel::GetIndexBufferCount() const
+  {
+    size_t count = 0;
+    for (auto iter = mIndexBuffers.begin(); iter != mIndexBuffers.end(); ++iter)
+      count += iter->second.size();
+    return count;
+  }
+
+
+
+  size_t CChunkedTerrainModel::GetSharedIndexBytes() const
+  {
+    //every patch holds a reference besides the map, each one after the first saves a copy
+    size_t bytes = 0;
+    for (auto iter = mIndexBuffers.begin(); iter != mIndexBuffers.end(); ++iter) {
+      for (auto buffer = iter->second.begin(); buffer != iter->second.end(); ++buffer) {
+        long users = buffer->use_count() - 1;
+        if (users > 1)
+          bytes += static_cast<size_t>(users - 1) * (*buffer)->indices.size() * sizeof(glm::uint);
+      }
+    }
+    return bytes;
+  }
+
+
+
+  std::shared_ptr<CChunkedTerrainModel::IndexBuffer> CChunkedTerrainModel::ShareIndexBuffer(std::shared_ptr<IndexBuffer> const & ibuf)
+  {
+    //64 bit fnv-1a hash of the index bytes
+    static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+    static const unsigned long long FNV_PRIME = 1099511628211ULL;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(ibuf->indices.data());
+    size_t size = ibuf->indices.size() * sizeof(glm::uint);
+    unsigned long long hash = FNV_OFFSET;
+    for (size_t i=0; i < size; ++i)
+      hash = (hash ^ data[i]) * FNV_PRIME;
+
+    //compare the content on hash collisions
+    std::vector<std::shared_ptr<IndexBuffer> > & bucket = mIndexBuffers[hash];
+    for (auto iter = bucket.begin(); iter != bucket.end(); ++iter) {
+      if ((*iter)->indices == ibuf->indices)
+        return *iter;
+    }
+
+    bucket.push_back(ibuf);
+    return ibuf;
+  }
+
+
+
+  //collects the finest patches with vertices: the loaded patches, whose childs are missing or not loaded
+  static void CollectFinestPatches(CChunkedTerrainModel::Patch * patch, std::vector<CChunkedTerrainModel::Patch*> & patches)
+  {
+    bool childsLoaded = (patch->child_count == 4);
+    for (glm::uint i=0; i < patch->child_count; ++i) {
+      if (!patch->childs[i]->IsLoaded())
+        childsLoaded = false;
+    }
+
+    if (childsLoaded) {
+      for (glm::uint i=0; i < patch->child_count; ++i)
+        CollectFinestPatches(patch->childs[i], patches);
+    }
+    else if (patch->IsLoaded()) {
+      patches.push_back(patch);
+    }
+  }
+
+
+
+  void CChunkedTerrainModel::BuildHeightPyramid()
+  {
+    std::vector<Patch*> patches;
+    glm::vec2 min(FLT_MAX), max(-FLT_MAX);
+    for (auto iter = mRoots.begin(); iter != mRoots.end(); ++iter) {
+      CollectFinestPatches(*iter, patches);
+      min = glm::min(min, vec2((*iter)->bbmin));
+      max = glm::max(max, vec2((*iter)->bbmax));
+    }
+    if (patches.empty())
+      return;
+
+    //the patches are roughly square grids (plus skirts), the finest one gives the sample spacing
+    float spacing = FLT_MAX;
+    for (auto iter = patches.begin(); iter != patches.end(); ++iter) {
+      float quads = glm::max(glm::floor(glm::sqrt(static_cast<float>((*iter)->vbuf.size()))) - 1.f, 1.f);
+      spacing = glm::min(spacing, ((*iter)->bbmax.x - (*iter)->bbmin.x) / quads);
+    }
+    if (spacing <= 0.f)
+      return;
+
+    glm::ivec2 samples = glm::ivec2(glm::ceil((max - min) / spacing)) + 1;
+    std::unique_ptr<CHeightPyramid> heights(new CHeightPyramid());
+    heights->Init(samples.x, samples.y, min, max);
+
+    //the footprints of the patches are disjoint
+    CHeightPyramid & pyramid = *heights;
+    bool strips = (mIndexPrimitive == GL_TRIANGLE_STRIP);
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, patches.size(), [&](size_t i) {
+      Patch const * patch = patches[i];
+      std::vector<glm::vec3> positions(patch->vbuf.size());
+      for (size_t v=0; v < patch->vbuf.size(); ++v)
+        positions[v] = patch->vbuf[v].p;
+
+      std::vector<glm::uint> triangles;
+      if (strips)
+        CIndexOptimizer::StripsToTriangles(patch->ibuf->indices, triangles);
+      pyramid.Rasterize(positions, strips ? triangles : patch->ibuf->indices, vec2(patch->bbmin), vec2(patch->bbmax));
+    });
+    pyramid.Build();
+    std::cout << "height pyramid of " << samples.x << " x " << samples.y << " samples consumes approx: " << pyramid.GetMemoryUsage() << "bytes!" << std::endl;
+    SetHeightPyramid(std::move(heights));
+  }
+
+
+
+  void CChunkedTerrainModel::AttachHierarchy(Patch* node)
+  {
+    UpdateBoundingBox(node->bbmin);
+    UpdateBoundingBox(node->bbmax);
+    if (node->IsLoaded())
+      node->ibuf = ShareIndexBuffer(node->ibuf);
+
+    for (glm::uint i=0; i < node->child_count; ++i)
+      AttachHierarchy(node->childs[i]);
+  }
+
+
+
+  bool CChunkedTerrainModel::LoadPatch(Patch* node, FILE* fp, bool optimizeStrips) {
 
     glm::uint count;
 
     fread(&node->bbmin.x, sizeof(glm::vec3), 1, fp);
-    node->bbmin = vec3(node->bbmin.x, node->bbmin.y, node->bbmin.z);
-    UpdateBoundingBox(node->bbmin);
     fread(&node->bbmax.x, sizeof(glm::vec3), 1, fp);
-    node->bbmin = vec3(node->bbmax.x, node->bbmax.y, node->bbmax.z);
-    UpdateBoundingBox(node->bbmax);
     fread(&node->error, sizeof(float), 1, fp);
 
     //alloc vbuf & ibuf
-    fread(&count, sizeof(glm::uint), 1, fp);
-    node->vbuf.resize(count);
-    fread(&count, sizeof(glm::uint), 1, fp);
-    node->ibuf.resize(count);
+    fread(&node->vcount, sizeof(glm::uint), 1, fp);
+    fread(&node->icount, sizeof(glm::uint), 1, fp);
+    node->payloadOffset = _ftelli64(fp);
+
+    //streamed payloads are read when the patch is needed
+    if (mStreaming) {
+      long long payload = static_cast<long long>(node->vcount) * sizeof(Vertex) + static_cast<long long>(node->icount) * sizeof(glm::uint);
+      _fseeki64(fp, payload, SEEK_CUR);
+    }
+    else {
+      node->vbuf.resize(node->vcount);
+      std::vector<glm::uint> indices(node->icount);
 
-    //read data
-    fread(node->vbuf.data(), sizeof(Vertex), node->vbuf.size(), fp);
-    for (auto iter = node->vbuf.begin(); iter != node->vbuf.end(); ++iter) {
+      //read data
+      fread(node->vbuf.data(), sizeof(Vertex), node->vbuf.size(), fp);
+      for (auto iter = node->vbuf.begin(); iter != node->vbuf.end(); ++iter) {
 
-      Vertex vertex = *iter;
-      iter->p.y = vertex.p.y;
-      iter->p.z = vertex.p.z;
-      iter->n.y = vertex.n.y;
-      iter->n.z = vertex.n.z;
+        Vertex vertex = *iter;
+        iter->p.y = vertex.p.y;
+        iter->p.z = vertex.p.z;
+        iter->n.y = vertex.n.y;
+        iter->n.z = vertex.n.z;
 
-    }
+      }
 
-    fread(node->ibuf.data(), sizeof(glm::uint), node->ibuf.size(), fp);
+      fread(indices.data(), sizeof(glm::uint), indices.size(), fp);
 
-    //std::cout << ".";
+      //convert the strips to a vertex cache optimized triangle list
+      if (optimizeStrips) {
+        std::vector<glm::uint> triangles;
+        CIndexOptimizer::StripsToTriangles(indices, triangles);
+        CIndexOptimizer::OptimizeVertexCache(triangles);
+        indices.swap(triangles);
+      }
+      node->ibuf = std::make_shared<IndexBuffer>();
+      node->ibuf->indices.swap(indices);
+    }
 
     fread(&count, sizeof(glm::uint), 1, fp);
-    node->child_count = count;
-
-    for (glm::uint i=0; i < node->child_count; ++i) {
-      node->childs[i] = new Patch(node);
-      if (!LoadHierarchy(node->childs[i], fp))
-        return false;
+    if (count > 4) {
+      std::cerr << "failed to read patch hierchary!" << std::endl;
+      return false;
     }
+    node->child_count = count;
 
     //detect read errors
     if (ferror(fp) != 0) {
@@ -344,4 +826,23 @@ namespace Terrain {
   }
 
 
+
+  bool CChunkedTerrainModel::LoadChilds(Patch* node, FILE* fp, bool optimizeStrips) {
+
+    for (glm::uint i=0; i < node->child_count; ++i) {
+      node->childs[i] = new Patch(node);
+      if (!LoadHierarchy(node->childs[i], fp, optimizeStrips))
+        return false;
+    }
+    return true;
+  }
+
+
+
+  bool CChunkedTerrainModel::LoadHierarchy(Patch* node, FILE* fp, bool optimizeStrips) {
+
+    return LoadPatch(node, fp, optimizeStrips) && LoadChilds(node, fp, optimizeStrips);
+  }
+
+
 } //namespace hfc
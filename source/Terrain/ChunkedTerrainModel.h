@@ -4,6 +4,9 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "ViewFrustum.h"
 #include "ErrorMetric.h"
 #include <GL/glew.h>
@@ -14,6 +17,8 @@ class GLUtils::CViewFrustum;
 
 namespace Terrain {
 
+  class CPatchStreamer;
+
 
   class CChunkedTerrainModel : public CTerrainModel {
   public:
@@ -22,17 +27,37 @@ namespace Terrain {
       glm::vec3 n;
     };
 
+    //index buffer shared by all patches with the same connectivity
+    struct IndexBuffer {
+      std::vector<glm::uint>	indices;
+      glm::uint				glbuf;
+      GLenum					itype;		//type of the indices on the gpu (16 or 32 bit)
+      glm::uint				commits;	//number of commited patches using the gpu buffer
+
+      IndexBuffer() : glbuf(0), itype(GL_UNSIGNED_INT), commits(0) {}
+      ~IndexBuffer();
+
+      //uploads the indices with the first commiting patch
+      void Commit();
+      //deletes the gpu buffer with the last releasing patch
+      void Release();
+    };
+
     struct Patch {
       //patch properties
       glm::vec3				bbmin;
       glm::vec3				bbmax;
       float 					error;
       std::vector<Vertex>		vbuf;
-      std::vector<glm::uint>	ibuf;
+      std::shared_ptr<IndexBuffer> ibuf;
       Patch* 					parent;
       glm::uint 				child_count;
       Patch*					childs[4];
-      glm::uint				glbufs[2];
+      glm::uint				glbufs[2];	//vertex buffer and (shared) index buffer
+      long long				payloadOffset;	//file offset of the vertices (streamed payloads)
+      glm::uint				vcount;
+      glm::uint				icount;		//number of indices in the file
+      glm::uint				lastUsed;	//last frame the patch was part of the cut or refined (streamed payloads)
 
       Patch(Patch* p);
       ~Patch();
@@ -45,6 +70,10 @@ namespace Terrain {
       void Release();
       //release gpu data of child patches (recursive)
       void ReleaseChilds();
+      //gets if the payload (vertices and indices) is in memory
+      bool IsLoaded() const {return ibuf != nullptr;}
+      //frees the payload of the child patches (recursive) not used since the given frame, returns true if a payload was freed
+      bool UnloadChilds(glm::uint usedBefore);
 
       //computes distance of p to the patch
       float DistanceTo(const glm::vec3& p) const;
@@ -61,6 +90,22 @@ namespace Terrain {
     Patch * Root(size_t i) {return mRoots[i];	}
     const Patch * Root(size_t i) const {	return mRoots[i];	}
 
+    //set if the strips are converted to vertex cache optimized triangle lists at load time, has to be called before Init.
+    //files written by the index-optimize tool already contain optimized lists
+    TERRAIN_API void SetIndexOptimization(bool optimize) {mIndexOptimization = optimize;}
+    TERRAIN_API bool GetIndexOptimization() const {return mIndexOptimization;}
+
+    //gets the number of distinct index buffers and the bytes saved by sharing them between the loaded patches
+    TERRAIN_API size_t GetIndexBufferCount() const;
+    TERRAIN_API size_t GetSharedIndexBytes() const;
+
+    //set if only the patch hierarchy is read by Init and the payloads are streamed in while the patches are needed,
+    //has to be called before Init
+    TERRAIN_API void SetStreaming(bool streaming) {mStreaming = streaming;}
+    TERRAIN_API bool GetStreaming() const {return mStreaming;}
+    //gets the number of payloads requested from the disk
+    TERRAIN_API size_t GetPendingPayloads() const;
+
     //initialize the terrain model
     TERRAIN_API virtual bool Init(const char* hfcfile) override;
     //free all allocated resources
@@ -79,12 +124,42 @@ namespace Terrain {
     void UpdateBoundingBox(glm::vec3 const & point);
 
     bool LoadTerrainProperties(FILE* fp);
-    bool LoadHierarchy(Patch* node, FILE* fp);
+    bool LoadHierarchy(Patch* node, FILE* fp, bool optimizeStrips);
+    //reads a single patch (without its childs)
+    bool LoadPatch(Patch* node, FILE* fp, bool optimizeStrips);
+    //reads the child hierarchies of a loaded patch
+    bool LoadChilds(Patch* node, FILE* fp, bool optimizeStrips);
+    //merges the bounds and index buffers of a loaded hierarchy into the model
+    void AttachHierarchy(Patch* node);
+    //builds the height pyramid from the finest loaded patches
+    void BuildHeightPyramid();
     void RecursiveUpdate(Patch* p, CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum);
+    //moves the payloads read by the streamer to their patches
+    void AttachPayloads();
+    //drops index buffers which are not used by any patch anymore
+    void ReleaseUnusedIndexBuffers();
+    //gets the index buffer with the same indices or adds a new one
+    std::shared_ptr<IndexBuffer> ShareIndexBuffer(std::shared_ptr<IndexBuffer> const & ibuf);
+    //revokes the preview and deletes the patches, the names of their gl buffers are kept for the render thread
+    void ClearHierarchy();
+    //deletes the gl buffers of a cleared hierarchy (render thread)
+    void DeleteReleasedGLObjects();
+    //locks the preview while the hierarchies are loaded asynchronously, returns false if there is nothing to update or render
+    bool LockPreview(std::unique_lock<std::mutex> & lock) const;
 
 
     std::vector<Patch*> mRoots;
     std::vector<Patch*> mActivePatches;
+    bool				mIndexOptimization;
+    GLenum				mIndexPrimitive;	//triangle strips or lists
+    std::unordered_map<unsigned long long, std::vector<std::shared_ptr<IndexBuffer> > > mIndexBuffers;	//by hash of the indices
+    bool				mStreaming;
+    std::unique_ptr<CPatchStreamer> mStreamer;
+    std::vector<std::pair<Patch*, float> > mPayloadRequests;	//payloads needed by the current cut and their screen space error
+    bool				mPayloadsUnloaded;
+    glm::uint			mFrame;				//number of updates, payloads are unloaded some frames after they left the cut
+    mutable std::mutex	mPreviewMutex;		//held by the render thread while it uses the preview, the loader takes it to revoke the preview
+    std::vector<GLuint>	mReleasedBuffers;	//gl buffers of a cleared hierarchy, deleted by the render thread (guarded by the preview mutex)
   };
 
 
@@ -0,0 +1,595 @@
+#include "TerrainPrecompiled.h"
+#include "ClipmapTerrainModel.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <GL/glew.h>
+#include "GLTexture.h"
+
+
+namespace Terrain {
+
+  //maps a global grid position to the position inside the toroidal buffer
+  static inline int Wrap(int value, int size)
+  {
+    int r = value % size;
+    return (r < 0) ? r + size : r;
+  }
+
+  //floor division which also works for negative values
+  static inline int FloorDiv(int value, int divisor)
+  {
+    return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+  }
+
+
+
+  CClipmapTerrainModel::CClipmapTerrainModel(glm::uint gridSize, glm::uint levels, float sampleSpacing, float heightScale)
+    : mIndexBuffer(0)
+    , mFinestLevel(0)
+    , mSampleSpacing(sampleSpacing)
+    , mHeightScale(heightScale)
+  {
+    //the grid needs 4k+1 samples, so that the finer level is placed on even coarse samples
+    //with at least one coarse quad ring left around it
+    mGridSize = static_cast<int>(glm::max(gridSize, 9u) - 1) / 4 * 4 + 1;
+    mLevels.resize(glm::max(levels, 1u));
+
+    mTerrainMax = vec3(FLT_MIN);
+    mTerrainMin = vec3(FLT_MAX);
+    mModelType = ModelType::ClipmapModel;
+  }
+
+
+
+  CClipmapTerrainModel::~CClipmapTerrainModel()
+  {
+    CancelLoading();
+    Clear();
+  }
+
+
+
+  bool CClipmapTerrainModel::Init(const char* heightmap)
+  {
+    mModelPath = std::string(heightmap);
+
+    GLUtils::CGLTexture image(mModelPath, false, true);
+    if (!image.LoadFromFile(false) || image.GetData().empty()) {
+      std::cerr << "failed to open heightmap " << heightmap << "!" << std::endl;
+      return false;
+    }
+
+    if (image.GetFormat() != GLUtils::Format::Gray8 && image.GetFormat() != GLUtils::Format::Gray16) {
+      std::cerr << "heightmap has to be a grayscale image!" << std::endl;
+      return false;
+    }
+    SetLoadingProgress(0.4f);
+
+    //copy the heights to the finest pyramid level (the first image row is the northern border)
+    GLUtils::CGLTexture::ImageData const & data = *image.GetData().begin()->second;
+    bool is16Bit = image.GetFormat() == GLUtils::Format::Gray16;
+    mPyramid.resize(1);
+    HeightLevel & base = mPyramid[0];
+    base.width = data.mWidth;
+    base.height = data.mHeight;
+    base.heights.resize(base.width * base.height);
+    for (int y=0; y < base.height; ++y) {
+      const unsigned char* row = data.GetPixels() + (base.height - 1 - y) * base.width * (is16Bit ? 2 : 1);
+      unsigned short* dst = base.heights.data() + y * base.width;
+      if (is16Bit) {
+        memcpy(dst, row, base.width * sizeof(unsigned short));
+      }
+      else {
+        for (int x=0; x < base.width; ++x) dst[x] = row[x];
+      }
+    }
+
+    unsigned short minHeight = *std::min_element(base.heights.begin(), base.heights.end());
+    unsigned short maxHeight = *std::max_element(base.heights.begin(), base.heights.end());
+    mTerrainMin = vec3(0.f, 0.f, minHeight * mHeightScale);
+    mTerrainMax = vec3((base.width-1) * mSampleSpacing, (base.height-1) * mSampleSpacing, maxHeight * mHeightScale);
+    std::cout << "heightmap has a size of: " << base.width << " x " << base.height << "!" << std::endl;
+
+    //base is not valid anymore, once the coarser levels are added
+    BuildPyramid();
+    SetLoadingProgress(0.5f);
+
+    //there is no need for levels, which are coarser than the pyramid
+    if (mLevels.size() > mPyramid.size()) mLevels.resize(mPyramid.size());
+    std::cout << "clipmap uses " << mLevels.size() << " levels of " << mGridSize << " x " << mGridSize << " vertices!" << std::endl;
+
+    //the levels are complete down to the coarsest one, so the clipmap is shown while the height queries are prepared.
+    //the render thread does not change the pyramid and the loader only builds the height pyramid from here on
+    if (IsLoadingCancelled()) {
+      std::cerr << "terrain loading cancelled!" << std::endl;
+      return false;
+    }
+    PublishPreview();
+
+    //the height queries use the unfiltered heightmap
+    HeightLevel const & finest = mPyramid[0];
+    if (finest.width >= 2 && finest.height >= 2) {
+      std::unique_ptr<CHeightPyramid> pyramid(new CHeightPyramid());
+      //the finest level is shared, the pyramid only stores the quantised ranges
+      pyramid->Init(finest.width, finest.height, vec2(mTerrainMin), vec2(mTerrainMax), finest.heights.data(), mHeightScale);
+      pyramid->Build();
+      SetHeightPyramid(std::move(pyramid));
+    }
+
+    return true;
+  }
+
+
+
+  void CClipmapTerrainModel::BuildPyramid()
+  {
+    //each coarser level is filtered with a [1 2 1]/4 tent filter, so that the coarse grid does not alias
+    while (mPyramid.size() < mLevels.size()) {
+      HeightLevel const & fine = mPyramid.back();
+      if (fine.width < 3 || fine.height < 3) break;
+
+      HeightLevel coarse;
+      coarse.width = (fine.width - 1) / 2 + 1;
+      coarse.height = (fine.height - 1) / 2 + 1;
+      coarse.heights.resize(coarse.width * coarse.height);
+
+      static const float WEIGHTS[3] = {0.25f, 0.5f, 0.25f};
+      for (int y=0; y < coarse.height; ++y) {
+        for (int x=0; x < coarse.width; ++x) {
+          float h = 0.f;
+          for (int dy=-1; dy <= 1; ++dy) {
+            int fy = glm::clamp(2*y + dy, 0, fine.height - 1);
+            for (int dx=-1; dx <= 1; ++dx) {
+              int fx = glm::clamp(2*x + dx, 0, fine.width - 1);
+              h += WEIGHTS[dx+1] * WEIGHTS[dy+1] * fine.heights[fy * fine.width + fx];
+            }
+          }
+          coarse.heights[y * coarse.width + x] = static_cast<unsigned short>(h + 0.5f);
+        }
+      }
+      mPyramid.push_back(coarse);
+    }
+  }
+
+
+
+  void CClipmapTerrainModel::Clear()
+  {
+    for (auto iter = mLevels.begin(); iter != mLevels.end(); ++iter) {
+      if (iter->glbuf) {
+        glDeleteBuffers(1, &iter->glbuf);
+      }
+      *iter = Level();
+    }
+
+    if (mIndexBuffer) {
+      glDeleteBuffers(1, &mIndexBuffer);
+      mIndexBuffer = 0;
+    }
+
+    //the height pyramid reads the finest level, so its readers have to be gone first
+    SetHeightPyramid(nullptr);
+    mPyramidEpochs.ReclaimAll();
+    mPyramid.clear();
+  }
+
+
+
+  void CClipmapTerrainModel::InitGLResources()
+  {
+    if (glGenBuffers == nullptr) {
+      GLenum glew_err = glewInit();
+      if (glew_err != GLEW_NO_ERROR) {
+        std::cout << "failed to initialize opengl extension wrapper: " << (const char*)glewGetErrorString(glew_err) << std::endl;
+        return;
+      }
+    }
+
+    if (mIndexBuffer == 0) {
+      //two triangles for each quad of the torus (including the quads which wrap around)
+      int n = mGridSize;
+      std::vector<glm::uint> ib;
+      ib.reserve(n * n * 6);
+      for (int r=0; r < n; ++r) {
+        for (int c=0; c < n; ++c) {
+          glm::uint a = r * n + c;
+          glm::uint b = r * n + (c + 1) % n;
+          glm::uint d = ((r + 1) % n) * n + c;
+          glm::uint e = ((r + 1) % n) * n + (c + 1) % n;
+          ib.push_back(a); ib.push_back(b); ib.push_back(e);
+          ib.push_back(a); ib.push_back(e); ib.push_back(d);
+        }
+      }
+
+      glGenBuffers(1, &mIndexBuffer);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, ib.size()*sizeof(glm::uint), ib.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    for (auto iter = mLevels.begin(); iter != mLevels.end(); ++iter) {
+      if (iter->glbuf == 0) {
+        glGenBuffers(1, &iter->glbuf);
+        glBindBuffer(GL_ARRAY_BUFFER, iter->glbuf);
+        glBufferData(GL_ARRAY_BUFFER, mGridSize * mGridSize * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+        iter->valid = false;
+      }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+
+
+  float CClipmapTerrainModel::SampleHeight(glm::uint level, int x, int y) const
+  {
+    HeightLevel const & l = mPyramid[level];
+    x = glm::clamp(x, 0, l.width - 1);
+    y = glm::clamp(y, 0, l.height - 1);
+    return l.heights[y * l.width + x] * mHeightScale;
+  }
+
+
+
+  float CClipmapTerrainModel::SampleHeight(glm::uint level, float x, float y) const
+  {
+    int x0 = static_cast<int>(glm::floor(x));
+    int y0 = static_cast<int>(glm::floor(y));
+    float fx = x - x0;
+    float fy = y - y0;
+
+    float h0 = glm::mix(SampleHeight(level, x0, y0), SampleHeight(level, x0 + 1, y0), fx);
+    float h1 = glm::mix(SampleHeight(level, x0, y0 + 1), SampleHeight(level, x0 + 1, y0 + 1), fx);
+    return glm::mix(h0, h1, fy);
+  }
+
+
+
+  float CClipmapTerrainModel::GetHeight(float x, float y) const
+  {
+    if (mPyramid.empty()) return 0.f;
+    return SampleHeight(0, x / mSampleSpacing, y / mSampleSpacing);
+  }
+
+
+
+  CClipmapTerrainModel::Vertex CClipmapTerrainModel::ComputeVertex(glm::uint level, int x, int y) const
+  {
+    Level const & l = mLevels[level];
+    float spacing = mSampleSpacing * static_cast<float>(1 << level);
+    int i = y - l.origin.y;
+    int j = x - l.origin.x;
+
+    //the outer boundary takes the heights of the coarser level, so that there are no cracks between the levels
+    bool boundary = (i == 0 || j == 0 || i == mGridSize - 1 || j == mGridSize - 1);
+    Vertex v;
+    v.p.x = x * spacing;
+    v.p.y = y * spacing;
+    if (boundary && level + 1 < mLevels.size()) {
+      v.p.z = SampleHeight(level + 1, 0.5f * x, 0.5f * y);
+    }
+    else {
+      v.p.z = SampleHeight(level, x, y);
+    }
+
+    float dx = SampleHeight(level, x + 1, y) - SampleHeight(level, x - 1, y);
+    float dy = SampleHeight(level, x, y + 1) - SampleHeight(level, x, y - 1);
+    v.n = glm::normalize(glm::vec3(-dx, -dy, 2.f * spacing));
+    return v;
+  }
+
+
+
+  void CClipmapTerrainModel::RebuildLevel(glm::uint level)
+  {
+    Level & l = mLevels[level];
+    int n = mGridSize;
+
+    l.vertices.resize(n * n);
+    for (int r=0; r < n; ++r) {
+      int y = l.origin.y + Wrap(r - l.origin.y, n);
+      for (int c=0; c < n; ++c) {
+        int x = l.origin.x + Wrap(c - l.origin.x, n);
+        l.vertices[r * n + c] = ComputeVertex(level, x, y);
+      }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, l.glbuf);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, l.vertices.size() * sizeof(Vertex), l.vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+
+
+  void CClipmapTerrainModel::UpdateRow(glm::uint level, int y)
+  {
+    Level & l = mLevels[level];
+    int n = mGridSize;
+    int r = Wrap(y, n);
+
+    for (int c=0; c < n; ++c) {
+      l.vertices[r * n + c] = ComputeVertex(level, l.origin.x + Wrap(c - l.origin.x, n), y);
+    }
+  }
+
+
+
+  void CClipmapTerrainModel::UpdateColumn(glm::uint level, int x)
+  {
+    Level & l = mLevels[level];
+    int n = mGridSize;
+    int c = Wrap(x, n);
+
+    for (int r=0; r < n; ++r) {
+      l.vertices[r * n + c] = ComputeVertex(level, x, l.origin.y + Wrap(r - l.origin.y, n));
+    }
+  }
+
+
+
+  void CClipmapTerrainModel::MoveLevel(glm::uint level, glm::ivec2 const & origin)
+  {
+    Level & l = mLevels[level];
+    int n = mGridSize;
+    glm::ivec2 old = l.origin;
+
+    if (!l.valid || glm::abs(origin.x - old.x) >= n || glm::abs(origin.y - old.y) >= n) {
+      l.origin = origin;
+      RebuildLevel(level);
+      l.valid = true;
+      return;
+    }
+    if (origin == old) return;
+
+    l.origin = origin;
+
+    //changed rows and columns of the torus
+    std::vector<bool> rowChanged(n, false);
+    std::vector<bool> columnChanged(n, false);
+    auto updateRow = [&](int y) {
+      UpdateRow(level, y);
+      rowChanged[Wrap(y, n)] = true;
+    };
+    auto updateColumn = [&](int x) {
+      UpdateColumn(level, x);
+      columnChanged[Wrap(x, n)] = true;
+    };
+
+    //update the rows and columns which entered the level
+    if (origin.y > old.y) {
+      for (int y=old.y + n; y < origin.y + n; ++y) updateRow(y);
+    }
+    else {
+      for (int y=origin.y; y < old.y; ++y) updateRow(y);
+    }
+    if (origin.x > old.x) {
+      for (int x=old.x + n; x < origin.x + n; ++x) updateColumn(x);
+    }
+    else {
+      for (int x=origin.x; x < old.x; ++x) updateColumn(x);
+    }
+
+    //the heights of the outer boundary differ from the interior, so the old and new boundary have to be rewritten
+    if (origin.y != old.y) {
+      int rows[4] = {old.y, old.y + n - 1, origin.y, origin.y + n - 1};
+      for (int i=0; i < 4; ++i) {
+        if (rows[i] >= origin.y && rows[i] < origin.y + n) updateRow(rows[i]);
+      }
+    }
+    if (origin.x != old.x) {
+      int columns[4] = {old.x, old.x + n - 1, origin.x, origin.x + n - 1};
+      for (int i=0; i < 4; ++i) {
+        if (columns[i] >= origin.x && columns[i] < origin.x + n) updateColumn(columns[i]);
+      }
+    }
+
+    //runs of changed rows are contiguous in the torus, runs of changed columns are uploaded row by row (skipping the
+    //changed rows), so the upload scales with the rows and columns which changed
+    glBindBuffer(GL_ARRAY_BUFFER, l.glbuf);
+    for (int r=0; r < n; ) {
+      int end = r;
+      while (end < n && rowChanged[end]) ++end;
+      if (end > r) {
+        glBufferSubData(GL_ARRAY_BUFFER, r * n * sizeof(Vertex), (end - r) * n * sizeof(Vertex), l.vertices.data() + r * n);
+        r = end;
+      }
+      else {
+        ++r;
+      }
+    }
+    for (int c=0; c < n; ) {
+      int end = c;
+      while (end < n && columnChanged[end]) ++end;
+      if (end > c) {
+        for (int r=0; r < n; ++r) {
+          if (!rowChanged[r])
+            glBufferSubData(GL_ARRAY_BUFFER, (r * n + c) * sizeof(Vertex), (end - c) * sizeof(Vertex), l.vertices.data() + r * n + c);
+        }
+        c = end;
+      }
+      else {
+        ++c;
+      }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+
+
+  void CClipmapTerrainModel::AddDrawRange(Level & level, int row, int column, int count) const
+  {
+    if (count <= 0) return;
+
+    int n = mGridSize;
+    int r = Wrap(level.origin.y + row, n);
+    int c = Wrap(level.origin.x + column, n);
+
+    //the range might wrap around the torus
+    int first = glm::min(count, n - c);
+    level.counts.push_back(first * 6);
+    level.offsets.push_back(reinterpret_cast<const GLvoid*>((r * n + c) * 6 * sizeof(glm::uint)));
+    if (count > first) {
+      level.counts.push_back((count - first) * 6);
+      level.offsets.push_back(reinterpret_cast<const GLvoid*>(r * n * 6 * sizeof(glm::uint)));
+    }
+  }
+
+
+
+  void CClipmapTerrainModel::UpdateDrawRanges(glm::uint level)
+  {
+    Level & l = mLevels[level];
+    int n = mGridSize;
+    int m = (n - 1) / 2;
+
+    //the finer level covers m x m quads of this level
+    bool hasHole = level > mFinestLevel;
+    if (hasHole) {
+      glm::ivec2 fineOrigin = mLevels[level-1].origin / 2 - l.origin;
+      l.hole = glm::ivec4(fineOrigin.x, fineOrigin.y, fineOrigin.x + m, fineOrigin.y + m);
+    }
+
+    l.counts.clear();
+    l.offsets.clear();
+    for (int row=0; row < n - 1; ++row) {
+      if (hasHole && row >= l.hole.y && row < l.hole.w) {
+        AddDrawRange(l, row, 0, l.hole.x);
+        AddDrawRange(l, row, l.hole.z, n - 1 - l.hole.z);
+      }
+      else {
+        AddDrawRange(l, row, 0, n - 1);
+      }
+    }
+  }
+
+
+
+  void CClipmapTerrainModel::Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum)
+  {
+    if (mPyramid.empty()) return;
+    InitGLResources();
+
+    int n = mGridSize;
+    int m = (n - 1) / 2;
+    glm::vec3 eye = metric.ViewPosition();
+
+    //levels are disabled, if the viewer is too high above the terrain to see their details
+    float eyeHeight = glm::abs(eye.z - GetHeight(eye.x, eye.y));
+    mFinestLevel = 0;
+    while (mFinestLevel + 1 < mLevels.size() && eyeHeight > 0.4f * n * mSampleSpacing * static_cast<float>(1 << mFinestLevel)) {
+      mLevels[mFinestLevel].valid = false;
+      ++mFinestLevel;
+    }
+
+    //finest level is centered around the viewer, each coarser level is centered around its finer level
+    //origins are always even, so that the vertices of the finer level boundary lie on the coarser grid
+    glm::ivec2 origin;
+    origin.x = static_cast<int>(glm::floor(eye.x / mSampleSpacing)) - m;
+    origin.y = static_cast<int>(glm::floor(eye.y / mSampleSpacing)) - m;
+    origin = glm::ivec2(FloorDiv(origin.x, 2) * 2, FloorDiv(origin.y, 2) * 2);
+
+    mNumberOfTriangles = 0;
+    for (glm::uint i=0; i < mLevels.size(); ++i) {
+      if (i > 0) {
+        origin = glm::ivec2(FloorDiv(origin.x / 2 - m / 2, 2) * 2, FloorDiv(origin.y / 2 - m / 2, 2) * 2);
+      }
+      Level & l = mLevels[i];
+      if (i < mFinestLevel) {
+        l.visible = false;
+        continue;
+      }
+
+      float spacing = mSampleSpacing * static_cast<float>(1 << i);
+      l.bbmin = glm::vec3(origin.x * spacing, origin.y * spacing, mTerrainMin.z);
+      l.bbmax = glm::vec3((origin.x + n - 1) * spacing, (origin.y + n - 1) * spacing, mTerrainMax.z);
+      l.visible = frustum.Intersects(l.bbmin, l.bbmax);
+
+      //the vertex buffer is updated even if the level is not visible, so that the incremental updates stay small
+      MoveLevel(i, origin);
+      UpdateDrawRanges(i);
+
+      for (auto iter = l.counts.begin(); iter != l.counts.end(); ++iter) {
+        mNumberOfTriangles += *iter / 3;
+      }
+    }
+  }
+
+
+
+  void CClipmapTerrainModel::Render() const
+  {
+    if (mIndexBuffer == 0) return;
+
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_POLYGON_OFFSET_LINE);
+    glPolygonOffset(1.0, 1.0);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    //reset number of rendered triangles
+    mNumberOfRenderedTriangles = 0;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+    for (auto iter = mLevels.begin(); iter != mLevels.end(); ++iter) {
+      if (!iter->visible || iter->counts.empty()) continue;
+
+      glBindBuffer(GL_ARRAY_BUFFER, iter->glbuf);
+      glVertexPointer(3, GL_FLOAT, sizeof(Vertex), 0);
+      glNormalPointer(GL_FLOAT, sizeof(Vertex), (void*)12);
+      glMultiDrawElements(GL_TRIANGLES, iter->counts.data(), GL_UNSIGNED_INT, const_cast<const GLvoid**>(iter->offsets.data()), static_cast<GLsizei>(iter->counts.size()));
+
+      //count number of rendered triangles
+      for (auto count = iter->counts.begin(); count != iter->counts.end(); ++count) {
+        mNumberOfRenderedTriangles += *count / 3;
+      }
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisable(GL_POLYGON_OFFSET_LINE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+  }
+
+
+
+  static void DrawLevelBounds(glm::vec3 const & bbmin, glm::vec3 const & bbmax)
+  {
+    glBegin(GL_LINE_LOOP);
+      glVertex3f(bbmin.x, bbmin.y, bbmin.z);
+      glVertex3f(bbmax.x, bbmin.y, bbmin.z);
+      glVertex3f(bbmax.x, bbmax.y, bbmin.z);
+      glVertex3f(bbmin.x, bbmax.y, bbmin.z);
+    glEnd();
+    glBegin(GL_LINE_LOOP);
+      glVertex3f(bbmin.x, bbmin.y, bbmax.z);
+      glVertex3f(bbmax.x, bbmin.y, bbmax.z);
+      glVertex3f(bbmax.x, bbmax.y, bbmax.z);
+      glVertex3f(bbmin.x, bbmax.y, bbmax.z);
+    glEnd();
+    glBegin(GL_LINES);
+      glVertex3f(bbmin.x, bbmin.y, bbmin.z); glVertex3f(bbmin.x, bbmin.y, bbmax.z);
+      glVertex3f(bbmax.x, bbmin.y, bbmin.z); glVertex3f(bbmax.x, bbmin.y, bbmax.z);
+      glVertex3f(bbmax.x, bbmax.y, bbmin.z); glVertex3f(bbmax.x, bbmax.y, bbmax.z);
+      glVertex3f(bbmin.x, bbmax.y, bbmin.z); glVertex3f(bbmin.x, bbmax.y, bbmax.z);
+    glEnd();
+  }
+
+
+
+  void CClipmapTerrainModel::RenderBounds() const
+  {
+    glDisable(GL_LIGHTING);
+
+    glColor3f(1.f, 1.f, 0.f);
+    for (auto iter = mLevels.begin(); iter != mLevels.end(); ++iter) {
+      if (iter->visible) {
+        DrawLevelBounds(iter->bbmin, iter->bbmax);
+      }
+    }
+    glEnable(GL_LIGHTING);
+  }
+
+
+} //namespace Terrain
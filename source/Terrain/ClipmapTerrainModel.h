@@ -0,0 +1,105 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "ViewFrustum.h"
+#include "ErrorMetric.h"
+#include <GL/glew.h>
+#include "TerrainModel.h"
+
+
+namespace Terrain {
+
+  //terrain model based on geometry clipmaps (losasso & hoppe)
+  //renders nested rings of a regular grid centered around the viewer. the grid heights are fetched
+  //from a filtered height pyramid and each level is stored in a toroidal vertex buffer, so moving
+  //the viewer only uploads the rows and columns which entered the level
+  class CClipmapTerrainModel : public CTerrainModel
+  {
+  public:
+    struct Vertex {
+      glm::vec3 p;
+      glm::vec3 n;
+    };
+
+    //one level of the height pyramid (heights as in the source heightmap)
+    struct HeightLevel {
+      std::vector<unsigned short> heights;
+      int width;
+      int height;
+    };
+
+    //one nested grid around the viewer
+    struct Level {
+      glm::uint glbuf;                  //toroidal vertex buffer (gridsize x gridsize)
+      std::vector<Vertex> vertices;     //copy of the vertex buffer, the changed rows and columns are updated here before the upload
+      glm::ivec2 origin;                //grid position of the lower left vertex (in level samples)
+      glm::ivec4 hole;                  //quads covered by the next finer level (x0, y0, x1, y1)
+      bool valid;                       //false if the vertex buffer has to be rebuild completely
+      bool visible;                     //result of the frustum test
+      glm::vec3 bbmin;
+      glm::vec3 bbmax;
+      std::vector<GLsizei> counts;      //index ranges used by glMultiDrawElements
+      std::vector<const GLvoid*> offsets;
+
+      Level() : glbuf(0), origin(0), hole(0), valid(false), visible(false) {}
+    };
+
+    //gridSize is rounded to 4k+1 samples, sampleSpacing is the distance of two samples of the heightmap,
+    //heightScale converts the heightmap values to world units
+    TERRAIN_API CClipmapTerrainModel(glm::uint gridSize = 255, glm::uint levels = 8, float sampleSpacing = 1.f, float heightScale = 0.05f);
+    TERRAIN_API virtual ~CClipmapTerrainModel();
+
+    //initialize the terrain model from a 8 or 16 bit grayscale png heightmap
+    TERRAIN_API virtual bool Init(const char* heightmap) override;
+    //free all allocated resources
+    TERRAIN_API virtual void Clear() override;
+
+    //update the terrain (move the clipmap levels along with the viewer)
+    TERRAIN_API virtual void Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum) override;
+    //render all active levels
+    TERRAIN_API virtual void Render() const override;
+    //render all bounds
+    TERRAIN_API virtual void RenderBounds() const override;
+
+    //gets the height of the terrain at the world position (x, y) using the finest pyramid level
+    TERRAIN_API float GetHeight(float x, float y) const;
+
+  private:
+    CClipmapTerrainModel(CClipmapTerrainModel const & rhs);             //forbidden
+    CClipmapTerrainModel & operator=(CClipmapTerrainModel const & rhs); //forbidden
+
+    void InitGLResources();
+    void BuildPyramid();
+
+    //height of the pyramid level at integer / fractional sample positions (clamped to the heightmap)
+    float SampleHeight(glm::uint level, int x, int y) const;
+    float SampleHeight(glm::uint level, float x, float y) const;
+
+    //computes the vertex at global grid position (x, y) of the level
+    Vertex ComputeVertex(glm::uint level, int x, int y) const;
+    //uploads a complete level
+    void RebuildLevel(glm::uint level);
+    //updates a single row / column of the level in the copy of the vertex buffer (given in global grid positions)
+    void UpdateRow(glm::uint level, int y);
+    void UpdateColumn(glm::uint level, int x);
+    //moves the level to a new origin, uploading only the rows and columns which changed
+    void MoveLevel(glm::uint level, glm::ivec2 const & origin);
+    //computes the index ranges of the level (ring with hole of the finer level)
+    void UpdateDrawRanges(glm::uint level);
+    void AddDrawRange(Level & level, int row, int column, int count) const;
+
+    std::vector<HeightLevel> mPyramid;
+    std::vector<Level> mLevels;
+    glm::uint mIndexBuffer;             //index buffer of the torus, shared by all levels
+    glm::uint mFinestLevel;             //finest level which is currently rendered
+
+    int mGridSize;
+    float mSampleSpacing;
+    float mHeightScale;
+  };
+
+
+} //namespace Terrain
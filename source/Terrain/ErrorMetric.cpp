@@ -48,6 +48,14 @@ namespace Terrain {
 
 
 
+  float CErrorMetric::ScreenSpaceError(glm::vec3 const & bbmin, glm::vec3 const & bbmax, float error) const 
+  {
+    float dist = glm::sqrt(BBoxDistance(bbmin, bbmax));
+    return mViewterm * error / glm::max(dist, 1e-3f);
+  }
+
+
+
   float CErrorMetric::BBoxDistance(glm::vec3 const & bbmin, glm::vec3 const & bbmax) const 
   {
     glm::vec3 d= glm::vec3(
@@ -32,6 +32,9 @@ namespace Terrain {
     //returns true if the screen space error is below the maximum screen space error tau
     TERRAIN_API bool Evaluate(glm::vec3 const & bbmin, glm::vec3 const & bbmax, float error) const;
 
+    //gets the projected screen space error of the bounding box relative to tau (refinement is needed above 1)
+    TERRAIN_API float ScreenSpaceError(glm::vec3 const & bbmin, glm::vec3 const & bbmax, float error) const;
+
   private:
     float BBoxDistance(glm::vec3 const & bbmin, glm::vec3 const & bbmax) const;
 
@@ -0,0 +1,127 @@
+#include "TerrainPrecompiled.h"
+#include "HeightDeltaCodec.h"
+
+namespace Terrain {
+
+  CHeightDeltaCodec::CHeightDeltaCodec(glm::uint patchSize, float quantStep, float heightOrigin)
+    : mPatchSize(patchSize)
+    , mQuantStep(quantStep > 0.f ? quantStep : 1.f)
+    , mHeightOrigin(heightOrigin)
+  {
+  }
+
+
+
+  int CHeightDeltaCodec::Quantize(float height) const
+  {
+    return static_cast<int>(glm::floor((height - mHeightOrigin) / mQuantStep + 0.5f));
+  }
+
+
+
+  void CHeightDeltaCodec::Predict(int const * parentHeights, glm::uint childIndex, int * prediction) const
+  {
+    int rowSize = mPatchSize + 1;
+    if (parentHeights == nullptr) {
+      memset(prediction, 0, sizeof(int) * rowSize * rowSize);
+      return;
+    }
+
+    //the child covers one quadrant of the parent with twice the resolution
+    int half = mPatchSize / 2;
+    int ox = (childIndex & 1) * half;
+    int oy = (childIndex >> 1) * half;
+
+    //odd samples average their two (or four) parent neighbors, even samples weight the same parent sample four times.
+    //the loop has no branches, so it is vectorized by the compiler
+    for (int y=0; y < rowSize; ++y) {
+      int const * row0 = parentHeights + (oy + (y >> 1)) * rowSize + ox;
+      int const * row1 = row0 + (y & 1) * rowSize;
+      int * out = prediction + y * rowSize;
+      for (int x=0; x < rowSize; ++x) {
+        int x0 = x >> 1;
+        int x1 = x0 + (x & 1);
+        out[x] = (row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2;
+      }
+    }
+  }
+
+
+
+  void CHeightDeltaCodec::Encode(int const * heights, int const * prediction, std::vector<unsigned char> & stream) const
+  {
+    glm::uint count = GetVertexCount();
+    for (glm::uint i=0; i < count; ++i) {
+      int residual = heights[i] - prediction[i];
+      glm::uint value = (static_cast<glm::uint>(residual) << 1) ^ static_cast<glm::uint>(residual >> 31);
+      while (value >= 0x80) {
+        stream.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+      }
+      stream.push_back(static_cast<unsigned char>(value));
+    }
+  }
+
+
+
+  bool CHeightDeltaCodec::Decode(unsigned char const * stream, size_t size, int const * prediction, int * heights) const
+  {
+    glm::uint count = GetVertexCount();
+    unsigned char const * end = stream + size;
+
+    //parse the residuals first, adding the prediction is a separate (vectorizable) pass
+    for (glm::uint i=0; i < count; ++i) {
+      glm::uint value = 0;
+      int shift = 0;
+      for (;;) {
+        if (stream == end || shift > 28)
+          return false;
+        unsigned char byte = *stream++;
+        value |= static_cast<glm::uint>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+          break;
+        shift += 7;
+      }
+      heights[i] = static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+    }
+
+    for (glm::uint i=0; i < count; ++i) {
+      heights[i] += prediction[i];
+    }
+    return stream == end;
+  }
+
+
+
+  void CHeightDeltaCodec::Reconstruct(int const * heights, glm::vec3 const & bbmin, glm::vec3 const & bbmax, float * vertices) const
+  {
+    int rowSize = mPatchSize + 1;
+    int last = mPatchSize;
+    glm::vec3 extent = bbmax - bbmin;
+    float dx = (mPatchSize > 0) ? extent.x / mPatchSize : 0.f;
+    float dy = (mPatchSize > 0) ? extent.y / mPatchSize : 0.f;
+
+    for (int y=0; y < rowSize; ++y) {
+      int y0 = glm::max(y-1, 0);
+      int y1 = glm::min(y+1, last);
+      for (int x=0; x < rowSize; ++x) {
+        int x0 = glm::max(x-1, 0);
+        int x1 = glm::min(x+1, last);
+        float* v = vertices + 6 * (y * rowSize + x);
+
+        v[0] = bbmin.x + dx * x;
+        v[1] = bbmin.y + dy * y;
+        v[2] = Dequantize(heights[y * rowSize + x]);
+
+        //central differences inside the patch, one sided at the border
+        float dzdx = (dx > 0.f) ? (heights[y * rowSize + x1] - heights[y * rowSize + x0]) * mQuantStep / ((x1 - x0) * dx) : 0.f;
+        float dzdy = (dy > 0.f) ? (heights[y1 * rowSize + x] - heights[y0 * rowSize + x]) * mQuantStep / ((y1 - y0) * dy) : 0.f;
+        glm::vec3 n = glm::normalize(glm::vec3(-dzdx, -dzdy, 1.f));
+        v[3] = n.x;
+        v[4] = n.y;
+        v[5] = n.z;
+      }
+    }
+  }
+
+} //namespace Terrain
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace Terrain {
+
+
+  //codes the heights of a regular patch grid as residuals against the bilinear upsampled parent patch.
+  //heights are integers in units of the quantisation step above the height origin, so encoder and decoder
+  //predict from exactly the same parent heights and the residuals stay small for smooth terrain
+  class CHeightDeltaCodec {
+  public:
+    //patchSize has to be even, so that every child sample lies on a parent sample or in between two of them
+    TERRAIN_API CHeightDeltaCodec(glm::uint patchSize = 0, float quantStep = 1.f, float heightOrigin = 0.f);
+
+    TERRAIN_API glm::uint GetPatchSize() const {return mPatchSize;}
+    TERRAIN_API float GetQuantStep() const {return mQuantStep;}
+    TERRAIN_API float GetHeightOrigin() const {return mHeightOrigin;}
+    //gets the number of vertices of one patch
+    TERRAIN_API glm::uint GetVertexCount() const {return (mPatchSize+1) * (mPatchSize+1);}
+
+    //converts between world heights and quantised heights
+    TERRAIN_API int Quantize(float height) const;
+    TERRAIN_API float Dequantize(int height) const {return mHeightOrigin + mQuantStep * height;}
+
+    //predicts the heights of the child (index 0..3) from the heights of the parent,
+    //without parent (root patch) the prediction is zero
+    TERRAIN_API void Predict(int const * parentHeights, glm::uint childIndex, int * prediction) const;
+
+    //appends the residuals of the heights to the stream (zigzag and varint coded)
+    TERRAIN_API void Encode(int const * heights, int const * prediction, std::vector<unsigned char> & stream) const;
+
+    //decodes the residuals of the stream and adds the prediction, returns false if the stream is corrupt
+    TERRAIN_API bool Decode(unsigned char const * stream, size_t size, int const * prediction, int * heights) const;
+
+    //computes position and normal (6 floats per vertex) of the regular grid spanning the bounds,
+    //the normals are derived from the heights by central differences
+    TERRAIN_API void Reconstruct(int const * heights, glm::vec3 const & bbmin, glm::vec3 const & bbmax, float * vertices) const;
+
+  private:
+    glm::uint mPatchSize;
+    float mQuantStep;
+    float mHeightOrigin;
+  };
+
+
+} //namespace Terrain
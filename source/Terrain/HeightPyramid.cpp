@@ -0,0 +1,735 @@
+#include "TerrainPrecompiled.h"
+#include "HeightPyramid.h"
+
+#include <cfloat>
+#include <xmmintrin.h>
+#include "ThreadPool.h"
+
+namespace Terrain {
+
+  //samples on the border of a rasterized rectangle or triangle are within this fraction of the sample spacing
+  static const float RASTER_EPSILON = 1e-3f;
+  //the range queries read at most this many entries per row and column
+  static const int RANGE_ENTRIES = 4;
+  //the clearance query splits a segment at most this often
+  static const int CLEARANCE_MAX_DEPTH = 40;
+
+
+
+  CHeightPyramid::CHeightPyramid()
+    : mColumns(0)
+    , mRows(0)
+    , mMin(0.f)
+    , mMax(0.f)
+    , mSpacing(0.f)
+    , mSharedHeights(nullptr)
+    , mSharedScale(1.f)
+    , mRangeMin(0.f)
+    , mRangeStep(1.f)
+  {
+  }
+
+
+
+  void CHeightPyramid::Init(int columns, int rows, glm::vec2 const & min, glm::vec2 const & max)
+  {
+    InitLevels(columns, rows, min, max);
+    mHeights.assign(static_cast<size_t>(mBlocksPerRow[0]) * ((mRows + 7) / 8) * 64, 0.f);
+  }
+
+
+
+  void CHeightPyramid::Init(int columns, int rows, glm::vec2 const & min, glm::vec2 const & max, unsigned short const * samples, float scale)
+  {
+    InitLevels(columns, rows, min, max);
+    mSharedHeights = samples;
+    mSharedScale = scale;
+  }
+
+
+
+  void CHeightPyramid::InitLevels(int columns, int rows, glm::vec2 const & min, glm::vec2 const & max)
+  {
+    Clear();
+    mColumns = glm::max(columns, 2);
+    mRows = glm::max(rows, 2);
+    mMin = min;
+    mMax = max;
+    mSpacing = (max - min) / glm::vec2(mColumns - 1, mRows - 1);
+
+    //the cells of level k cover 2^k quads, the last level has a single cell
+    glm::ivec2 size(mColumns, mRows);
+    mLevelSize.push_back(size);
+    size -= 1;
+    while (mLevelSize.size() == 1 || mLevelSize.back() != glm::ivec2(1)) {
+      size = (size + 1) / 2;
+      mLevelSize.push_back(size);
+    }
+
+    Range empty = { 0, 0 };
+    for (size_t level=0; level < mLevelSize.size(); ++level) {
+      glm::ivec2 blocks = (mLevelSize[level] + 7) / 8;
+      mBlocksPerRow.push_back(blocks.x);
+      if (level > 0)
+        mRanges.push_back(std::vector<Range>(static_cast<size_t>(blocks.x) * blocks.y * 64, empty));
+    }
+  }
+
+
+
+  void CHeightPyramid::Clear()
+  {
+    mColumns = mRows = 0;
+    std::vector<float>().swap(mHeights);
+    mSharedHeights = nullptr;
+    mRanges.clear();
+    mLevelSize.clear();
+    mBlocksPerRow.clear();
+  }
+
+
+
+  size_t CHeightPyramid::GetMemoryUsage() const
+  {
+    size_t bytes = mHeights.size() * sizeof(float);
+    for (auto iter = mRanges.begin(); iter != mRanges.end(); ++iter)
+      bytes += iter->size() * sizeof(Range);
+    return bytes;
+  }
+
+
+
+  void CHeightPyramid::Rasterize(std::vector<glm::vec3> const & positions, std::vector<glm::uint> const & triangles, glm::vec2 const & min, glm::vec2 const & max)
+  {
+    //samples of the rectangle, the max borders of the grid belong to the adjacent rectangles
+    glm::vec2 lower = (min - mMin) / mSpacing;
+    glm::vec2 upper = (max - mMin) / mSpacing;
+    int x0 = glm::max(static_cast<int>(glm::ceil(lower.x - RASTER_EPSILON)), 0);
+    int y0 = glm::max(static_cast<int>(glm::ceil(lower.y - RASTER_EPSILON)), 0);
+    int x1 = (upper.x >= mColumns - 1 - RASTER_EPSILON) ? mColumns : glm::min(static_cast<int>(glm::ceil(upper.x - RASTER_EPSILON)), mColumns);
+    int y1 = (upper.y >= mRows - 1 - RASTER_EPSILON) ? mRows : glm::min(static_cast<int>(glm::ceil(upper.y - RASTER_EPSILON)), mRows);
+
+    for (size_t t=0; t + 2 < triangles.size(); t += 3) {
+      glm::vec3 const & pa = positions[triangles[t]];
+      glm::vec3 const & pb = positions[triangles[t+1]];
+      glm::vec3 const & pc = positions[triangles[t+2]];
+      glm::vec2 a = (glm::vec2(pa) - mMin) / mSpacing;
+      glm::vec2 b = (glm::vec2(pb) - mMin) / mSpacing;
+      glm::vec2 c = (glm::vec2(pc) - mMin) / mSpacing;
+
+      //vertical triangles (like skirts) cover no samples
+      float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+      if (glm::abs(area) < 1e-6f)
+        continue;
+
+      glm::vec2 tmin = glm::min(a, glm::min(b, c));
+      glm::vec2 tmax = glm::max(a, glm::max(b, c));
+      int sx0 = glm::max(static_cast<int>(glm::ceil(tmin.x - RASTER_EPSILON)), x0);
+      int sy0 = glm::max(static_cast<int>(glm::ceil(tmin.y - RASTER_EPSILON)), y0);
+      int sx1 = glm::min(static_cast<int>(glm::floor(tmax.x + RASTER_EPSILON)) + 1, x1);
+      int sy1 = glm::min(static_cast<int>(glm::floor(tmax.y + RASTER_EPSILON)) + 1, y1);
+
+      for (int y = sy0; y < sy1; ++y) {
+        for (int x = sx0; x < sx1; ++x) {
+          glm::vec2 s(static_cast<float>(x), static_cast<float>(y));
+          float wa = ((b.x - s.x) * (c.y - s.y) - (b.y - s.y) * (c.x - s.x)) / area;
+          float wb = ((c.x - s.x) * (a.y - s.y) - (c.y - s.y) * (a.x - s.x)) / area;
+          float wc = 1.f - wa - wb;
+          if (wa >= -RASTER_EPSILON && wb >= -RASTER_EPSILON && wc >= -RASTER_EPSILON)
+            SetHeight(x, y, wa * pa.z + wb * pb.z + wc * pc.z);
+        }
+      }
+    }
+  }
+
+
+
+  void CHeightPyramid::Build()
+  {
+    //the step leaves room above the highest sample, so the quantised maxima do not round below it
+    glm::vec2 range = GetSampleRange(0, 0, mColumns - 1, mRows - 1);
+    mRangeMin = range.x;
+    mRangeStep = (range.y > range.x) ? (range.y - range.x) / 65534.f : 1.f;
+
+    for (size_t level=1; level < mLevelSize.size(); ++level)
+      BuildLevel(static_cast<int>(level), glm::ivec2(0), mLevelSize[level] - 1);
+  }
+
+
+
+  void CHeightPyramid::BuildRegion(int x0, int y0, int x1, int y1)
+  {
+    //a sample belongs to the quads on both sides of it
+    glm::ivec2 first = glm::max(glm::ivec2(x0, y0) - 1, glm::ivec2(0));
+    glm::ivec2 last = glm::min(glm::ivec2(x1, y1), glm::ivec2(mColumns - 2, mRows - 2));
+    if (mRanges.empty() || last.x < first.x || last.y < first.y)
+      return;
+
+    //samples outside of the quantised height range need other steps
+    glm::vec2 range = GetSampleRange(glm::max(x0, 0), glm::max(y0, 0), glm::min(x1, mColumns - 1), glm::min(y1, mRows - 1));
+    if (range.x < mRangeMin || range.y > DecodeHeight(65535)) {
+      Build();
+      return;
+    }
+
+    for (size_t level=1; level < mLevelSize.size(); ++level) {
+      int k = static_cast<int>(level);
+      BuildLevel(k, glm::ivec2(first.x >> k, first.y >> k), glm::ivec2(last.x >> k, last.y >> k));
+    }
+  }
+
+
+
+  glm::vec2 CHeightPyramid::GetSampleRange(int x0, int y0, int x1, int y1) const
+  {
+    glm::vec2 range(FLT_MAX, -FLT_MAX);
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        float h = GetSample(x, y);
+        range = glm::vec2(glm::min(range.x, h), glm::max(range.y, h));
+      }
+    }
+    return range;
+  }
+
+
+
+  unsigned short CHeightPyramid::QuantiseMin(float height) const
+  {
+    //the division may round up, the decoded step has to be below the height
+    unsigned short value = static_cast<unsigned short>(glm::clamp(glm::floor((height - mRangeMin) / mRangeStep), 0.f, 65535.f));
+    while (value > 0 && DecodeHeight(value) > height)
+      --value;
+    return value;
+  }
+
+
+
+  unsigned short CHeightPyramid::QuantiseMax(float height) const
+  {
+    unsigned short value = static_cast<unsigned short>(glm::clamp(glm::ceil((height - mRangeMin) / mRangeStep), 0.f, 65535.f));
+    while (value < 65535 && DecodeHeight(value) < height)
+      ++value;
+    return value;
+  }
+
+
+
+  void CHeightPyramid::BuildLevel(int level, glm::ivec2 const & first, glm::ivec2 const & last)
+  {
+    //every block row is built by one thread
+    glm::ivec2 finer = mLevelSize[level - 1];
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(first.y / 8, last.y / 8 + 1, [&](size_t blockRow) {
+      std::vector<Range> & ranges = mRanges[level - 1];
+      int yBegin = glm::max(static_cast<int>(blockRow) * 8, first.y);
+      int yEnd = glm::min(static_cast<int>(blockRow + 1) * 8, last.y + 1);
+      for (int y = yBegin; y < yEnd; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+          Range range = { 65535, 0 };
+          if (level == 1) {
+            //the samples of the 2x2 quads (3x3 samples) are quantised outwards
+            glm::vec2 samples = GetSampleRange(2 * x, 2 * y, glm::min(2 * x + 2, finer.x - 1), glm::min(2 * y + 2, finer.y - 1));
+            range.min = QuantiseMin(samples.x);
+            range.max = QuantiseMax(samples.y);
+          }
+          else {
+            //the quantised ranges of the finer cells are merged exactly
+            for (int j = 2 * y; j <= glm::min(2 * y + 1, finer.y - 1); ++j) {
+              for (int i = 2 * x; i <= glm::min(2 * x + 1, finer.x - 1); ++i) {
+                Range const & r = mRanges[level - 2][BlockIndex(i, j, mBlocksPerRow[level - 1])];
+                range.min = glm::min(range.min, r.min);
+                range.max = glm::max(range.max, r.max);
+              }
+            }
+          }
+          ranges[BlockIndex(x, y, mBlocksPerRow[level])] = range;
+        }
+      }
+    });
+  }
+
+
+
+  float CHeightPyramid::GetHeight(glm::vec2 const & position) const
+  {
+    glm::vec2 u = glm::round((position - mMin) / mSpacing);
+    int x = glm::clamp(static_cast<int>(u.x), 0, mColumns - 1);
+    int y = glm::clamp(static_cast<int>(u.y), 0, mRows - 1);
+    return GetSample(x, y);
+  }
+
+
+
+  float CHeightPyramid::GetBilinearHeight(glm::vec2 const & position) const
+  {
+    glm::vec2 u = glm::clamp((position - mMin) / mSpacing, glm::vec2(0.f), glm::vec2(mColumns - 1, mRows - 1));
+    int x = glm::min(static_cast<int>(u.x), mColumns - 2);
+    int y = glm::min(static_cast<int>(u.y), mRows - 2);
+    float fx = u.x - x;
+    float fy = u.y - y;
+
+    float h0 = glm::mix(GetSample(x, y), GetSample(x + 1, y), fx);
+    float h1 = glm::mix(GetSample(x, y + 1), GetSample(x + 1, y + 1), fx);
+    return glm::mix(h0, h1, fy);
+  }
+
+
+
+  float CHeightPyramid::GetHeight(glm::vec2 const & position, float tolerance, int & level, float & error) const
+  {
+    if (mRanges.empty()) {
+      level = 0;
+      error = 0.f;
+      return 0.f;
+    }
+
+    //the cells containing the quad of the position, the ranges grow with the levels
+    glm::vec2 u = glm::clamp((position - mMin) / mSpacing, glm::vec2(0.f), glm::vec2(mColumns - 1, mRows - 1));
+    int x = glm::min(static_cast<int>(u.x), mColumns - 2);
+    int y = glm::min(static_cast<int>(u.y), mRows - 2);
+    int top = static_cast<int>(mRanges.size());
+    auto fits = [&](int k) -> bool {
+      if (k == 0)
+        return true;
+      glm::vec2 range = GetRange(k, x >> k, y >> k);
+      return range.y - range.x <= 2.f * tolerance;
+    };
+
+    level = glm::clamp(level, 0, top);
+    if (fits(level)) {
+      while (level < top && fits(level + 1))
+        ++level;
+    }
+    else {
+      while (!fits(level))
+        --level;
+    }
+
+    if (level == 0) {
+      error = 0.f;
+      return GetBilinearHeight(position);
+    }
+    glm::vec2 range = GetRange(level, x >> level, y >> level);
+    error = 0.5f * (range.y - range.x);
+    return 0.5f * (range.x + range.y);
+  }
+
+
+
+  bool CHeightPyramid::GetHeightRange(glm::vec2 const & min, glm::vec2 const & max, glm::vec2 & range) const
+  {
+    if (mRanges.empty() || max.x < mMin.x || max.y < mMin.y || min.x > mMax.x || min.y > mMax.y)
+      return false;
+
+    //quads touching the rectangle
+    glm::vec2 lower = (min - mMin) / mSpacing;
+    glm::vec2 upper = (max - mMin) / mSpacing;
+    int qx0 = glm::clamp(static_cast<int>(glm::floor(lower.x)), 0, mColumns - 2);
+    int qy0 = glm::clamp(static_cast<int>(glm::floor(lower.y)), 0, mRows - 2);
+    int qx1 = glm::clamp(static_cast<int>(glm::floor(upper.x)), 0, mColumns - 2);
+    int qy1 = glm::clamp(static_cast<int>(glm::floor(upper.y)), 0, mRows - 2);
+
+    //finest level, which covers the quads with few entries
+    int level = 0;
+    while ((qx1 >> level) - (qx0 >> level) >= RANGE_ENTRIES || (qy1 >> level) - (qy0 >> level) >= RANGE_ENTRIES)
+      ++level;
+
+    range = glm::vec2(FLT_MAX, -FLT_MAX);
+    if (level == 0) {
+      for (int y = qy0; y <= qy1 + 1; ++y) {
+        for (int x = qx0; x <= qx1 + 1; ++x) {
+          float h = GetSample(x, y);
+          range = glm::vec2(glm::min(range.x, h), glm::max(range.y, h));
+        }
+      }
+    }
+    else {
+      for (int y = qy0 >> level; y <= (qy1 >> level); ++y) {
+        for (int x = qx0 >> level; x <= (qx1 >> level); ++x) {
+          glm::vec2 r = GetRange(level, x, y);
+          range = glm::vec2(glm::min(range.x, r.x), glm::max(range.y, r.y));
+        }
+      }
+    }
+    return true;
+  }
+
+
+
+  glm::vec2 CHeightPyramid::GetHeightRange() const
+  {
+    return mRanges.empty() ? glm::vec2(0.f) : GetRange(static_cast<int>(mRanges.size()), 0, 0);
+  }
+
+
+
+  //intersects the ray with four boxes at once (slab test), gets the entry distances or FLT_MAX for the boxes which are missed
+  static void IntersectBoxes(__m128 const origin[3], __m128 const inverse[3], __m128 const bmin[3], __m128 const bmax[3], float maxDistance, float entry[4])
+  {
+    __m128 tnear = _mm_setzero_ps();
+    __m128 tfar = _mm_set1_ps(maxDistance);
+    for (int axis=0; axis < 3; ++axis) {
+      __m128 t1 = _mm_mul_ps(_mm_sub_ps(bmin[axis], origin[axis]), inverse[axis]);
+      __m128 t2 = _mm_mul_ps(_mm_sub_ps(bmax[axis], origin[axis]), inverse[axis]);
+      tnear = _mm_max_ps(tnear, _mm_min_ps(t1, t2));
+      tfar = _mm_min_ps(tfar, _mm_max_ps(t1, t2));
+    }
+    __m128 missed = _mm_cmpgt_ps(tnear, tfar);
+    _mm_storeu_ps(entry, _mm_or_ps(_mm_and_ps(missed, _mm_set1_ps(FLT_MAX)), _mm_andnot_ps(missed, tnear)));
+  }
+
+
+
+  //intersects the ray with a triangle (moeller & trumbore), returns the distance or FLT_MAX
+  static float IntersectTriangle(glm::vec3 const & origin, glm::vec3 const & direction, glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c)
+  {
+    glm::vec3 e1 = b - a;
+    glm::vec3 e2 = c - a;
+    glm::vec3 p = glm::cross(direction, e2);
+    float det = glm::dot(e1, p);
+    if (glm::abs(det) < 1e-12f)
+      return FLT_MAX;
+
+    float invDet = 1.f / det;
+    glm::vec3 s = origin - a;
+    float u = glm::dot(s, p) * invDet;
+    if (u < 0.f || u > 1.f)
+      return FLT_MAX;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(direction, q) * invDet;
+    if (v < 0.f || u + v > 1.f)
+      return FLT_MAX;
+
+    float t = glm::dot(e2, q) * invDet;
+    return (t >= 0.f) ? t : FLT_MAX;
+  }
+
+
+
+  bool CHeightPyramid::RayCast(Ray const & ray, RayHit & hit) const
+  {
+    hit = RayHit();
+    if (mRanges.empty())
+      return false;
+
+    //the traversal runs in sample space, which keeps the ray parameter. axis parallel rays get a tiny direction, so the
+    //slabs never multiply zero with infinity
+    glm::vec3 origin((ray.origin.x - mMin.x) / mSpacing.x, (ray.origin.y - mMin.y) / mSpacing.y, ray.origin.z);
+    glm::vec3 direction(ray.direction.x / mSpacing.x, ray.direction.y / mSpacing.y, ray.direction.z);
+    glm::vec3 inverse;
+    for (int axis=0; axis < 3; ++axis) {
+      float d = direction[axis];
+      inverse[axis] = 1.f / ((glm::abs(d) < 1e-20f) ? (d < 0.f ? -1e-20f : 1e-20f) : d);
+    }
+    __m128 origin4[3] = { _mm_set1_ps(origin.x), _mm_set1_ps(origin.y), _mm_set1_ps(origin.z) };
+    __m128 inverse4[3] = { _mm_set1_ps(inverse.x), _mm_set1_ps(inverse.y), _mm_set1_ps(inverse.z) };
+
+    struct Cell {
+      int level;
+      int x;
+      int y;
+      float entry;
+    };
+    Cell stack[128];
+    int top = 0;
+    float nearest = ray.maxDistance;
+    glm::ivec2 nearestQuad;
+    int nearestTriangle = -1;
+
+    //the single cell of the top level
+    {
+      glm::vec2 range = GetHeightRange();
+      __m128 bmin[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_set1_ps(range.x) };
+      __m128 bmax[3] = { _mm_set1_ps(static_cast<float>(mColumns - 1)), _mm_set1_ps(static_cast<float>(mRows - 1)), _mm_set1_ps(range.y) };
+      float entry[4];
+      IntersectBoxes(origin4, inverse4, bmin, bmax, nearest, entry);
+      if (entry[0] == FLT_MAX)
+        return false;
+      Cell root = { static_cast<int>(mRanges.size()), 0, 0, entry[0] };
+      stack[top++] = root;
+    }
+
+    while (top > 0) {
+      Cell cell = stack[--top];
+      if (cell.entry >= nearest)
+        continue;
+
+      //the childs of level 1 cells are quads, their triangles are intersected
+      if (cell.level == 1) {
+        for (int i=0; i < 4; ++i) {
+          int x = 2 * cell.x + (i & 1);
+          int y = 2 * cell.y + (i >> 1);
+          if (x >= mColumns - 1 || y >= mRows - 1)
+            continue;
+
+          glm::vec3 p00(x, y, GetSample(x, y));
+          glm::vec3 p10(x + 1, y, GetSample(x + 1, y));
+          glm::vec3 p11(x + 1, y + 1, GetSample(x + 1, y + 1));
+          glm::vec3 p01(x, y + 1, GetSample(x, y + 1));
+          float t0 = IntersectTriangle(origin, direction, p00, p10, p11);
+          float t1 = IntersectTriangle(origin, direction, p00, p11, p01);
+          if (t0 < nearest) {
+            nearest = t0;
+            nearestQuad = glm::ivec2(x, y);
+            nearestTriangle = 0;
+          }
+          if (t1 < nearest) {
+            nearest = t1;
+            nearestQuad = glm::ivec2(x, y);
+            nearestTriangle = 1;
+          }
+        }
+        continue;
+      }
+
+      //the child cells are tested at once, missing childs at the borders get empty boxes
+      int level = cell.level - 1;
+      int size = 1 << level;
+      glm::ivec2 cells = mLevelSize[level];
+      float bmin[3][4], bmax[3][4];
+      for (int i=0; i < 4; ++i) {
+        int x = 2 * cell.x + (i & 1);
+        int y = 2 * cell.y + (i >> 1);
+        if (x < cells.x && y < cells.y) {
+          glm::vec2 range = GetRange(level, x, y);
+          bmin[0][i] = static_cast<float>(x * size);
+          bmin[1][i] = static_cast<float>(y * size);
+          bmin[2][i] = range.x;
+          bmax[0][i] = static_cast<float>(glm::min((x + 1) * size, mColumns - 1));
+          bmax[1][i] = static_cast<float>(glm::min((y + 1) * size, mRows - 1));
+          bmax[2][i] = range.y;
+        }
+        else {
+          bmin[0][i] = bmin[1][i] = bmin[2][i] = 1.f;
+          bmax[0][i] = bmax[1][i] = bmax[2][i] = 0.f;
+        }
+      }
+
+      __m128 bmin4[3] = { _mm_loadu_ps(bmin[0]), _mm_loadu_ps(bmin[1]), _mm_loadu_ps(bmin[2]) };
+      __m128 bmax4[3] = { _mm_loadu_ps(bmax[0]), _mm_loadu_ps(bmax[1]), _mm_loadu_ps(bmax[2]) };
+      float entry[4];
+      IntersectBoxes(origin4, inverse4, bmin4, bmax4, nearest, entry);
+
+      //the nearest child is pushed last, so it is traversed first
+      int order[4] = { 0, 1, 2, 3 };
+      for (int i=1; i < 4; ++i) {
+        for (int j=i; j > 0 && entry[order[j]] > entry[order[j-1]]; --j)
+          std::swap(order[j], order[j-1]);
+      }
+      for (int i=0; i < 4; ++i) {
+        int c = order[i];
+        if (entry[c] == FLT_MAX || bmin[0][c] > bmax[0][c])
+          continue;
+        Cell child = { level, 2 * cell.x + (c & 1), 2 * cell.y + (c >> 1), entry[c] };
+        stack[top++] = child;
+      }
+    }
+
+    if (nearestTriangle < 0)
+      return false;
+
+    //the normal of the triangle in world space
+    int x = nearestQuad.x, y = nearestQuad.y;
+    glm::vec3 a(0.f, 0.f, GetSample(x, y));
+    glm::vec3 b = (nearestTriangle == 0) ? glm::vec3(mSpacing.x, 0.f, GetSample(x + 1, y)) : glm::vec3(mSpacing.x, mSpacing.y, GetSample(x + 1, y + 1));
+    glm::vec3 c = (nearestTriangle == 0) ? glm::vec3(mSpacing.x, mSpacing.y, GetSample(x + 1, y + 1)) : glm::vec3(0.f, mSpacing.y, GetSample(x, y + 1));
+    glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+
+    hit.hit = true;
+    hit.distance = nearest;
+    hit.position = ray.origin + nearest * ray.direction;
+    hit.normal = (normal.z < 0.f) ? -normal : normal;
+    return true;
+  }
+
+
+
+  float CHeightPyramid::GetMaxHeight(int x0, int y0, int x1, int y1, float lower) const
+  {
+    struct Cell {
+      int level;
+      int x;
+      int y;
+    };
+    Cell stack[128];
+    int top = 0;
+
+    //the descent starts at the finest level where the quads touch at most 2x2 cells
+    int level = 1;
+    while (level < static_cast<int>(mRanges.size()) && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+      ++level;
+    for (int y = (y0 >> level); y <= (y1 >> level); ++y) {
+      for (int x = (x0 >> level); x <= (x1 >> level); ++x) {
+        Cell cell = { level, x, y };
+        stack[top++] = cell;
+      }
+    }
+
+    float height = lower;
+    while (top > 0) {
+      Cell cell = stack[--top];
+      glm::vec2 range = GetRange(cell.level, cell.x, cell.y);
+      int cx0 = cell.x << cell.level;
+      int cy0 = cell.y << cell.level;
+      int cx1 = glm::min((cell.x + 1) << cell.level, mColumns - 1) - 1;
+      int cy1 = glm::min((cell.y + 1) << cell.level, mRows - 1) - 1;
+      if (range.y <= height || cx1 < x0 || cy1 < y0 || cx0 > x1 || cy0 > y1)
+        continue;
+
+      if (cx0 >= x0 && cy0 >= y0 && cx1 <= x1 && cy1 <= y1) {
+        height = range.y;
+      }
+      else if (cell.level == 1) {
+        for (int y = glm::max(cy0, y0); y <= glm::min(cy1, y1) + 1; ++y) {
+          for (int x = glm::max(cx0, x0); x <= glm::min(cx1, x1) + 1; ++x)
+            height = glm::max(height, GetSample(x, y));
+        }
+      }
+      else {
+        glm::ivec2 cells = mLevelSize[cell.level - 1];
+        for (int i=0; i < 4; ++i) {
+          Cell child = { cell.level - 1, 2 * cell.x + (i & 1), 2 * cell.y + (i >> 1) };
+          if (child.x < cells.x && child.y < cells.y)
+            stack[top++] = child;
+        }
+      }
+    }
+    return height;
+  }
+
+
+
+  bool CHeightPyramid::GetClearanceBound(glm::vec3 const & p0, glm::vec3 const & p1, float lateral, float & clearance) const
+  {
+    glm::vec2 range;
+    if (!GetHeightRange(glm::min(glm::vec2(p0), glm::vec2(p1)) - lateral, glm::max(glm::vec2(p0), glm::vec2(p1)) + lateral, range))
+      return false;
+    clearance = glm::min(p0.z, p1.z) - range.y;
+    return true;
+  }
+
+
+
+  float CHeightPyramid::GetLeafClearance(glm::vec3 const & p0, glm::vec3 const & p1, float lateral, float upper) const
+  {
+    glm::ivec2 quadMax(mColumns - 2, mRows - 2);
+    glm::ivec2 q0 = glm::clamp(glm::ivec2(glm::floor((glm::min(glm::vec2(p0), glm::vec2(p1)) - lateral - mMin) / mSpacing)), glm::ivec2(0), quadMax);
+    glm::ivec2 q1 = glm::clamp(glm::ivec2(glm::floor((glm::max(glm::vec2(p0), glm::vec2(p1)) + lateral - mMin) / mSpacing)), glm::ivec2(0), quadMax);
+    float bottom = glm::min(p0.z, p1.z);
+    float lower = (upper == FLT_MAX) ? -FLT_MAX : bottom - upper;
+    float height = GetMaxHeight(q0.x, q0.y, q1.x, q1.y, lower);
+    //the lower height is not subtracted again, which could round below upper
+    return (height > lower) ? bottom - height : upper;
+  }
+
+
+
+  bool CHeightPyramid::GetClearance(FlightCorridor const & corridor, ClearanceResult & result) const
+  {
+    result = ClearanceResult();
+    if (mRanges.empty() || corridor.path.empty())
+      return false;
+
+    //the path is split in parts, whose clearance is bounded by the height ranges of the pyramid. the first conflict is searched
+    //front to back skipping the parts which keep the required clearance, the smallest clearance by splitting the part with the
+    //lowest bound first. the parts are refined down to the sample spacing, so the clearance is never above the exact one and
+    //below it by about the height change of the path over one sample spacing
+
+    //parts of the segments, steep parts are refined by their length so the height of the path changes little over a leaf
+    struct Part {
+      size_t segment;
+      float t0;
+      float t1;
+      int depth;
+      float bound;
+      bool operator<(Part const & rhs) const {return bound > rhs.bound;}
+    };
+    float lateral = corridor.lateralDistance;
+    float leafLength = glm::min(mSpacing.x, mSpacing.y);
+    std::vector<glm::vec3> const & path = corridor.path;
+    size_t segments = glm::max<size_t>(path.size(), 2) - 1;
+    auto point = [&](size_t segment, float t) -> glm::vec3 {
+      return glm::mix(path[segment], path[glm::min(segment + 1, path.size() - 1)], t);
+    };
+    auto isLeaf = [&](Part const & part) -> bool {
+      float length = glm::distance(path[part.segment], path[glm::min(part.segment + 1, path.size() - 1)]);
+      return (part.t1 - part.t0) * length <= leafLength || part.depth >= CLEARANCE_MAX_DEPTH;
+    };
+
+    //first conflict: the parts are split front to back (a single point is a segment of length zero), parts whose bound
+    //keeps the required clearance are skipped
+    float pathDistance = 0.f;
+    for (size_t s=0; s < segments && !result.conflict; ++s) {
+      float length = glm::distance(path[s], path[glm::min(s + 1, path.size() - 1)]);
+      Part stack[CLEARANCE_MAX_DEPTH + 2];
+      int top = 0;
+      Part segment = { s, 0.f, 1.f, 0, 0.f };
+      stack[top++] = segment;
+      while (top > 0) {
+        Part part = stack[--top];
+        glm::vec3 p0 = point(s, part.t0);
+        glm::vec3 p1 = point(s, part.t1);
+        float bound;
+        if (!GetClearanceBound(p0, p1, lateral, bound) || bound >= corridor.requiredClearance)
+          continue;
+
+        if (!isLeaf(part)) {
+          float tm = 0.5f * (part.t0 + part.t1);
+          Part second = { s, tm, part.t1, part.depth + 1, 0.f };
+          Part first = { s, part.t0, tm, part.depth + 1, 0.f };
+          stack[top++] = second;
+          stack[top++] = first;
+        }
+        else if (GetLeafClearance(p0, p1, lateral, corridor.requiredClearance) < corridor.requiredClearance) {
+          result.conflict = true;
+          result.conflictDistance = pathDistance + part.t0 * length;
+          result.conflictPosition = p0;
+          break;
+        }
+      }
+      pathDistance += length;
+    }
+
+    //smallest clearance: the part with the lowest bound is split first, the search ends when no bound is below the best leaf
+    std::vector<Part> heap;
+    for (size_t s=0; s < segments; ++s) {
+      Part segment = { s, 0.f, 1.f, 0, 0.f };
+      if (GetClearanceBound(point(s, 0.f), point(s, 1.f), lateral, segment.bound))
+        heap.push_back(segment);
+    }
+    std::make_heap(heap.begin(), heap.end());
+    while (!heap.empty() && heap.front().bound < result.minClearance) {
+      Part part = heap.front();
+      std::pop_heap(heap.begin(), heap.end());
+      heap.pop_back();
+      glm::vec3 p0 = point(part.segment, part.t0);
+      glm::vec3 p1 = point(part.segment, part.t1);
+
+      if (isLeaf(part)) {
+        float clearance = GetLeafClearance(p0, p1, lateral, result.minClearance);
+        if (clearance < result.minClearance) {
+          result.minClearance = clearance;
+          result.minPosition = (p0.z <= p1.z) ? p0 : p1;
+        }
+        continue;
+      }
+
+      float tm = 0.5f * (part.t0 + part.t1);
+      glm::vec3 pm = point(part.segment, tm);
+      Part first = { part.segment, part.t0, tm, part.depth + 1, 0.f };
+      Part second = { part.segment, tm, part.t1, part.depth + 1, 0.f };
+      if (GetClearanceBound(p0, pm, lateral, first.bound) && first.bound < result.minClearance) {
+        heap.push_back(first);
+        std::push_heap(heap.begin(), heap.end());
+      }
+      if (GetClearanceBound(pm, p1, lateral, second.bound) && second.bound < result.minClearance) {
+        heap.push_back(second);
+        std::push_heap(heap.begin(), heap.end());
+      }
+    }
+    return true;
+  }
+
+
+
+} //namespace Terrain
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cfloat>
+
+
+namespace Terrain {
+
+  struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;      //in units of the direction length
+
+    Ray() : origin(0.f), direction(0.f, 0.f, -1.f), maxDistance(FLT_MAX) {}
+    Ray(glm::vec3 const & o, glm::vec3 const & d, float maxDist = FLT_MAX) : origin(o), direction(d), maxDistance(maxDist) {}
+  };
+
+  struct RayHit {
+    bool hit;
+    float distance;         //along the ray in units of the direction length
+    glm::vec3 position;
+    glm::vec3 normal;       //of the hit triangle, facing upwards
+
+    RayHit() : hit(false), distance(FLT_MAX), position(0.f), normal(0.f, 0.f, 1.f) {}
+  };
+
+  //flight path with a corridor around it, the terrain within the lateral distance of the path has to stay below the
+  //path by the required clearance
+  struct FlightCorridor {
+    std::vector<glm::vec3> path;    //polyline, at least one point
+    float lateralDistance;          //on the ground to both sides of the path
+    float requiredClearance;        //vertical distance to the terrain
+
+    FlightCorridor() : lateralDistance(0.f), requiredClearance(0.f) {}
+  };
+
+  struct ClearanceResult {
+    float minClearance;             //smallest height of the path above the terrain in the corridor (FLT_MAX over no terrain)
+    glm::vec3 minPosition;          //path position of the smallest clearance
+    bool conflict;                  //the clearance falls below the required clearance somewhere
+    float conflictDistance;         //along the path to the first conflict
+    glm::vec3 conflictPosition;     //path position of the first conflict
+
+    ClearanceResult() : minClearance(FLT_MAX), minPosition(0.f), conflict(false), conflictDistance(FLT_MAX), conflictPosition(0.f) {}
+  };
+
+  //elevation profile along a ground polyline, sampled every spacing along the line (and at its end)
+  struct ProfileRequest {
+    std::vector<glm::vec2> path;    //at least one point
+    float spacing;                  //along the path, the vertices only if not positive
+    float tolerance;                //allowed height error of the samples
+
+    ProfileRequest() : spacing(1.f), tolerance(0.f) {}
+  };
+
+  struct ProfilePoint {
+    float distance;                 //along the path
+    glm::vec3 position;             //ground position and height
+    float error;                    //bound of the height error
+    int level;                      //pyramid level the height was read from
+
+    ProfilePoint() : distance(0.f), position(0.f), error(0.f), level(0) {}
+  };
+
+  //min/max height pyramid (maximum mipmap) over a regular grid of height samples.
+  //level 0 holds the samples, level k > 0 the height range of the cells of 2^k x 2^k sample quads. the ranges are quantised
+  //to 16 bit steps over the height range of the samples, rounded outwards, so they stay conservative. every level is stored
+  //in blocks of 8x8 entries, so queries of neighboring positions touch few cache lines. once the pyramid is built the
+  //queries are read only and can be used by any number of threads concurrently
+  class CHeightPyramid
+  {
+  public:
+    TERRAIN_API CHeightPyramid();
+
+    //allocates a grid of columns x rows samples (at least 2 x 2) covering the ground rectangle [min, max], row 0 is at min.y.
+    //all heights are zero until they are set
+    TERRAIN_API void Init(int columns, int rows, glm::vec2 const & min, glm::vec2 const & max);
+    //uses the 16 bit samples (row by row, times the scale) of the model as level 0 instead of a copy, they have to stay
+    //unchanged while the pyramid lives. the samples can not be set
+    TERRAIN_API void Init(int columns, int rows, glm::vec2 const & min, glm::vec2 const & max, unsigned short const * samples, float scale);
+    //free all levels
+    TERRAIN_API void Clear();
+
+    //set a sample, the pyramid has to be built afterwards
+    TERRAIN_API void SetHeight(int x, int y, float height) {mHeights[BlockIndex(x, y, mBlocksPerRow[0])] = height;}
+    //set the samples inside the ground rectangle [min, max) (and on the max borders of the grid) to the heights of the triangles.
+    //patches with disjoint rectangles can be rasterized concurrently, the pyramid has to be built afterwards
+    TERRAIN_API void Rasterize(std::vector<glm::vec3> const & positions, std::vector<glm::uint> const & triangles, glm::vec2 const & min, glm::vec2 const & max);
+    //build the height ranges of the levels from the samples
+    TERRAIN_API void Build();
+    //build the height ranges of the cells containing the samples [x0, x1] x [y0, y1] again, after they were set
+    TERRAIN_API void BuildRegion(int x0, int y0, int x1, int y1);
+
+    TERRAIN_API bool IsEmpty() const {return mHeights.empty() && mSharedHeights == nullptr;}
+    TERRAIN_API int GetColumns() const {return mColumns;}
+    TERRAIN_API int GetRows() const {return mRows;}
+    TERRAIN_API int GetLevelCount() const {return static_cast<int>(mRanges.size()) + 1;}
+    TERRAIN_API glm::vec2 const & GetMin() const {return mMin;}
+    TERRAIN_API glm::vec2 const & GetMax() const {return mMax;}
+    //get the ground distance of two samples
+    TERRAIN_API glm::vec2 const & GetSpacing() const {return mSpacing;}
+    //get the number of bytes of all levels
+    TERRAIN_API size_t GetMemoryUsage() const;
+
+    //get the height of the sample nearest to the ground position (clamped to the grid)
+    TERRAIN_API float GetHeight(glm::vec2 const & position) const;
+    //get the height from the coarsest level whose cell at the ground position has a height range within twice the tolerance, the
+    //middle of the range is returned (the samples are interpolated bilinearly on level 0). the search starts at the given level
+    //and goes up or down from there (neighboring positions mostly stay on the same level), it gets the level read
+    TERRAIN_API float GetHeight(glm::vec2 const & position, float tolerance, int & level, float & error) const;
+    //get the height of a sample
+    TERRAIN_API float GetSampleHeight(int x, int y) const {return GetSample(x, y);}
+    //get the height interpolated bilinearly between the four samples around the ground position (clamped to the grid)
+    TERRAIN_API float GetBilinearHeight(glm::vec2 const & position) const;
+    //get a conservative height range (min, max) of the surface over the ground rectangle, read from at most 4x4 cells of
+    //the finest level resolving it (5x5 samples on level 0). returns false if the rectangle does not overlap the grid
+    TERRAIN_API bool GetHeightRange(glm::vec2 const & min, glm::vec2 const & max, glm::vec2 & range) const;
+    //get the height range of the whole grid
+    TERRAIN_API glm::vec2 GetHeightRange() const;
+    //cast the ray against the samples (two triangles per quad, split from (x, y) to (x+1, y+1)). the cells are traversed from the
+    //top level down, nearest first, and cells behind the nearest hit are skipped. returns false if the ray misses
+    TERRAIN_API bool RayCast(Ray const & ray, RayHit & hit) const;
+    //get the conservative clearance of the flight path over the terrain in the corridor, returns false if the pyramid or the path is empty
+    TERRAIN_API bool GetClearance(FlightCorridor const & corridor, ClearanceResult & result) const;
+
+  private:
+    //quantised height range of a cell
+    struct Range {
+      unsigned short min;
+      unsigned short max;
+    };
+
+    //gets the index of the entry (x, y) in the blocked storage of a level
+    static size_t BlockIndex(int x, int y, int blocksPerRow) {
+      return ((static_cast<size_t>(y >> 3) * blocksPerRow + (x >> 3)) << 6) + ((y & 7) << 3) + (x & 7);
+    }
+
+    float GetSample(int x, int y) const {
+      return mSharedHeights ? mSharedHeights[static_cast<size_t>(y) * mColumns + x] * mSharedScale : mHeights[BlockIndex(x, y, mBlocksPerRow[0])];
+    }
+    //allocates the levels of the grid
+    void InitLevels(int columns, int rows, glm::vec2 const & min, glm::vec2 const & max);
+    //gets the height range of the samples [x0, x1] x [y0, y1]
+    glm::vec2 GetSampleRange(int x0, int y0, int x1, int y1) const;
+    //builds the ranges of the cells [first, last] of a level from the level below
+    void BuildLevel(int level, glm::ivec2 const & first, glm::ivec2 const & last);
+    //quantises the height to the step below / above it
+    unsigned short QuantiseMin(float height) const;
+    unsigned short QuantiseMax(float height) const;
+    float DecodeHeight(unsigned short value) const {return mRangeMin + value * mRangeStep;}
+    glm::vec2 GetRange(int level, int x, int y) const {
+      Range const & r = mRanges[level - 1][BlockIndex(x, y, mBlocksPerRow[level])];
+      return glm::vec2(DecodeHeight(r.min), DecodeHeight(r.max));
+    }
+    //get the highest sample of the quads [x0, x1] x [y0, y1], or lower if no sample is higher. the descent starts at the finest
+    //level covering the quads with 2x2 cells, cells inside the quads or not higher than the result so far are not descended
+    float GetMaxHeight(int x0, int y0, int x1, int y1, float lower) const;
+    //get a lower bound of the clearance of the path part from the height range of its corridor
+    bool GetClearanceBound(glm::vec3 const & p0, glm::vec3 const & p1, float lateral, float & clearance) const;
+    //get the clearance of the path part over the highest sample of its corridor, or upper if it is not below
+    float GetLeafClearance(glm::vec3 const & p0, glm::vec3 const & p1, float lateral, float upper) const;
+
+    int mColumns;
+    int mRows;
+    glm::vec2 mMin;
+    glm::vec2 mMax;
+    glm::vec2 mSpacing;
+    std::vector<float> mHeights;                    //level 0 (if the samples are not shared)
+    unsigned short const * mSharedHeights;          //level 0 shared with the model, the heights are the samples times the scale
+    float mSharedScale;
+    float mRangeMin;                                //lowest sample, the ranges are quantised in steps above it
+    float mRangeStep;
+    std::vector<std::vector<Range>> mRanges;        //min and max height of the cells of level k at k-1
+    std::vector<glm::ivec2> mLevelSize;             //entries per row and column of every level
+    std::vector<int> mBlocksPerRow;                 //blocks per row of every level
+  };
+
+
+} //namespace Terrain
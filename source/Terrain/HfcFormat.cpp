@@ -0,0 +1,93 @@
+#include "TerrainPrecompiled.h"
+#include "HfcFormat.h"
+
+#include <iostream>
+#include <cstring>
+
+namespace Terrain {
+  namespace Hfc {
+
+    //skips a patch and its childs: bounds and error (7 floats), vertex count, index count,
+    //vertices (6 floats each), indices, child count
+    static bool SkipHierarchy(FILE* fp)
+    {
+      glm::uint counts[2], childCount;
+      if (_fseeki64(fp, 7 * sizeof(float), SEEK_CUR) != 0 || fread(counts, sizeof(glm::uint), 2, fp) != 2)
+        return false;
+
+      long long payload = static_cast<long long>(counts[0]) * 6 * sizeof(float) + static_cast<long long>(counts[1]) * sizeof(glm::uint);
+      if (_fseeki64(fp, payload, SEEK_CUR) != 0 || fread(&childCount, sizeof(glm::uint), 1, fp) != 1 || childCount > 4)
+        return false;
+
+      for (glm::uint i=0; i < childCount; ++i) {
+        if (!SkipHierarchy(fp))
+          return false;
+      }
+      return true;
+    }
+
+
+
+    bool ScanRootOffsets(FILE* fp, glm::uint numRoots, std::vector<long long> & offsets)
+    {
+      offsets.resize(numRoots);
+      for (glm::uint i=0; i < numRoots; ++i) {
+        offsets[i] = _ftelli64(fp);
+        if (!SkipHierarchy(fp)) {
+          std::cerr << "failed to scan patch hierarchy " << i << "!" << std::endl;
+          return false;
+        }
+      }
+      return true;
+    }
+
+
+
+    bool ReadRootIndex(const char* hfcfile, long long fileSize, glm::uint numRoots, std::vector<long long> & offsets)
+    {
+      FILE* fp = nullptr;
+      if (fopen_s(&fp, GetRootIndexPath(hfcfile).c_str(), "rb") != 0 || fp == nullptr)
+        return false;
+
+      //a sidecar of an older version of the hfc file is ignored
+      char sig[4];
+      long long size = 0;
+      glm::uint count = 0;
+      fread(sig, 1, 4, fp);
+      fread(&size, sizeof(long long), 1, fp);
+      fread(&count, sizeof(glm::uint), 1, fp);
+      if (memcmp(sig, INDEX_MAGIC, 4) != 0 || size != fileSize || count != numRoots) {
+        fclose(fp);
+        std::cout << "root index of " << hfcfile << " does not match the terrain file!" << std::endl;
+        return false;
+      }
+
+      offsets.resize(numRoots);
+      bool success = fread(offsets.data(), sizeof(long long), numRoots, fp) == numRoots;
+      fclose(fp);
+      return success;
+    }
+
+
+
+    bool WriteRootIndex(const char* hfcfile, long long fileSize, std::vector<long long> const & offsets)
+    {
+      FILE* fp = nullptr;
+      std::string path = GetRootIndexPath(hfcfile);
+      if (fopen_s(&fp, path.c_str(), "wb") != 0 || fp == nullptr) {
+        std::cerr << "failed to create root index " << path << "!" << std::endl;
+        return false;
+      }
+
+      glm::uint count = static_cast<glm::uint>(offsets.size());
+      fwrite(INDEX_MAGIC, 1, 4, fp);
+      fwrite(&fileSize, sizeof(long long), 1, fp);
+      fwrite(&count, sizeof(glm::uint), 1, fp);
+      fwrite(offsets.data(), sizeof(long long), offsets.size(), fp);
+      bool success = ferror(fp) == 0;
+      fclose(fp);
+      return success;
+    }
+
+  } //namespace Hfc
+} //namespace Terrain
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+namespace Terrain {
+  namespace Hfc {
+
+    //the root count in the header of hfc files has this bit set, if the index buffers of the patches are
+    //optimized triangle lists instead of triangle strips
+    static const glm::uint TriangleListFlag = 0x80000000;
+
+    //file signature of the root index sidecar (<file>.idx): magic, uint64 size of the hfc file, uint root count,
+    //int64 file offset of every root hierarchy
+    static const char INDEX_MAGIC[] = {'H','F','C','I'};
+
+    //gets the path of the root index sidecar of a hfc file
+    inline std::string GetRootIndexPath(const char* hfcfile) {
+      return std::string(hfcfile) + ".idx";
+    }
+
+    //finds the file offsets of the root hierarchies by skipping over the patch payloads,
+    //fp has to be positioned behind the root count
+    TERRAIN_API bool ScanRootOffsets(FILE* fp, glm::uint numRoots, std::vector<long long> & offsets);
+
+    //reads the root offsets from the sidecar, returns false if there is none or it does not match the hfc file
+    TERRAIN_API bool ReadRootIndex(const char* hfcfile, long long fileSize, glm::uint numRoots, std::vector<long long> & offsets);
+
+    //writes the root offsets of a hfc file to its sidecar
+    TERRAIN_API bool WriteRootIndex(const char* hfcfile, long long fileSize, std::vector<long long> const & offsets);
+
+  } //namespace Hfc
+} //namespace Terrain
@@ -0,0 +1,223 @@
+#include "TerrainPrecompiled.h"
+#include "IndexOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Terrain {
+
+  //scoring of forsyth's algorithm
+  static const float CACHE_DECAY_POWER = 1.5f;
+  static const float LAST_TRIANGLE_SCORE = 0.75f;
+  static const float VALENCE_BOOST_SCALE = 2.f;
+  static const float VALENCE_BOOST_POWER = 0.5f;
+
+
+
+  static float VertexScore(int cachePosition, glm::uint remainingTriangles, glm::uint cacheSize)
+  {
+    //vertices without triangles left are not interesting anymore
+    if (remainingTriangles == 0)
+      return -1.f;
+
+    float score = 0.f;
+    if (cachePosition >= 0) {
+      //the vertices of the last triangle get a fixed score, so the next triangle does not just reuse them
+      if (cachePosition < 3) {
+        score = LAST_TRIANGLE_SCORE;
+      }
+      else {
+        float scale = 1.f / (cacheSize - 3);
+        score = std::pow(1.f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+      }
+    }
+
+    //boost vertices with few triangles left, so they are finished early
+    score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+  }
+
+
+
+  void CIndexOptimizer::StripsToTriangles(std::vector<glm::uint> const & strips, std::vector<glm::uint> & triangles)
+  {
+    triangles.clear();
+    size_t start = 0;
+    for (size_t i=0; i < strips.size(); ++i) {
+      if (strips[i] == RESTART_INDEX) {
+        start = i + 1;
+        continue;
+      }
+      if (i - start < 2)
+        continue;
+
+      //every second triangle of a strip has a flipped winding
+      glm::uint a = strips[i-2];
+      glm::uint b = strips[i-1];
+      glm::uint c = strips[i];
+      if (a == b || b == c || a == c)
+        continue;
+
+      if ((i - start) % 2 == 0) {
+        triangles.push_back(a);
+        triangles.push_back(b);
+      }
+      else {
+        triangles.push_back(b);
+        triangles.push_back(a);
+      }
+      triangles.push_back(c);
+    }
+  }
+
+
+
+  void CIndexOptimizer::OptimizeVertexCache(std::vector<glm::uint> & triangles, glm::uint cacheSize)
+  {
+    size_t triangleCount = triangles.size() / 3;
+    if (triangleCount == 0 || cacheSize <= 3)
+      return;
+
+    glm::uint vertexCount = *std::max_element(triangles.begin(), triangles.end()) + 1;
+
+    //triangles of every vertex (the first remaining[v] entries are the triangles not added yet)
+    std::vector<glm::uint> remaining(vertexCount, 0);
+    for (size_t i=0; i < triangleCount * 3; ++i)
+      ++remaining[triangles[i]];
+
+    std::vector<glm::uint> offsets(vertexCount + 1, 0);
+    for (glm::uint v=0; v < vertexCount; ++v)
+      offsets[v+1] = offsets[v] + remaining[v];
+
+    std::vector<glm::uint> adjacency(offsets[vertexCount]);
+    std::vector<glm::uint> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i=0; i < triangleCount * 3; ++i)
+      adjacency[fill[triangles[i]]++] = static_cast<glm::uint>(i / 3);
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (glm::uint v=0; v < vertexCount; ++v)
+      vertexScore[v] = VertexScore(-1, remaining[v], cacheSize);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> added(triangleCount, false);
+    size_t best = 0;
+    for (size_t t=0; t < triangleCount; ++t) {
+      triangleScore[t] = vertexScore[triangles[t*3]] + vertexScore[triangles[t*3+1]] + vertexScore[triangles[t*3+2]];
+      if (triangleScore[t] > triangleScore[best])
+        best = t;
+    }
+
+    std::vector<glm::uint> output;
+    output.reserve(triangleCount * 3);
+    std::vector<glm::uint> cache, nextCache;
+    size_t scanPosition = 0;
+
+    while (output.size() < triangleCount * 3) {
+      added[best] = true;
+      glm::uint const * triangle = &triangles[best*3];
+      output.insert(output.end(), triangle, triangle + 3);
+
+      //remove the triangle from the remaining triangles of its vertices
+      for (int k=0; k < 3; ++k) {
+        glm::uint v = triangle[k];
+        glm::uint* first = &adjacency[offsets[v]];
+        glm::uint* last = first + remaining[v] - 1;
+        std::iter_swap(std::find(first, last, static_cast<glm::uint>(best)), last);
+        --remaining[v];
+      }
+
+      //move the vertices of the triangle to the front of the lru cache
+      nextCache.assign(triangle, triangle + 3);
+      for (auto iter = cache.begin(); iter != cache.end(); ++iter) {
+        if (*iter != triangle[0] && *iter != triangle[1] && *iter != triangle[2])
+          nextCache.push_back(*iter);
+      }
+
+      for (size_t i=0; i < nextCache.size(); ++i) {
+        glm::uint v = nextCache[i];
+        cachePosition[v] = (i < cacheSize) ? static_cast<int>(i) : -1;
+        vertexScore[v] = VertexScore(cachePosition[v], remaining[v], cacheSize);
+      }
+
+      //rescore the triangles of the cached (and just evicted) vertices and pick the best one
+      float bestScore = -1.f;
+      for (size_t i=0; i < nextCache.size(); ++i) {
+        glm::uint v = nextCache[i];
+        for (glm::uint j=0; j < remaining[v]; ++j) {
+          glm::uint t = adjacency[offsets[v] + j];
+          triangleScore[t] = vertexScore[triangles[t*3]] + vertexScore[triangles[t*3+1]] + vertexScore[triangles[t*3+2]];
+          if (triangleScore[t] > bestScore) {
+            bestScore = triangleScore[t];
+            best = t;
+          }
+        }
+      }
+
+      if (nextCache.size() > cacheSize)
+        nextCache.resize(cacheSize);
+      cache.swap(nextCache);
+
+      //no triangle in the cache left, continue with the next unprocessed one
+      if (bestScore < 0.f) {
+        while (scanPosition < triangleCount && added[scanPosition])
+          ++scanPosition;
+        if (scanPosition == triangleCount)
+          break;
+        best = scanPosition;
+      }
+    }
+
+    triangles.swap(output);
+  }
+
+
+
+  CIndexOptimizer::CacheStatistics CIndexOptimizer::SimulateVertexCache(std::vector<glm::uint> const & triangles, glm::uint cacheSize)
+  {
+    CacheStatistics statistics;
+    statistics.triangles = triangles.size() / 3;
+    if (triangles.empty())
+      return statistics;
+
+    glm::uint vertexCount = *std::max_element(triangles.begin(), triangles.end()) + 1;
+    std::vector<bool> referenced(vertexCount, false);
+    std::vector<size_t> insertedAt(vertexCount, 0);   //miss counter at the time the vertex entered the cache (+1)
+
+    for (size_t i=0; i < statistics.triangles * 3; ++i) {
+      glm::uint v = triangles[i];
+      if (!referenced[v]) {
+        referenced[v] = true;
+        ++statistics.vertices;
+      }
+
+      //a vertex is still in the fifo, if less than cacheSize vertices were inserted after it
+      if (insertedAt[v] == 0 || statistics.misses - insertedAt[v] >= cacheSize) {
+        ++statistics.misses;
+        insertedAt[v] = statistics.misses;
+      }
+    }
+    return statistics;
+  }
+
+
+
+  bool CIndexOptimizer::NarrowIndices(std::vector<glm::uint> const & indices, std::vector<unsigned short> & narrow)
+  {
+    narrow.resize(indices.size());
+    for (size_t i=0; i < indices.size(); ++i) {
+      if (indices[i] == RESTART_INDEX) {
+        narrow[i] = RESTART_INDEX16;
+      }
+      else if (indices[i] >= RESTART_INDEX16) {
+        narrow.clear();
+        return false;
+      }
+      else {
+        narrow[i] = static_cast<unsigned short>(indices[i]);
+      }
+    }
+    return true;
+  }
+
+} //namespace Terrain
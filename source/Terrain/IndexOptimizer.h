@@ -0,0 +1,62 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <climits>
+
+namespace Terrain {
+
+
+  //reorders the index buffers of the terrain for the post transform vertex cache.
+  //the strips of the terrain files are converted to triangle lists, which are sorted with forsyth's
+  //linear-speed vertex cache optimisation
+  class CIndexOptimizer
+  {
+  public:
+    //result of a simulated fifo vertex cache
+    struct CacheStatistics {
+      size_t triangles;
+      size_t vertices;        //referenced vertices
+      size_t misses;          //transformed vertices
+
+      CacheStatistics() : triangles(0), vertices(0), misses(0) {}
+
+      //average cache miss ratio (transformed vertices per triangle)
+      float ACMR() const {return triangles > 0 ? static_cast<float>(misses) / triangles : 0.f;}
+      //average transform to vertex ratio (1 is optimal)
+      float ATVR() const {return vertices > 0 ? static_cast<float>(misses) / vertices : 0.f;}
+
+      CacheStatistics & operator+=(CacheStatistics const & rhs) {
+        triangles += rhs.triangles;
+        vertices += rhs.vertices;
+        misses += rhs.misses;
+        return *this;
+      }
+    };
+
+    //restart index of the triangle strips in the terrain files
+    static const glm::uint RESTART_INDEX = UINT_MAX;
+    //restart index of strips with 16 bit indices
+    static const unsigned short RESTART_INDEX16 = USHRT_MAX;
+
+    //converts primitive restart triangle strips to a triangle list with the same winding, degenerated triangles are dropped
+    TERRAIN_API static void StripsToTriangles(std::vector<glm::uint> const & strips, std::vector<glm::uint> & triangles);
+
+    //reorders the triangles of the list for a vertex cache of the given size
+    TERRAIN_API static void OptimizeVertexCache(std::vector<glm::uint> & triangles, glm::uint cacheSize = 32);
+
+    //simulates a fifo vertex cache of the given size on the triangle list
+    TERRAIN_API static CacheStatistics SimulateVertexCache(std::vector<glm::uint> const & triangles, glm::uint cacheSize = 16);
+
+    //converts the indices to 16 bit (the restart index is mapped as well), returns false if an index does not fit
+    TERRAIN_API static bool NarrowIndices(std::vector<glm::uint> const & indices, std::vector<unsigned short> & narrow);
+
+  private:
+    CIndexOptimizer() {}  //static class - forbidden
+    ~CIndexOptimizer() {} //static class - forbidden
+  };
+
+
+} //namespace Terrain
@@ -0,0 +1,237 @@
+#include "TerrainPrecompiled.h"
+#include "PatchStreamer.h"
+#include "IndexOptimizer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace Terrain {
+
+  //requests are coalesced, if the gap between the payloads is not larger than this (patch headers between the payloads)
+  static const long long COALESCE_GAP = 4096;
+  //maximum size of a coalesced read
+  static const long long COALESCE_SPAN = 4 << 20;
+
+
+
+  CPatchStreamer::CPatchStreamer()
+    : mOptimizeStrips(false)
+    , mStop(false)
+  {
+  }
+
+
+
+  CPatchStreamer::~CPatchStreamer()
+  {
+    Close();
+  }
+
+
+
+  bool CPatchStreamer::Open(const char* hfcfile, bool optimizeStrips, size_t numberOfThreads)
+  {
+    Close();
+
+    //every thread reads through its own file handle, so seek and read do not interfere. the handles are opened here,
+    //so no thread is started without one and the requests are never left unserviced
+    std::vector<FILE*> files;
+    for (size_t i=0; i < glm::max<size_t>(numberOfThreads, 1); ++i) {
+      FILE* fp = nullptr;
+      if (fopen_s(&fp, hfcfile, "rb") != 0 || fp == nullptr) {
+        std::cerr << "failed to open terrain file " << hfcfile << "!" << std::endl;
+        for (auto iter = files.begin(); iter != files.end(); ++iter)
+          fclose(*iter);
+        return false;
+      }
+      files.push_back(fp);
+    }
+
+    mOptimizeStrips = optimizeStrips;
+    mStop = false;
+    mStatistics = Statistics();
+    for (auto iter = files.begin(); iter != files.end(); ++iter)
+      mThreads.push_back(std::thread(&CPatchStreamer::IOLoop, this, *iter));
+    return true;
+  }
+
+
+
+  void CPatchStreamer::Close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+    mQueueChanged.notify_all();
+
+    for (auto iter = mThreads.begin(); iter != mThreads.end(); ++iter)
+      iter->join();
+    mThreads.clear();
+
+    mQueue.clear();
+    mInFlight.clear();
+    mFailed.clear();
+    mLoaded.clear();
+  }
+
+
+
+  void CPatchStreamer::Schedule(std::vector<Request> const & requests)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+
+      //requests which are not repeated are cancelled
+      std::map<long long, Read> queue;
+      for (auto iter = requests.begin(); iter != requests.end(); ++iter) {
+        Patch* patch = iter->patch;
+        if (mInFlight.count(patch) != 0 || mFailed.count(patch) != 0)
+          continue;
+
+        Read read;
+        read.patch = patch;
+        read.offset = patch->payloadOffset;
+        read.size = static_cast<size_t>(patch->vcount) * sizeof(Vertex) + static_cast<size_t>(patch->icount) * sizeof(glm::uint);
+        read.vcount = patch->vcount;
+        read.icount = patch->icount;
+        read.priority = iter->priority;
+        queue[read.offset] = read;
+      }
+
+      for (auto iter = mQueue.begin(); iter != mQueue.end(); ++iter) {
+        if (queue.count(iter->first) == 0)
+          ++mStatistics.cancelled;
+      }
+      mQueue.swap(queue);
+    }
+    mQueueChanged.notify_all();
+  }
+
+
+
+  void CPatchStreamer::Collect(std::vector<Payload> & loaded)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto iter = mLoaded.begin(); iter != mLoaded.end(); ++iter) {
+      mInFlight.erase(iter->patch);
+      loaded.push_back(std::move(*iter));
+    }
+    mLoaded.clear();
+  }
+
+
+
+  size_t CPatchStreamer::GetPendingCount() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueue.size() + mInFlight.size();
+  }
+
+
+
+  CPatchStreamer::Statistics CPatchStreamer::GetStatistics() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStatistics;
+  }
+
+
+
+  void CPatchStreamer::IOLoop(FILE* fp)
+  {
+    std::vector<Read> batch;
+    std::vector<unsigned char> bytes;
+    std::vector<Payload> payloads;
+
+    for (;;) {
+      long long end;
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStop && mQueue.empty())
+          mQueueChanged.wait(lock);
+        if (mStop)
+          break;
+
+        //the most important request and its neighbors in the file
+        auto best = mQueue.begin();
+        for (auto iter = mQueue.begin(); iter != mQueue.end(); ++iter) {
+          if (iter->second.priority > best->second.priority)
+            best = iter;
+        }
+
+        auto first = best, last = best;
+        end = best->second.offset + best->second.size;
+        while (first != mQueue.begin()) {
+          auto prev = first;
+          --prev;
+          if (first->second.offset - static_cast<long long>(prev->second.offset + prev->second.size) > COALESCE_GAP || end - prev->second.offset > COALESCE_SPAN)
+            break;
+          first = prev;
+        }
+        for (auto next = best; ++next != mQueue.end(); ) {
+          if (next->second.offset - end > COALESCE_GAP || static_cast<long long>(next->second.offset + next->second.size) - first->second.offset > COALESCE_SPAN)
+            break;
+          last = next;
+          end = next->second.offset + next->second.size;
+        }
+
+        batch.clear();
+        ++last;
+        for (auto iter = first; iter != last; ++iter) {
+          batch.push_back(iter->second);
+          mInFlight.insert(iter->second.patch);
+        }
+        mQueue.erase(first, last);
+      }
+
+      //one read for all payloads of the batch
+      long long offset = batch.front().offset;
+      bytes.resize(static_cast<size_t>(end - offset));
+      bool success = _fseeki64(fp, offset, SEEK_SET) == 0 && fread(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+      if (!success)
+        std::cerr << "failed to read patch payload at " << offset << "!" << std::endl;
+
+      payloads.clear();
+      for (auto iter = batch.begin(); success && iter != batch.end(); ++iter) {
+        unsigned char const * src = bytes.data() + (iter->offset - offset);
+        payloads.push_back(Payload());
+        Payload & payload = payloads.back();
+        payload.patch = iter->patch;
+        payload.vbuf.resize(iter->vcount);
+        payload.indices.resize(iter->icount);
+        if (iter->vcount > 0)
+          memcpy(payload.vbuf.data(), src, iter->vcount * sizeof(Vertex));
+        if (iter->icount > 0)
+          memcpy(payload.indices.data(), src + iter->vcount * sizeof(Vertex), iter->icount * sizeof(glm::uint));
+
+        if (mOptimizeStrips) {
+          std::vector<glm::uint> triangles;
+          CIndexOptimizer::StripsToTriangles(payload.indices, triangles);
+          CIndexOptimizer::OptimizeVertexCache(triangles);
+          payload.indices.swap(triangles);
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        //patches which could not be read are not requested again, the others stay in flight until they are collected
+        for (auto iter = batch.begin(); !success && iter != batch.end(); ++iter) {
+          mInFlight.erase(iter->patch);
+          mFailed.insert(iter->patch);
+        }
+        for (auto iter = payloads.begin(); iter != payloads.end(); ++iter)
+          mLoaded.push_back(std::move(*iter));
+
+        ++mStatistics.reads;
+        mStatistics.payloads += payloads.size();
+        mStatistics.bytes += bytes.size();
+      }
+    }
+
+    fclose(fp);
+  }
+
+
+} //namespace Terrain
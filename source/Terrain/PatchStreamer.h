@@ -0,0 +1,99 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "ChunkedTerrainModel.h"
+
+namespace Terrain {
+
+
+  //reads the payloads of chunked terrain patches on a few i/o threads.
+  //requests are serviced by priority (projected screen space error), requests of payloads that lie next to each
+  //other in the file are coalesced to one read. the render thread only queues requests and collects finished
+  //payloads, so it never waits for the disk
+  class CPatchStreamer
+  {
+  public:
+    typedef CChunkedTerrainModel::Patch Patch;
+    typedef CChunkedTerrainModel::Vertex Vertex;
+
+    struct Request {
+      Patch*	patch;
+      float		priority;
+
+      Request(Patch* p, float prio) : patch(p), priority(prio) {}
+    };
+
+    struct Payload {
+      Patch*					patch;
+      std::vector<Vertex>		vbuf;
+      std::vector<glm::uint>	indices;
+    };
+
+    struct Statistics {
+      size_t reads;       //file reads
+      size_t payloads;    //payloads read (more than reads if requests were coalesced)
+      size_t bytes;       //bytes read
+      size_t cancelled;   //queued requests dropped from the queue
+
+      Statistics() : reads(0), payloads(0), bytes(0), cancelled(0) {}
+    };
+
+    TERRAIN_API CPatchStreamer();
+    TERRAIN_API ~CPatchStreamer();
+
+    //starts the i/o threads reading from the hfc file, the strips are converted to optimized triangle lists if requested
+    TERRAIN_API bool Open(const char* hfcfile, bool optimizeStrips, size_t numberOfThreads = 2);
+    //stops the i/o threads and drops all requests
+    TERRAIN_API void Close();
+
+    //queues the requested payloads and updates the priority of queued ones.
+    //queued requests not contained in the list are cancelled, payloads already being read are finished
+    TERRAIN_API void Schedule(std::vector<Request> const & requests);
+
+    //moves the finished payloads to loaded (does not block on i/o)
+    TERRAIN_API void Collect(std::vector<Payload> & loaded);
+
+    //gets the number of queued and running requests
+    TERRAIN_API size_t GetPendingCount() const;
+    TERRAIN_API Statistics GetStatistics() const;
+
+  private:
+    CPatchStreamer(CPatchStreamer const & rhs);             //forbidden
+    CPatchStreamer & operator=(CPatchStreamer const & rhs); //forbidden
+
+    struct Read {
+      Patch*		patch;
+      long long		offset;
+      size_t		size;
+      glm::uint		vcount;
+      glm::uint		icount;
+      float			priority;
+    };
+
+    //services the queue with its own file handle, closes it when the streamer is stopped
+    void IOLoop(FILE* fp);
+
+    std::map<long long, Read> mQueue;           //by file offset, so adjacent payloads are found for coalescing
+    std::unordered_set<Patch*> mInFlight;
+    std::unordered_set<Patch*> mFailed;
+    std::vector<Payload> mLoaded;
+    std::vector<std::thread> mThreads;
+    mutable std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    Statistics mStatistics;
+    bool mOptimizeStrips;
+    bool mStop;
+  };
+
+
+} //namespace Terrain
@@ -1,9 +1,14 @@
 #include "TerrainPrecompiled.h"
 #include "RasterTerrainModel.h"
+#include "RlodFormat.h"
+#include "IndexOptimizer.h"
 #include <cstdio>
 #include <iostream>
+#include <atomic>
 #include <GL/glew.h>
 #include <glm/gtc/half_float.hpp>
+#include <zlib.h>
+#include "ThreadPool.h"
 
 
 namespace Terrain {
@@ -24,25 +29,82 @@ namespace Terrain {
 
 
   
-  CRasterTerrainModel::Patch* NavigateFSM(CRasterTerrainModel::Patch* node, int c) {
+  CRasterTerrainModel::Patch* NavigateFSM(CRasterTerrainModel::Patch* node, int c, CRasterTerrainModel::Patch* const * borderRoots) {
     if (c == -1 || node == nullptr) {
       return node;
     }
+    //leaving the root continues in the adjacent terrain
+    if (node->parent == nullptr) {
+      return borderRoots[c];
+    }
     std::pair<glm::uint, int> cmd = FSM_TABLE[node->GetCIndex()][c];
-    node = NavigateFSM(node->parent, cmd.second);
+    node = NavigateFSM(node->parent, cmd.second, borderRoots);
     if (node) 
       node = node->childs[cmd.first];
 
     return node;
   }
 
-  CRasterTerrainModel::Patch::Patch(Patch* p) 
+  //encodes a unit vector with 8 bits per component (octahedral mapping)
+  static unsigned short EncodeOctahedral(glm::vec3 const & n) 
+  {
+    float sum = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    glm::vec2 e = (sum > 0.f) ? glm::vec2(n.x, n.y) / sum : glm::vec2(0.f);
+    if (n.z < 0.f) {
+      glm::vec2 s(e.x >= 0.f ? 1.f : -1.f, e.y >= 0.f ? 1.f : -1.f);
+      e = (glm::vec2(1.f) - glm::abs(glm::vec2(e.y, e.x))) * s;
+    }
+    e = glm::clamp(e * 0.5f + 0.5f, 0.f, 1.f) * 255.f + 0.5f;
+    return static_cast<unsigned short>((static_cast<unsigned int>(e.x) << 8) | static_cast<unsigned int>(e.y));
+  }
+
+
+
+  static glm::vec3 DecodeOctahedral(unsigned short value) 
+  {
+    glm::vec2 e = glm::vec2(static_cast<float>(value >> 8), static_cast<float>(value & 0xff)) / 255.f * 2.f - 1.f;
+    glm::vec3 n(e.x, e.y, 1.f - glm::abs(e.x) - glm::abs(e.y));
+    if (n.z < 0.f) {
+      glm::vec2 s(e.x >= 0.f ? 1.f : -1.f, e.y >= 0.f ? 1.f : -1.f);
+      glm::vec2 f = (glm::vec2(1.f) - glm::abs(glm::vec2(e.y, e.x))) * s;
+      n.x = f.x;
+      n.y = f.y;
+    }
+    return glm::normalize(n);
+  }
+
+
+
+  //decodes the vertices of a half payload (3 position and 3 normal halfs per vertex)
+  static void DecodeHalfVertices(unsigned short const * q, size_t count, glm::vec3 const & bbmin, glm::vec3 const & bbmax, std::vector<CRasterTerrainModel::Vertex> & vertices) 
+  {
+    glm::vec3 extent = bbmax - bbmin;
+    vertices.resize(count);
+    for (size_t i=0; i < count; ++i, q += 6) {
+      CRasterTerrainModel::Vertex & v = vertices[i];
+      v.p.x = bbmin.x + extent.x * glm::detail::toFloat32(q[0]);
+      v.p.y = bbmin.y + extent.y * glm::detail::toFloat32(q[1]);
+      v.p.z = bbmin.z + extent.z * glm::detail::toFloat32(q[2]);
+      v.n.x = 2.f * glm::detail::toFloat32(q[3]) - 1.f;
+      v.n.y = 2.f * glm::detail::toFloat32(q[4]) - 1.f;
+      v.n.z = 2.f * glm::detail::toFloat32(q[5]) - 1.f;
+    }
+  }
+
+
+
+  CRasterTerrainModel::Patch::Patch(Patch* p, PatchState* s) 
     : parent(p) 
+    , state(s)
   {
     child_mask  = 0;
     childs[0] = childs[1] = childs[2] = childs[3] = 0;
-    glbuf = 0;
-    tessLevel = 0;
+    neigbor[0] = neigbor[1] = 0;
+    payload = FloatPayload;
+    zcount = 0;
+    zsize = 0;
+    zencoding = Rlod::RawEncoding;
+    corrupt = false;
   }
 
 
@@ -57,23 +119,238 @@ namespace Terrain {
   }
 
 
-  void CRasterTerrainModel::Patch::Commit() 
+  void CRasterTerrainModel::Patch::SetVertices(std::vector<Vertex> const & vertices, PayloadFormat format) 
+  {
+    payload = format;
+    glm::vec3 extent = bbmax - bbmin;
+    glm::vec3 scale = glm::vec3(
+      extent.x > 0.f ? 1.f / extent.x : 0.f,
+      extent.y > 0.f ? 1.f / extent.y : 0.f,
+      extent.z > 0.f ? 1.f / extent.z : 0.f);
+
+    switch (format) {
+    case HalfPayload:
+      //same layout as the compressed rlod files
+      vbuf.clear();
+      qbuf.resize(vertices.size() * 6);
+      for (size_t i=0; i < vertices.size(); ++i) {
+        glm::vec3 p = (vertices[i].p - bbmin) * scale;
+        glm::vec3 n = vertices[i].n * 0.5f + 0.5f;
+        unsigned short* q = &qbuf[i*6];
+        q[0] = glm::detail::toFloat16(p.x); q[1] = glm::detail::toFloat16(p.y); q[2] = glm::detail::toFloat16(p.z);
+        q[3] = glm::detail::toFloat16(n.x); q[4] = glm::detail::toFloat16(n.y); q[5] = glm::detail::toFloat16(n.z);
+      }
+      break;
+    case QuantizedPayload:
+      vbuf.clear();
+      qbuf.resize(vertices.size() * 4);
+      for (size_t i=0; i < vertices.size(); ++i) {
+        glm::vec3 p = glm::clamp((vertices[i].p - bbmin) * scale, 0.f, 1.f) * 65535.f + 0.5f;
+        unsigned short* q = &qbuf[i*4];
+        q[0] = static_cast<unsigned short>(p.x);
+        q[1] = static_cast<unsigned short>(p.y);
+        q[2] = static_cast<unsigned short>(p.z);
+        q[3] = EncodeOctahedral(vertices[i].n);
+      }
+      break;
+    default:
+      qbuf.clear();
+      vbuf = vertices;
+      break;
+    }
+  }
+
+
+
+  std::vector<CRasterTerrainModel::Vertex> const & CRasterTerrainModel::Patch::GetVertices(std::vector<Vertex> & buffer) const 
+  {
+    glm::vec3 extent = bbmax - bbmin;
+
+    switch (payload) {
+    case HalfPayload:
+      DecodeHalfVertices(qbuf.data(), qbuf.size() / 6, bbmin, bbmax, buffer);
+      return buffer;
+    case QuantizedPayload:
+      buffer.resize(qbuf.size() / 4);
+      for (size_t i=0; i < buffer.size(); ++i) {
+        unsigned short const * q = &qbuf[i*4];
+        Vertex & v = buffer[i];
+        v.p = bbmin + extent * (glm::vec3(q[0], q[1], q[2]) / 65535.f);
+        v.n = DecodeOctahedral(q[3]);
+      }
+      return buffer;
+    default:
+      return vbuf;
+    }
+  }
+
+
+
+  size_t CRasterTerrainModel::Patch::GetPayloadSize() const 
+  {
+    return vbuf.size() * sizeof(Vertex) + qbuf.size() * sizeof(unsigned short) + zbuf.size() + hbuf.size() * sizeof(int);
+  }
+
+
+
+  size_t CRasterTerrainModel::Patch::GetVertexCount() const 
+  {
+    switch (payload) {
+    case HalfPayload:       return qbuf.size() / 6;
+    case QuantizedPayload:  return qbuf.size() / 4;
+    default:                return vbuf.size();
+    }
+  }
+
+
+
+  bool CRasterTerrainModel::Patch::Inflate(PayloadFormat format, CHeightDeltaCodec const & codec) 
+  {
+    if (!IsDeflated()) 
+      return true;
+    //a corrupt payload is reported once
+    if (corrupt)
+      return false;
+
+    if (Rlod::IsDeltaEncoding(zencoding)) {
+      if (parent && parent->hbuf.empty()) {
+        std::cerr << "failed to decode payload of patch " << label << ", the parent is not decoded!" << std::endl;
+        corrupt = true;
+        return false;
+      }
+      std::vector<Vertex> vertices;
+      if (!Decode(codec, parent ? parent->hbuf.data() : nullptr, vertices, hbuf)) {
+        std::cerr << "failed to decode payload of patch " << label << "!" << std::endl;
+        corrupt = true;
+        return false;
+      }
+      std::vector<unsigned char>().swap(zbuf);
+
+      if (IsLeaf())
+        std::vector<int>().swap(hbuf);
+      SetVertices(vertices, format);
+      return true;
+    }
+
+    //inflate into the format of the file
+    bool half = Rlod::IsHalfEncoding(zencoding);
+    uLongf size = zcount * (half ? sizeof(glm::half) : sizeof(Vertex));
+    uLongf expected = size;
+    int result;
+    if (half) {
+      payload = HalfPayload;
+      qbuf.resize(zcount);
+      result = uncompress(reinterpret_cast<Bytef*>(qbuf.data()), &size, zbuf.data(), static_cast<uLong>(zbuf.size()));
+    }
+    else {
+      payload = FloatPayload;
+      vbuf.resize(zcount);
+      result = uncompress(reinterpret_cast<Bytef*>(vbuf.data()), &size, zbuf.data(), static_cast<uLong>(zbuf.size()));
+    }
+
+    //the deflated bytes are kept, so the patch stays deflated
+    if (result != Z_OK || size != expected) {
+      std::cerr << "failed to inflate payload of patch " << label << "!" << std::endl;
+      std::vector<Vertex>().swap(vbuf);
+      std::vector<unsigned short>().swap(qbuf);
+      corrupt = true;
+      return false;
+    }
+    std::vector<unsigned char>().swap(zbuf);
+
+    //convert, if the payload is kept in another format
+    if (payload != format) {
+      std::vector<Vertex> vertices;
+      if (payload == FloatPayload) {
+        vertices.swap(vbuf);
+        SetVertices(vertices, format);
+      }
+      else {
+        SetVertices(GetVertices(vertices), format);
+      }
+    }
+    return true;
+  }
+
+
+
+  bool CRasterTerrainModel::Patch::Decode(CHeightDeltaCodec const & codec, int const * parentHeights, std::vector<Vertex> & vertices, std::vector<int> & heights) const 
+  {
+    heights.clear();
+    if (!IsDeflated() || corrupt)
+      return false;
+
+    //deflated payloads and residual streams are inflated into a temporary buffer
+    std::vector<unsigned char> inflated;
+    unsigned char const * stream = zbuf.data();
+    size_t streamSize = zbuf.size();
+    if (Rlod::IsDeflatedEncoding(zencoding)) {
+      uLongf size = zsize;
+      inflated.resize(zsize);
+      if (uncompress(inflated.data(), &size, zbuf.data(), static_cast<uLong>(zbuf.size())) != Z_OK || size != zsize)
+        return false;
+      stream = inflated.data();
+      streamSize = inflated.size();
+    }
+
+    if (Rlod::IsDeltaEncoding(zencoding)) {
+      //heights are predicted from the parent heights, x and y are given by the regular grid
+      if (zcount != codec.GetVertexCount() || (parent && parentHeights == nullptr))
+        return false;
+      std::vector<int> prediction(zcount);
+      codec.Predict(parentHeights, GetCIndex(), prediction.data());
+      heights.resize(zcount);
+      if (!codec.Decode(stream, streamSize, prediction.data(), heights.data())) {
+        heights.clear();
+        return false;
+      }
+      vertices.resize(zcount);
+      codec.Reconstruct(heights.data(), bbmin, bbmax, &vertices[0].p.x);
+    }
+    else if (Rlod::IsHalfEncoding(zencoding)) {
+      DecodeHalfVertices(reinterpret_cast<unsigned short const *>(stream), zcount / 6, bbmin, bbmax, vertices);
+    }
+    else {
+      Vertex const * first = reinterpret_cast<Vertex const *>(stream);
+      vertices.assign(first, first + zcount);
+    }
+    return true;
+  }
+
+
+
+  void CRasterTerrainModel::Patch::Commit(bool compact, std::vector<Vertex> & vertexBuffer, std::vector<unsigned short> & heights) 
   {
     if (!IsCommited()) {
-      glGenBuffers(1, &glbuf);
+      //quantised payloads are decoded into the scratch buffer
+      std::vector<Vertex> const & vertices = GetVertices(vertexBuffer);
+
+      glGenBuffers(1, &state->glbuf);
 
       //upload data
-      glBindBuffer(GL_ARRAY_BUFFER, glbuf);
-      glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*vbuf.size(), vbuf.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, state->glbuf);
+      if (compact) {
+        //heights are normalized to the bounds of the patch
+        float scale = (bbmax.z > bbmin.z) ? 65535.f / (bbmax.z - bbmin.z) : 0.f;
+        heights.resize(vertices.size());
+        for (size_t i=0; i < vertices.size(); ++i) {
+          heights[i] = static_cast<unsigned short>(glm::clamp((vertices[i].p.z - bbmin.z) * scale, 0.f, 65535.f) + 0.5f);
+        }
+        glBufferData(GL_ARRAY_BUFFER, sizeof(unsigned short)*heights.size(), heights.data(), GL_STATIC_DRAW);
+      }
+      else {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
+      }
       glBindBuffer(GL_ARRAY_BUFFER, 0);
+      state->compactbuf = compact;
     }
   }
 
   void CRasterTerrainModel::Patch::Release() 
   {
     if (IsCommited()) {
-      glDeleteBuffers(1, &glbuf);
-      glbuf = 0;
+      glDeleteBuffers(1, &state->glbuf);
+      state->glbuf = 0;
     }
   }
 
@@ -103,21 +380,247 @@ namespace Terrain {
 
 
 
+  //checks if the vertices of the patch (and its childs) form a regular grid spanning the bounds of the patch
+  //patches which are still deflated are skipped, they are expected to share the layout of the inflated ones
+  static bool IsRegularGrid(CRasterTerrainModel::Patch const * patch, glm::uint patchSize) 
+  {
+    for (glm::uint i=0; i < 4; ++i)
+      if (patch->childs[i] && !IsRegularGrid(patch->childs[i], patchSize))
+        return false;
+
+    if (patch->IsDeflated()) 
+      return true;
+
+    std::vector<CRasterTerrainModel::Vertex> buffer;
+    std::vector<CRasterTerrainModel::Vertex> const & vertices = patch->GetVertices(buffer);
+    glm::uint size = patchSize+1;
+    if (vertices.size() != size*size) return false;
+
+    glm::vec3 extent = patch->bbmax - patch->bbmin;
+    float tolerance = 1e-3f * glm::max(extent.x, extent.y);
+    for (glm::uint y=0; y < size; ++y) {
+      for (glm::uint x=0; x < size; ++x) {
+        glm::vec3 const & p = vertices[y*size + x].p;
+        if (glm::abs(p.x - (patch->bbmin.x + extent.x * x / patchSize)) > tolerance) return false;
+        if (glm::abs(p.y - (patch->bbmin.y + extent.y * y / patchSize)) > tolerance) return false;
+        if (p.z < patch->bbmin.z - tolerance || p.z > patch->bbmax.z + tolerance) return false;
+      }
+    }
+
+    return true;
+  }
+
+
+
+  //sums up the payload sizes of the patch and its childs
+  static size_t GetPayloadSize(CRasterTerrainModel::Patch const * patch) 
+  {
+    size_t size = patch->GetPayloadSize();
+    for (glm::uint i=0; i < 4; ++i)
+      if (patch->childs[i])
+        size += GetPayloadSize(patch->childs[i]);
+    return size;
+  }
+
+
+
+  //collects the patches of the hierarchy, which are still deflated
+  static void CollectDeflatedPatches(CRasterTerrainModel::Patch * patch, std::vector<CRasterTerrainModel::Patch*> & patches) 
+  {
+    if (patch->IsDeflated())
+      patches.push_back(patch);
+    for (glm::uint i=0; i < 4; ++i)
+      if (patch->childs[i])
+        CollectDeflatedPatches(patch->childs[i], patches);
+  }
+
+
+
+  //frees the heights of delta coded patches, they are only needed to decode deflated childs
+  static void ReleaseDeltaHeights(CRasterTerrainModel::Patch * patch) 
+  {
+    std::vector<int>().swap(patch->hbuf);
+    for (glm::uint i=0; i < 4; ++i)
+      if (patch->childs[i])
+        ReleaseDeltaHeights(patch->childs[i]);
+  }
+
+
+
+  //gets the number of ancestors of the patch
+  static glm::uint GetDepth(CRasterTerrainModel::Patch const * patch) 
+  {
+    glm::uint depth = 0;
+    for (patch = patch->parent; patch; patch = patch->parent)
+      ++depth;
+    return depth;
+  }
+
+
+
+  //gets the depth of the finest patches below the patch: the patches, whose childs are not complete
+  static glm::uint GetFinestDepth(CRasterTerrainModel::Patch const * patch) 
+  {
+    glm::uint depth = 0;
+    for (int i=0; i < 4; ++i) {
+      if (!patch->childs[i])
+        return 0;
+      depth = glm::max(depth, GetFinestDepth(patch->childs[i]) + 1);
+    }
+    return depth;
+  }
+
+
+
+  //rasterizes the finest patches below the patch with the given vertices and heights (of delta coded payloads). deflated childs
+  //are decoded into temporary buffers, a patch is rasterized itself if its childs are not complete or one of them is corrupt
+  static void RasterizeFinestPatches(CRasterTerrainModel::Patch const * patch, std::vector<CRasterTerrainModel::Vertex> const & vertices, std::vector<int> const & heights,
+    CHeightDeltaCodec const & codec, std::vector<glm::uint> const & triangles, CHeightPyramid & pyramid) 
+  {
+    std::vector<CRasterTerrainModel::Vertex> childVertices[4];
+    std::vector<int> childHeights[4];
+    bool decoded = true;
+    for (int i=0; i < 4 && decoded; ++i) {
+      CRasterTerrainModel::Patch const * child = patch->childs[i];
+      if (!child || child->corrupt) {
+        decoded = false;
+      }
+      else if (child->IsDeflated()) {
+        decoded = child->Decode(codec, heights.empty() ? nullptr : heights.data(), childVertices[i], childHeights[i]);
+      }
+      else {
+        childVertices[i] = child->GetVertices(childVertices[i]);
+        childHeights[i] = child->hbuf;
+      }
+    }
+
+    if (!decoded) {
+      std::vector<glm::vec3> positions(vertices.size());
+      for (size_t v=0; v < vertices.size(); ++v)
+        positions[v] = vertices[v].p;
+      pyramid.Rasterize(positions, triangles, vec2(patch->bbmin), vec2(patch->bbmax));
+      return;
+    }
+
+    //the footprints of the childs are disjoint
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, 4, [&](size_t i) {
+      RasterizeFinestPatches(patch->childs[i], childVertices[i], childHeights[i], codec, triangles, pyramid);
+    });
+  }
+
+
+
+  //delivers the patches of the hierarchy covering the polygon at the error of the query, returns false if the callback
+  //stopped the query
+  static bool QueryPatches(CRasterTerrainModel::Patch const * patch, int level, CRegionPolygon const & polygon, RegionQuery const & query,
+    std::vector<glm::uint> const & triangles, RegionCallback const & callback, RegionPatch & result, std::vector<CRasterTerrainModel::Vertex> & buffer) 
+  {
+    CRegionPolygon::Overlap overlap = polygon.Classify(glm::vec2(patch->bbmin), glm::vec2(patch->bbmax));
+    if (overlap == CRegionPolygon::Outside)
+      return true;
+
+    if (patch->error > query.maxError && !patch->IsLeaf()) {
+      for (int i=0; i < 4; ++i)
+        if (patch->childs[i] && !QueryPatches(patch->childs[i], level + 1, polygon, query, triangles, callback, result, buffer))
+          return false;
+      return true;
+    }
+
+    result.label = patch->label;
+    result.level = level;
+    result.bbmin = patch->bbmin;
+    result.bbmax = patch->bbmax;
+    result.error = patch->error;
+    result.inside = (overlap == CRegionPolygon::Inside);
+    result.triangles.clear();
+    if (query.clipTriangles && !patch->IsDeflated()) {
+      std::vector<CRasterTerrainModel::Vertex> const & vertices = patch->GetVertices(buffer);
+      for (size_t i=0; i + 2 < triangles.size(); i += 3) {
+        if (triangles[i] >= vertices.size() || triangles[i+1] >= vertices.size() || triangles[i+2] >= vertices.size())
+          continue;
+        glm::vec3 const & a = vertices[triangles[i]].p;
+        glm::vec3 const & b = vertices[triangles[i+1]].p;
+        glm::vec3 const & c = vertices[triangles[i+2]].p;
+        if (result.inside) {
+          result.triangles.push_back(a);
+          result.triangles.push_back(b);
+          result.triangles.push_back(c);
+        }
+        else {
+          polygon.ClipTriangle(a, b, c, result.triangles);
+        }
+      }
+    }
+    return callback(result);
+  }
+
+
+
+  //gets the first sample and the sample step of the vertex grid of the patch in the height pyramid
+  static void GetPatchGrid(CRasterTerrainModel::Patch const * patch, CHeightPyramid const & pyramid, glm::uint patchSize, glm::ivec2 & origin, int & step) 
+  {
+    glm::vec2 spacing = pyramid.GetSpacing();
+    origin = glm::ivec2(glm::round((glm::vec2(patch->bbmin) - pyramid.GetMin()) / spacing));
+    step = glm::max(static_cast<int>(glm::round((patch->bbmax.x - patch->bbmin.x) / spacing.x)) / static_cast<int>(patchSize), 1);
+  }
+
+
+
+  //collects the patches with their depth, whose vertices or normals read the samples [first, last]. the normals read
+  //the samples one vertex spacing around the vertices, the childs are only visited if the patch is collected
+  static void CollectEditedPatches(CRasterTerrainModel::Patch * patch, glm::uint depth, CHeightPyramid const & pyramid, glm::uint patchSize,
+    glm::ivec2 const & first, glm::ivec2 const & last, std::vector<std::pair<glm::uint, CRasterTerrainModel::Patch*>> & patches) 
+  {
+    glm::ivec2 origin;
+    int step;
+    GetPatchGrid(patch, pyramid, patchSize, origin, step);
+    glm::ivec2 end = origin + glm::ivec2(patchSize * step + step);
+    origin -= glm::ivec2(step);
+    if (origin.x > last.x || origin.y > last.y || end.x < first.x || end.y < first.y)
+      return;
+
+    patches.push_back(std::make_pair(depth, patch));
+    for (int i=0; i < 4; ++i)
+      if (patch->childs[i])
+        CollectEditedPatches(patch->childs[i], depth + 1, pyramid, patchSize, first, last, patches);
+  }
+
+
+
   CRasterTerrainModel::CRasterTerrainModel()
     :mRoot(nullptr)
     , mPatchSize(0)
     , mTessLevels(0)
+    , mIndexOptimization(true)
+    , mTessellationPrimitive(GL_TRIANGLE_STRIP)
+    , mTessellationIndexType(GL_UNSIGNED_INT)
+    , mPayloadFormat(FloatPayload)
+    , mInflateOnDemand(false)
+    , mFileSize(0)
     , mOutlineIBO(0)
+    , mRenderMode(TriangleStrips)
+    , mTessQuadSize(0)
+    , mTessPatchIBO(0)
+    , mTessVertexTexture(0)
+    , mTessQuery(0)
+    , mViewTerm(0.f)
+    , mVertexFormat(FullVertex)
+    , mRegularGrid(false)
+    , mCompactGridVBO(0)
+    , mCompactFallback(false)
   {
+    mUniforms.program = 0;
     mTerrainMax = vec3(FLT_MIN);
     mTerrainMin = vec3(FLT_MAX);
     mModelType = ModelType::RasterModel;
+    mBorderRoots[0] = mBorderRoots[1] = mBorderRoots[2] = mBorderRoots[3] = nullptr;
   }
 
 
 
   CRasterTerrainModel::~CRasterTerrainModel() 
   {
+    CancelLoading();
     Clear();
   }
 
@@ -146,9 +649,27 @@ namespace Terrain {
     if (mTessellationIBOs.empty()) {
       mTessellationIBOs.resize(mTessellationIBufs.size());
       glGenBuffers(static_cast<GLsizei>(mTessellationIBOs.size()), mTessellationIBOs.data());
+
+      //16 bit indices, if the vertices of a patch allow it. the index type is shared by all buffers,
+      //so all of them stay 32 bit if a single buffer cannot be narrowed
+      std::vector<std::vector<unsigned short>> narrow;
+      mTessellationIndexType = ((mPatchSize+1)*(mPatchSize+1) < CIndexOptimizer::RESTART_INDEX16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+      if (mTessellationIndexType == GL_UNSIGNED_SHORT) {
+        narrow.resize(mTessellationIBufs.size());
+        for (glm::uint i=0; i < mTessellationIBufs.size(); i++) {
+          if (!CIndexOptimizer::NarrowIndices(mTessellationIBufs[i], narrow[i])) {
+            mTessellationIndexType = GL_UNSIGNED_INT;
+            narrow.clear();
+            break;
+          }
+        }
+      }
       for (glm::uint i=0; i < mTessellationIBOs.size(); i++) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mTessellationIBOs[i]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::uint)*mTessellationIBufs[i].size(), mTessellationIBufs[i].data(), GL_STATIC_DRAW);
+        if (mTessellationIndexType == GL_UNSIGNED_SHORT)
+          glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short)*narrow[i].size(), narrow[i].data(), GL_STATIC_DRAW);
+        else
+          glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::uint)*mTessellationIBufs[i].size(), mTessellationIBufs[i].data(), GL_STATIC_DRAW);
       }
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
@@ -166,9 +687,57 @@ namespace Terrain {
       glBufferData(GL_ELEMENT_ARRAY_BUFFER, ib.size()*sizeof(glm::uint), ib.data(), GL_STATIC_DRAW);
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
-  }
 
-  static const char MAGIC[] = {'R','L','O','D'};
+    //the hardware tessellation needs gl 4.0
+    if (mTessPatchIBO == 0 && glPatchParameteri != nullptr && mPatchSize > 0) {
+
+      //largest power of two (max. tessellation level is 64) dividing the patch, but prefer several
+      //quads per patch as long as the decimation towards the coarsest neighbor can be expressed
+      mTessQuadSize = 1;
+      while (mTessQuadSize < 64 && mPatchSize % (mTessQuadSize*2) == 0) mTessQuadSize *= 2;
+      glm::uint minQuadSize = 1 << (glm::max(mTessLevels, 1u) - 1);
+      while (mPatchSize / mTessQuadSize < 4 && mTessQuadSize / 2 >= minQuadSize) mTessQuadSize /= 2;
+
+      std::vector<glm::uint>	ib;
+      glm::uint size = (mPatchSize+1);
+      for (glm::uint y=0; y < mPatchSize; y += mTessQuadSize) {
+        for (glm::uint x=0; x < mPatchSize; x += mTessQuadSize) {
+          glm::uint base = y*size + x;
+          ib.push_back(base);
+          ib.push_back(base + mTessQuadSize);
+          ib.push_back(base + mTessQuadSize*size + mTessQuadSize);
+          ib.push_back(base + mTessQuadSize*size);
+        }
+      }
+
+      glGenBuffers(1, &mTessPatchIBO);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mTessPatchIBO);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, ib.size()*sizeof(glm::uint), ib.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+      glGenTextures(1, &mTessVertexTexture);
+      //the query object is created by its first use, so the first frame can already read back a result
+      glGenQueries(1, &mTessQuery);
+      glBeginQuery(GL_PRIMITIVES_GENERATED, mTessQuery);
+      glEndQuery(GL_PRIMITIVES_GENERATED);
+    }
+
+    //the compact vertex format still needs an enabled vertex array to provoke the vertices
+    if (mCompactGridVBO == 0 && mPatchSize > 0) {
+      std::vector<short> grid;
+      for (glm::uint y=0; y <= mPatchSize; ++y) {
+        for (glm::uint x=0; x <= mPatchSize; ++x) {
+          grid.push_back(static_cast<short>(x));
+          grid.push_back(static_cast<short>(y));
+        }
+      }
+
+      glGenBuffers(1, &mCompactGridVBO);
+      glBindBuffer(GL_ARRAY_BUFFER, mCompactGridVBO);
+      glBufferData(GL_ARRAY_BUFFER, grid.size()*sizeof(short), grid.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+  }
 
   bool CRasterTerrainModel::Init(const char* hfcfile) 
   {
@@ -182,10 +751,14 @@ namespace Terrain {
       return false;
     }
 
+    _fseeki64(fp, 0, SEEK_END);
+    mFileSize = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+
     //read magic
     char sig[4];
     fread(sig, 1, 4, fp);
-    if (memcmp(sig, MAGIC, 4) != 0) {
+    if (memcmp(sig, Rlod::MAGIC, 4) != 0) {
       fclose(fp);
       std::cerr << "terrain file is not a raster-lod!" << std::endl;
       return false;
@@ -194,6 +767,13 @@ namespace Terrain {
     //read compress flag
     uint compressFlag;
     fread(&compressFlag, sizeof(glm::uint), 1, fp);
+    bool triangleLists = (compressFlag & Rlod::TriangleListFlag) != 0;
+    compressFlag &= Rlod::EncodingMask;
+    if (!Rlod::IsKnownEncoding(compressFlag)) {
+      fclose(fp);
+      std::cerr << "raster-lod has an unknown payload encoding " << compressFlag << "!" << std::endl;
+      return false;
+    }
 
     //read extent
     float extent[4];
@@ -223,17 +803,130 @@ namespace Terrain {
     }
     std::cout << "tessellation buffers consumes approx: " << tessBufferSize << "bytes!" << std::endl;
 
+    //convert the strips to vertex cache optimized triangle lists
+    if (!triangleLists && mIndexOptimization) {
+      CIndexOptimizer::CacheStatistics before, after;
+      std::vector<glm::uint> triangles;
+      for (glm::uint i=0; i < mTessellationIBufs.size(); ++i) {
+        CIndexOptimizer::StripsToTriangles(mTessellationIBufs[i], triangles);
+        before += CIndexOptimizer::SimulateVertexCache(triangles);
+        CIndexOptimizer::OptimizeVertexCache(triangles);
+        after += CIndexOptimizer::SimulateVertexCache(triangles);
+        mTessellationIBufs[i].swap(triangles);
+      }
+      triangleLists = true;
+      std::cout << "tessellation buffers optimized, ACMR: " << before.ACMR() << " -> " << after.ACMR() << ", ATVR: " << before.ATVR() << " -> " << after.ATVR() << "!" << std::endl;
+    }
+    mTessellationPrimitive = triangleLists ? GL_TRIANGLES : GL_TRIANGLE_STRIP;
+
+    //read quantisation of delta coded heights
+    if (Rlod::IsDeltaEncoding(compressFlag)) {
+      float quantisation[2];
+      fread(quantisation, sizeof(float), 2, fp);
+      if (mPatchSize % 2 != 0) {
+        fclose(fp);
+        ClearHierarchy();
+        std::cerr << "delta coded raster-lod needs an even patch size!" << std::endl;
+        return false;
+      }
+      mDeltaCodec = CHeightDeltaCodec(mPatchSize, quantisation[0], quantisation[1]);
+      std::cout << "terrain heights are delta coded with a quantisation step of: " << quantisation[0] << "!" << std::endl;
+    }
+
 
-    std::cout << "\treading patch hierarchy |";
-    mRoot = new Patch(0);
-    if (!LoadHierarchy(mRoot, compressFlag == 1, fp)) {
-      Clear();
+    mRoot = CreatePatch(nullptr);
+    if (!LoadHierarchy(mRoot, compressFlag, fp)) {
+      fclose(fp);
+      ClearHierarchy();
       return false;
     }
-    std::cout << "\r\treading patch hierarchy [done]" << std::endl;
+    fclose(fp);
+
+    //inflate all deflated payloads now, or the rest when the patches get active (the root is inflated while loading)
+    std::vector<Patch*> deflated;
+    if (!mInflateOnDemand)
+      CollectDeflatedPatches(mRoot, deflated);
+    if (!InflatePatches(deflated)) {
+      ClearHierarchy();
+      return false;
+    }
+    if (!mInflateOnDemand)
+      ReleaseDeltaHeights(mRoot);
+    std::cout << "patch payloads consume approx: " << GetPayloadSize(mRoot) << "bytes!" << std::endl;
+
+    BuildHeightPyramid();
 
     //assign neighbors
     AssignChildNeighbors(mRoot);
+
+    mRegularGrid = IsRegularGrid(mRoot, mPatchSize);
+    if (!mRegularGrid) {
+      std::cout << "terrain patches are no regular grids, compact vertex format is not available!" << std::endl;
+    }
+    SetLoadingProgress(1.f);
+    return true;
+  }
+
+
+
+  bool CRasterTerrainModel::SetVertexFormat(VertexFormat format) 
+  {
+    if (format == CompactHeight && !mRegularGrid) {
+      std::cerr << "compact vertex format needs regular patch grids!" << std::endl;
+      return false;
+    }
+
+    //patches are recommitted in the new format during the next update
+    mVertexFormat = format;
+    mCompactFallback = false;
+    return true;
+  }
+
+
+
+  void CRasterTerrainModel::SetBorderNeighbor(Border border, CRasterTerrainModel const * neighbor) 
+  {
+    mBorderRoots[border] = neighbor ? neighbor->mRoot : nullptr;
+
+    //the neighbors along the border are found through the root of the adjacent terrain
+    if (mRoot)
+      AssignChildNeighbors(mRoot);
+  }
+
+
+
+  size_t CRasterTerrainModel::GetMemoryUsage() const 
+  {
+    return mRoot ? GetPayloadSize(mRoot) : 0;
+  }
+
+
+
+  bool CRasterTerrainModel::QueryRegion(RegionQuery const & query, RegionCallback const & callback) const 
+  {
+    if (IsLoading() || !mRoot || mTessellationIBufs.empty())
+      return false;
+
+    //the coarsest patches with an error within the maximum error (or the leaves) are streamed, patches outside the polygon are
+    //rejected by their bounds
+    CRegionPolygon polygon;
+    if (!polygon.Init(query.polygon)) {
+      std::cerr << "failed to query the region, the polygon has no area or intersects itself!" << std::endl;
+      return false;
+    }
+
+    //the first stitching buffer triangulates the full resolution patch
+    std::vector<glm::uint> triangles;
+    if (query.clipTriangles) {
+      if (mTessellationPrimitive == GL_TRIANGLE_STRIP)
+        CIndexOptimizer::StripsToTriangles(mTessellationIBufs[0], triangles);
+      else
+        triangles = mTessellationIBufs[0];
+    }
+
+    RegionPatch result;
+    std::vector<Vertex> buffer;
+    QueryPatches(mRoot, 0, polygon, query, triangles, callback, result, buffer);
     return true;
   }
 
@@ -241,37 +934,380 @@ namespace Terrain {
 
   void CRasterTerrainModel::Clear() 
   {
+    ClearHierarchy();
+    DeleteReleasedGLObjects();
+  }
+
+
+
+  void CRasterTerrainModel::ClearHierarchy() 
+  {
+    //the render thread must not use the preview anymore, the names of its gl objects are kept for it
+    std::lock_guard<std::mutex> lock(mPreviewMutex);
+    RevokePreview();
 
     mTessellationIBufs.clear();
-    if (!mTessellationIBOs.empty()) {
-      glDeleteBuffers(static_cast<GLsizei>(mTessellationIBOs.size()), mTessellationIBOs.data());
-      mTessellationIBOs.clear();
-    }
+    mReleasedBuffers.insert(mReleasedBuffers.end(), mTessellationIBOs.begin(), mTessellationIBOs.end());
+    mTessellationIBOs.clear();
     if (mOutlineIBO) {
-      glDeleteBuffers(1, &mOutlineIBO);
+      mReleasedBuffers.push_back(mOutlineIBO);
       mOutlineIBO = 0;
     }
+    if (mTessPatchIBO) {
+      mReleasedBuffers.push_back(mTessPatchIBO);
+      mReleasedTextures.push_back(mTessVertexTexture);
+      mReleasedQueries.push_back(mTessQuery);
+      mTessPatchIBO = mTessVertexTexture = mTessQuery = 0;
+    }
+    if (mCompactGridVBO) {
+      mReleasedBuffers.push_back(mCompactGridVBO);
+      mCompactGridVBO = 0;
+    }
+
+    //the committed patches are released with the states, so deleting the patches does not call gl
+    for (auto iter = mPatchStates.begin(); iter != mPatchStates.end(); ++iter) {
+      if (iter->glbuf) {
+        mReleasedBuffers.push_back(iter->glbuf);
+        iter->glbuf = 0;
+      }
+    }
     
     if (mRoot) {
       delete mRoot;
       mRoot = nullptr;
     }
+    mPatchStates.clear();
+    mActivePatches.clear();
+    mBorderRoots[0] = mBorderRoots[1] = mBorderRoots[2] = mBorderRoots[3] = nullptr;
+    SetHeightPyramid(nullptr);
+  }
+
+
+
+  void CRasterTerrainModel::DeleteReleasedGLObjects() 
+  {
+    std::lock_guard<std::mutex> lock(mPreviewMutex);
+    if (!mReleasedBuffers.empty())
+      glDeleteBuffers(static_cast<GLsizei>(mReleasedBuffers.size()), mReleasedBuffers.data());
+    if (!mReleasedTextures.empty())
+      glDeleteTextures(static_cast<GLsizei>(mReleasedTextures.size()), mReleasedTextures.data());
+    if (!mReleasedQueries.empty())
+      glDeleteQueries(static_cast<GLsizei>(mReleasedQueries.size()), mReleasedQueries.data());
+    mReleasedBuffers.clear();
+    mReleasedTextures.clear();
+    mReleasedQueries.clear();
+  }
+
+
+
+  bool CRasterTerrainModel::LockPreview(std::unique_lock<std::mutex> & lock) const 
+  {
+    LoadingState state = GetLoadingState();
+    if (state == PreviewLoading) {
+      lock = std::unique_lock<std::mutex>(mPreviewMutex);
+      state = GetLoadingState();
+    }
+    return (state == PreviewLoading || state == NotLoading) && mRoot != nullptr;
   }
 
 
 
   void CRasterTerrainModel::Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum) 
   {
+    //the gl objects of a failed loading and the pyramids replaced by edits are deleted here
+    DeleteReleasedGLObjects();
+    mPyramidEpochs.Reclaim();
+
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
+
     InitGLResources();
 
+    mViewPosition = metric.ViewPosition();
+    mViewTerm = metric.ViewTerm();
+
     mActivePatches.clear();
-    RecursiveUpdate(mRoot, metric, frustum);
+    if (preview.owns_lock() && GetLoadingState() == PreviewLoading) {
+      //the childs are still loaded, only the root is shown
+      mRoot->state->tessLevel = 0;
+      if (frustum.Intersects(mRoot->bbmin, mRoot->bbmax))
+        mActivePatches.push_back(mRoot);
+    }
+    else {
+      RecursiveUpdate(mRoot, metric, frustum);
+    }
+
+    //inflate streamed payloads of the new active patches in parallel, before they are committed
+    bool inflated = true;
+    if (mInflateOnDemand) {
+      std::vector<Patch*> deflated;
+      std::vector<Patch*>::const_iterator itr, itre = mActivePatches.end();
+      for (itr = mActivePatches.begin(); itr != itre; ++itr) {
+        if ((*itr)->IsDeflated())
+          deflated.push_back(*itr);
+      }
+      inflated = InflatePatches(deflated);
+    }
+
+    //patches without the vertices of the stitching buffers (corrupt payloads) are neither committed nor drawn
+    bool compact = (mVertexFormat == CompactHeight && !mCompactFallback);
+    size_t vertexCount = (mPatchSize+1) * (mPatchSize+1);
+    size_t active = 0;
+    for (size_t i=0; i < mActivePatches.size(); ++i) {
+      Patch* p = mActivePatches[i];
+      if ((!inflated && p->IsDeflated()) || p->GetVertexCount() != vertexCount)
+        continue;
+
+      if (p->IsCommited() && p->state->compactbuf != compact) {
+        p->Release();
+      }
+      p->Commit(compact, mCommitVertices, mCommitHeights);
+      mActivePatches[active++] = p;
+    }
+    mActivePatches.resize(active);
+  }
+
+
+
+  void CRasterTerrainModel::BuildHeightPyramid() 
+  {
+    if (!mRoot || mRoot->IsDeflated() || mTessellationIBufs.empty())
+      return;
+
+    //the patches are grids of patch size quads, so the finest ones give the sample spacing. the pyramid is built from them
+    //even if their payloads are inflated on demand, the coarser patches are above or below the surface by their error
+    glm::uint depth = GetFinestDepth(mRoot);
+    int samples = (mPatchSize << depth) + 1;
+    std::unique_ptr<CHeightPyramid> heights(new CHeightPyramid());
+    heights->Init(samples, samples, vec2(mRoot->bbmin), vec2(mRoot->bbmax));
+
+    //the first stitching buffer triangulates the full resolution patch
+    std::vector<glm::uint> triangles;
+    if (mTessellationPrimitive == GL_TRIANGLE_STRIP)
+      CIndexOptimizer::StripsToTriangles(mTessellationIBufs[0], triangles);
+    else
+      triangles = mTessellationIBufs[0];
+
+    CHeightPyramid & pyramid = *heights;
+    std::vector<Vertex> buffer;
+    RasterizeFinestPatches(mRoot, mRoot->GetVertices(buffer), mRoot->hbuf, mDeltaCodec, triangles, pyramid);
+    pyramid.Build();
+    std::cout << "height pyramid of " << samples << " x " << samples << " samples consumes approx: " << pyramid.GetMemoryUsage() << "bytes!" << std::endl;
+    SetHeightPyramid(std::move(heights));
+  }
+
+
+
+  bool CRasterTerrainModel::EditHeights(glm::vec2 const & min, glm::vec2 const & max, HeightEdit const & edit) 
+  {
+    //only the patches around the rectangle are touched: their vertices and normals are set from the samples, their bounds
+    //and errors are propagated to the ancestors and the committed ones are uploaded again. the patches and the committed
+    //buffers are changed in place, so the edit has to run on the render thread between the frames. the queries on other
+    //threads keep reading the previous pyramid, the edited copy is published when the patches are done
+    if (IsLoading() || !mRoot || !mHeightPyramid.load()) {
+      std::cerr << "failed to edit the terrain, it is not loaded!" << std::endl;
+      return false;
+    }
+    //the patches are rebuilt from the samples of the pyramid, which need to hold the heights of all vertices
+    if (!mRegularGrid || mInflateOnDemand) {
+      std::cerr << "failed to edit the terrain, it needs regular patch grids and inflated payloads!" << std::endl;
+      return false;
+    }
+
+    CHeightPyramid const & current = *mHeightPyramid.load();
+    glm::vec2 spacing = current.GetSpacing();
+    glm::ivec2 first = glm::max(glm::ivec2(glm::ceil((min - current.GetMin()) / spacing)), glm::ivec2(0));
+    glm::ivec2 last = glm::min(glm::ivec2(glm::floor((max - current.GetMin()) / spacing)), glm::ivec2(current.GetColumns() - 1, current.GetRows() - 1));
+    if (first.x > last.x || first.y > last.y)
+      return true;
+
+    std::unique_ptr<CHeightPyramid> edited(new CHeightPyramid(current));
+    CHeightPyramid & pyramid = *edited;
+
+    //edit the samples row by row in parallel and update their cells
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(first.y, last.y + 1, [&](size_t row) {
+      int y = static_cast<int>(row);
+      for (int x = first.x; x <= last.x; ++x) {
+        glm::vec2 position = pyramid.GetMin() + glm::vec2(x, y) * spacing;
+        pyramid.SetHeight(x, y, edit(position, pyramid.GetSampleHeight(x, y)));
+      }
+    });
+    pyramid.BuildRegion(first.x, first.y, last.x, last.y);
+
+    //update the patches level by level from the deepest one, the patches of one level in parallel
+    std::vector<std::pair<glm::uint, Patch*>> levels;
+    CollectEditedPatches(mRoot, 0, pyramid, mPatchSize, first, last, levels);
+    std::sort(levels.begin(), levels.end(), [](std::pair<glm::uint, Patch*> const & a, std::pair<glm::uint, Patch*> const & b) {
+      return a.first > b.first;
+    });
+    for (size_t begin=0, end=0; begin < levels.size(); begin = end) {
+      while (end < levels.size() && levels[end].first == levels[begin].first)
+        ++end;
+
+      GLUtils::CThreadPool::GetDefaultPool().ParallelFor(begin, end, [&](size_t i) {
+        UpdateEditedPatch(levels[i].second, pyramid);
+      });
+    }
+
+    //only the committed edited patches are uploaded again
+    for (auto iter = levels.begin(); iter != levels.end(); ++iter) {
+      Patch* p = iter->second;
+      if (p->IsCommited()) {
+        bool compact = p->state->compactbuf;
+        p->Release();
+        p->Commit(compact, mCommitVertices, mCommitHeights);
+      }
+    }
+
+    //the root bounds are recomputed from the edited patches, so they shrink as well
+    mTerrainMin.z = mRoot->bbmin.z;
+    mTerrainMax.z = mRoot->bbmax.z;
+    SetHeightPyramid(std::move(edited));
+    return true;
+  }
+
+
+
+  bool CRasterTerrainModel::AddCrater(glm::vec2 const & center, float radius, float depth) 
+  {
+    if (radius <= 0.f)
+      return true;
+
+    return EditHeights(center - radius, center + radius, [=](glm::vec2 const & position, float height) {
+      float d = glm::length(position - center) / radius;
+      return (d < 1.f) ? height - depth * (1.f - d * d) : height;
+    });
+  }
+
+
+
+  bool CRasterTerrainModel::Flatten(glm::vec2 const & min, glm::vec2 const & max, float height, float margin) 
+  {
+    margin = glm::max(margin, 0.f);
+    return EditHeights(min - margin, max + margin, [=](glm::vec2 const & position, float h) {
+      //the weight fades linearly from the rectangle to the border of the margin
+      float d = glm::length(glm::max(glm::max(min - position, position - max), glm::vec2(0.f)));
+      float weight = (margin > 0.f) ? glm::clamp(1.f - d / margin, 0.f, 1.f) : (d > 0.f ? 0.f : 1.f);
+      return glm::mix(h, height, weight);
+    });
+  }
+
+
+
+  void CRasterTerrainModel::UpdateEditedPatch(Patch* patch, CHeightPyramid const & pyramid) 
+  {
+    glm::vec2 spacing = pyramid.GetSpacing();
+    glm::ivec2 maxSample(pyramid.GetColumns() - 1, pyramid.GetRows() - 1);
+    auto sample = [&](int x, int y) {
+      return pyramid.GetSampleHeight(glm::clamp(x, 0, maxSample.x), glm::clamp(y, 0, maxSample.y));
+    };
+
+    int P = static_cast<int>(mPatchSize);
+    glm::ivec2 origin;
+    int s;
+    GetPatchGrid(patch, pyramid, mPatchSize, origin, s);
+
+    //same vertices and normals as built by rlod-build, central differences on the grid of the level,
+    //one-sided at the borders of the grid
+    std::vector<Vertex> buffer;
+    std::vector<Vertex> vertices = patch->GetVertices(buffer);
+    float bbmin = FLT_MAX;
+    float bbmax = -FLT_MAX;
+    for (int j=0; j <= P; ++j) {
+      for (int i=0; i <= P; ++i) {
+        int x = origin.x + i * s;
+        int y = origin.y + j * s;
+        Vertex & v = vertices[j * (P+1) + i];
+        v.p.z = sample(x, y);
+
+        int xl = glm::max(x - s, 0), xr = glm::min(x + s, maxSample.x);
+        int yl = glm::max(y - s, 0), yr = glm::min(y + s, maxSample.y);
+        float dx = (sample(xr, y) - sample(xl, y)) / ((xr - xl) * spacing.x);
+        float dy = (sample(x, yr) - sample(x, yl)) / ((yr - yl) * spacing.y);
+        v.n = glm::normalize(glm::vec3(-dx, -dy, 1.f));
+
+        bbmin = glm::min(bbmin, v.p.z);
+        bbmax = glm::max(bbmax, v.p.z);
+      }
+    }
+
+    //the error of inner patches is the largest height difference between the samples at half the vertex spacing and the
+    //triangles (split from the lower left to the upper right corner), but at least the error of the childs
+    bool inner = false;
+    float error = 0.f;
+    for (int i=0; i < 4; ++i) {
+      if (patch->childs[i]) {
+        inner = true;
+        error = glm::max(error, patch->childs[i]->error);
+        bbmin = glm::min(bbmin, patch->childs[i]->bbmin.z);
+        bbmax = glm::max(bbmax, patch->childs[i]->bbmax.z);
+      }
+    }
+    if (inner && s > 1) {
+      int f = s / 2;
+      for (int y = origin.y; y <= origin.y + P * s; y += f) {
+        for (int x = origin.x; x <= origin.x + P * s; x += f) {
+          int cx = glm::min((x - origin.x) / s, P - 1);
+          int cy = glm::min((y - origin.y) / s, P - 1);
+          float u = static_cast<float>(x - origin.x - cx * s) / s;
+          float v = static_cast<float>(y - origin.y - cy * s) / s;
+          float a = vertices[cy * (P+1) + cx].p.z;
+          float b = vertices[cy * (P+1) + cx + 1].p.z;
+          float c = vertices[(cy + 1) * (P+1) + cx + 1].p.z;
+          float d = vertices[(cy + 1) * (P+1) + cx].p.z;
+          float h = (u >= v) ? a + u * (b - a) + v * (c - b) : a + v * (d - a) + u * (c - d);
+          error = glm::max(error, glm::abs(sample(x, y) - h));
+        }
+      }
+    }
+    if (inner)
+      patch->error = error;
+
+    //the payload is encoded relative to the new bounds
+    patch->bbmin.z = bbmin;
+    patch->bbmax.z = bbmax;
+    patch->SetVertices(vertices, mPayloadFormat);
+  }
+
+
+
+  bool CRasterTerrainModel::InflatePatches(std::vector<Patch*> patches) 
+  {
+    //delta coded patches are predicted from their parent, so deflated ancestors are decoded as well
+    for (size_t i=0; i < patches.size(); ++i) {
+      Patch* parent = patches[i]->parent;
+      if (parent && parent->IsDeflated() && Rlod::IsDeltaEncoding(parent->zencoding))
+        patches.push_back(parent);
+    }
+    std::sort(patches.begin(), patches.end());
+    patches.erase(std::unique(patches.begin(), patches.end()), patches.end());
+
+    //inflate level by level, all patches of one level in parallel
+    std::vector<std::pair<glm::uint, Patch*>> levels;
+    for (auto iter = patches.begin(); iter != patches.end(); ++iter)
+      levels.push_back(std::make_pair(GetDepth(*iter), *iter));
+    std::sort(levels.begin(), levels.end());
+
+    std::atomic<bool> success(true);
+    PayloadFormat format = mPayloadFormat;
+    CHeightDeltaCodec const & codec = mDeltaCodec;
+    for (size_t begin=0, end=0; begin < levels.size(); begin = end) {
+      while (end < levels.size() && levels[end].first == levels[begin].first)
+        ++end;
+
+      GLUtils::CThreadPool::GetDefaultPool().ParallelFor(begin, end, [&](size_t i) {
+        if (!levels[i].second->Inflate(format, codec))
+          success = false;
+      });
+    }
+    return success;
   }
 
 
   void CRasterTerrainModel::RecursiveUpdate(Patch * p, CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum) 
   {
-    p->tessLevel = 0;
+    p->state->tessLevel = 0;
     if (frustum.Intersects(p->bbmin, p->bbmax)) {
       if (metric.Evaluate(p->bbmin, p->bbmax, p->error) && !p->IsLeaf()) {
 
@@ -280,7 +1316,7 @@ namespace Terrain {
             RecursiveUpdate(p->childs[i], metric, frustum);
       }
       else {
-        p->Commit();
+        //committed after the traversal, when the payload is inflated
         p->ReleaseChilds();
         p->propagateTessLevel(0);
         mActivePatches.push_back(p);
@@ -340,6 +1376,9 @@ namespace Terrain {
 
   void CRasterTerrainModel::RenderBounds() const 
   {
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
 
     glDisable(GL_LIGHTING);
   
@@ -353,6 +1392,9 @@ namespace Terrain {
 
 
   void CRasterTerrainModel::RenderOutline() const {
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
     
     glEnableClientState(GL_VERTEX_ARRAY);
     
@@ -365,16 +1407,21 @@ namespace Terrain {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
+    UniformLocations const & uniforms = GetUniformLocations();
+    if (uniforms.compactPatch != -1)
+      glUniform1f(uniforms.patchSize, static_cast<float>(mPatchSize));
+
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mOutlineIBO);
     std::vector<Patch*>::const_iterator itr, itre = mActivePatches.end();
     for (itr = mActivePatches.begin(); itr != itre; ++itr) {
-      Patch* p = (*itr);
-
-      glBindBuffer(GL_ARRAY_BUFFER, p->glbuf);
-      glVertexPointer(3, GL_FLOAT, sizeof(CRasterTerrainModel::Vertex), 0);
+      BindPatchVertices(*itr, uniforms, false);
       glDrawElements(GL_LINE_LOOP, static_cast<GLsizei>(mPatchSize*4), GL_UNSIGNED_INT, 0);
     }
 
+    if (uniforms.compactPatch != -1) {
+      glUniform1i(uniforms.compactPatch, 0);
+      glDisableVertexAttribArray(1);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glLineWidth(1.0f);
@@ -384,6 +1431,10 @@ namespace Terrain {
 
   void CRasterTerrainModel::Render() const 
   {
+    std::unique_lock<std::mutex> preview;
+    if (!LockPreview(preview))
+      return;
+
     //glColor3f(1.0f, 0.0f, 0.0f);
     if (glPrimitiveRestartIndex == nullptr)  {
       GLenum glew_err = glewInit();
@@ -393,16 +1444,28 @@ namespace Terrain {
       }
     }
     
+    UniformLocations const & uniforms = GetUniformLocations();
+    if (mRenderMode == HardwareTessellation && RenderTessellated(uniforms)) {
+      return;
+    }
+
     glEnable(GL_POLYGON_OFFSET_FILL);
     glEnable(GL_POLYGON_OFFSET_LINE);
     glPolygonOffset(1.0, 1.0);
     
 
     glEnable(GL_PRIMITIVE_RESTART);
-    glPrimitiveRestartIndex(UINT_MAX);
+    glPrimitiveRestartIndex((mTessellationIndexType == GL_UNSIGNED_SHORT) ? CIndexOptimizer::RESTART_INDEX16 : CIndexOptimizer::RESTART_INDEX);
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
 
+    //compact patches are reconstructed by the bound program
+    GLint compactLocation = uniforms.compactPatch;
+    if (compactLocation != -1) {
+      glUniform1i(compactLocation, 0);
+      glUniform1f(uniforms.patchSize, static_cast<float>(mPatchSize));
+    }
+
     //reset number of rendered triangles
     mNumberOfRenderedTriangles = 0;
 
@@ -410,23 +1473,28 @@ namespace Terrain {
     for (itr = mActivePatches.begin(); itr != itre; ++itr) {
       Patch* p = (*itr);
 
-      //compute id
-      uint hlv = p->neigbor[0] ? p->neigbor[0]->tessLevel : 0;
-      uint vlv = p->neigbor[1] ? p->neigbor[1]->tessLevel : 0;
+      //compute id, neighbors coarser than the tessellation buffers cover are stitched with the coarsest buffer
+      uint hlv = glm::min<uint>(p->neigbor[0] ? p->neigbor[0]->state->tessLevel : 0, mTessLevels - 1);
+      uint vlv = glm::min<uint>(p->neigbor[1] ? p->neigbor[1]->state->tessLevel : 0, mTessLevels - 1);
       uint cid = p->GetCIndex();
       uint tessID = vlv + hlv*mTessLevels + cid*(mTessLevels*mTessLevels);
 
-      glBindBuffer(GL_ARRAY_BUFFER, p->glbuf);
+      BindPatchVertices(p, uniforms, true);
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mTessellationIBOs[tessID]);
-      glVertexPointer(3, GL_FLOAT, sizeof(CRasterTerrainModel::Vertex), 0);
-      glNormalPointer(GL_FLOAT, sizeof(CRasterTerrainModel::Vertex), (void*)12);
       //glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>((*itr)->vbuf.size()));
-      glDrawElements(GL_TRIANGLE_STRIP, static_cast<GLsizei>(mTessellationIBufs[tessID].size()), GL_UNSIGNED_INT, 0);
+      glDrawElements(mTessellationPrimitive, static_cast<GLsizei>(mTessellationIBufs[tessID].size()), mTessellationIndexType, 0);
 
       //count number of rendered triangles
-      mNumberOfRenderedTriangles += static_cast<unsigned int>(mTessellationIBufs[tessID].size());
+      if (mTessellationPrimitive == GL_TRIANGLES)
+        mNumberOfRenderedTriangles += static_cast<unsigned int>(mTessellationIBufs[tessID].size() / 3);
+      else
+        mNumberOfRenderedTriangles += static_cast<unsigned int>(mTessellationIBufs[tessID].size());
     }
 
+    if (compactLocation != -1) {
+      glUniform1i(compactLocation, 0);
+      glDisableVertexAttribArray(1);
+    }
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glDisableClientState(GL_NORMAL_ARRAY);
@@ -437,16 +1505,160 @@ namespace Terrain {
 
 
 
-  bool CRasterTerrainModel::LoadHierarchy(Patch* node, bool compress, FILE* fp) {
+  void CRasterTerrainModel::FallBackToFullVertices(Patch* patch) const 
+  {
+    //the next updates commit the patches with full vertices as well, until the vertex format is set again
+    mCompactFallback = true;
+    patch->Release();
+    patch->Commit(false, mCommitVertices, mCommitHeights);
+  }
+
+
+
+  void CRasterTerrainModel::BindPatchVertices(Patch* patch, UniformLocations const & uniforms, bool normals) const 
+  {
+    if (patch->state->compactbuf && uniforms.compactPatch == -1)
+      FallBackToFullVertices(patch);
+
+    if (patch->state->compactbuf) {
+      glUniform1i(uniforms.compactPatch, 1);
+      glUniform3f(uniforms.patchMin, patch->bbmin.x, patch->bbmin.y, patch->bbmin.z);
+      glUniform3f(uniforms.patchMax, patch->bbmax.x, patch->bbmax.y, patch->bbmax.z);
+      glBindBuffer(GL_ARRAY_BUFFER, mCompactGridVBO);
+      glVertexPointer(2, GL_SHORT, 0, 0);
+      if (normals) glDisableClientState(GL_NORMAL_ARRAY);
+      glBindBuffer(GL_ARRAY_BUFFER, patch->state->glbuf);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, 0, 0);
+    }
+    else {
+      if (uniforms.compactPatch != -1) {
+        glUniform1i(uniforms.compactPatch, 0);
+        glDisableVertexAttribArray(1);
+      }
+      glBindBuffer(GL_ARRAY_BUFFER, patch->state->glbuf);
+      glVertexPointer(3, GL_FLOAT, sizeof(CRasterTerrainModel::Vertex), 0);
+      if (normals) {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, sizeof(CRasterTerrainModel::Vertex), (void*)12);
+      }
+    }
+  }
+
 
-    static const char LOADING_CHARS[] = {'|', '/', '-', '\\' };
-    static int CUR_CHAR = 0;
 
-    static std::vector<glm::half>	readbuf;
+  bool CRasterTerrainModel::RenderTessellated(UniformLocations const & uniforms) const 
+  {
+    //the evaluation shader reads full vertices
+    if (mTessPatchIBO == 0 || mVertexFormat == CompactHeight) return false;
+
+    //the tessellation stages are part of the bound program
+    GLint patchInfoLocation = uniforms.tessPatchInfo;
+    GLint edgeLevelsLocation = uniforms.tessEdgeLevels;
+    if (patchInfoLocation == -1 || edgeLevelsLocation == -1) return false;
+
+    glUniform3f(uniforms.tessViewPosition, mViewPosition.x, mViewPosition.y, mViewPosition.z);
+    glUniform1i(uniforms.patchVertices, 3);
+
+    //the triangle count of the previous frame is read back without stalling the pipeline
+    GLuint available = 0;
+    glGetQueryObjectuiv(mTessQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      glGetQueryObjectuiv(mTessQuery, GL_QUERY_RESULT, &mNumberOfRenderedTriangles);
+    }
+
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_POLYGON_OFFSET_LINE);
+    glPolygonOffset(1.0, 1.0);
+
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, mTessVertexTexture);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mTessPatchIBO);
+
+    glm::uint quadsPerEdge = mPatchSize / mTessQuadSize;
+    glBeginQuery(GL_PRIMITIVES_GENERATED, mTessQuery);
+
+    std::vector<Patch*>::const_iterator itr, itre = mActivePatches.end();
+    for (itr = mActivePatches.begin(); itr != itre; ++itr) {
+      Patch* p = (*itr);
+      if (p->state->compactbuf) continue;
+
+      //edges towards a coarser neighbor are decimated like the stitching index buffers (south, east, north, west)
+      uint hlv = p->neigbor[0] ? p->neigbor[0]->state->tessLevel : 0;
+      uint vlv = p->neigbor[1] ? p->neigbor[1]->state->tessLevel : 0;
+      uint cid = p->GetCIndex();
+      float edgeLevels[4] = {float(mTessQuadSize), float(mTessQuadSize), float(mTessQuadSize), float(mTessQuadSize)};
+      edgeLevels[(cid < 2) ? 0 : 2] = static_cast<float>(glm::max(mTessQuadSize >> hlv, 1u));
+      edgeLevels[(cid & 1) ? 1 : 3] = static_cast<float>(glm::max(mTessQuadSize >> vlv, 1u));
+
+      glUniform4f(patchInfoLocation, static_cast<float>(mPatchSize), static_cast<float>(mTessQuadSize), p->error, mViewTerm);
+      glUniform4f(edgeLevelsLocation, edgeLevels[0], edgeLevels[1], edgeLevels[2], edgeLevels[3]);
+
+      glBindBuffer(GL_ARRAY_BUFFER, p->state->glbuf);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, p->state->glbuf);
+      glVertexPointer(3, GL_FLOAT, sizeof(CRasterTerrainModel::Vertex), 0);
+      glDrawElements(GL_PATCHES, static_cast<GLsizei>(quadsPerEdge*quadsPerEdge*4), GL_UNSIGNED_INT, 0);
+    }
+
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glDisable(GL_POLYGON_OFFSET_LINE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    return true;
+  }
+
+
+
+  CRasterTerrainModel::UniformLocations const & CRasterTerrainModel::GetUniformLocations() const 
+  {
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    if (mUniforms.program == static_cast<GLuint>(program) && program != 0)
+      return mUniforms;
+
+    //without a program all uniforms are missing
+    GLuint id = static_cast<GLuint>(program);
+    mUniforms.program          = id;
+    mUniforms.compactPatch     = id ? glGetUniformLocation(id, "compactPatch") : -1;
+    mUniforms.patchMin         = id ? glGetUniformLocation(id, "patchMin") : -1;
+    mUniforms.patchMax         = id ? glGetUniformLocation(id, "patchMax") : -1;
+    mUniforms.patchSize        = id ? glGetUniformLocation(id, "patchSize") : -1;
+    mUniforms.tessPatchInfo    = id ? glGetUniformLocation(id, "tessPatchInfo") : -1;
+    mUniforms.tessEdgeLevels   = id ? glGetUniformLocation(id, "tessEdgeLevels") : -1;
+    mUniforms.tessViewPosition = id ? glGetUniformLocation(id, "tessViewPosition") : -1;
+    mUniforms.patchVertices    = id ? glGetUniformLocation(id, "patchVertices") : -1;
+    return mUniforms;
+  }
+
+
+
+  CRasterTerrainModel::Patch* CRasterTerrainModel::CreatePatch(Patch* parent) 
+  {
+    //the render thread may use the states of the preview, while the loader adds patches
+    mPatchStates.push_back(PatchState());
+    return new Patch(parent, &mPatchStates.back());
+  }
+
+
+
+  bool CRasterTerrainModel::LoadHierarchy(Patch* node, glm::uint encoding, FILE* fp) {
+
+    std::vector<Vertex>	vertices;
 
-    glm::vec3 extent;
     glm::uint count, cmask;
 
+    if (IsLoadingCancelled()) {
+      std::cerr << "terrain loading cancelled!" << std::endl;
+      return false;
+    }
+    SetLoadingProgress(0.9f * static_cast<float>(_ftelli64(fp)) / static_cast<float>(glm::max(mFileSize, 1LL)));
+
     //read label
     fread(&node->label, sizeof(glm::uint), 1, fp);
     
@@ -460,23 +1672,37 @@ namespace Terrain {
     fread(&node->error, sizeof(float), 1, fp);
 
     //read vertex data
-    if (compress) {
+    if (Rlod::IsDeltaEncoding(encoding)) {
+      //keep the residual stream, it is decoded on the worker pool after the parent
+      glm::uint size;
+      fread(&node->zcount, sizeof(glm::uint), 1, fp);
+      fread(&node->zsize, sizeof(glm::uint), 1, fp);
+      size = node->zsize;
+      if (Rlod::IsDeflatedEncoding(encoding))
+        fread(&size, sizeof(glm::uint), 1, fp);
+      node->zencoding = encoding;
+      node->zbuf.resize(size);
+      fread(node->zbuf.data(), 1, size, fp);
+    }
+    else if (Rlod::IsDeflatedEncoding(encoding)) {
+      //keep the deflated bytes, they are inflated on the worker pool
+      glm::uint size;
+      fread(&node->zcount, sizeof(glm::uint), 1, fp);
+      fread(&size, sizeof(glm::uint), 1, fp);
+      node->zencoding = encoding;
+      node->zsize = node->zcount * static_cast<glm::uint>(Rlod::IsHalfEncoding(encoding) ? sizeof(glm::half) : sizeof(Vertex));
+      node->zbuf.resize(size);
+      fread(node->zbuf.data(), 1, size, fp);
+    }
+    else if (Rlod::IsHalfEncoding(encoding)) {
       fread(&count, sizeof(glm::uint), 1, fp);
-      readbuf.resize(count);
-      fread(readbuf.data(), sizeof(glm::half), count, fp);
+      node->payload = HalfPayload;
+      node->qbuf.resize(count);
+      fread(node->qbuf.data(), sizeof(glm::half), count, fp);
     
-      //decompress
-      extent = node->bbmax - node->bbmin;
-      node->vbuf.reserve(count/6);
-      for (uint i=0; i < readbuf.size(); i+=6) {
-        Vertex v;
-        v.p.x = node->bbmin.x + extent.x*static_cast<float>(readbuf[i]);
-        v.p.y = (node->bbmin.y + extent.y*static_cast<float>(readbuf[i + 1]));
-        v.p.z = (node->bbmin.z + extent.z* static_cast<float>(readbuf[i + 2])); 
-        v.n.x = (2.f*static_cast<float>(readbuf[i + 3]) - 1.f);
-        v.n.y = (2.f*static_cast<float>(readbuf[i + 4]) - 1.f);
-        v.n.z = (2.f*static_cast<float>(readbuf[i + 5]) - 1.f);
-        node->vbuf.push_back(v);
+      //decompress, if the payload is kept in another format
+      if (mPayloadFormat != HalfPayload) {
+        node->SetVertices(node->GetVertices(vertices), mPayloadFormat);
       }
     }
     else {
@@ -493,18 +1719,30 @@ namespace Terrain {
         iter->n.z = vertex.n.z;
 
       }
+
+      if (mPayloadFormat != FloatPayload) {
+        vertices.swap(node->vbuf);
+        node->SetVertices(vertices, mPayloadFormat);
+      }
     }
 
     //read child mask
     fread(&cmask, sizeof(glm::uint), 1, fp);
     node->child_mask = cmask;
 
+    //the root is shown as a preview, while the childs are read
+    if (node == mRoot) {
+      if (!node->Inflate(mPayloadFormat, mDeltaCodec))
+        return false;
+      PublishPreview();
+    }
+
     //read childs
     for (glm::uint i=0; i < 4; ++i) {
       Patch* p = nullptr;
       if (cmask & (1 << i)) {
-        p = new Patch(node);
-        if (!LoadHierarchy(p, compress, fp))
+        p = CreatePatch(node);
+        if (!LoadHierarchy(p, encoding, fp))
           return false;
       }
       node->childs[i] = p;
@@ -516,9 +1754,6 @@ namespace Terrain {
       return false;
     }
 
-    CUR_CHAR = (CUR_CHAR+1) % 4;
-    //std::cout << "\r\treading patch hierarchy " << LOADING_CHARS[CUR_CHAR];
-
     return true;
   }
 
@@ -527,23 +1762,23 @@ namespace Terrain {
   void CRasterTerrainModel::AssignChildNeighbors(Patch* patch) {
 
     if (patch->childs[0]) {
-      patch->childs[0]->neigbor[0] = NavigateFSM(patch->childs[0], SOUTH);
-      patch->childs[0]->neigbor[1] = NavigateFSM(patch->childs[0], WEST);
+      patch->childs[0]->neigbor[0] = NavigateFSM(patch->childs[0], SOUTH, mBorderRoots);
+      patch->childs[0]->neigbor[1] = NavigateFSM(patch->childs[0], WEST, mBorderRoots);
       AssignChildNeighbors(patch->childs[0]);
     }
     if (patch->childs[1]) {
-      patch->childs[1]->neigbor[0] = NavigateFSM(patch->childs[1], SOUTH);
-      patch->childs[1]->neigbor[1] = NavigateFSM(patch->childs[1], EAST);
+      patch->childs[1]->neigbor[0] = NavigateFSM(patch->childs[1], SOUTH, mBorderRoots);
+      patch->childs[1]->neigbor[1] = NavigateFSM(patch->childs[1], EAST, mBorderRoots);
       AssignChildNeighbors(patch->childs[1]);
     }
     if (patch->childs[2]) {
-      patch->childs[2]->neigbor[0] = NavigateFSM(patch->childs[2], NORTH);
-      patch->childs[2]->neigbor[1] = NavigateFSM(patch->childs[2], WEST);
+      patch->childs[2]->neigbor[0] = NavigateFSM(patch->childs[2], NORTH, mBorderRoots);
+      patch->childs[2]->neigbor[1] = NavigateFSM(patch->childs[2], WEST, mBorderRoots);
       AssignChildNeighbors(patch->childs[2]);
     }
     if (patch->childs[3]) {
-      patch->childs[3]->neigbor[0] = NavigateFSM(patch->childs[3], NORTH);
-      patch->childs[3]->neigbor[1] = NavigateFSM(patch->childs[3], EAST);
+      patch->childs[3]->neigbor[0] = NavigateFSM(patch->childs[3], NORTH, mBorderRoots);
+      patch->childs[3]->neigbor[1] = NavigateFSM(patch->childs[3], EAST, mBorderRoots);
       AssignChildNeighbors(patch->childs[3]);
     }
   }
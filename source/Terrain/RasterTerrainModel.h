@@ -4,10 +4,14 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <mutex>
+#include <functional>
+#include <deque>
 #include "ViewFrustum.h"
 #include "ErrorMetric.h"
 #include <GL/glew.h>
 #include "TerrainModel.h"
+#include "HeightDeltaCodec.h"
 
 
 class GLUtils::CViewFrustum;
@@ -19,32 +23,98 @@ namespace Terrain {
   {
   public:
     typedef std::vector<uint>		IndexBuffer;
+
+    //how the active patches are submitted to the gpu
+    enum RenderMode {
+      TriangleStrips,         //precomputed stitching index buffers
+      HardwareTessellation    //coarse quads as GL_PATCHES, refined by the tessellation stages of the bound program
+    };
+
+    //how the patch vertices are kept in RAM
+    enum PayloadFormat {
+      FloatPayload,           //position and normal as floats (24 bytes)
+      HalfPayload,            //position relative to the bounds and normal as half floats (12 bytes)
+      QuantizedPayload        //16 bit position relative to the bounds and octahedral normal (8 bytes)
+    };
+
+    //how the patch vertices are stored on the gpu
+    enum VertexFormat {
+      FullVertex,             //position and normal as floats (24 bytes)
+      CompactHeight           //normalized 16 bit height, x/y are reconstructed from the vertex id (2 bytes)
+    };
+
+    //borders of the terrain (same order as the neighbor directions of the patches)
+    enum Border {
+      SouthBorder,
+      EastBorder,
+      NorthBorder,
+      WestBorder
+    };
+
     struct Vertex {
       glm::vec3 p;
       glm::vec3 n;
     };
 
+    //height modification, gets the ground position and the height of a sample and returns the new height. it is called
+    //concurrently for the samples
+    typedef std::function<float(glm::vec2 const & position, float height)> HeightEdit;
+
+    //per frame state of a patch, only used by the render thread. it is kept apart from the geometry and bounds of the
+    //patches, which do not change while the cut is updated, so queries on other threads never share a written field
+    struct PatchState {
+      glm::uint				glbuf;
+      bool					compactbuf;		//glbuf contains the heights only
+      uint					tessLevel;
+
+      PatchState() : glbuf(0), compactbuf(false), tessLevel(0) {}
+    };
+
     struct Patch {
       //patch properties
       uint					label;
       glm::vec3				bbmin;
       glm::vec3				bbmax;
       float 					error;
-      std::vector<Vertex>		vbuf;
+      std::vector<Vertex>		vbuf;		//vertices (float payload)
+      std::vector<unsigned short>	qbuf;	//encoded vertices (half and quantized payload)
+      PayloadFormat			payload;
       Patch* 					parent;
       uint					child_mask;
       Patch*					childs[4];
       Patch*					neigbor[2];
-      glm::uint				glbuf;
-      uint					tessLevel;
+      PatchState*				state;			//in the state array of the model
+      std::vector<unsigned char>	zbuf;	//deflated or delta coded payload of the rlod file, until the patch is inflated
+      uint					zcount;			//element count of the payload
+      uint					zsize;			//size of the inflated payload in bytes
+      uint					zencoding;		//encoding of the payload (see RlodFormat.h)
+      std::vector<int>		hbuf;			//quantised heights of delta coded patches, the childs are predicted from them
+      bool					corrupt;		//the payload could not be inflated, it stays deflated and the patch is not drawn
 
-      Patch(Patch* p);
+      Patch(Patch* p, PatchState* s);
       ~Patch();
 
+      //sets the vertices, which are encoded in the given payload format
+      void SetVertices(std::vector<Vertex> const & vertices, PayloadFormat format);
+      //gets the vertices, quantised payloads are decoded into the provided buffer
+      std::vector<Vertex> const & GetVertices(std::vector<Vertex> & buffer) const;
+      //gets the number of bytes of the payload in RAM
+      size_t GetPayloadSize() const;
+      //gets the number of inflated vertices
+      size_t GetVertexCount() const;
+      //gets if the payload is still deflated
+      bool IsDeflated() const {return !zbuf.empty();}
+      //inflates the payload and keeps it in the given format. touches this patch only (and reads the heights of
+      //the parent for delta coded payloads), so distinct patches can be inflated concurrently
+      bool Inflate(PayloadFormat format, CHeightDeltaCodec const & codec);
+      //decodes the deflated payload into float vertices without inflating the patch, delta coded payloads are predicted from
+      //the heights of the parent and get their heights (the predictions of the childs)
+      bool Decode(CHeightDeltaCodec const & codec, int const * parentHeights, std::vector<Vertex> & vertices, std::vector<int> & heights) const;
+
       //gets if the patch is commited to GPU
-      bool IsCommited() const {return glbuf != 0;}
-      //commit data to gpu
-      void Commit();
+      bool IsCommited() const {return state->glbuf != 0;}
+      //commit data to gpu (compact uploads the heights only), the buffers are scratch space of the model
+      void Commit(bool compact, std::vector<Vertex> & vertexBuffer, std::vector<unsigned short> & heights);
       //release gpu data of patch and there childs
       void Release();
       //release gpu data of child patches (recursive)
@@ -54,13 +124,13 @@ namespace Terrain {
         return label;
       }
       void propagateTessLevel(uint l) {
-        tessLevel = l;
+        state->tessLevel = l;
         for (int i=0; i < 4; ++i)
           if (childs[i])
             childs[i]->propagateTessLevel(l+1);
       }
       //gets index of child node in the parent
-      int GetCIndex() {
+      int GetCIndex() const {
         return (label-1) & 0x03;
       }
 
@@ -91,27 +161,139 @@ namespace Terrain {
     TERRAIN_API virtual void RenderOutline() const override;
     //render all bounds
     TERRAIN_API virtual void RenderBounds() const override;
+
+    //set how the patches are rendered. hardware tessellation needs a bound program with tessellation stages
+    //(see shader/viewer/tessellation.glsl), else the stitching index buffers are used
+    TERRAIN_API void SetRenderMode(RenderMode mode) {mRenderMode = mode;}
+    TERRAIN_API RenderMode GetRenderMode() const {return mRenderMode;}
+
+    //set the vertex format of the gpu buffers. the compact format needs a regular patch grid and a bound program, which
+    //reconstructs the vertices (see shader/viewer/shader.glsl), else the patches are committed with full vertices once.
+    //returns false if the format is not supported
+    TERRAIN_API bool SetVertexFormat(VertexFormat format);
+    TERRAIN_API VertexFormat GetVertexFormat() const {return mVertexFormat;}
+
+    //set how the patch payloads are kept in RAM, has to be called before Init
+    TERRAIN_API void SetPayloadFormat(PayloadFormat format) {mPayloadFormat = format;}
+    TERRAIN_API PayloadFormat GetPayloadFormat() const {return mPayloadFormat;}
+
+    //set if the stitching strips are converted to vertex cache optimized triangle lists at load time, has to be called before Init.
+    //files written by the index-optimize tool already contain optimized lists
+    TERRAIN_API void SetIndexOptimization(bool optimize) {mIndexOptimization = optimize;}
+    TERRAIN_API bool GetIndexOptimization() const {return mIndexOptimization;}
+
+    //set if deflated payloads are inflated when a patch gets active instead of at load time, has to be called before Init
+    TERRAIN_API void SetInflateOnDemand(bool onDemand) {mInflateOnDemand = onDemand;}
+    TERRAIN_API bool GetInflateOnDemand() const {return mInflateOnDemand;}
+
+    //links the patches along a border to the adjacent terrain (or unlinks them with nullptr), so the edges are stitched
+    //against the level of detail of the neighbor. both terrains need the same patch size and hierarchy depth
+    TERRAIN_API void SetBorderNeighbor(Border border, CRasterTerrainModel const * neighbor);
+
+    //gets the number of bytes of all patch payloads in RAM
+    TERRAIN_API size_t GetMemoryUsage() const;
+
+    //applies the edit to the height samples in the ground rectangle [min, max] and rebuilds the patches around it. the edit
+    //runs on the render thread and must not overlap QueryRegion, which reads the patches changed in place. the pyramid is
+    //edited as a copy, which replaces the queried one
+    TERRAIN_API bool EditHeights(glm::vec2 const & min, glm::vec2 const & max, HeightEdit const & edit);
+    //stream the patches covering the polygon, the triangles of the first stitching buffer are clipped if requested. the
+    //payloads are read, so with inflate on demand the query has to run on the render thread (deflated patches have no triangles)
+    TERRAIN_API virtual bool QueryRegion(RegionQuery const & query, RegionCallback const & callback) const override;
+
+    //lowers a bowl of the radius, which is depth deep at the center
+    TERRAIN_API bool AddCrater(glm::vec2 const & center, float radius, float depth);
+    //flattens the rectangle to the height and blends it into the terrain around it over the margin (e.g. for runways)
+    TERRAIN_API bool Flatten(glm::vec2 const & min, glm::vec2 const & max, float height, float margin);
   private:
+    //uniforms of a terrain program, -1 if the program does not use them
+    struct UniformLocations {
+      GLuint		program;
+      GLint		compactPatch;
+      GLint		patchMin;
+      GLint		patchMax;
+      GLint		patchSize;
+      GLint		tessPatchInfo;
+      GLint		tessEdgeLevels;
+      GLint		tessViewPosition;
+      GLint		patchVertices;
+    };
+
     CRasterTerrainModel(CRasterTerrainModel const & rhs);             //forbidden
     CRasterTerrainModel & operator=(CRasterTerrainModel const & rhs); //forbidden
 
     void InitGLResources();
+    //frees the patches and the tessellation buffers in RAM, the gl objects are handed over to the render thread. the loader
+    //calls it when the loading fails, the gl objects of the preview were created by the render thread
+    void ClearHierarchy();
+    //deletes the gl objects handed over by ClearHierarchy, has to be called on the render thread
+    void DeleteReleasedGLObjects();
     void UpdateBoundingBox(glm::vec3 const & point);
 
     bool LoadTerrainProperties(FILE* fp);
-    bool LoadHierarchy(Patch* node, bool compress, FILE* fp);
+    bool LoadHierarchy(Patch* node, glm::uint encoding, FILE* fp);
+    //inflates the given patches (and deflated delta coded ancestors) on the worker pool, parents before childs
+    bool InflatePatches(std::vector<Patch*> patches);
+    //builds the height pyramid from the finest patches, deflated ones are decoded for it
+    void BuildHeightPyramid();
+    //sets the vertices, normals, bounds and error of an edited patch from the samples of the height pyramid, the childs
+    //have to be updated before
+    void UpdateEditedPatch(Patch* patch, CHeightPyramid const & pyramid);
+    //creates a patch with a new state
+    Patch* CreatePatch(Patch* parent);
     void AssignChildNeighbors(Patch* patch);
     void RecursiveUpdate(Patch* p, CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum);
+    //renders the active patches as GL_PATCHES, returns false if the bound program has no tessellation stages
+    bool RenderTessellated(UniformLocations const & uniforms) const;
+    //gets the uniforms of the bound program, they are looked up again when another program is bound
+    UniformLocations const & GetUniformLocations() const;
+    //commits a compact patch again with full vertices, once a bound program can not reconstruct its vertices
+    void FallBackToFullVertices(Patch* patch) const;
+    //sets the vertex arrays of the patch, compact patches are set up for the bound program
+    void BindPatchVertices(Patch* patch, UniformLocations const & uniforms, bool normals) const;
+    //locks the preview while the hierarchy is loaded asynchronously, returns false if there is nothing to update or render
+    bool LockPreview(std::unique_lock<std::mutex> & lock) const;
 
 
     Patch* mRoot;
+    Patch* mBorderRoots[4];		//roots of the adjacent terrains
     std::vector<Patch*> mActivePatches;
+    std::deque<PatchState> mPatchStates;	//of all patches, the addresses stay valid while patches are added
     
     std::vector<IndexBuffer>	mTessellationIBufs;
     std::vector<GLuint>			mTessellationIBOs;
     glm::uint					mOutlineIBO;
+    bool						mIndexOptimization;
+    GLenum						mTessellationPrimitive;	//triangle strips or lists
+    GLenum						mTessellationIndexType;	//16 or 32 bit indices on the gpu
     glm::uint					mPatchSize;
     glm::uint					mTessLevels;
+    PayloadFormat				mPayloadFormat;
+    bool						mInflateOnDemand;
+    CHeightDeltaCodec			mDeltaCodec;		//codec of delta coded files
+    long long					mFileSize;			//size of the loaded file (for the loading progress)
+    mutable std::mutex			mPreviewMutex;		//held by the render thread while it uses the preview, the loader takes it to revoke the preview
+    std::vector<GLuint>			mReleasedBuffers;	//gl objects of a cleared hierarchy, deleted by the render thread (guarded by the preview mutex)
+    std::vector<GLuint>			mReleasedTextures;
+    std::vector<GLuint>			mReleasedQueries;
+    mutable std::vector<Vertex>	mCommitVertices;	//scratch buffers of the commits on the render thread
+    mutable std::vector<unsigned short>	mCommitHeights;
+
+    //hardware tessellation
+    RenderMode					mRenderMode;
+    glm::uint					mTessQuadSize;		//vertices per edge of one tessellation patch
+    glm::uint					mTessPatchIBO;		//control points of the coarse quad grid (shared by all patches)
+    glm::uint					mTessVertexTexture;	//texture buffer exposing the patch vertices to the evaluation shader
+    mutable glm::uint			mTessQuery;			//counts the generated triangles
+
+    //compact vertex format
+    VertexFormat				mVertexFormat;
+    bool						mRegularGrid;		//all patches are regular grids spanning their bounds
+    glm::uint					mCompactGridVBO;	//shared vertex array, only used to provoke the vertices
+    mutable bool				mCompactFallback;	//a bound program could not reconstruct compact patches, they are committed with full vertices
+    mutable UniformLocations	mUniforms;			//of the last bound program
+    glm::vec3					mViewPosition;		//view position of the last update
+    float						mViewTerm;			//view term of the last update
   };
 
 
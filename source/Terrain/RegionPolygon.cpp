@@ -0,0 +1,221 @@
+#include "TerrainPrecompiled.h"
+#include "RegionPolygon.h"
+
+#include <cfloat>
+#include <algorithm>
+
+namespace Terrain {
+
+  //twice the signed area of the triangle, positive if counter clockwise
+  static float Cross(glm::vec2 const & a, glm::vec2 const & b, glm::vec2 const & c)
+  {
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  }
+
+
+
+  //gets if the point lies inside or on the border of the counter clockwise triangle
+  static bool InTriangle(glm::vec2 const & p, glm::vec2 const & a, glm::vec2 const & b, glm::vec2 const & c)
+  {
+    return Cross(a, b, p) >= 0.f && Cross(b, c, p) >= 0.f && Cross(c, a, p) >= 0.f;
+  }
+
+
+
+  //gets if the segment touches the rectangle (liang-barsky clipping of the segment)
+  static bool SegmentIntersectsRect(glm::vec2 const & p, glm::vec2 const & q, glm::vec2 const & min, glm::vec2 const & max)
+  {
+    glm::vec2 d = q - p;
+    float t0 = 0.f;
+    float t1 = 1.f;
+    for (int axis=0; axis < 2; ++axis) {
+      if (d[axis] == 0.f) {
+        if (p[axis] < min[axis] || p[axis] > max[axis])
+          return false;
+        continue;
+      }
+      float ta = (min[axis] - p[axis]) / d[axis];
+      float tb = (max[axis] - p[axis]) / d[axis];
+      t0 = glm::max(t0, glm::min(ta, tb));
+      t1 = glm::min(t1, glm::max(ta, tb));
+      if (t0 > t1)
+        return false;
+    }
+    return true;
+  }
+
+
+
+  CRegionPolygon::CRegionPolygon()
+    : mMin(FLT_MAX)
+    , mMax(-FLT_MAX)
+  {
+  }
+
+
+
+  bool CRegionPolygon::Init(std::vector<glm::vec2> const & points)
+  {
+    mPoints.clear();
+    mTriangles.clear();
+    mMin = glm::vec2(FLT_MAX);
+    mMax = glm::vec2(-FLT_MAX);
+
+    //repeated points (and the closing point) are dropped
+    for (auto iter = points.begin(); iter != points.end(); ++iter) {
+      if (mPoints.empty() || *iter != mPoints.back())
+        mPoints.push_back(*iter);
+    }
+    while (mPoints.size() > 1 && mPoints.front() == mPoints.back())
+      mPoints.pop_back();
+    if (mPoints.size() < 3)
+      return false;
+
+    float area = 0.f;
+    for (size_t i=0, j=mPoints.size() - 1; i < mPoints.size(); j = i++)
+      area += mPoints[j].x * mPoints[i].y - mPoints[i].x * mPoints[j].y;
+    if (area == 0.f)
+      return false;
+    if (area < 0.f)
+      std::reverse(mPoints.begin(), mPoints.end());
+
+    for (auto iter = mPoints.begin(); iter != mPoints.end(); ++iter) {
+      mMin = glm::min(mMin, *iter);
+      mMax = glm::max(mMax, *iter);
+    }
+
+    //ear clipping: a convex corner without other corners in its triangle is cut off
+    std::vector<size_t> corners(mPoints.size());
+    for (size_t i=0; i < corners.size(); ++i)
+      corners[i] = i;
+
+    while (corners.size() > 3) {
+      size_t n = corners.size();
+      bool cut = false;
+      for (size_t i=0; i < n && !cut; ++i) {
+        glm::vec2 const & a = mPoints[corners[(i + n - 1) % n]];
+        glm::vec2 const & b = mPoints[corners[i]];
+        glm::vec2 const & c = mPoints[corners[(i + 1) % n]];
+        float cross = Cross(a, b, c);
+        if (cross < 0.f)
+          continue;
+
+        //collinear corners are dropped without a triangle
+        bool ear = true;
+        for (size_t j=0; j < n && ear && cross > 0.f; ++j) {
+          glm::vec2 const & p = mPoints[corners[j]];
+          if (p != a && p != b && p != c && InTriangle(p, a, b, c))
+            ear = false;
+        }
+        if (!ear)
+          continue;
+
+        if (cross > 0.f) {
+          mTriangles.push_back(a);
+          mTriangles.push_back(b);
+          mTriangles.push_back(c);
+        }
+        corners.erase(corners.begin() + i);
+        cut = true;
+      }
+
+      //self intersecting polygon
+      if (!cut) {
+        mTriangles.clear();
+        return false;
+      }
+    }
+
+    if (Cross(mPoints[corners[0]], mPoints[corners[1]], mPoints[corners[2]]) > 0.f) {
+      for (int i=0; i < 3; ++i)
+        mTriangles.push_back(mPoints[corners[i]]);
+    }
+    return !mTriangles.empty();
+  }
+
+
+
+  bool CRegionPolygon::Contains(glm::vec2 const & point) const
+  {
+    bool inside = false;
+    for (size_t i=0, j=mPoints.size() - 1; i < mPoints.size(); j = i++) {
+      glm::vec2 const & p = mPoints[i];
+      glm::vec2 const & q = mPoints[j];
+      if ((p.y > point.y) != (q.y > point.y) && point.x < p.x + (point.y - p.y) * (q.x - p.x) / (q.y - p.y))
+        inside = !inside;
+    }
+    return inside;
+  }
+
+
+
+  CRegionPolygon::Overlap CRegionPolygon::Classify(glm::vec2 const & min, glm::vec2 const & max) const
+  {
+    if (mPoints.empty() || min.x > mMax.x || min.y > mMax.y || max.x < mMin.x || max.y < mMin.y)
+      return Outside;
+
+    for (size_t i=0, j=mPoints.size() - 1; i < mPoints.size(); j = i++) {
+      if (SegmentIntersectsRect(mPoints[j], mPoints[i], min, max))
+        return Intersecting;
+    }
+
+    //no border passes the rectangle, so it is inside or outside as a whole, or contains the whole polygon
+    if (Contains((min + max) * 0.5f))
+      return Inside;
+    glm::vec2 const & p = mPoints.front();
+    if (p.x >= min.x && p.y >= min.y && p.x <= max.x && p.y <= max.y)
+      return Intersecting;
+    return Outside;
+  }
+
+
+
+  void CRegionPolygon::ClipTriangle(glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c, std::vector<glm::vec3> & triangles) const
+  {
+    glm::vec2 min = glm::min(glm::min(glm::vec2(a), glm::vec2(b)), glm::vec2(c));
+    glm::vec2 max = glm::max(glm::max(glm::vec2(a), glm::vec2(b)), glm::vec2(c));
+
+    //the triangle clipped by three edges has at most six corners
+    glm::vec3 buffers[2][6];
+    for (size_t t=0; t < mTriangles.size(); t += 3) {
+      glm::vec2 const * ear = &mTriangles[t];
+      glm::vec2 earMin = glm::min(glm::min(ear[0], ear[1]), ear[2]);
+      glm::vec2 earMax = glm::max(glm::max(ear[0], ear[1]), ear[2]);
+      if (earMin.x > max.x || earMin.y > max.y || earMax.x < min.x || earMax.y < min.y)
+        continue;
+
+      //sutherland-hodgman against the edges of the ear, the inside is left of them
+      glm::vec3* polygon = buffers[0];
+      polygon[0] = a;
+      polygon[1] = b;
+      polygon[2] = c;
+      int count = 3;
+      for (int edge=0; edge < 3 && count > 0; ++edge) {
+        glm::vec2 const & e0 = ear[edge];
+        glm::vec2 const & e1 = ear[(edge + 1) % 3];
+        glm::vec3* clipped = (polygon == buffers[0]) ? buffers[1] : buffers[0];
+        int clippedCount = 0;
+        for (int i=0; i < count; ++i) {
+          glm::vec3 const & s = polygon[(i + count - 1) % count];
+          glm::vec3 const & e = polygon[i];
+          float ds = Cross(e0, e1, glm::vec2(s));
+          float de = Cross(e0, e1, glm::vec2(e));
+          if ((ds >= 0.f) != (de >= 0.f) && clippedCount < 6)
+            clipped[clippedCount++] = s + (e - s) * (ds / (ds - de));
+          if (de >= 0.f && clippedCount < 6)
+            clipped[clippedCount++] = e;
+        }
+        polygon = clipped;
+        count = clippedCount;
+      }
+
+      for (int i=2; i < count; ++i) {
+        triangles.push_back(polygon[0]);
+        triangles.push_back(polygon[i - 1]);
+        triangles.push_back(polygon[i]);
+      }
+    }
+  }
+
+
+} //namespace Terrain
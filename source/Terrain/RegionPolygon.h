@@ -0,0 +1,74 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <functional>
+
+
+namespace Terrain {
+
+  //query of the patches covering a ground polygon (e.g. the terrain under an airport or airspace)
+  struct RegionQuery {
+    std::vector<glm::vec2> polygon;   //no self intersections, either orientation
+    float maxError;                   //largest geometric error of the delivered patches
+    bool clipTriangles;               //deliver the triangles of the patches clipped to the polygon
+
+    RegionQuery() : maxError(0.f), clipTriangles(false) {}
+  };
+
+  //patch delivered by a region query, it is reused for the next patch
+  struct RegionPatch {
+    unsigned int label;
+    int level;                        //depth in the quadtree
+    glm::vec3 bbmin;
+    glm::vec3 bbmax;
+    float error;
+    bool inside;                      //the patch lies inside the polygon, its triangles are not clipped
+    std::vector<glm::vec3> triangles; //three positions each, if requested
+
+    RegionPatch() : label(0), level(0), bbmin(0.f), bbmax(0.f), error(0.f), inside(false) {}
+  };
+
+  //gets the next patch of a region query, returns false to stop the query
+  typedef std::function<bool(RegionPatch const & patch)> RegionCallback;
+
+  //simple ground polygon of a region query.
+  //the polygon is split into triangles by ear clipping once, the terrain triangles are clipped against these convex
+  //pieces, so concave polygons (airspaces) are clipped exactly
+  class CRegionPolygon
+  {
+  public:
+    enum Overlap {
+      Outside,
+      Intersecting,     //the border of the polygon passes the rectangle, or the polygon lies inside it
+      Inside
+    };
+
+    TERRAIN_API CRegionPolygon();
+
+    //sets the polygon (no self intersections, either orientation), returns false if it has less than 3 points or no area
+    TERRAIN_API bool Init(std::vector<glm::vec2> const & points);
+
+    TERRAIN_API glm::vec2 const & GetMin() const {return mMin;}
+    TERRAIN_API glm::vec2 const & GetMax() const {return mMax;}
+    TERRAIN_API std::vector<glm::vec2> const & GetTriangles() const {return mTriangles;}
+
+    //gets if the point lies inside the polygon
+    TERRAIN_API bool Contains(glm::vec2 const & point) const;
+    //classifies the ground rectangle [min, max] against the polygon
+    TERRAIN_API Overlap Classify(glm::vec2 const & min, glm::vec2 const & max) const;
+    //clips the triangle on the ground and adds the triangles of the part inside the polygon (three positions each), the
+    //heights are interpolated in the plane of the triangle
+    TERRAIN_API void ClipTriangle(glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c, std::vector<glm::vec3> & triangles) const;
+
+  private:
+    std::vector<glm::vec2> mPoints;       //counter clockwise
+    std::vector<glm::vec2> mTriangles;    //ear triangles, counter clockwise, three points each
+    glm::vec2 mMin;
+    glm::vec2 mMax;
+  };
+
+
+} //namespace Terrain
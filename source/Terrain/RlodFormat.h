@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+
+namespace Terrain {
+  namespace Rlod {
+
+    //file signature of raster-lod files
+    static const char MAGIC[] = {'R','L','O','D'};
+
+    //encoding of the patch payloads (compress flag in the file header)
+    enum PayloadEncoding {
+      RawEncoding           = 0,    //uint count, count float vertices (position, normal)
+      HalfEncoding          = 1,    //uint count, count half floats (6 per vertex, relative to the patch bounds)
+      DeflatedRawEncoding   = 2,    //raw payload deflated per patch: uint count, uint compressed size, compressed bytes
+      DeflatedHalfEncoding  = 3,    //half payload deflated per patch, stored like the deflated raw payload
+      DeltaEncoding         = 4,    //quantised heights as residuals against the parent (see CHeightDeltaCodec):
+                                    //uint vertex count, uint stream size, residual stream
+      DeflatedDeltaEncoding = 5     //delta payload deflated per patch: uint vertex count, uint stream size, uint compressed size, compressed bytes
+    };
+    //delta coded files store the float quantisation step and float height origin behind the tessellation buffers
+
+    //the compress flag has this bit set, if the tessellation buffers are optimized triangle lists instead of triangle strips
+    static const glm::uint TriangleListFlag = 0x100;
+    //bits of the compress flag holding the payload encoding
+    static const glm::uint EncodingMask = 0xff;
+
+    //gets if the encoding is supported by the loader
+    inline bool IsKnownEncoding(glm::uint encoding) {
+      return encoding <= DeflatedDeltaEncoding;
+    }
+
+    //gets if the payload consists of half floats
+    inline bool IsHalfEncoding(glm::uint encoding) {
+      return encoding == HalfEncoding || encoding == DeflatedHalfEncoding;
+    }
+
+    //gets if every patch payload is deflated on its own
+    inline bool IsDeflatedEncoding(glm::uint encoding) {
+      return encoding == DeflatedRawEncoding || encoding == DeflatedHalfEncoding || encoding == DeflatedDeltaEncoding;
+    }
+
+    //gets if the patch heights are coded against the parent patch
+    inline bool IsDeltaEncoding(glm::uint encoding) {
+      return encoding == DeltaEncoding || encoding == DeflatedDeltaEncoding;
+    }
+
+  } //namespace Rlod
+} //namespace Terrain
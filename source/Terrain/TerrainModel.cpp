@@ -1,6 +1,209 @@
 #include "TerrainPrecompiled.h"
 #include "TerrainModel.h"
 
+#include <iostream>
+#include <algorithm>
+#include "ThreadPool.h"
 
 namespace Terrain {
+
+  void CTerrainModel::InitAsync(const char* file)
+  {
+    //a running loader is finished first, the model is initialized only once at a time
+    CancelLoading();
+
+    mCancelLoading = false;
+    mLoadingProgress = 0.f;
+    mLoadingTime = 0.0;
+    mLoadingStart = std::chrono::high_resolution_clock::now();
+    mLoadingState = Loading;
+
+    std::string path(file);
+    mLoader = std::thread([this, path]() {
+      bool success = Init(path.c_str());
+      mLoadingTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - mLoadingStart).count();
+      if (success) {
+        mLoadingProgress = 1.f;
+        std::cout << "loaded terrain " << path << " in " << mLoadingTime << "s!" << std::endl;
+      }
+      mLoadingState = success ? NotLoading : LoadingFailed;
+    });
+  }
+
+
+
+  bool CTerrainModel::WaitForLoading()
+  {
+    if (mLoader.joinable())
+      mLoader.join();
+    return GetLoadingState() != LoadingFailed;
+  }
+
+
+
+  void CTerrainModel::CancelLoading()
+  {
+    mCancelLoading = true;
+    WaitForLoading();
+    mCancelLoading = false;
+  }
+
+
+
+  double CTerrainModel::GetLoadingTime() const
+  {
+    if (IsLoading())
+      return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - mLoadingStart).count();
+    return mLoadingTime;
+  }
+
+
+
+  void CTerrainModel::SetHeightPyramid(std::unique_ptr<CHeightPyramid> pyramid)
+  {
+    CHeightPyramid* previous = mHeightPyramid.exchange(pyramid.release());
+    if (previous != nullptr)
+      mPyramidEpochs.Retire([previous]() { delete previous; });
+    mPyramidEpochs.Reclaim();
+  }
+
+
+
+  //rays of a batch cast by one task
+  static const size_t RAYS_PER_TASK = 64;
+
+  //spreads the lower 16 bits to the even bits
+  static glm::uint SpreadBits(glm::uint v)
+  {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  }
+
+
+
+  bool CTerrainModel::RayCast(Ray const & ray, RayHit & hit) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mPyramidEpochs);
+    CHeightPyramid const * pyramid = GetHeightPyramid();
+    if (pyramid == nullptr) {
+      hit = RayHit();
+      return false;
+    }
+    return pyramid->RayCast(ray, hit);
+  }
+
+
+
+  bool CTerrainModel::GetClearance(FlightCorridor const & corridor, ClearanceResult & result) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mPyramidEpochs);
+    CHeightPyramid const * pyramid = GetHeightPyramid();
+    if (pyramid == nullptr) {
+      result = ClearanceResult();
+      return false;
+    }
+    return pyramid->GetClearance(corridor, result);
+  }
+
+
+
+  bool CTerrainModel::GetProfileHeight(glm::vec2 const & position, float tolerance, int & level, float & height, float & error) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mPyramidEpochs);
+    CHeightPyramid const * pyramid = GetHeightPyramid();
+    if (pyramid == nullptr)
+      return false;
+    height = pyramid->GetHeight(position, tolerance, level, error);
+    return true;
+  }
+
+
+
+  bool CTerrainModel::GetProfile(ProfileRequest const & request, std::vector<ProfilePoint> & profile) const
+  {
+    profile.clear();
+    if (request.path.empty())
+      return false;
+
+    //every height is read from the coarsest pyramid level within the tolerance, starting at the level of the previous sample
+    int level = 0;
+    auto sample = [&](glm::vec2 const & position, float distance) -> bool {
+      ProfilePoint point;
+      point.distance = distance;
+      if (!GetProfileHeight(position, request.tolerance, level, point.position.z, point.error))
+        return false;
+      point.position = glm::vec3(position, point.position.z);
+      point.level = level;
+      profile.push_back(point);
+      return true;
+    };
+
+    //samples every spacing along the segments (or at their starts), the remainder of a segment carries over to the next one
+    float distance = 0.f;
+    float next = 0.f;
+    size_t samples = 0;
+    for (size_t s=0; s + 1 < request.path.size(); ++s) {
+      glm::vec2 const & a = request.path[s];
+      glm::vec2 const & b = request.path[s + 1];
+      float length = glm::distance(a, b);
+      while (next < distance + length) {
+        if (!sample(glm::mix(a, b, (next - distance) / length), next)) {
+          profile.clear();
+          return false;
+        }
+        ++samples;
+        next = (request.spacing > 0.f) ? samples * request.spacing : distance + length;
+      }
+      distance += length;
+    }
+
+    if (!sample(request.path.back(), distance)) {
+      profile.clear();
+      return false;
+    }
+    return true;
+  }
+
+
+
+  void CTerrainModel::GetProfiles(std::vector<ProfileRequest> const & requests, std::vector<std::vector<ProfilePoint>> & profiles) const
+  {
+    profiles.assign(requests.size(), std::vector<ProfilePoint>());
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, requests.size(), [&](size_t request) {
+      GetProfile(requests[request], profiles[request]);
+    });
+  }
+
+
+
+  void CTerrainModel::RayCastBatch(std::vector<Ray> const & rays, std::vector<RayHit> & hits) const
+  {
+    hits.assign(rays.size(), RayHit());
+
+    //the rays are ordered by the direction octant and the morton code of the origin on the ground, so the rays of one task
+    //traverse the same cells. the hits do not depend on the number of threads
+    glm::vec2 extent = glm::max(glm::vec2(mTerrainMax) - glm::vec2(mTerrainMin), glm::vec2(1e-6f));
+    std::vector<std::pair<unsigned long long, size_t>> order(rays.size());
+    for (size_t i=0; i < rays.size(); ++i) {
+      glm::vec2 cell = glm::clamp((glm::vec2(rays[i].origin) - glm::vec2(mTerrainMin)) / extent, 0.f, 1.f) * 65535.f;
+      glm::uint morton = SpreadBits(static_cast<glm::uint>(cell.x)) | (SpreadBits(static_cast<glm::uint>(cell.y)) << 1);
+      glm::uint octant = (rays[i].direction.x < 0.f ? 1 : 0) | (rays[i].direction.y < 0.f ? 2 : 0) | (rays[i].direction.z < 0.f ? 4 : 0);
+      order[i] = std::make_pair((static_cast<unsigned long long>(octant) << 32) | morton, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t tasks = (rays.size() + RAYS_PER_TASK - 1) / RAYS_PER_TASK;
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, tasks, [&](size_t task) {
+      size_t end = glm::min((task + 1) * RAYS_PER_TASK, rays.size());
+      for (size_t i = task * RAYS_PER_TASK; i < end; ++i) {
+        size_t ray = order[i].second;
+        RayCast(rays[ray], hits[ray]);
+      }
+    });
+  }
+
 }
\ No newline at end of file
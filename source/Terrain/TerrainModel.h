@@ -3,25 +3,56 @@
 #include "TerrainDefines.h"
 #include "ViewFrustum.h"
 #include "ErrorMetric.h"
+#include "HeightPyramid.h"
+#include "RegionPolygon.h"
+#include "EpochManager.h"
 
 #include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
 
 namespace Terrain {
   enum ModelType  
   {ChunkedLOD,
-   RasterModel
+   RasterModel,
+   ClipmapModel
+  };
+
+  enum LoadingState
+  {NotLoading,      //no asynchronous loading is running, the model is ready if it was initialized
+   Loading,         //the model is initialized on the loader thread, it must not be updated or rendered yet
+   PreviewLoading,  //the model is still initialized on the loader thread, but a coarse preview can be updated and rendered
+   LoadingFailed    //the asynchronous initialization failed
   };
 
   class CTerrainModel
   {
   public:
-    CTerrainModel(void) : mNumberOfRenderedTriangles(0), mNumberOfTriangles(0) {}
-    virtual ~CTerrainModel(void) {}
+    CTerrainModel(void) : mHeightPyramid(nullptr), mNumberOfRenderedTriangles(0), mNumberOfTriangles(0), mLoadingState(NotLoading), mLoadingProgress(0.f), mCancelLoading(false), mLoadingTime(0.0) {}
+    //derived models have to call CancelLoading in their destructor, the loader thread uses the derived model
+    virtual ~CTerrainModel(void) {delete mHeightPyramid.load();}
 
     //initialize the terrain model?    
     TERRAIN_API virtual bool Init(const char* hfcfile) = 0;
     //free all allocated resources?    
     TERRAIN_API virtual void Clear(void) = 0;
+
+    //initialize the terrain model on a loader thread, the call returns immediately.
+    //the model may only be updated and rendered, when the loading state is NotLoading (after a successful start) or PreviewLoading
+    TERRAIN_API void InitAsync(const char* file);
+    //wait for the loader thread, returns false if the asynchronous initialization failed
+    TERRAIN_API bool WaitForLoading();
+    //stop the loading as soon as possible and wait for the loader thread
+    TERRAIN_API void CancelLoading();
+    TERRAIN_API LoadingState GetLoadingState() const {return static_cast<LoadingState>(mLoadingState.load());}
+    TERRAIN_API bool IsLoading() const {LoadingState state = GetLoadingState(); return state == Loading || state == PreviewLoading;}
+    //get the loaded fraction of the terrain (0 to 1)
+    TERRAIN_API float GetLoadingProgress() const {return mLoadingProgress;}
+    //get the seconds spent loading (up to now, while the loading is running)
+    TERRAIN_API double GetLoadingTime() const;
+
     //update the terrain (find cut through hierarchy)
     TERRAIN_API virtual void Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum) = 0;
     //render all active patches?    
@@ -36,6 +67,26 @@ namespace Terrain {
 
     TERRAIN_API unsigned int GetNumberOfRenderedTriangles(void) const { return mNumberOfRenderedTriangles; }
 
+    //get the min/max height pyramid built at load time (nullptr while loading or if there is none). an edit publishes a new
+    //pyramid, so a caller on another thread than the editing one keeps a read guard of GetPyramidEpochs while it uses the pyramid
+    TERRAIN_API CHeightPyramid const * GetHeightPyramid(void) const { return IsLoading() ? nullptr : mHeightPyramid.load(); }
+    //get the epochs, which reclaim the pyramids replaced by edits (the queries of the model enter them on their own)
+    TERRAIN_API GLUtils::CEpochManager & GetPyramidEpochs(void) const { return mPyramidEpochs; }
+    //cast the ray against the height pyramid, returns false if it misses the terrain (or the model has no pyramid)
+    TERRAIN_API virtual bool RayCast(Ray const & ray, RayHit & hit) const;
+    //cast the rays on the thread pool, the hits are in the order of the rays
+    TERRAIN_API void RayCastBatch(std::vector<Ray> const & rays, std::vector<RayHit> & hits) const;
+    //get the clearance of the flight path over the terrain in the corridor, returns false if the model has no pyramid
+    TERRAIN_API virtual bool GetClearance(FlightCorridor const & corridor, ClearanceResult & result) const;
+    //get the elevation profile along the path of the request, returns false if the model has no pyramid
+    TERRAIN_API bool GetProfile(ProfileRequest const & request, std::vector<ProfilePoint> & profile) const;
+    //get the profiles of the requests on the thread pool, profiles of failed requests are empty
+    TERRAIN_API void GetProfiles(std::vector<ProfileRequest> const & requests, std::vector<std::vector<ProfilePoint>> & profiles) const;
+    //get the height at the ground position within the tolerance, level is the start of the search and gets the level read
+    TERRAIN_API virtual bool GetProfileHeight(glm::vec2 const & position, float tolerance, int & level, float & height, float & error) const;
+    //stream the patches covering the polygon of the query through the callback, returns false if the model cannot query regions
+    TERRAIN_API virtual bool QueryRegion(RegionQuery const & query, RegionCallback const & callback) const {return false;}
+
   protected:
     CTerrainModel(CTerrainModel const & rhs);             //forbidden
     CTerrainModel & operator=(CTerrainModel const & rhs); //forbidden
@@ -43,9 +94,30 @@ namespace Terrain {
     glm::vec3 mTerrainMax;
     ModelType mModelType;
     std::string mModelPath;
+    std::atomic<CHeightPyramid*> mHeightPyramid;
+    mutable GLUtils::CEpochManager mPyramidEpochs;	//readers of the published pyramid, a replaced one is deleted once they left
+
+    //publishes the pyramid, the previous one is retired and deleted by a later reclaim
+    void SetHeightPyramid(std::unique_ptr<CHeightPyramid> pyramid);
 
     //counts the number of rendered triangles
     mutable unsigned int mNumberOfRenderedTriangles;
     mutable unsigned int mNumberOfTriangles;
+
+    //called by the loader while initializing
+    void SetLoadingProgress(float progress) {mLoadingProgress = progress;}
+    bool IsLoadingCancelled() const {return mCancelLoading;}
+    //makes the coarse preview available to the render thread
+    void PublishPreview() {if (mLoadingState == Loading) mLoadingState = PreviewLoading;}
+    //withdraws the preview, before the loader frees it
+    void RevokePreview() {if (mLoadingState == PreviewLoading) mLoadingState = Loading;}
+
+  private:
+    std::thread mLoader;
+    std::atomic<int> mLoadingState;
+    std::atomic<float> mLoadingProgress;
+    std::atomic<bool> mCancelLoading;
+    std::chrono::high_resolution_clock::time_point mLoadingStart;
+    double mLoadingTime;      //written by the loader before the state leaves Loading
   };
 }
\ No newline at end of file
@@ -0,0 +1,451 @@
+#include "TerrainPrecompiled.h"
+#include "TerrainWorld.h"
+#include "RlodFormat.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace Terrain {
+
+  //grid offsets of the borders (south, east, north, west)
+  static const int BORDER_OFFSETS[4][2] = { {0, -1}, {1, 0}, {0, 1}, {-1, 0} };
+
+
+
+  CTerrainWorld::CTerrainWorld()
+    : mColumns(0)
+    , mRows(0)
+    , mPagingDistance(10000.f)
+    , mMemoryBudget(512 * 1024 * 1024)
+    , mMemoryUsage(0)
+    , mFrame(0)
+    , mLoadedTiles(new std::vector<LoadedTile>())
+  {
+    mTerrainMax = vec3(-FLT_MAX);
+    mTerrainMin = vec3(FLT_MAX);
+    //the tiles are rendered like raster models
+    mModelType = ModelType::RasterModel;
+  }
+
+
+
+  CTerrainWorld::~CTerrainWorld()
+  {
+    CancelLoading();
+    Clear();
+    delete mLoadedTiles.load();
+  }
+
+
+
+  bool CTerrainWorld::Init(const char* worldfile)
+  {
+    Clear();
+    mModelPath = std::string(worldfile);
+
+    std::ifstream file(worldfile);
+    if (!file) {
+      std::cerr << "failed to open world file " << worldfile << "!" << std::endl;
+      return false;
+    }
+
+    if (!(file >> mColumns >> mRows) || mColumns <= 0 || mRows <= 0) {
+      std::cerr << "world file " << worldfile << " has no valid grid size!" << std::endl;
+      return false;
+    }
+
+    //tile paths are relative to the world file
+    std::string directory = mModelPath.substr(0, mModelPath.find_last_of("/\\") + 1);
+    mGrid.assign(mColumns * mRows, -1);
+
+    std::string line;
+    while (std::getline(file, line)) {
+      std::istringstream stream(line);
+      Tile tile;
+      std::string path;
+      if (!(stream >> tile.column >> tile.row) || !std::getline(stream >> std::ws, path) || path.empty())
+        continue;
+
+      if (tile.column < 0 || tile.column >= mColumns || tile.row < 0 || tile.row >= mRows || mGrid[tile.row * mColumns + tile.column] != -1) {
+        std::cerr << "world file has an invalid tile " << tile.column << ", " << tile.row << "!" << std::endl;
+        continue;
+      }
+
+      tile.path = directory + path;
+      if (!ReadTileExtent(tile))
+        continue;
+
+      mGrid[tile.row * mColumns + tile.column] = static_cast<int>(mTiles.size());
+      mTiles.push_back(tile);
+
+      mTerrainMin = glm::min(mTerrainMin, vec3(tile.min, 0.f));
+      mTerrainMax = glm::max(mTerrainMax, vec3(tile.max, 0.f));
+    }
+
+    std::cout << "world has " << mTiles.size() << " tiles in a grid of " << mColumns << "x" << mRows << "!" << std::endl;
+    return !mTiles.empty();
+  }
+
+
+
+  bool CTerrainWorld::ReadTileExtent(Tile & tile) const
+  {
+    FILE* fp = nullptr;
+    if (fopen_s(&fp, tile.path.c_str(), "rb") != 0 || fp == nullptr) {
+      std::cerr << "failed to open terrain file " << tile.path << "!" << std::endl;
+      return false;
+    }
+
+    //magic, compress flag, extent (x min, x max, y min, y max)
+    char sig[4];
+    glm::uint compressFlag;
+    float extent[4];
+    fread(sig, 1, 4, fp);
+    fread(&compressFlag, sizeof(glm::uint), 1, fp);
+    size_t read = fread(extent, sizeof(float), 4, fp);
+    fclose(fp);
+
+    if (memcmp(sig, Rlod::MAGIC, 4) != 0 || read != 4) {
+      std::cerr << "terrain file " << tile.path << " is not a raster-lod!" << std::endl;
+      return false;
+    }
+
+    tile.min = glm::vec2(extent[0], extent[2]);
+    tile.max = glm::vec2(extent[1], extent[3]);
+    return true;
+  }
+
+
+
+  void CTerrainWorld::Clear()
+  {
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (iter->model)
+        UnloadTile(*iter);
+    }
+
+    mTiles.clear();
+    mGrid.clear();
+    mColumns = mRows = 0;
+    mMemoryUsage = 0;
+    //the models of the unloaded tiles are deleted after the running queries
+    mEpochs.ReclaimAll();
+    mTerrainMax = vec3(-FLT_MAX);
+    mTerrainMin = vec3(FLT_MAX);
+  }
+
+
+
+  size_t CTerrainWorld::GetLoadedTileCount() const
+  {
+    size_t count = 0;
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (iter->loaded)
+        ++count;
+    }
+    return count;
+  }
+
+
+
+  CTerrainWorld::Tile* CTerrainWorld::FindTile(int column, int row)
+  {
+    if (column < 0 || column >= mColumns || row < 0 || row >= mRows)
+      return nullptr;
+    int index = mGrid[row * mColumns + column];
+    return (index >= 0) ? &mTiles[index] : nullptr;
+  }
+
+
+
+  void CTerrainWorld::LoadTile(Tile & tile)
+  {
+    std::cout << "loading tile " << tile.column << ", " << tile.row << "..." << std::endl;
+    tile.model = new CRasterTerrainModel();
+    tile.model->InitAsync(tile.path.c_str());
+  }
+
+
+
+  void CTerrainWorld::FinishTile(Tile & tile)
+  {
+    if (tile.model->GetLoadingState() == LoadingFailed) {
+      std::cerr << "failed to load tile " << tile.column << ", " << tile.row << "!" << std::endl;
+      delete tile.model;
+      tile.model = nullptr;
+      tile.failed = true;
+      return;
+    }
+
+    tile.loaded = true;
+    tile.memory = tile.model->GetMemoryUsage();
+    mMemoryUsage += tile.memory;
+    LinkNeighbors(tile, true);
+    PublishTiles();
+  }
+
+
+
+  void CTerrainWorld::UnloadTile(Tile & tile)
+  {
+    std::cout << "unloading tile " << tile.column << ", " << tile.row << "..." << std::endl;
+
+    //the neighbors must not reference the patches anymore, a running loader is cancelled by the model
+    CRasterTerrainModel* model = tile.model;
+    bool loaded = tile.loaded;
+    if (loaded)
+      LinkNeighbors(tile, false);
+    tile.model = nullptr;
+    tile.loaded = false;
+    mMemoryUsage -= tile.memory;
+    tile.memory = 0;
+
+    //queries may still use a loaded model until it is reclaimed
+    if (loaded) {
+      PublishTiles();
+      mEpochs.Retire([model]() { delete model; });
+    }
+    else {
+      delete model;
+    }
+  }
+
+
+
+  void CTerrainWorld::PublishTiles()
+  {
+    //the ground extent covers all tiles, the heights are taken from the loaded ones
+    glm::vec2 groundMin(FLT_MAX), groundMax(-FLT_MAX);
+    float heightMin = FLT_MAX, heightMax = -FLT_MAX;
+
+    std::vector<LoadedTile>* tiles = new std::vector<LoadedTile>();
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      groundMin = glm::min(groundMin, iter->min);
+      groundMax = glm::max(groundMax, iter->max);
+      if (iter->loaded) {
+        LoadedTile tile = {iter->min, iter->max, iter->model};
+        tiles->push_back(tile);
+
+        glm::vec3 bbmin, bbmax;
+        iter->model->GetBoundings(bbmin, bbmax);
+        heightMin = glm::min(heightMin, bbmin.z);
+        heightMax = glm::max(heightMax, bbmax.z);
+      }
+    }
+
+    if (tiles->empty())
+      heightMin = heightMax = 0.f;
+    mTerrainMin = vec3(groundMin, heightMin);
+    mTerrainMax = vec3(groundMax, heightMax);
+
+    std::vector<LoadedTile> const * previous = mLoadedTiles.exchange(tiles);
+    mEpochs.Retire([previous]() { delete previous; });
+  }
+
+
+
+  void CTerrainWorld::LinkNeighbors(Tile & tile, bool link)
+  {
+    for (int border=0; border < 4; ++border) {
+      Tile* neighbor = FindTile(tile.column + BORDER_OFFSETS[border][0], tile.row + BORDER_OFFSETS[border][1]);
+      if (neighbor == nullptr || !neighbor->loaded)
+        continue;
+
+      CRasterTerrainModel::Border opposite = static_cast<CRasterTerrainModel::Border>((border + 2) % 4);
+      tile.model->SetBorderNeighbor(static_cast<CRasterTerrainModel::Border>(border), link ? neighbor->model : nullptr);
+      neighbor->model->SetBorderNeighbor(opposite, link ? tile.model : nullptr);
+    }
+  }
+
+
+
+  void CTerrainWorld::EvictTiles()
+  {
+    while (mMemoryUsage > mMemoryBudget) {
+      Tile* oldest = nullptr;
+      for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+        if (iter->loaded && iter->lastUsed != mFrame && (oldest == nullptr || iter->lastUsed < oldest->lastUsed))
+          oldest = &(*iter);
+      }
+
+      if (oldest == nullptr)
+        return;
+      UnloadTile(*oldest);
+    }
+  }
+
+
+
+  void CTerrainWorld::Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum)
+  {
+    ++mFrame;
+    mEpochs.Reclaim();
+
+    //finish the tile loaded in the background
+    bool loading = false;
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (!iter->model || iter->loaded)
+        continue;
+      if (iter->model->IsLoading())
+        loading = true;
+      else
+        FinishTile(*iter);
+    }
+
+    //tiles within the paging distance are needed, the nearest missing one is loaded when the loader is idle
+    glm::vec2 eye = glm::vec2(metric.ViewPosition());
+    Tile* nearest = nullptr;
+    float nearestDistance = FLT_MAX;
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      glm::vec2 d = glm::max(glm::max(iter->min - eye, eye - iter->max), glm::vec2(0.f));
+      float distance = glm::length(d);
+      if (distance > mPagingDistance)
+        continue;
+
+      iter->lastUsed = mFrame;
+      if (!iter->model && !iter->failed && distance < nearestDistance) {
+        nearest = &(*iter);
+        nearestDistance = distance;
+      }
+    }
+
+    if (nearest && !loading)
+      LoadTile(*nearest);
+    EvictTiles();
+
+    //the cut of all tiles is found before any tile is rendered, so the stitching sees the levels of the neighbors
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (iter->loaded)
+        iter->model->Update(metric, frustum);
+    }
+  }
+
+
+
+  void CTerrainWorld::Render() const
+  {
+    mNumberOfRenderedTriangles = 0;
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (iter->loaded) {
+        iter->model->Render();
+        mNumberOfRenderedTriangles += iter->model->GetNumberOfRenderedTriangles();
+      }
+    }
+  }
+
+
+
+  void CTerrainWorld::RenderOutline() const
+  {
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (iter->loaded)
+        iter->model->RenderOutline();
+    }
+  }
+
+
+
+  void CTerrainWorld::RenderBounds() const
+  {
+    for (auto iter = mTiles.begin(); iter != mTiles.end(); ++iter) {
+      if (iter->loaded)
+        iter->model->RenderBounds();
+    }
+  }
+
+
+
+  bool CTerrainWorld::RayCast(Ray const & ray, RayHit & hit) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mEpochs);
+    std::vector<LoadedTile> const & tiles = *mLoadedTiles.load();
+
+    hit = RayHit();
+    Ray nearest = ray;
+    for (auto iter = tiles.begin(); iter != tiles.end(); ++iter) {
+      RayHit tileHit;
+      if (iter->model->RayCast(nearest, tileHit)) {
+        hit = tileHit;
+        nearest.maxDistance = tileHit.distance;
+      }
+    }
+    return hit.hit;
+  }
+
+
+
+  bool CTerrainWorld::GetProfileHeight(glm::vec2 const & position, float tolerance, int & level, float & height, float & error) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mEpochs);
+    std::vector<LoadedTile> const & tiles = *mLoadedTiles.load();
+
+    for (auto iter = tiles.begin(); iter != tiles.end(); ++iter) {
+      if (position.x >= iter->min.x && position.y >= iter->min.y && position.x <= iter->max.x && position.y <= iter->max.y)
+        return iter->model->GetProfileHeight(position, tolerance, level, height, error);
+    }
+    return false;
+  }
+
+
+
+  bool CTerrainWorld::QueryRegion(RegionQuery const & query, RegionCallback const & callback) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mEpochs);
+    std::vector<LoadedTile> const & tiles = *mLoadedTiles.load();
+
+    glm::vec2 min(FLT_MAX), max(-FLT_MAX);
+    for (auto iter = query.polygon.begin(); iter != query.polygon.end(); ++iter) {
+      min = glm::min(min, *iter);
+      max = glm::max(max, *iter);
+    }
+
+    //the tiles are queried one after the other, until the callback stops
+    bool found = false;
+    bool stopped = false;
+    RegionCallback forward = [&](RegionPatch const & patch) -> bool {
+      stopped = !callback(patch);
+      return !stopped;
+    };
+    for (auto iter = tiles.begin(); iter != tiles.end() && !stopped; ++iter) {
+      if (iter->min.x > max.x || iter->min.y > max.y || iter->max.x < min.x || iter->max.y < min.y)
+        continue;
+      if (iter->model->QueryRegion(query, forward))
+        found = true;
+    }
+    return found;
+  }
+
+
+
+  bool CTerrainWorld::GetClearance(FlightCorridor const & corridor, ClearanceResult & result) const
+  {
+    GLUtils::CEpochManager::ReadGuard guard(mEpochs);
+    std::vector<LoadedTile> const & tiles = *mLoadedTiles.load();
+
+    result = ClearanceResult();
+    bool found = false;
+    for (auto iter = tiles.begin(); iter != tiles.end(); ++iter) {
+      ClearanceResult tileResult;
+      if (!iter->model->GetClearance(corridor, tileResult))
+        continue;
+
+      found = true;
+      if (tileResult.minClearance < result.minClearance) {
+        result.minClearance = tileResult.minClearance;
+        result.minPosition = tileResult.minPosition;
+      }
+      if (tileResult.conflict && tileResult.conflictDistance < result.conflictDistance) {
+        result.conflict = true;
+        result.conflictDistance = tileResult.conflictDistance;
+        result.conflictPosition = tileResult.conflictPosition;
+      }
+    }
+    return found;
+  }
+
+
+} //namespace Terrain
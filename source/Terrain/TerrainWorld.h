@@ -0,0 +1,126 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <atomic>
+#include "ViewFrustum.h"
+#include "EpochManager.h"
+#include "ErrorMetric.h"
+#include "TerrainModel.h"
+#include "RasterTerrainModel.h"
+
+
+namespace Terrain {
+
+  //terrain world made of a grid of raster-lod tiles.
+  //tiles within the paging distance of the viewer are loaded in the background (nearest first, one at a time), tiles which were not needed for the
+  //longest time are evicted as soon as the loaded tiles exceed the memory budget. all loaded tiles are updated and
+  //rendered as one scene, adjacent tiles are linked so the seams are stitched like the patches inside a tile.
+  //
+  //the world file is a text file: "<columns> <rows>" followed by one "<column> <row> <file.rlod>" line per tile
+  //(row 0 is the southern row, paths are relative to the world file). all tiles need the same patch size and depth.
+  //
+  //the queries (ray casts, clearances, profiles) can run on other threads while the render thread pages and updates the
+  //tiles. they read the list of loaded tiles published by the render thread within an epoch, unloaded tiles are deleted
+  //by the render thread once no query can use them anymore
+  class CTerrainWorld : public CTerrainModel
+  {
+  public:
+    struct Tile {
+      int						column;
+      int						row;
+      std::string				path;
+      glm::vec2				min;		//ground extent of the tile
+      glm::vec2				max;
+      CRasterTerrainModel*	model;		//nullptr while the tile is not loaded
+      bool					loaded;		//the model finished loading and is linked to its neighbors
+      size_t					memory;		//payload bytes of the loaded tile
+      unsigned int			lastUsed;	//last update the tile was within the paging distance
+      bool					failed;		//tile could not be loaded, it is not tried again
+
+      Tile() : column(0), row(0), min(0.f), max(0.f), model(nullptr), loaded(false), memory(0), lastUsed(0), failed(false) {}
+    };
+
+    TERRAIN_API CTerrainWorld();
+    TERRAIN_API virtual ~CTerrainWorld();
+
+    //set the distance around the viewer (on the ground) in which tiles are loaded
+    TERRAIN_API void SetPagingDistance(float distance) {mPagingDistance = distance;}
+    TERRAIN_API float GetPagingDistance() const {return mPagingDistance;}
+
+    //set the number of payload bytes the loaded tiles may consume, tiles within the paging distance are never evicted
+    TERRAIN_API void SetMemoryBudget(size_t bytes) {mMemoryBudget = bytes;}
+    TERRAIN_API size_t GetMemoryBudget() const {return mMemoryBudget;}
+    TERRAIN_API size_t GetMemoryUsage() const {return mMemoryUsage;}
+
+    TERRAIN_API size_t GetTileCount() const {return mTiles.size();}
+    TERRAIN_API size_t GetLoadedTileCount() const;
+    TERRAIN_API Tile const & GetTile(size_t i) const {return mTiles[i];}
+
+    //read the world file (the tiles are loaded during the updates)
+    TERRAIN_API virtual bool Init(const char* worldfile) override;
+    //free all tiles
+    TERRAIN_API virtual void Clear() override;
+
+    //page the tiles around the viewer and update the cut of all loaded tiles
+    TERRAIN_API virtual void Update(CErrorMetric const & metric, GLUtils::CViewFrustum const & frustum) override;
+    //render the active patches of all loaded tiles
+    TERRAIN_API virtual void Render() const override;
+    //render the outlines of all loaded tiles
+    TERRAIN_API virtual void RenderOutline() const override;
+    //render the bounds of all loaded tiles
+    TERRAIN_API virtual void RenderBounds() const override;
+    //cast the ray against the loaded tiles, the nearest hit is taken
+    TERRAIN_API virtual bool RayCast(Ray const & ray, RayHit & hit) const override;
+    //get the clearance over the loaded tiles, the smallest clearance and the first conflict of all tiles
+    TERRAIN_API virtual bool GetClearance(FlightCorridor const & corridor, ClearanceResult & result) const override;
+    //get the height from the loaded tile containing the position
+    TERRAIN_API virtual bool GetProfileHeight(glm::vec2 const & position, float tolerance, int & level, float & height, float & error) const override;
+    //stream the patches of the loaded tiles overlapping the polygon, tile by tile
+    TERRAIN_API virtual bool QueryRegion(RegionQuery const & query, RegionCallback const & callback) const override;
+
+  private:
+    CTerrainWorld(CTerrainWorld const & rhs);             //forbidden
+    CTerrainWorld & operator=(CTerrainWorld const & rhs); //forbidden
+
+    //loaded tile as seen by the queries
+    struct LoadedTile {
+      glm::vec2					min;
+      glm::vec2					max;
+      CRasterTerrainModel const*	model;
+    };
+
+    //gets the tile of the grid cell or nullptr
+    Tile* FindTile(int column, int row);
+    //reads the ground extent from the header of the raster-lod file
+    bool ReadTileExtent(Tile & tile) const;
+    //starts loading the tile in the background
+    void LoadTile(Tile & tile);
+    //links and accounts a tile, whose model finished loading
+    void FinishTile(Tile & tile);
+    void UnloadTile(Tile & tile);
+    //links (or unlinks) the borders of the tile and its loaded neighbors
+    void LinkNeighbors(Tile & tile, bool link);
+    //evicts the least recently used tiles until the budget is met
+    void EvictTiles();
+    //publishes the list of loaded tiles to the queries, the previous list is retired
+    void PublishTiles();
+
+    std::vector<Tile>	mTiles;
+    std::vector<int>	mGrid;			//tile index of every grid cell (-1 without tile)
+    int					mColumns;
+    int					mRows;
+    float				mPagingDistance;
+    size_t				mMemoryBudget;
+    size_t				mMemoryUsage;
+    unsigned int		mFrame;
+
+    std::atomic<std::vector<LoadedTile> const*>	mLoadedTiles;	//read by the queries, replaced by the render thread
+    mutable GLUtils::CEpochManager				mEpochs;		//reclaims the lists and models the queries may still use
+  };
+
+
+} //namespace Terrain
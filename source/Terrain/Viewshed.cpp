@@ -0,0 +1,198 @@
+#include "TerrainPrecompiled.h"
+#include "Viewshed.h"
+
+#include <cfloat>
+#include <iostream>
+#include <xmmintrin.h>
+#include "ThreadPool.h"
+
+namespace Terrain {
+
+  CViewshed::CViewshed()
+    : mWidth(0)
+    , mHeight(0)
+    , mObserver(0)
+    , mOrigin(0)
+    , mMin(0.f)
+    , mMax(0.f)
+    , mSpacing(0.f)
+    , mVisibleCount(0)
+  {
+  }
+
+
+
+  void CViewshed::Clear()
+  {
+    std::vector<unsigned char>().swap(mRaster);
+    mWidth = mHeight = 0;
+    mVisibleCount = 0;
+  }
+
+
+
+  bool CViewshed::Compute(CTerrainModel const & model, ViewshedSettings const & settings)
+  {
+    GLUtils::CEpochManager::ReadGuard guard(model.GetPyramidEpochs());
+    CHeightPyramid const * pyramid = model.GetHeightPyramid();
+    if (pyramid == nullptr) {
+      std::cerr << "failed to compute the viewshed, the terrain has no height pyramid!" << std::endl;
+      Clear();
+      return false;
+    }
+    return Compute(*pyramid, settings);
+  }
+
+
+
+  bool CViewshed::Compute(CHeightPyramid const & pyramid, ViewshedSettings const & settings)
+  {
+    Clear();
+    if (pyramid.IsEmpty())
+      return false;
+
+    mSpacing = pyramid.GetSpacing();
+    glm::vec2 u = glm::round((settings.observer - pyramid.GetMin()) / mSpacing);
+    if (u.x < 0.f || u.y < 0.f || u.x > pyramid.GetColumns() - 1 || u.y > pyramid.GetRows() - 1) {
+      std::cerr << "failed to compute the viewshed, the observer is outside the terrain!" << std::endl;
+      return false;
+    }
+    mObserver = glm::ivec2(u);
+
+    //the samples within the radius square
+    glm::ivec2 reach = glm::ivec2(glm::max(glm::vec2(settings.radius), glm::vec2(0.f)) / mSpacing);
+    mOrigin = glm::max(mObserver - reach, glm::ivec2(0));
+    glm::ivec2 last = glm::min(mObserver + reach, glm::ivec2(pyramid.GetColumns() - 1, pyramid.GetRows() - 1));
+    mWidth = last.x - mOrigin.x + 1;
+    mHeight = last.y - mOrigin.y + 1;
+    mMin = pyramid.GetMin() + glm::vec2(mOrigin) * mSpacing;
+    mMax = pyramid.GetMin() + glm::vec2(last) * mSpacing;
+    mRaster.assign(static_cast<size_t>(mWidth) * mHeight, static_cast<unsigned char>(Outside));
+
+    float eye = pyramid.GetSampleHeight(mObserver.x, mObserver.y) + settings.observerHeight;
+    mRaster[static_cast<size_t>(mObserver.y - mOrigin.y) * mWidth + (mObserver.x - mOrigin.x)] = static_cast<unsigned char>(Visible);
+
+    size_t visible[8];
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, 8, [&](size_t octant) {
+      visible[octant] = SweepOctant(pyramid, settings, static_cast<int>(octant), eye);
+    });
+
+    mVisibleCount = 1;
+    for (int octant=0; octant < 8; ++octant)
+      mVisibleCount += visible[octant];
+    return true;
+  }
+
+
+
+  size_t CViewshed::SweepOctant(CHeightPyramid const & pyramid, ViewshedSettings const & settings, int octant, float eye)
+  {
+    //ring i holds the samples (i, j) with 0 <= j <= i along the major and minor axis of the octant
+    int sx = (octant & 1) ? -1 : 1;
+    int sy = (octant & 2) ? -1 : 1;
+    bool swap = (octant & 4) != 0;
+    float major = swap ? mSpacing.y : mSpacing.x;
+    float minor = swap ? mSpacing.x : mSpacing.y;
+    glm::ivec2 last = mOrigin + glm::ivec2(mWidth - 1, mHeight - 1);
+    int reachX = (sx > 0) ? last.x - mObserver.x : mObserver.x - mOrigin.x;
+    int reachY = (sy > 0) ? last.y - mObserver.y : mObserver.y - mOrigin.y;
+    int rings = swap ? reachY : reachX;
+    int minorReach = swap ? reachX : reachY;
+
+    //the samples on the axes and diagonals belong to two octants, they are written by one of them
+    bool ownsAxis = (swap ? sx : sy) > 0;
+    bool ownsDiagonal = !swap;
+
+    //horizons (tangent of the elevation angle) of the previous and the current ring, shifted by one. the entries around
+    //the swept samples are lowest, so they do not contribute to the interpolation
+    std::vector<float> previous(rings + 8, -FLT_MAX);
+    std::vector<float> current(rings + 8, -FLT_MAX);
+    std::vector<float> heights(rings + 8, 0.f);
+    float radius2 = settings.radius * settings.radius;
+    size_t visible = 0;
+
+    __m128 eye4 = _mm_set1_ps(eye);
+    __m128 target4 = _mm_set1_ps(settings.targetHeight);
+    __m128 one4 = _mm_set1_ps(1.f);
+    __m128 minor4 = _mm_set1_ps(minor);
+    __m128 lanes4 = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+
+    for (int i=1; i <= rings; ++i) {
+      float di = i * major;
+      if (di * di > radius2)
+        break;
+      int end = glm::min(glm::min(i, minorReach), static_cast<int>(glm::sqrt(radius2 - di * di) / minor));
+
+      for (int j=0; j <= end; ++j) {
+        int dx = swap ? j : i;
+        int dy = swap ? i : j;
+        heights[j] = pyramid.GetSampleHeight(mObserver.x + sx * dx, mObserver.y + sy * dy);
+      }
+
+      //the line of sight to (i, j) passes the previous ring at j - j / i, between the samples j - 1 and j
+      __m128 inverse4 = _mm_set1_ps(1.f / i);
+      __m128 di2 = _mm_set1_ps(di * di);
+      for (int j=0; j <= end; j += 4) {
+        __m128 j4 = _mm_add_ps(_mm_set1_ps(static_cast<float>(j)), lanes4);
+        __m128 w = _mm_mul_ps(j4, inverse4);
+        __m128 horizon = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&previous[j]), w), _mm_mul_ps(_mm_loadu_ps(&previous[j + 1]), _mm_sub_ps(one4, w)));
+
+        __m128 dj = _mm_mul_ps(j4, minor4);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(di2, _mm_mul_ps(dj, dj)));
+        __m128 h = _mm_sub_ps(_mm_loadu_ps(&heights[j]), eye4);
+        __m128 slope = _mm_div_ps(h, distance);
+        __m128 targetSlope = _mm_div_ps(_mm_add_ps(h, target4), distance);
+
+        int mask = _mm_movemask_ps(_mm_cmpge_ps(targetSlope, horizon));
+        _mm_storeu_ps(&current[j + 1], _mm_max_ps(horizon, slope));
+
+        for (int k=0; k < 4 && j + k <= end; ++k) {
+          int jj = j + k;
+          if ((jj == 0 && !ownsAxis) || (jj == i && !ownsDiagonal))
+            continue;
+          int dx = swap ? jj : i;
+          int dy = swap ? i : jj;
+          float dx2 = dx * mSpacing.x, dy2 = dy * mSpacing.y;
+          if (dx2 * dx2 + dy2 * dy2 > radius2)
+            continue;
+
+          bool isVisible = (mask & (1 << k)) != 0;
+          size_t index = static_cast<size_t>(mObserver.y + sy * dy - mOrigin.y) * mWidth + (mObserver.x + sx * dx - mOrigin.x);
+          mRaster[index] = static_cast<unsigned char>(isVisible ? Visible : Hidden);
+          if (isVisible)
+            ++visible;
+        }
+      }
+
+      //the entry after the ring is the border of the next ring
+      current[end + 2] = -FLT_MAX;
+      std::swap(previous, current);
+    }
+    return visible;
+  }
+
+
+
+  CViewshed::Visibility CViewshed::GetVisibility(glm::vec2 const & position) const
+  {
+    if (mRaster.empty())
+      return Outside;
+    glm::vec2 u = glm::round((position - mMin) / mSpacing);
+    if (u.x < 0.f || u.y < 0.f || u.x > mWidth - 1 || u.y > mHeight - 1)
+      return Outside;
+    return static_cast<Visibility>(mRaster[static_cast<size_t>(u.y) * mWidth + static_cast<size_t>(u.x)]);
+  }
+
+
+
+  bool CViewshed::CreateTexture(GLUtils::CGLTexture & texture, bool loadToGPU) const
+  {
+    if (mRaster.empty()) {
+      std::cerr << "failed to create the viewshed texture, there is no viewshed!" << std::endl;
+      return false;
+    }
+    return texture.LoadFromMemory(mWidth, mHeight, GLUtils::Format::Gray8, mRaster, loadToGPU);
+  }
+
+
+} //namespace Terrain
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "TerrainDefines.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "GLTexture.h"
+#include "HeightPyramid.h"
+#include "TerrainModel.h"
+
+
+namespace Terrain {
+
+  struct ViewshedSettings {
+    glm::vec2 observer;     //ground position
+    float observerHeight;   //eye height above the terrain
+    float targetHeight;     //a sample is visible if a target of this height standing on it can be seen
+    float radius;           //ground distance
+
+    ViewshedSettings() : observer(0.f), observerHeight(2.f), targetHeight(0.f), radius(1000.f) {}
+  };
+
+  //viewshed of an observer over the samples of a height pyramid (xdraw).
+  //the samples around the observer are swept in square rings, every sample gets the horizon of the ring before interpolated
+  //between the two samples its line of sight passes. the eight octants are swept in parallel, the samples of a ring four at
+  //a time with sse. the result is a raster of the samples within the radius, one byte each, which can be uploaded as an
+  //overlay texture
+  class CViewshed
+  {
+  public:
+    enum Visibility {
+      Outside = 0,          //beyond the radius or the terrain
+      Hidden = 64,
+      Visible = 255,
+    };
+
+    TERRAIN_API CViewshed();
+
+    //computes the viewshed over the height pyramid of the model, returns false if the model has none (e.g. while loading)
+    TERRAIN_API bool Compute(CTerrainModel const & model, ViewshedSettings const & settings);
+    //computes the viewshed over the samples of the pyramid, returns false if the observer is outside the samples
+    TERRAIN_API bool Compute(CHeightPyramid const & pyramid, ViewshedSettings const & settings);
+    TERRAIN_API void Clear();
+
+    //raster of Visibility values, row 0 is the southern row
+    TERRAIN_API std::vector<unsigned char> const & GetRaster() const {return mRaster;}
+    TERRAIN_API int GetWidth() const {return mWidth;}
+    TERRAIN_API int GetHeight() const {return mHeight;}
+    //ground positions of the first and the last sample of the raster
+    TERRAIN_API glm::vec2 const & GetMin() const {return mMin;}
+    TERRAIN_API glm::vec2 const & GetMax() const {return mMax;}
+    TERRAIN_API size_t GetVisibleCount() const {return mVisibleCount;}
+    //get the visibility of the sample nearest to the ground position
+    TERRAIN_API Visibility GetVisibility(glm::vec2 const & position) const;
+
+    //sets the raster as a gray texture, the samples are the texel centers
+    TERRAIN_API bool CreateTexture(GLUtils::CGLTexture & texture, bool loadToGPU = true) const;
+
+  private:
+    //sweeps the rings of one octant, the octant bits are the signs of x and y and the swap of the axes
+    size_t SweepOctant(CHeightPyramid const & pyramid, ViewshedSettings const & settings, int octant, float eye);
+
+    std::vector<unsigned char> mRaster;
+    int mWidth;
+    int mHeight;
+    glm::ivec2 mObserver;     //sample of the observer
+    glm::ivec2 mOrigin;       //sample of the first raster entry
+    glm::vec2 mMin;
+    glm::vec2 mMax;
+    glm::vec2 mSpacing;
+    size_t mVisibleCount;
+  };
+
+
+} //namespace Terrain
@@ -0,0 +1,806 @@
+#include "BuildTools.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cfloat>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <glm/glm.hpp>
+#include <zlib.h>
+#include <png.h>
+#include "RlodFormat.h"
+#include "HfcFormat.h"
+#include "IndexOptimizer.h"
+#include "ThreadPool.h"
+#include "PayloadTools.h"
+
+
+namespace Tools {
+
+  struct BuildSettings {
+    int patchSize;
+    float sampleSpacing;  //distance of the heightmap samples
+    float heightScale;    //height of one heightmap unit
+    glm::uint encoding;
+    int level;            //deflate level
+    bool chunked;         //chunked-lod (hfc) patches with skirts instead of raster-lod payloads
+    int rootLevel;        //level of the root patches of chunked files
+    std::vector<glm::uint> chunkIndices;  //triangle list shared by all chunked patches
+  };
+
+  //bounds, error and payload location of a built patch
+  struct BuiltPatch {
+    glm::vec3 bbmin;
+    glm::vec3 bbmax;
+    float error;
+    long long offset;     //payload in the temporary payload file
+    glm::uint size;
+  };
+
+  //rows of the height grid around one row of patches, every stride-th sample
+  struct HeightBand {
+    int yStart;
+    int stride;
+    int columns;
+    int gridSize;
+    std::vector<unsigned short> heights;
+
+    //gets the height at the grid position (multiple of the stride), positions outside the grid are clamped
+    float Get(int x, int y) const {
+      x = glm::clamp(x, 0, gridSize - 1);
+      y = glm::clamp(y, 0, gridSize - 1);
+      return static_cast<float>(heights[((y - yStart) / stride) * columns + x / stride]);
+    }
+  };
+
+  //fills the band with every stride-th row and column of the rows [yStart, yEnd] (clamped to the grid)
+  typedef std::function<bool(int yStart, int yEnd, int stride, HeightBand & band)> BandReader;
+
+
+
+  static void PngReadCallback(png_structp png, png_bytep data, png_size_t length)
+  {
+    FILE* fp = static_cast<FILE*>(png_get_io_ptr(png));
+    if (fread(data, 1, length, fp) != length)
+      png_error(png, "unexpected end of file");
+  }
+
+
+
+  //streams the rows of the heightmap to the height file (rows from south to north). the grid is the smallest one
+  //with patchSize * 2^depth + 1 samples per side covering the heightmap, samples beyond the heightmap repeat its border
+  static bool StreamHeightmap(const char* file, FILE* out, int patchSize, int & gridSize, int & depth)
+  {
+    FILE* fp = nullptr;
+    if (fopen_s(&fp, file, "rb") != 0 || fp == nullptr) {
+      std::cerr << "failed to open heightmap " << file << "!" << std::endl;
+      return false;
+    }
+
+    unsigned char signature[8];
+    if (fread(signature, 1, 8, fp) != 8 || png_sig_cmp(signature, 0, 8) != 0) {
+      fclose(fp);
+      std::cerr << "heightmap " << file << " is not a png!" << std::endl;
+      return false;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (info == nullptr) {
+      png_destroy_read_struct(&png, nullptr, nullptr);
+      fclose(fp);
+      return false;
+    }
+
+    std::vector<unsigned short> row, gridRow;
+    if (setjmp(png_jmpbuf(png))) {
+      png_destroy_read_struct(&png, &info, nullptr);
+      fclose(fp);
+      std::cerr << "failed to decode heightmap " << file << "!" << std::endl;
+      return false;
+    }
+
+    png_set_read_fn(png, fp, PngReadCallback);
+    png_set_sig_bytes(png, 8);
+    png_read_info(png, info);
+
+    png_uint_32 width, height;
+    int bitDepth, colorType, interlaceType;
+    png_get_IHDR(png, info, &width, &height, &bitDepth, &colorType, &interlaceType, nullptr, nullptr);
+    if (colorType != PNG_COLOR_TYPE_GRAY || bitDepth != 16 || interlaceType != PNG_INTERLACE_NONE || width < 2 || height < 2) {
+      png_destroy_read_struct(&png, &info, nullptr);
+      fclose(fp);
+      std::cerr << "heightmap has to be a 16 bit grayscale png without interlacing!" << std::endl;
+      return false;
+    }
+    //little endian samples like LoadPngImage
+    png_set_swap(png);
+    png_read_update_info(png, info);
+
+    depth = 0;
+    while ((static_cast<png_uint_32>(patchSize) << depth) < glm::max(width, height) - 1)
+      ++depth;
+    gridSize = (patchSize << depth) + 1;
+    std::cout << "heightmap has a size of: " << width << " x " << height << ", grid of " << gridSize << " x " << gridSize << " samples!" << std::endl;
+
+    //one row at a time, so the heightmap never has to fit into memory
+    row.resize(width);
+    gridRow.resize(gridSize);
+    bool success = true;
+    for (png_uint_32 r=0; r < height && success; ++r) {
+      png_read_row(png, reinterpret_cast<png_bytep>(row.data()), nullptr);
+      for (int x=0; x < gridSize; ++x)
+        gridRow[x] = row[glm::min<png_uint_32>(x, width - 1)];
+
+      //the first image row is the northern border, the grid rows beyond the image repeat it
+      int y = static_cast<int>(height - 1 - r);
+      int yEnd = (r == 0) ? gridSize : y + 1;
+      for (; y < yEnd && success; ++y) {
+        success = _fseeki64(out, static_cast<long long>(y) * gridSize * sizeof(unsigned short), SEEK_SET) == 0 &&
+          fwrite(gridRow.data(), sizeof(unsigned short), gridSize, out) == static_cast<size_t>(gridSize);
+      }
+    }
+
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(fp);
+    if (!success)
+      std::cerr << "failed to write the height file!" << std::endl;
+    return success;
+  }
+
+
+
+  //reads every stride-th row and column of the rows [yStart, yEnd] (clamped to the grid)
+  static bool ReadBand(FILE* heights, int gridSize, int yStart, int yEnd, int stride, HeightBand & band, std::vector<unsigned short> & row)
+  {
+    band.yStart = yStart;
+    band.stride = stride;
+    band.gridSize = gridSize;
+    band.columns = (gridSize - 1) / stride + 1;
+    int rows = (yEnd - yStart) / stride + 1;
+    band.heights.resize(static_cast<size_t>(rows) * band.columns);
+    row.resize(gridSize);
+
+    for (int r=0; r < rows; ++r) {
+      int y = glm::clamp(yStart + r * stride, 0, gridSize - 1);
+      if (_fseeki64(heights, static_cast<long long>(y) * gridSize * sizeof(unsigned short), SEEK_SET) != 0 ||
+        fread(row.data(), sizeof(unsigned short), gridSize, heights) != static_cast<size_t>(gridSize)) {
+        std::cerr << "failed to read the height file!" << std::endl;
+        return false;
+      }
+
+      unsigned short* dst = &band.heights[static_cast<size_t>(r) * band.columns];
+      for (int x=0; x < band.columns; ++x)
+        dst[x] = row[x * stride];
+    }
+    return true;
+  }
+
+
+
+  //encodes the vertices of a chunked payload: uint vertex count, uint index count, vertices, indices
+  static bool EncodeChunkedPayload(std::vector<Vertex> const & vertices, std::vector<glm::uint> const & indices, std::vector<unsigned char> & payload)
+  {
+    glm::uint counts[2] = { static_cast<glm::uint>(vertices.size()), static_cast<glm::uint>(indices.size()) };
+    size_t vsize = vertices.size() * sizeof(Vertex);
+    payload.resize(sizeof(counts) + vsize + indices.size() * sizeof(glm::uint));
+    memcpy(payload.data(), counts, sizeof(counts));
+    memcpy(payload.data() + sizeof(counts), vertices.data(), vsize);
+    memcpy(payload.data() + sizeof(counts) + vsize, indices.data(), indices.size() * sizeof(glm::uint));
+    return true;
+  }
+
+
+
+  //gets the grid vertex at the position k of the border loop (counter clockwise from the south west corner)
+  static int PerimeterIndex(int k, int patchSize)
+  {
+    int side = k / patchSize;
+    int t = k % patchSize;
+    switch (side) {
+    case 0:  return t;
+    case 1:  return t * (patchSize+1) + patchSize;
+    case 2:  return patchSize * (patchSize+1) + patchSize - t;
+    default: return (patchSize - t) * (patchSize+1);
+    }
+  }
+
+
+
+  //builds the vertices, bounds and error of a patch. the error is the largest height difference between the samples
+  //of the next finer level and the triangles of the patch, but at least the error of the childs
+  static bool BuildPatch(HeightBand const & band, BuildSettings const & settings, int depth, int level, int px, int py,
+    std::vector<BuiltPatch> const * childs, BuiltPatch & patch, std::vector<unsigned char> & payload)
+  {
+    int P = settings.patchSize;
+    int s = 1 << (depth - level);
+    int x0 = px * P * s;
+    int y0 = py * P * s;
+
+    std::vector<Vertex> vertices((P+1) * (P+1));
+    patch.bbmin = glm::vec3(FLT_MAX);
+    patch.bbmax = glm::vec3(-FLT_MAX);
+    for (int j=0; j <= P; ++j) {
+      for (int i=0; i <= P; ++i) {
+        int x = x0 + i * s;
+        int y = y0 + j * s;
+        Vertex & v = vertices[j * (P+1) + i];
+        v.p = glm::vec3(x * settings.sampleSpacing, y * settings.sampleSpacing, band.Get(x, y) * settings.heightScale);
+
+        //central differences on the grid of the level, one-sided at the borders of the grid
+        int xl = glm::max(x - s, 0), xr = glm::min(x + s, band.gridSize - 1);
+        int yl = glm::max(y - s, 0), yr = glm::min(y + s, band.gridSize - 1);
+        float dx = (band.Get(xr, y) - band.Get(xl, y)) * settings.heightScale / ((xr - xl) * settings.sampleSpacing);
+        float dy = (band.Get(x, yr) - band.Get(x, yl)) * settings.heightScale / ((yr - yl) * settings.sampleSpacing);
+        v.n = glm::normalize(glm::vec3(-dx, -dy, 1.f));
+
+        patch.bbmin = glm::min(patch.bbmin, v.p);
+        patch.bbmax = glm::max(patch.bbmax, v.p);
+      }
+    }
+
+    patch.error = 0.f;
+    if (childs) {
+      //quads are split along the diagonal from the lower left to the upper right corner
+      int f = s / 2;
+      for (int y = y0; y <= y0 + P * s; y += f) {
+        for (int x = x0; x <= x0 + P * s; x += f) {
+          int cx = glm::min((x - x0) / s, P - 1);
+          int cy = glm::min((y - y0) / s, P - 1);
+          float u = static_cast<float>(x - x0 - cx * s) / s;
+          float v = static_cast<float>(y - y0 - cy * s) / s;
+          float a = band.Get(x0 + cx * s, y0 + cy * s);
+          float b = band.Get(x0 + cx * s + s, y0 + cy * s);
+          float c = band.Get(x0 + cx * s + s, y0 + cy * s + s);
+          float d = band.Get(x0 + cx * s, y0 + cy * s + s);
+          float h = (u >= v) ? a + u * (b - a) + v * (c - b) : a + v * (d - a) + u * (c - d);
+          patch.error = glm::max(patch.error, glm::abs(band.Get(x, y) - h) * settings.heightScale);
+        }
+      }
+
+      //child i covers the quarter (i & 1, i >> 1), the bounds contain the childs
+      int childsPerSide = 2 << level;
+      for (int i=0; i < 4; ++i) {
+        BuiltPatch const & child = (*childs)[(2 * py + (i >> 1)) * childsPerSide + 2 * px + (i & 1)];
+        patch.error = glm::max(patch.error, child.error);
+        patch.bbmin = glm::min(patch.bbmin, child.bbmin);
+        patch.bbmax = glm::max(patch.bbmax, child.bbmax);
+      }
+    }
+
+    //chunked patches hang skirts below their borders, which hide the cracks to coarser neighbors. the skirts reach
+    //below the patch by its error, but at least by one sample distance
+    if (settings.chunked) {
+      float skirtBottom = patch.bbmin.z - glm::max(patch.error, s * settings.sampleSpacing);
+      for (int k=0; k < 4 * P; ++k) {
+        Vertex skirt = vertices[PerimeterIndex(k, P)];
+        skirt.p.z = skirtBottom;
+        vertices.push_back(skirt);
+      }
+      patch.bbmin.z = skirtBottom;
+    }
+
+    if (settings.chunked)
+      return EncodeChunkedPayload(vertices, settings.chunkIndices, payload);
+    return EncodePayload(vertices, settings.encoding, settings.level, patch.bbmin, patch.bbmax, payload);
+  }
+
+
+
+  //builds the patches of a level row by row, the patches of a row are built in parallel
+  static bool BuildLevel(BandReader const & readBand, FILE* payloads, BuildSettings const & settings, int depth, int level,
+    std::vector<BuiltPatch> const * childs, std::vector<BuiltPatch> & patches)
+  {
+    int P = settings.patchSize;
+    int s = 1 << (depth - level);
+    int n = 1 << level;
+    //the error needs the samples of the next finer level, the normals one sample around the patch
+    int stride = childs ? s / 2 : s;
+
+    HeightBand band;
+    std::vector<std::vector<unsigned char>> bytes(n);
+    patches.resize(static_cast<size_t>(n) * n);
+
+    for (int py=0; py < n; ++py) {
+      int y0 = py * P * s;
+      if (!readBand(y0 - s, y0 + P * s + s, stride, band))
+        return false;
+
+      std::atomic<bool> success(true);
+      GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, n, [&](size_t px) {
+        if (!BuildPatch(band, settings, depth, level, static_cast<int>(px), py, childs, patches[py * n + px], bytes[px]))
+          success = false;
+      });
+      if (!success)
+        return false;
+
+      //the payloads are appended in patch order
+      for (int px=0; px < n; ++px) {
+        BuiltPatch & patch = patches[py * n + px];
+        patch.offset = _ftelli64(payloads);
+        patch.size = static_cast<glm::uint>(bytes[px].size());
+        if (fwrite(bytes[px].data(), 1, bytes[px].size(), payloads) != bytes[px].size()) {
+          std::cerr << "failed to write the payload file!" << std::endl;
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+
+
+  static void AddTriangle(glm::ivec2 a, glm::ivec2 b, glm::ivec2 c, int patchSize, std::vector<glm::uint> & triangles)
+  {
+    //counter clockwise seen from above, collapsed triangles are dropped
+    int area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0)
+      return;
+    if (area < 0)
+      std::swap(b, c);
+
+    triangles.push_back(a.y * (patchSize+1) + a.x);
+    triangles.push_back(b.y * (patchSize+1) + b.x);
+    triangles.push_back(c.y * (patchSize+1) + c.x);
+  }
+
+
+
+  //gets the vertex of a border (south, east, north, west) at the position t along it, on the border or on the ring inside it
+  static glm::ivec2 BorderVertex(int side, int t, bool inner, int patchSize)
+  {
+    int d = inner ? 1 : 0;
+    switch (side) {
+    case 0:  return glm::ivec2(t, d);
+    case 1:  return glm::ivec2(patchSize - d, t);
+    case 2:  return glm::ivec2(t, patchSize - d);
+    default: return glm::ivec2(d, t);
+    }
+  }
+
+
+
+  //triangulates the band between a border, which keeps every step-th vertex, and the ring of vertices inside it
+  static void TriangulateBorder(int patchSize, int side, int step, std::vector<glm::uint> & triangles)
+  {
+    std::vector<int> outer, inner;
+    for (int t=0; t <= patchSize; t += step)
+      outer.push_back(t);
+    for (int t=1; t < patchSize; ++t)
+      inner.push_back(t);
+
+    size_t i = 0, j = 0;
+    while (i + 1 < outer.size() || j + 1 < inner.size()) {
+      if (i + 1 < outer.size() && (j + 1 == inner.size() || outer[i+1] <= inner[j+1])) {
+        AddTriangle(BorderVertex(side, outer[i], false, patchSize), BorderVertex(side, outer[i+1], false, patchSize), BorderVertex(side, inner[j], true, patchSize), patchSize, triangles);
+        ++i;
+      }
+      else {
+        AddTriangle(BorderVertex(side, outer[i], false, patchSize), BorderVertex(side, inner[j+1], true, patchSize), BorderVertex(side, inner[j], true, patchSize), patchSize, triangles);
+        ++j;
+      }
+    }
+  }
+
+
+
+  //builds the stitching index buffer of a child with a coarser horizontal (south or north) and vertical (east or west) neighbor
+  static void BuildStitchingBuffer(int patchSize, int cid, int hlv, int vlv, std::vector<glm::uint> & triangles)
+  {
+    triangles.clear();
+    for (int y=1; y < patchSize - 1; ++y) {
+      for (int x=1; x < patchSize - 1; ++x) {
+        AddTriangle(glm::ivec2(x, y), glm::ivec2(x+1, y), glm::ivec2(x+1, y+1), patchSize, triangles);
+        AddTriangle(glm::ivec2(x, y), glm::ivec2(x+1, y+1), glm::ivec2(x, y+1), patchSize, triangles);
+      }
+    }
+
+    int horizontal = (cid < 2) ? 0 : 2;
+    int vertical = (cid & 1) ? 1 : 3;
+    for (int side=0; side < 4; ++side) {
+      int step = 1;
+      if (side == horizontal) step = glm::min(1 << hlv, patchSize);
+      if (side == vertical) step = glm::min(1 << vlv, patchSize);
+      TriangulateBorder(patchSize, side, step, triangles);
+    }
+    Terrain::CIndexOptimizer::OptimizeVertexCache(triangles);
+  }
+
+
+
+  //builds the triangle list of the chunked patches: the grid and the skirts below its borders
+  static void BuildChunkIndices(int patchSize, std::vector<glm::uint> & triangles)
+  {
+    triangles.clear();
+    for (int y=0; y < patchSize; ++y) {
+      for (int x=0; x < patchSize; ++x) {
+        AddTriangle(glm::ivec2(x, y), glm::ivec2(x+1, y), glm::ivec2(x+1, y+1), patchSize, triangles);
+        AddTriangle(glm::ivec2(x, y), glm::ivec2(x+1, y+1), glm::ivec2(x, y+1), patchSize, triangles);
+      }
+    }
+
+    //the skirt vertices follow the grid in the order of the border loop, the skirts face outwards
+    glm::uint skirts = (patchSize+1) * (patchSize+1);
+    int count = 4 * patchSize;
+    for (int k=0; k < count; ++k) {
+      glm::uint a = PerimeterIndex(k, patchSize);
+      glm::uint b = PerimeterIndex((k + 1) % count, patchSize);
+      glm::uint sa = skirts + k;
+      glm::uint sb = skirts + (k + 1) % count;
+      glm::uint skirt[6] = { sa, sb, b, sa, b, a };
+      triangles.insert(triangles.end(), skirt, skirt + 6);
+    }
+    Terrain::CIndexOptimizer::OptimizeVertexCache(triangles);
+  }
+
+
+
+  //writes the patch and its childs (depth first like the loaders read them)
+  static bool WriteHierarchy(FILE* out, FILE* payloads, BuildSettings const & settings, std::vector<std::vector<BuiltPatch>> const & levels,
+    int level, int px, int py, glm::uint label, std::vector<unsigned char> & buffer)
+  {
+    BuiltPatch const & patch = levels[level][(py << level) + px];
+    //chunked patches have no label
+    if (!settings.chunked)
+      fwrite(&label, sizeof(glm::uint), 1, out);
+    fwrite(&patch.bbmin.x, sizeof(glm::vec3), 1, out);
+    fwrite(&patch.bbmax.x, sizeof(glm::vec3), 1, out);
+    fwrite(&patch.error, sizeof(float), 1, out);
+
+    buffer.resize(patch.size);
+    if (_fseeki64(payloads, patch.offset, SEEK_SET) != 0 || fread(buffer.data(), 1, buffer.size(), payloads) != buffer.size()) {
+      std::cerr << "failed to read the payload file!" << std::endl;
+      return false;
+    }
+    fwrite(buffer.data(), 1, buffer.size(), out);
+
+    //child mask of raster-lod patches, child count of chunked patches
+    bool leaf = (level + 1 == static_cast<int>(levels.size()));
+    glm::uint childs = leaf ? 0 : (settings.chunked ? 4 : 0x0f);
+    fwrite(&childs, sizeof(glm::uint), 1, out);
+    for (int i=0; i < 4 && !leaf; ++i) {
+      if (!WriteHierarchy(out, payloads, settings, levels, level + 1, 2 * px + (i & 1), 2 * py + (i >> 1), label * 4 + i + 1, buffer))
+        return false;
+    }
+
+    if (ferror(out) != 0) {
+      std::cerr << "failed to write patch hierarchy!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+
+
+  //writes the header, the stitching buffers and the hierarchy of a raster-lod file
+  static bool WriteRlodFile(FILE* out, FILE* payloads, BuildSettings const & settings, std::vector<std::vector<BuiltPatch>> const & levels, int gridSize)
+  {
+    //the stitching buffers are optimized triangle lists, neighbors more levels coarser than the patch size allows
+    //to decimate to use the coarsest buffer
+    int depth = static_cast<int>(levels.size()) - 1;
+    int tessLevels = 1;
+    while (tessLevels <= depth && (1 << tessLevels) <= settings.patchSize)
+      ++tessLevels;
+
+    glm::uint compressFlag = settings.encoding | Terrain::Rlod::TriangleListFlag;
+    float extent[4] = { 0.f, (gridSize - 1) * settings.sampleSpacing, 0.f, (gridSize - 1) * settings.sampleSpacing };
+    glm::uint patchSize = settings.patchSize;
+    glm::uint levelCount = tessLevels;
+    fwrite(Terrain::Rlod::MAGIC, 1, 4, out);
+    fwrite(&compressFlag, sizeof(glm::uint), 1, out);
+    fwrite(extent, sizeof(float), 4, out);
+    fwrite(&patchSize, sizeof(glm::uint), 1, out);
+    fwrite(&levelCount, sizeof(glm::uint), 1, out);
+
+    std::vector<glm::uint> triangles;
+    for (int cid=0; cid < 4; ++cid) {
+      for (int hlv=0; hlv < tessLevels; ++hlv) {
+        for (int vlv=0; vlv < tessLevels; ++vlv) {
+          BuildStitchingBuffer(settings.patchSize, cid, hlv, vlv, triangles);
+          glm::uint count = static_cast<glm::uint>(triangles.size());
+          fwrite(&count, sizeof(glm::uint), 1, out);
+          fwrite(triangles.data(), sizeof(glm::uint), count, out);
+        }
+      }
+    }
+
+    std::vector<unsigned char> buffer;
+    return WriteHierarchy(out, payloads, settings, levels, 0, 0, 0, 0, buffer);
+  }
+
+
+
+  //writes the root count and the root hierarchies of a hfc file
+  static bool WriteHfcFile(FILE* out, FILE* payloads, BuildSettings const & settings, std::vector<std::vector<BuiltPatch>> const & levels,
+    int rootLevel, std::vector<long long> & offsets)
+  {
+    int n = 1 << rootLevel;
+    glm::uint numRoots = static_cast<glm::uint>(n * n) | Terrain::Hfc::TriangleListFlag;
+    fwrite(&numRoots, sizeof(glm::uint), 1, out);
+
+    std::vector<unsigned char> buffer;
+    offsets.clear();
+    for (int py=0; py < n; ++py) {
+      for (int px=0; px < n; ++px) {
+        offsets.push_back(_ftelli64(out));
+        if (!WriteHierarchy(out, payloads, settings, levels, rootLevel, px, py, 0, buffer))
+          return false;
+      }
+    }
+    return true;
+  }
+
+
+
+  //builds the levels from the leaves up and writes the raster-lod or hfc file
+  static bool BuildFile(BandReader const & readBand, int gridSize, int depth, const char* output, BuildSettings const & settings,
+    std::chrono::high_resolution_clock::time_point start)
+  {
+    std::string payloadPath = std::string(output) + ".payloads.tmp";
+    FILE* payloads = nullptr;
+    if (fopen_s(&payloads, payloadPath.c_str(), "w+b") != 0 || payloads == nullptr) {
+      std::cerr << "failed to create the payload file " << payloadPath << "!" << std::endl;
+      return false;
+    }
+
+    //every level needs the bounds and errors of its childs, the levels above the roots of chunked files are not needed.
+    //the levels are indexed from the root level of the whole quadtree
+    int rootLevel = settings.chunked ? glm::min(settings.rootLevel, depth) : 0;
+    std::vector<std::vector<BuiltPatch>> levels(depth + 1);
+    bool success = true;
+    for (int level = depth; level >= rootLevel && success; --level) {
+      success = BuildLevel(readBand, payloads, settings, depth, level, (level < depth) ? &levels[level + 1] : nullptr, levels[level]);
+      std::cout << "\tbuilt level " << level << " with " << levels[level].size() << " patches" << std::endl;
+    }
+
+    FILE* out = nullptr;
+    if (success && (fopen_s(&out, output, "wb") != 0 || out == nullptr)) {
+      std::cerr << "failed to create terrain file " << output << "!" << std::endl;
+      success = false;
+    }
+
+    long long size = 0;
+    std::vector<long long> offsets;
+    if (success) {
+      success = settings.chunked ? WriteHfcFile(out, payloads, settings, levels, rootLevel, offsets) : WriteRlodFile(out, payloads, settings, levels, gridSize);
+      size = _ftelli64(out);
+      fclose(out);
+    }
+    fclose(payloads);
+    remove(payloadPath.c_str());
+
+    //the chunked loader reads the roots in parallel with the root index
+    if (success && settings.chunked)
+      success = Terrain::Hfc::WriteRootIndex(output, size, offsets);
+
+    if (success) {
+      double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+      std::cout << "built " << output << " with " << depth + 1 - rootLevel << " levels: " << size << " bytes in "
+        << std::fixed << std::setprecision(2) << time << "s!" << std::endl;
+    }
+    return success;
+  }
+
+
+
+  static bool BuildRlod(const char* heightmap, const char* output, BuildSettings const & settings)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    //temporary height file next to the output
+    std::string heightPath = std::string(output) + ".heights.tmp";
+    FILE* heights = nullptr;
+    if (fopen_s(&heights, heightPath.c_str(), "w+b") != 0 || heights == nullptr) {
+      std::cerr << "failed to create the height file " << heightPath << "!" << std::endl;
+      return false;
+    }
+
+    int gridSize = 0, depth = 0;
+    std::vector<unsigned short> row;
+    bool success = StreamHeightmap(heightmap, heights, settings.patchSize, gridSize, depth) &&
+      BuildFile([&](int yStart, int yEnd, int stride, HeightBand & band) {
+        return ReadBand(heights, gridSize, yStart, yEnd, stride, band, row);
+      }, gridSize, depth, output, settings, start);
+
+    fclose(heights);
+    remove(heightPath.c_str());
+    return success;
+  }
+
+
+
+  static bool CheckSettings(BuildSettings const & settings)
+  {
+    if (settings.patchSize < 2 || (settings.patchSize & (settings.patchSize - 1)) != 0 || (settings.patchSize + 1) * (settings.patchSize + 1) >= 65535) {
+      std::cerr << "the patch size has to be a power of two between 2 and 128!" << std::endl;
+      return false;
+    }
+    if (settings.sampleSpacing <= 0.f) {
+      std::cerr << "the sample spacing has to be positive!" << std::endl;
+      return false;
+    }
+    if (settings.chunked && settings.encoding != Terrain::Rlod::RawEncoding) {
+      std::cerr << "hfc files only store raw payloads!" << std::endl;
+      return false;
+    }
+    if (Terrain::Rlod::IsDeltaEncoding(settings.encoding)) {
+      std::cerr << "delta coded files are written with rlod-convert from the built file!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+
+
+  int RlodBuild(int argc, char* argv[])
+  {
+    BuildSettings settings;
+    settings.patchSize = (argc > 2) ? atoi(argv[2]) : 64;
+    settings.sampleSpacing = (argc > 3) ? static_cast<float>(atof(argv[3])) : 1.f;
+    settings.heightScale = (argc > 4) ? static_cast<float>(atof(argv[4])) : 1.f;
+    settings.encoding = Terrain::Rlod::RawEncoding;
+    settings.level = (argc > 6) ? atoi(argv[6]) : Z_DEFAULT_COMPRESSION;
+    settings.chunked = false;
+    settings.rootLevel = 0;
+
+    if (argc < 2 || (argc > 5 && !ParseEncoding(argv[5], settings.encoding))) {
+      std::cerr << "usage: rlod-build <heightmap.png> <output.rlod> [patch size] [sample spacing] [height scale] [raw|half|deflate-raw|deflate-half] [deflate level]" << std::endl;
+      std::cerr << "delta coded files are written with rlod-convert from the built file" << std::endl;
+      return 1;
+    }
+    if (!CheckSettings(settings))
+      return 1;
+
+    return BuildRlod(argv[0], argv[1], settings) ? 0 : 1;
+  }
+
+
+
+  //hashes the lattice point to a value in [-1, 1]
+  static float LatticeValue(int x, int y, glm::uint seed)
+  {
+    glm::uint h = (seed * 0x9e3779b9u) ^ (static_cast<glm::uint>(x) * 0x85ebca6bu) ^ (static_cast<glm::uint>(y) * 0xc2b2ae35u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return static_cast<float>(h) / 2147483647.5f - 1.f;
+  }
+
+
+
+  //smooth interpolation of the lattice values
+  static float ValueNoise(double x, double y, glm::uint seed)
+  {
+    double fx = floor(x);
+    double fy = floor(y);
+    int ix = static_cast<int>(fx);
+    int iy = static_cast<int>(fy);
+    float u = static_cast<float>(x - fx);
+    float v = static_cast<float>(y - fy);
+    u = u * u * (3.f - 2.f * u);
+    v = v * v * (3.f - 2.f * v);
+
+    float a = LatticeValue(ix, iy, seed);
+    float b = LatticeValue(ix + 1, iy, seed);
+    float c = LatticeValue(ix, iy + 1, seed);
+    float d = LatticeValue(ix + 1, iy + 1, seed);
+    return glm::mix(glm::mix(a, b, u), glm::mix(c, d, u), v);
+  }
+
+
+
+  struct NoiseSettings {
+    glm::uint seed;
+    float roughness;      //amplitude of an octave relative to the previous one
+    int octaves;
+    double wavelength;    //wavelength of the first octave in samples
+  };
+
+  //gets the fractal brownian motion at the grid position as 16 bit height
+  static unsigned short FractalHeight(int x, int y, NoiseSettings const & noise)
+  {
+    double frequency = 1.0 / noise.wavelength;
+    float amplitude = 1.f;
+    float sum = 0.f, total = 0.f;
+    for (int octave=0; octave < noise.octaves; ++octave) {
+      sum += amplitude * ValueNoise(x * frequency, y * frequency, noise.seed + octave * 0x632be5abu);
+      total += amplitude;
+      amplitude *= noise.roughness;
+      frequency *= 2.0;
+    }
+
+    float h = glm::clamp(0.5f + 0.75f * sum / total, 0.f, 1.f);
+    return static_cast<unsigned short>(h * 65535.f + 0.5f);
+  }
+
+
+
+  //evaluates the noise for every stride-th row and column of the rows [yStart, yEnd] (clamped to the grid), the rows in parallel
+  static bool GenerateBand(NoiseSettings const & noise, int gridSize, int yStart, int yEnd, int stride, HeightBand & band)
+  {
+    band.yStart = yStart;
+    band.stride = stride;
+    band.gridSize = gridSize;
+    band.columns = (gridSize - 1) / stride + 1;
+    int rows = (yEnd - yStart) / stride + 1;
+    band.heights.resize(static_cast<size_t>(rows) * band.columns);
+
+    GLUtils::CThreadPool::GetDefaultPool().ParallelFor(0, rows, [&](size_t r) {
+      int y = glm::clamp(yStart + static_cast<int>(r) * stride, 0, gridSize - 1);
+      unsigned short* dst = &band.heights[r * band.columns];
+      for (int x=0; x < band.columns; ++x)
+        dst[x] = FractalHeight(x * stride, y, noise);
+    });
+    return true;
+  }
+
+
+
+  int Generate(int argc, char* argv[])
+  {
+    if (argc < 1) {
+      std::cerr << "usage: generate <output.rlod|output.hfc> [seed] [depth] [patch size] [sample spacing] [height scale] [roughness] [raw|half|deflate-raw|deflate-half] [root level]" << std::endl;
+      return 1;
+    }
+
+    std::string path = argv[0];
+    NoiseSettings noise;
+    noise.seed = (argc > 1) ? static_cast<glm::uint>(strtoul(argv[1], nullptr, 10)) : 1;
+    int depth = (argc > 2) ? atoi(argv[2]) : 6;
+    noise.roughness = (argc > 6) ? static_cast<float>(atof(argv[6])) : 0.5f;
+
+    BuildSettings settings;
+    settings.patchSize = (argc > 3) ? atoi(argv[3]) : 64;
+    settings.sampleSpacing = (argc > 4) ? static_cast<float>(atof(argv[4])) : 1.f;
+    settings.heightScale = (argc > 5) ? static_cast<float>(atof(argv[5])) : 0.05f;
+    settings.encoding = Terrain::Rlod::RawEncoding;
+    settings.level = Z_DEFAULT_COMPRESSION;
+    settings.chunked = path.substr(path.find_last_of('.') + 1) == "hfc";
+    settings.rootLevel = (argc > 8) ? atoi(argv[8]) : 0;
+
+    if (argc > 7 && !ParseEncoding(argv[7], settings.encoding)) {
+      std::cerr << "unknown payload encoding " << argv[7] << "!" << std::endl;
+      return 1;
+    }
+    if (depth < 0 || depth > 12 || settings.rootLevel < 0 || noise.roughness <= 0.f) {
+      std::cerr << "the depth has to be between 0 and 12, the root level and the roughness must not be negative!" << std::endl;
+      return 1;
+    }
+    if (!CheckSettings(settings))
+      return 1;
+
+    if (settings.chunked)
+      BuildChunkIndices(settings.patchSize, settings.chunkIndices);
+
+    //the first octave spans half the grid, the last one two samples
+    int gridSize = (settings.patchSize << depth) + 1;
+    noise.wavelength = 0.5 * (gridSize - 1);
+    noise.octaves = 0;
+    for (double wavelength = noise.wavelength; wavelength >= 2.0; wavelength *= 0.5)
+      ++noise.octaves;
+    noise.octaves = glm::max(noise.octaves, 1);
+
+    //uncompressed size of the vertices, so the depth can be picked for the wanted file size
+    long long patches = 0;
+    for (int level = settings.chunked ? glm::min(settings.rootLevel, depth) : 0; level <= depth; ++level)
+      patches += 1ll << (2 * level);
+    long long vertices = (settings.patchSize + 1) * (settings.patchSize + 1) + (settings.chunked ? 4 * settings.patchSize : 0);
+    std::cout << "generating a grid of " << gridSize << " x " << gridSize << " samples (seed " << noise.seed << ", " << noise.octaves << " octaves): "
+      << patches << " patches with about " << (patches * vertices * sizeof(Vertex)) / (1024 * 1024) << " MB of vertices!" << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    bool success = BuildFile([&](int yStart, int yEnd, int stride, HeightBand & band) {
+      return GenerateBand(noise, gridSize, yStart, yEnd, stride, band);
+    }, gridSize, depth, argv[0], settings, start);
+    return success ? 0 : 1;
+  }
+
+} //namespace Tools
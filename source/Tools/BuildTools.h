@@ -0,0 +1,17 @@
+#pragma once
+
+
+namespace Tools {
+
+  //builds a raster-lod file from a 16 bit grayscale png heightmap (the first image row is the northern border).
+  //the heightmap is streamed to a temporary height file, the quadtree is built level by level from the leaves up,
+  //the patches of a level are built in parallel. the patch size has to be a power of two
+  //usage: rlod-build <heightmap.png> <output.rlod> [patch size] [sample spacing] [height scale] [raw|half|deflate-raw|deflate-half] [deflate level]
+  int RlodBuild(int argc, char* argv[]);
+
+  //generates a raster-lod or hfc file (by the extension) from seeded fractal noise, the output is identical for the same
+  //arguments. the grid has patch size * 2^depth + 1 samples per side, hfc files get 4^root level roots
+  //usage: generate <output.rlod|output.hfc> [seed] [depth] [patch size] [sample spacing] [height scale] [roughness] [raw|half|deflate-raw|deflate-half] [root level]
+  int Generate(int argc, char* argv[]);
+
+} //namespace Tools
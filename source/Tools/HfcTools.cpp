@@ -0,0 +1,43 @@
+#include "HfcTools.h"
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include "HfcFormat.h"
+
+
+namespace Tools {
+
+  int HfcIndex(int argc, char* argv[])
+  {
+    if (argc < 1) {
+      std::cerr << "usage: hfc-index <file.hfc> [file.hfc ...]" << std::endl;
+      return 1;
+    }
+
+    for (int i=0; i < argc; ++i) {
+      FILE* fp = nullptr;
+      if (fopen_s(&fp, argv[i], "rb") != 0 || fp == nullptr) {
+        std::cerr << "failed to open terrain file " << argv[i] << "!" << std::endl;
+        return 1;
+      }
+
+      glm::uint numRoots = 0;
+      fread(&numRoots, sizeof(glm::uint), 1, fp);
+      numRoots &= ~Terrain::Hfc::TriangleListFlag;
+
+      std::vector<long long> offsets;
+      bool success = Terrain::Hfc::ScanRootOffsets(fp, numRoots, offsets);
+      _fseeki64(fp, 0, SEEK_END);
+      long long fileSize = _ftelli64(fp);
+      fclose(fp);
+
+      if (!success || !Terrain::Hfc::WriteRootIndex(argv[i], fileSize, offsets))
+        return 1;
+      std::cout << "indexed " << numRoots << " root hierarchies of " << argv[i] << "!" << std::endl;
+    }
+    return 0;
+  }
+
+} //namespace Tools
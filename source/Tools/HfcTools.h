@@ -0,0 +1,10 @@
+#pragma once
+
+
+namespace Tools {
+
+  //writes the root index sidecar (<file.hfc>.idx), so the loader reads the root hierarchies in parallel without scanning the file
+  //usage: hfc-index <file.hfc> [file.hfc ...]
+  int HfcIndex(int argc, char* argv[]);
+
+} //namespace Tools
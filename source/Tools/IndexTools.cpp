@@ -0,0 +1,213 @@
+#include "IndexTools.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <glm/glm.hpp>
+#include "RlodFormat.h"
+#include "HfcFormat.h"
+#include "IndexOptimizer.h"
+
+
+namespace Tools {
+
+  struct IndexStats {
+    size_t buffers;
+    size_t bytesBefore;
+    size_t bytesAfter;
+    Terrain::CIndexOptimizer::CacheStatistics before;
+    Terrain::CIndexOptimizer::CacheStatistics after;
+
+    IndexStats() : buffers(0), bytesBefore(0), bytesAfter(0) {}
+  };
+
+
+
+  //converts the strips to an optimized triangle list
+  static void OptimizeIndices(std::vector<glm::uint> const & strips, std::vector<glm::uint> & triangles, glm::uint cacheSize, IndexStats & stats)
+  {
+    Terrain::CIndexOptimizer::StripsToTriangles(strips, triangles);
+    stats.before += Terrain::CIndexOptimizer::SimulateVertexCache(triangles);
+    Terrain::CIndexOptimizer::OptimizeVertexCache(triangles, cacheSize);
+    stats.after += Terrain::CIndexOptimizer::SimulateVertexCache(triangles);
+
+    ++stats.buffers;
+    stats.bytesBefore += strips.size() * sizeof(glm::uint);
+    stats.bytesAfter += triangles.size() * sizeof(glm::uint);
+  }
+
+
+
+  //copies the rest of the file
+  static void CopyRemaining(FILE* in, FILE* out)
+  {
+    std::vector<char> buffer(1 << 20);
+    size_t size;
+    while ((size = fread(buffer.data(), 1, buffer.size(), in)) > 0)
+      fwrite(buffer.data(), 1, size, out);
+  }
+
+
+
+  //the stitching buffers of a raster-lod are rewritten, the patch payloads are copied verbatim
+  static bool OptimizeRlod(FILE* in, FILE* out, glm::uint cacheSize, IndexStats & stats)
+  {
+    char sig[4];
+    glm::uint compressFlag;
+    fread(sig, 1, 4, in);
+    fread(&compressFlag, sizeof(glm::uint), 1, in);
+    if (memcmp(sig, Terrain::Rlod::MAGIC, 4) != 0) {
+      std::cerr << "terrain file is not a raster-lod!" << std::endl;
+      return false;
+    }
+    if (compressFlag & Terrain::Rlod::TriangleListFlag) {
+      std::cerr << "terrain file is already optimized!" << std::endl;
+      return false;
+    }
+
+    compressFlag |= Terrain::Rlod::TriangleListFlag;
+    fwrite(sig, 1, 4, out);
+    fwrite(&compressFlag, sizeof(glm::uint), 1, out);
+
+    float extent[4];
+    glm::uint patchSize, tessLevels;
+    fread(extent, sizeof(float), 4, in);
+    fread(&patchSize, sizeof(glm::uint), 1, in);
+    fread(&tessLevels, sizeof(glm::uint), 1, in);
+    fwrite(extent, sizeof(float), 4, out);
+    fwrite(&patchSize, sizeof(glm::uint), 1, out);
+    fwrite(&tessLevels, sizeof(glm::uint), 1, out);
+
+    std::vector<glm::uint> strips, triangles;
+    for (glm::uint i=0; i < tessLevels*tessLevels*4; ++i) {
+      glm::uint count;
+      fread(&count, sizeof(glm::uint), 1, in);
+      strips.resize(count);
+      fread(strips.data(), sizeof(glm::uint), count, in);
+
+      OptimizeIndices(strips, triangles, cacheSize, stats);
+      count = static_cast<glm::uint>(triangles.size());
+      fwrite(&count, sizeof(glm::uint), 1, out);
+      fwrite(triangles.data(), sizeof(glm::uint), count, out);
+    }
+
+    CopyRemaining(in, out);
+    return ferror(in) == 0 && ferror(out) == 0;
+  }
+
+
+
+  //every patch of a hfc file has its own index buffer
+  static bool OptimizeHfcHierarchy(FILE* in, FILE* out, glm::uint cacheSize, IndexStats & stats)
+  {
+    //bounds, error and vertices are copied
+    float header[7];
+    glm::uint vcount, icount;
+    fread(header, sizeof(float), 7, in);
+    fread(&vcount, sizeof(glm::uint), 1, in);
+    fread(&icount, sizeof(glm::uint), 1, in);
+    std::vector<float> vertices(vcount * 6);
+    fread(vertices.data(), sizeof(float), vertices.size(), in);
+    std::vector<glm::uint> strips(icount);
+    fread(strips.data(), sizeof(glm::uint), icount, in);
+
+    std::vector<glm::uint> triangles;
+    OptimizeIndices(strips, triangles, cacheSize, stats);
+
+    icount = static_cast<glm::uint>(triangles.size());
+    fwrite(header, sizeof(float), 7, out);
+    fwrite(&vcount, sizeof(glm::uint), 1, out);
+    fwrite(&icount, sizeof(glm::uint), 1, out);
+    fwrite(vertices.data(), sizeof(float), vertices.size(), out);
+    fwrite(triangles.data(), sizeof(glm::uint), icount, out);
+
+    glm::uint childCount = 0;
+    fread(&childCount, sizeof(glm::uint), 1, in);
+    fwrite(&childCount, sizeof(glm::uint), 1, out);
+    if (childCount > 4 || ferror(in) != 0 || feof(in) != 0 || ferror(out) != 0) {
+      std::cerr << "failed to read patch hierarchy!" << std::endl;
+      return false;
+    }
+
+    for (glm::uint i=0; i < childCount; ++i) {
+      if (!OptimizeHfcHierarchy(in, out, cacheSize, stats))
+        return false;
+    }
+    return true;
+  }
+
+
+
+  static bool OptimizeHfc(FILE* in, FILE* out, glm::uint cacheSize, std::vector<long long> & offsets, IndexStats & stats)
+  {
+    glm::uint numRoots;
+    fread(&numRoots, sizeof(glm::uint), 1, in);
+    if (numRoots & Terrain::Hfc::TriangleListFlag) {
+      std::cerr << "terrain file is already optimized!" << std::endl;
+      return false;
+    }
+
+    glm::uint flaggedRoots = numRoots | Terrain::Hfc::TriangleListFlag;
+    fwrite(&flaggedRoots, sizeof(glm::uint), 1, out);
+    for (glm::uint i=0; i < numRoots; ++i) {
+      offsets.push_back(_ftelli64(out));
+      if (!OptimizeHfcHierarchy(in, out, cacheSize, stats))
+        return false;
+    }
+    return true;
+  }
+
+
+
+  int IndexOptimize(int argc, char* argv[])
+  {
+    if (argc < 2) {
+      std::cerr << "usage: index-optimize <input.rlod|input.hfc> <output> [cache size]" << std::endl;
+      return 1;
+    }
+    glm::uint cacheSize = (argc > 2) ? static_cast<glm::uint>(atoi(argv[2])) : 32;
+
+    FILE* in = nullptr;
+    if (fopen_s(&in, argv[0], "rb") != 0 || in == nullptr) {
+      std::cerr << "failed to open terrain file " << argv[0] << "!" << std::endl;
+      return 1;
+    }
+
+    FILE* out = nullptr;
+    if (fopen_s(&out, argv[1], "wb") != 0 || out == nullptr) {
+      fclose(in);
+      std::cerr << "failed to create terrain file " << argv[1] << "!" << std::endl;
+      return 1;
+    }
+
+    //raster-lod files start with their signature, everything else is taken as hfc
+    char sig[4] = {0};
+    fread(sig, 1, 4, in);
+    rewind(in);
+
+    IndexStats stats;
+    bool hfc = memcmp(sig, Terrain::Rlod::MAGIC, 4) != 0;
+    std::vector<long long> offsets;
+    bool success = hfc ?
+      OptimizeHfc(in, out, cacheSize, offsets, stats) :
+      OptimizeRlod(in, out, cacheSize, stats);
+    long long fileSize = _ftelli64(out);
+    fclose(in);
+    fclose(out);
+
+    //the root index lets the loader read the hierarchies of the optimized file in parallel
+    if (!success || (hfc && !Terrain::Hfc::WriteRootIndex(argv[1], fileSize, offsets)))
+      return 1;
+
+    std::cout << "optimized " << stats.buffers << " index buffers for a vertex cache of " << cacheSize << " entries!" << std::endl
+      << std::fixed << std::setprecision(3)
+      << "  index bytes: " << stats.bytesBefore << " -> " << stats.bytesAfter << std::endl
+      << "  ACMR (fifo 16): " << stats.before.ACMR() << " -> " << stats.after.ACMR() << std::endl
+      << "  ATVR (fifo 16): " << stats.before.ATVR() << " -> " << stats.after.ATVR() << std::endl;
+    return 0;
+  }
+
+} //namespace Tools
@@ -0,0 +1,10 @@
+#pragma once
+
+
+namespace Tools {
+
+  //converts the triangle strips of a raster-lod or hfc file to vertex cache optimized triangle lists
+  //usage: index-optimize <input.rlod|input.hfc> <output> [cache size]
+  int IndexOptimize(int argc, char* argv[]);
+
+} //namespace Tools
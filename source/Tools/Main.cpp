@@ -0,0 +1,50 @@
+#include <iostream>
+#include <cstring>
+
+#include "RlodTools.h"
+#include "IndexTools.h"
+#include "HfcTools.h"
+#include "BuildTools.h"
+#include "QueryTools.h"
+#include "TextureTools.h"
+
+
+struct Command {
+  const char* name;
+  int (*run)(int argc, char* argv[]);
+  const char* usage;
+};
+
+static const Command COMMANDS[] = {
+  { "rlod-convert", Tools::RlodConvert, "<input.rlod> <output.rlod> <raw|half|deflate-raw|deflate-half|delta|deflate-delta> [deflate level] [quantisation step]" },
+  { "rlod-bench",   Tools::RlodBench,   "<file.rlod> [file.rlod ...]" },
+  { "index-optimize", Tools::IndexOptimize, "<input.rlod|input.hfc> <output> [cache size]" },
+  { "hfc-index",    Tools::HfcIndex,    "<file.hfc> [file.hfc ...]" },
+  { "rlod-build",   Tools::RlodBuild,   "<heightmap.png> <output.rlod> [patch size] [sample spacing] [height scale] [raw|half|deflate-raw|deflate-half] [deflate level]" },
+  { "generate",     Tools::Generate,    "<output.rlod|output.hfc> [seed] [depth] [patch size] [sample spacing] [height scale] [roughness] [raw|half|deflate-raw|deflate-half] [root level]" },
+  { "raybench",     Tools::RayBench,    "<file.rlod|file.hfc|heightmap.png> [rays] [seed]" },
+  { "clearbench",   Tools::ClearBench,  "<file.rlod|file.hfc|heightmap.png> [queries] [seed] [lateral distance] [required clearance]" },
+  { "viewshed",     Tools::Viewshed,    "<file.rlod|file.hfc|heightmap.png> [x y] [observer height] [radius] [target height]" },
+  { "profilebench", Tools::ProfileBench, "<file.rlod|file.hfc|heightmap.png> [profiles] [seed] [tolerance] [spacing]" },
+  { "region-export", Tools::RegionExport, "<file.rlod> <output.obj> <max error> <x y> <x y> <x y> [x y ...]" },
+  { "pngbench",     Tools::PngBench,    "<file.png> [file.png ...]" },
+};
+
+
+//command line tools working on the terrain data sets
+int main(int argc, char* argv[])
+{
+  if (argc >= 2) {
+    for (size_t i=0; i < sizeof(COMMANDS) / sizeof(Command); ++i) {
+      if (strcmp(argv[1], COMMANDS[i].name) == 0) {
+        return COMMANDS[i].run(argc - 2, argv + 2);
+      }
+    }
+  }
+
+  std::cerr << "usage: TerrainTools <command> [arguments]" << std::endl;
+  for (size_t i=0; i < sizeof(COMMANDS) / sizeof(Command); ++i) {
+    std::cerr << "  " << COMMANDS[i].name << " " << COMMANDS[i].usage << std::endl;
+  }
+  return 1;
+}
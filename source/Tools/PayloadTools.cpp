@@ -0,0 +1,87 @@
+#include "PayloadTools.h"
+
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/half_float.hpp>
+#include <zlib.h>
+#include "RlodFormat.h"
+
+
+namespace Tools {
+
+  static const char* ENCODING_NAMES[] = { "raw", "half", "deflate-raw", "deflate-half", "delta", "deflate-delta" };
+
+
+
+  bool ParseEncoding(const char* name, glm::uint & encoding)
+  {
+    for (glm::uint i=0; Terrain::Rlod::IsKnownEncoding(i); ++i) {
+      if (strcmp(name, ENCODING_NAMES[i]) == 0) {
+        encoding = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+
+  const char* EncodingName(glm::uint encoding)
+  {
+    return Terrain::Rlod::IsKnownEncoding(encoding) ? ENCODING_NAMES[encoding] : "unknown";
+  }
+
+
+
+  bool EncodePayload(std::vector<Vertex> const & vertices, glm::uint encoding, int level, glm::vec3 const & bbmin, glm::vec3 const & bbmax,
+    std::vector<unsigned char> & payload)
+  {
+    glm::uint count;
+    std::vector<unsigned char> bytes;
+
+    if (Terrain::Rlod::IsHalfEncoding(encoding)) {
+      glm::vec3 extent = bbmax - bbmin;
+      glm::vec3 scale = glm::vec3(
+        extent.x > 0.f ? 1.f / extent.x : 0.f,
+        extent.y > 0.f ? 1.f / extent.y : 0.f,
+        extent.z > 0.f ? 1.f / extent.z : 0.f);
+
+      count = static_cast<glm::uint>(vertices.size() * 6);
+      bytes.resize(count * sizeof(glm::half));
+      glm::detail::hdata* q = reinterpret_cast<glm::detail::hdata*>(bytes.data());
+      for (size_t i=0; i < vertices.size(); ++i, q += 6) {
+        glm::vec3 p = (vertices[i].p - bbmin) * scale;
+        glm::vec3 n = vertices[i].n * 0.5f + 0.5f;
+        q[0] = glm::detail::toFloat16(p.x); q[1] = glm::detail::toFloat16(p.y); q[2] = glm::detail::toFloat16(p.z);
+        q[3] = glm::detail::toFloat16(n.x); q[4] = glm::detail::toFloat16(n.y); q[5] = glm::detail::toFloat16(n.z);
+      }
+    }
+    else {
+      count = static_cast<glm::uint>(vertices.size());
+      bytes.resize(vertices.size() * sizeof(Vertex));
+      if (count > 0)
+        memcpy(bytes.data(), vertices.data(), bytes.size());
+    }
+
+    payload.resize(sizeof(glm::uint));
+    memcpy(payload.data(), &count, sizeof(glm::uint));
+
+    if (Terrain::Rlod::IsDeflatedEncoding(encoding)) {
+      uLongf zsize = compressBound(static_cast<uLong>(bytes.size()));
+      payload.resize(2 * sizeof(glm::uint) + zsize);
+      if (compress2(payload.data() + 2 * sizeof(glm::uint), &zsize, bytes.data(), static_cast<uLong>(bytes.size()), level) != Z_OK) {
+        std::cerr << "failed to deflate patch payload!" << std::endl;
+        return false;
+      }
+
+      glm::uint size = static_cast<glm::uint>(zsize);
+      memcpy(payload.data() + sizeof(glm::uint), &size, sizeof(glm::uint));
+      payload.resize(2 * sizeof(glm::uint) + zsize);
+    }
+    else {
+      payload.insert(payload.end(), bytes.begin(), bytes.end());
+    }
+    return true;
+  }
+
+} //namespace Tools
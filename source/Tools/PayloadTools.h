@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+
+namespace Tools {
+
+  //vertex layout of the raw payload
+  struct Vertex {
+    glm::vec3 p;
+    glm::vec3 n;
+  };
+
+  //parses the name of a payload encoding, returns false for unknown encodings
+  bool ParseEncoding(const char* name, glm::uint & encoding);
+
+  //gets the name of a payload encoding
+  const char* EncodingName(glm::uint encoding);
+
+  //encodes the vertices of a patch as raw or half payload (not delta coded): uint count, [uint deflated size,] bytes
+  bool EncodePayload(std::vector<Vertex> const & vertices, glm::uint encoding, int level, glm::vec3 const & bbmin, glm::vec3 const & bbmax,
+    std::vector<unsigned char> & payload);
+
+} //namespace Tools
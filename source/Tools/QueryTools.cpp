@@ -0,0 +1,373 @@
+#include "QueryTools.h"
+
+#include <cstdlib>
+#include <cstdio>
+#include <cfloat>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <glm/glm.hpp>
+#include "TerrainModel.h"
+#include "RasterTerrainModel.h"
+#include "ChunkedTerrainModel.h"
+#include "ClipmapTerrainModel.h"
+#include "Viewshed.h"
+#include "ThreadPool.h"
+
+
+namespace Tools {
+
+  //loads the terrain model selected by the file extension (like the viewer)
+  static std::unique_ptr<Terrain::CTerrainModel> LoadModel(std::string const & path)
+  {
+    std::unique_ptr<Terrain::CTerrainModel> model;
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    if (extension == "hfc")
+      model.reset(new Terrain::CChunkedTerrainModel());
+    else if (extension == "png")
+      model.reset(new Terrain::CClipmapTerrainModel());
+    else
+      model.reset(new Terrain::CRasterTerrainModel());
+
+    if (!model->Init(path.c_str())) {
+      std::cerr << "failed to load terrain " << path << "!" << std::endl;
+      model.reset();
+    }
+    else if (model->GetHeightPyramid() == nullptr) {
+      std::cerr << "terrain " << path << " has no height pyramid!" << std::endl;
+      model.reset();
+    }
+    return model;
+  }
+
+
+
+  //uniform random number in [0, 1), the same on every platform
+  static float Random(std::mt19937 & rng)
+  {
+    return static_cast<float>(rng() >> 8) * (1.f / 16777216.f);
+  }
+
+
+
+  int RayBench(int argc, char* argv[])
+  {
+    if (argc < 1) {
+      std::cerr << "usage: raybench <file.rlod|file.hfc|heightmap.png> [rays] [seed]" << std::endl;
+      return 1;
+    }
+    size_t count = (argc > 1) ? static_cast<size_t>(atoi(argv[1])) : 100000;
+    std::mt19937 rng((argc > 2) ? static_cast<std::mt19937::result_type>(strtoul(argv[2], nullptr, 10)) : 1);
+
+    std::unique_ptr<Terrain::CTerrainModel> model = LoadModel(argv[0]);
+    if (!model)
+      return 1;
+
+    //rays from above the terrain onto random ground positions, from steep picking rays to grazing line of sight rays
+    Terrain::CHeightPyramid const & pyramid = *model->GetHeightPyramid();
+    glm::vec2 min = pyramid.GetMin();
+    glm::vec2 extent = pyramid.GetMax() - min;
+    glm::vec2 heights = pyramid.GetHeightRange();
+    std::vector<Terrain::Ray> rays(count);
+    for (size_t i=0; i < count; ++i) {
+      glm::vec2 target = min + extent * glm::vec2(Random(rng), Random(rng));
+      glm::vec2 offset = (glm::vec2(Random(rng), Random(rng)) - 0.5f) * extent * 0.5f;
+      float height = heights.y + (heights.y - heights.x + 1.f) * Random(rng);
+      glm::vec3 origin(target + offset, height);
+      rays[i] = Terrain::Ray(origin, glm::vec3(target, heights.x) - origin, 2.f);
+    }
+
+    //single rays
+    std::vector<Terrain::RayHit> single(count);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i=0; i < count; ++i)
+      model->RayCast(rays[i], single[i]);
+    double singleTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    //batch
+    std::vector<Terrain::RayHit> batch;
+    start = std::chrono::high_resolution_clock::now();
+    model->RayCastBatch(rays, batch);
+    double batchTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    size_t hits = 0, mismatches = 0;
+    double checksum = 0.0;
+    for (size_t i=0; i < count; ++i) {
+      if (single[i].hit) {
+        ++hits;
+        checksum += single[i].distance;
+      }
+      if (single[i].hit != batch[i].hit || single[i].distance != batch[i].distance)
+        ++mismatches;
+    }
+
+    std::cout << std::endl << "pyramid of " << pyramid.GetColumns() << " x " << pyramid.GetRows() << " samples, " << pyramid.GetLevelCount() << " levels" << std::endl;
+    std::cout << count << " rays, " << hits << " hits, checksum " << std::fixed << std::setprecision(6) << checksum << std::endl;
+    std::cout << std::setprecision(0)
+      << "single: " << std::setw(12) << count / glm::max(singleTime, 1e-9) << " rays/s" << std::endl
+      << "batch:  " << std::setw(12) << count / glm::max(batchTime, 1e-9) << " rays/s ("
+      << GLUtils::CThreadPool::GetDefaultPool().GetNumberOfThreads() + 1 << " threads)" << std::endl;
+    if (mismatches > 0) {
+      std::cerr << mismatches << " batched rays differ from the single rays!" << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+
+
+  //points of a look-ahead path
+  static const int PATH_POINTS = 16;
+
+  int ClearBench(int argc, char* argv[])
+  {
+    if (argc < 1) {
+      std::cerr << "usage: clearbench <file.rlod|file.hfc|heightmap.png> [queries] [seed] [lateral distance] [required clearance]" << std::endl;
+      return 1;
+    }
+    size_t count = (argc > 1) ? static_cast<size_t>(atoi(argv[1])) : 10000;
+    std::mt19937 rng((argc > 2) ? static_cast<std::mt19937::result_type>(strtoul(argv[2], nullptr, 10)) : 1);
+
+    std::unique_ptr<Terrain::CTerrainModel> model = LoadModel(argv[0]);
+    if (!model)
+      return 1;
+
+    Terrain::CHeightPyramid const & pyramid = *model->GetHeightPyramid();
+    glm::vec2 min = pyramid.GetMin();
+    glm::vec2 extent = pyramid.GetMax() - min;
+    glm::vec2 heights = pyramid.GetHeightRange();
+    glm::vec2 spacing = pyramid.GetSpacing();
+    float lateral = (argc > 3) ? static_cast<float>(atof(argv[3])) : 2.f * glm::max(spacing.x, spacing.y);
+    float required = (argc > 4) ? static_cast<float>(atof(argv[4])) : 0.05f * (heights.y - heights.x);
+
+    //straight paths of a twentieth of the terrain from the height range, some climbing and some descending
+    std::vector<Terrain::FlightCorridor> corridors(count);
+    float length = 0.05f * glm::max(extent.x, extent.y);
+    for (size_t i=0; i < count; ++i) {
+      Terrain::FlightCorridor & corridor = corridors[i];
+      corridor.lateralDistance = lateral;
+      corridor.requiredClearance = required;
+      float angle = 6.2831853f * Random(rng);
+      glm::vec2 start = min + extent * glm::vec2(Random(rng), Random(rng));
+      glm::vec2 step = glm::vec2(glm::cos(angle), glm::sin(angle)) * length / static_cast<float>(PATH_POINTS - 1);
+      float height = heights.x + (heights.y - heights.x) * (0.5f + Random(rng));
+      float climb = (heights.y - heights.x) * (Random(rng) - 0.7f) / static_cast<float>(PATH_POINTS - 1);
+      for (int p=0; p < PATH_POINTS; ++p)
+        corridor.path.push_back(glm::vec3(start + step * static_cast<float>(p), height + climb * static_cast<float>(p)));
+    }
+
+    std::vector<Terrain::ClearanceResult> results(count);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i=0; i < count; ++i)
+      model->GetClearance(corridors[i], results[i]);
+    double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    size_t conflicts = 0;
+    double checksum = 0.0;
+    for (size_t i=0; i < count; ++i) {
+      if (results[i].conflict) {
+        ++conflicts;
+        checksum += results[i].conflictDistance;
+      }
+      if (results[i].minClearance != FLT_MAX)
+        checksum += results[i].minClearance;
+    }
+
+    std::cout << std::endl << "pyramid of " << pyramid.GetColumns() << " x " << pyramid.GetRows() << " samples, " << pyramid.GetLevelCount() << " levels" << std::endl;
+    std::cout << count << " corridors of " << PATH_POINTS << " points over " << length << ", lateral distance " << lateral
+      << ", required clearance " << required << std::endl;
+    std::cout << conflicts << " conflicts, checksum " << std::fixed << std::setprecision(6) << checksum << std::endl;
+    std::cout << std::setprecision(2) << "query: " << std::setw(10) << time * 1e6 / glm::max<size_t>(count, 1) << " us" << std::endl;
+    return 0;
+  }
+
+
+
+  //vertices of a profile polyline
+  static const int PROFILE_POINTS = 8;
+
+  int ProfileBench(int argc, char* argv[])
+  {
+    if (argc < 1) {
+      std::cerr << "usage: profilebench <file.rlod|file.hfc|heightmap.png> [profiles] [seed] [tolerance] [spacing]" << std::endl;
+      return 1;
+    }
+    size_t count = (argc > 1) ? static_cast<size_t>(atoi(argv[1])) : 1000;
+    std::mt19937 rng((argc > 2) ? static_cast<std::mt19937::result_type>(strtoul(argv[2], nullptr, 10)) : 1);
+
+    std::unique_ptr<Terrain::CTerrainModel> model = LoadModel(argv[0]);
+    if (!model)
+      return 1;
+
+    Terrain::CHeightPyramid const & pyramid = *model->GetHeightPyramid();
+    glm::vec2 min = pyramid.GetMin();
+    glm::vec2 extent = pyramid.GetMax() - min;
+    glm::vec2 heights = pyramid.GetHeightRange();
+    glm::vec2 spacing = pyramid.GetSpacing();
+    float tolerance = (argc > 3) ? static_cast<float>(atof(argv[3])) : 0.01f * (heights.y - heights.x);
+    float sampleSpacing = (argc > 4) ? static_cast<float>(atof(argv[4])) : glm::max(spacing.x, spacing.y);
+
+    //polylines of random vertices within a tenth of the terrain
+    std::vector<Terrain::ProfileRequest> requests(count);
+    for (size_t i=0; i < count; ++i) {
+      Terrain::ProfileRequest & request = requests[i];
+      request.spacing = sampleSpacing;
+      request.tolerance = tolerance;
+      glm::vec2 start = min + extent * glm::vec2(Random(rng), Random(rng));
+      for (int p=0; p < PROFILE_POINTS; ++p)
+        request.path.push_back(glm::clamp(start + (glm::vec2(Random(rng), Random(rng)) - 0.5f) * extent * 0.1f, min, min + extent));
+    }
+
+    //single profiles
+    std::vector<std::vector<Terrain::ProfilePoint>> single(count);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i=0; i < count; ++i)
+      model->GetProfile(requests[i], single[i]);
+    double singleTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    //batch
+    std::vector<std::vector<Terrain::ProfilePoint>> batch;
+    start = std::chrono::high_resolution_clock::now();
+    model->GetProfiles(requests, batch);
+    double batchTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    size_t samples = 0, mismatches = 0, violations = 0;
+    double levels = 0.0, error = 0.0, maxError = 0.0;
+    for (size_t i=0; i < count; ++i) {
+      if (single[i].size() != batch[i].size())
+        ++mismatches;
+      for (size_t p=0; p < single[i].size(); ++p) {
+        Terrain::ProfilePoint const & point = single[i][p];
+        if (p < batch[i].size() && point.position != batch[i][p].position)
+          ++mismatches;
+        double e = glm::abs(point.position.z - pyramid.GetBilinearHeight(glm::vec2(point.position)));
+        if (e > tolerance * 1.0001f + 1e-4f)
+          ++violations;
+        levels += point.level;
+        error += e;
+        maxError = glm::max(maxError, e);
+      }
+      samples += single[i].size();
+    }
+
+    std::cout << std::endl << "pyramid of " << pyramid.GetColumns() << " x " << pyramid.GetRows() << " samples, " << pyramid.GetLevelCount() << " levels" << std::endl;
+    std::cout << count << " profiles, " << samples << " samples every " << sampleSpacing << ", tolerance " << tolerance << std::endl;
+    std::cout << std::fixed << std::setprecision(3) << "mean level " << levels / glm::max<size_t>(samples, 1)
+      << ", mean error " << error / glm::max<size_t>(samples, 1) << ", max error " << maxError << std::endl;
+    std::cout << std::setprecision(0)
+      << "single: " << std::setw(12) << samples / glm::max(singleTime, 1e-9) << " samples/s" << std::endl
+      << "batch:  " << std::setw(12) << samples / glm::max(batchTime, 1e-9) << " samples/s ("
+      << GLUtils::CThreadPool::GetDefaultPool().GetNumberOfThreads() + 1 << " threads)" << std::endl;
+    if (mismatches > 0 || violations > 0) {
+      std::cerr << mismatches << " batched profiles differ, " << violations << " samples exceed the tolerance!" << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+
+
+  int Viewshed(int argc, char* argv[])
+  {
+    if (argc < 1) {
+      std::cerr << "usage: viewshed <file.rlod|file.hfc|heightmap.png> [x y] [observer height] [radius] [target height]" << std::endl;
+      return 1;
+    }
+
+    std::unique_ptr<Terrain::CTerrainModel> model = LoadModel(argv[0]);
+    if (!model)
+      return 1;
+
+    Terrain::CHeightPyramid const & pyramid = *model->GetHeightPyramid();
+    Terrain::ViewshedSettings settings;
+    settings.observer = 0.5f * (pyramid.GetMin() + pyramid.GetMax());
+    settings.radius = glm::length(pyramid.GetMax() - pyramid.GetMin());
+    if (argc > 2)
+      settings.observer = glm::vec2(static_cast<float>(atof(argv[1])), static_cast<float>(atof(argv[2])));
+    if (argc > 3)
+      settings.observerHeight = static_cast<float>(atof(argv[3]));
+    if (argc > 4)
+      settings.radius = static_cast<float>(atof(argv[4]));
+    if (argc > 5)
+      settings.targetHeight = static_cast<float>(atof(argv[5]));
+
+    Terrain::CViewshed viewshed;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!viewshed.Compute(pyramid, settings))
+      return 1;
+    double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    size_t samples = 0;
+    std::vector<unsigned char> const & raster = viewshed.GetRaster();
+    for (auto iter = raster.begin(); iter != raster.end(); ++iter) {
+      if (*iter != Terrain::CViewshed::Outside)
+        ++samples;
+    }
+
+    std::cout << std::endl << "observer at " << settings.observer.x << ", " << settings.observer.y << " (" << settings.observerHeight
+      << " above the terrain), radius " << settings.radius << std::endl;
+    std::cout << "raster of " << viewshed.GetWidth() << " x " << viewshed.GetHeight() << " samples, " << viewshed.GetVisibleCount()
+      << " of " << samples << " visible (" << std::fixed << std::setprecision(2) << 100.0 * viewshed.GetVisibleCount() / glm::max<size_t>(samples, 1) << "%)" << std::endl;
+    std::cout << "viewshed: " << std::setw(10) << time * 1e3 << " ms (" << GLUtils::CThreadPool::GetDefaultPool().GetNumberOfThreads() + 1 << " threads)" << std::endl;
+    return 0;
+  }
+
+
+
+  int RegionExport(int argc, char* argv[])
+  {
+    if (argc < 9) {
+      std::cerr << "usage: region-export <file.rlod> <output.obj> <max error> <x y> <x y> <x y> [x y ...]" << std::endl;
+      return 1;
+    }
+
+    Terrain::RegionQuery query;
+    query.maxError = static_cast<float>(atof(argv[2]));
+    query.clipTriangles = true;
+    for (int i=3; i + 1 < argc; i += 2)
+      query.polygon.push_back(glm::vec2(atof(argv[i]), atof(argv[i+1])));
+
+    std::unique_ptr<Terrain::CTerrainModel> model = LoadModel(argv[0]);
+    if (!model)
+      return 1;
+
+    FILE* out = nullptr;
+    if (fopen_s(&out, argv[1], "w") != 0 || out == nullptr) {
+      std::cerr << "failed to open " << argv[1] << "!" << std::endl;
+      return 1;
+    }
+
+    //the triangles are written while the patches arrive, the faces use relative indices
+    size_t patches = 0, insidePatches = 0, triangles = 0;
+    float maxError = 0.f;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool success = model->QueryRegion(query, [&](Terrain::RegionPatch const & patch) {
+      ++patches;
+      if (patch.inside)
+        ++insidePatches;
+      maxError = glm::max(maxError, patch.error);
+      for (size_t i=0; i + 2 < patch.triangles.size(); i += 3) {
+        for (int k=0; k < 3; ++k)
+          fprintf(out, "v %f %f %f\n", patch.triangles[i+k].x, patch.triangles[i+k].y, patch.triangles[i+k].z);
+        fprintf(out, "f -3 -2 -1\n");
+      }
+      triangles += patch.triangles.size() / 3;
+      return true;
+    });
+    double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    fclose(out);
+
+    if (!success) {
+      std::cerr << "terrain " << argv[0] << " does not support region queries!" << std::endl;
+      return 1;
+    }
+    std::cout << std::endl << patches << " patches (" << insidePatches << " inside the polygon), max error " << maxError << std::endl;
+    std::cout << triangles << " triangles written to " << argv[1] << " in " << std::fixed << std::setprecision(1) << time * 1e3 << " ms" << std::endl;
+    return 0;
+  }
+
+} //namespace Tools
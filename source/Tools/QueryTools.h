@@ -0,0 +1,31 @@
+#pragma once
+
+
+namespace Tools {
+
+  //measures the ray casts against the height pyramid of a terrain in rays per second, single rays on the calling thread
+  //and batches on the thread pool. the rays are random oblique rays onto the terrain (seeded, so the runs are comparable)
+  //usage: raybench <file.rlod|file.hfc|heightmap.png> [rays] [seed]
+  int RayBench(int argc, char* argv[]);
+
+  //measures the clearance queries of flight corridors against the height pyramid of a terrain in microseconds per query.
+  //the corridors are random look-ahead paths over the terrain (seeded), some of them descend into the terrain
+  //usage: clearbench <file.rlod|file.hfc|heightmap.png> [queries] [seed] [lateral distance] [required clearance]
+  int ClearBench(int argc, char* argv[]);
+
+  //computes the viewshed of an observer over the height pyramid of a terrain and reports the time and the visible samples.
+  //the observer is at the center of the terrain by default, the radius covers the whole terrain
+  //usage: viewshed <file.rlod|file.hfc|heightmap.png> [x y] [observer height] [radius] [target height]
+  int Viewshed(int argc, char* argv[]);
+
+  //measures the elevation profiles along random polylines over a terrain, single profiles on the calling thread and batches on
+  //the thread pool. reports the samples per second, the levels read and the height errors against the finest level
+  //usage: profilebench <file.rlod|file.hfc|heightmap.png> [profiles] [seed] [tolerance] [spacing]
+  int ProfileBench(int argc, char* argv[]);
+
+  //exports the terrain under a ground polygon as a wavefront obj. the patches covering the polygon within the maximum error
+  //are streamed from the region query, their triangles clipped to the polygon
+  //usage: region-export <file.rlod> <output.obj> <max error> <x y> <x y> <x y> [x y ...]
+  int RegionExport(int argc, char* argv[]);
+
+} //namespace Tools
@@ -0,0 +1,447 @@
+#include "RlodTools.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <glm/glm.hpp>
+#include <glm/gtc/half_float.hpp>
+#include <zlib.h>
+#include "RlodFormat.h"
+#include "HeightDeltaCodec.h"
+#include "RasterTerrainModel.h"
+#include "PayloadTools.h"
+
+
+namespace Tools {
+
+  struct ConvertStats {
+    size_t patches;
+    size_t rawBytes;      //payload bytes as raw vertices
+    size_t storedBytes;   //payload bytes written to the file
+
+    ConvertStats() : patches(0), rawBytes(0), storedBytes(0) {}
+  };
+
+  //quantised heights of the parent patch in the input and output file (delta coded files only)
+  struct DeltaContext {
+    Terrain::CHeightDeltaCodec codec;
+    std::vector<int> const * parentHeights;
+    glm::uint childIndex;
+  };
+
+  //inflates the bytes of a deflated payload
+  static bool InflatePayload(std::vector<unsigned char> const & zbytes, std::vector<unsigned char> & bytes)
+  {
+    uLongf size = static_cast<uLongf>(bytes.size());
+    if (uncompress(bytes.data(), &size, zbytes.data(), static_cast<uLong>(zbytes.size())) != Z_OK || size != bytes.size()) {
+      std::cerr << "failed to inflate patch payload!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+
+
+  //reads and decodes the residuals of a delta coded patch
+  static bool ReadDeltaPayload(FILE* fp, glm::uint encoding, glm::vec3 const & bbmin, glm::vec3 const & bbmax,
+    DeltaContext const & delta, std::vector<Vertex> & vertices, std::vector<int> & heights)
+  {
+    glm::uint count, size, zsize;
+    fread(&count, sizeof(glm::uint), 1, fp);
+    fread(&size, sizeof(glm::uint), 1, fp);
+    std::vector<unsigned char> stream(size);
+    if (Terrain::Rlod::IsDeflatedEncoding(encoding)) {
+      fread(&zsize, sizeof(glm::uint), 1, fp);
+      std::vector<unsigned char> zbytes(zsize);
+      fread(zbytes.data(), 1, zsize, fp);
+      if (!InflatePayload(zbytes, stream))
+        return false;
+    }
+    else {
+      fread(stream.data(), 1, size, fp);
+    }
+
+    std::vector<int> prediction(delta.codec.GetVertexCount());
+    heights.resize(delta.codec.GetVertexCount());
+    delta.codec.Predict(delta.parentHeights ? delta.parentHeights->data() : nullptr, delta.childIndex, prediction.data());
+    if (count != delta.codec.GetVertexCount() || !delta.codec.Decode(stream.data(), stream.size(), prediction.data(), heights.data())) {
+      std::cerr << "failed to decode patch payload!" << std::endl;
+      return false;
+    }
+
+    vertices.resize(count);
+    delta.codec.Reconstruct(heights.data(), bbmin, bbmax, &vertices[0].p.x);
+    return true;
+  }
+
+
+
+  //quantises the heights of the patch and writes the residuals against the parent
+  static bool WriteDeltaPayload(FILE* fp, glm::uint encoding, int level, glm::vec3 const & bbmin, glm::vec3 const & bbmax,
+    DeltaContext const & delta, std::vector<Vertex> const & vertices, std::vector<int> & heights, ConvertStats & stats)
+  {
+    //the decoder reconstructs x and y from the bounds, so the patches have to be regular grids
+    glm::uint patchSize = delta.codec.GetPatchSize();
+    glm::uint rowSize = patchSize + 1;
+    glm::vec3 extent = bbmax - bbmin;
+    float tolerance = 1e-3f * glm::max(extent.x, extent.y);
+    if (vertices.size() != delta.codec.GetVertexCount()) {
+      std::cerr << "patches are no regular grids, delta coding is not possible!" << std::endl;
+      return false;
+    }
+
+    heights.resize(vertices.size());
+    for (glm::uint y=0; y < rowSize; ++y) {
+      for (glm::uint x=0; x < rowSize; ++x) {
+        glm::vec3 const & p = vertices[y*rowSize + x].p;
+        if (glm::abs(p.x - (bbmin.x + extent.x * x / patchSize)) > tolerance || glm::abs(p.y - (bbmin.y + extent.y * y / patchSize)) > tolerance) {
+          std::cerr << "patches are no regular grids, delta coding is not possible!" << std::endl;
+          return false;
+        }
+        heights[y*rowSize + x] = delta.codec.Quantize(p.z);
+      }
+    }
+
+    std::vector<int> prediction(vertices.size());
+    std::vector<unsigned char> stream;
+    delta.codec.Predict(delta.parentHeights ? delta.parentHeights->data() : nullptr, delta.childIndex, prediction.data());
+    delta.codec.Encode(heights.data(), prediction.data(), stream);
+
+    glm::uint count = static_cast<glm::uint>(vertices.size());
+    glm::uint size = static_cast<glm::uint>(stream.size());
+    fwrite(&count, sizeof(glm::uint), 1, fp);
+    fwrite(&size, sizeof(glm::uint), 1, fp);
+    stats.rawBytes += vertices.size() * sizeof(Vertex);
+
+    if (Terrain::Rlod::IsDeflatedEncoding(encoding)) {
+      uLongf zsize = compressBound(size);
+      std::vector<unsigned char> zbytes(zsize);
+      if (compress2(zbytes.data(), &zsize, stream.data(), size, level) != Z_OK) {
+        std::cerr << "failed to deflate patch payload!" << std::endl;
+        return false;
+      }
+
+      glm::uint stored = static_cast<glm::uint>(zsize);
+      fwrite(&stored, sizeof(glm::uint), 1, fp);
+      fwrite(zbytes.data(), 1, zsize, fp);
+      stats.storedBytes += zsize;
+    }
+    else {
+      fwrite(stream.data(), 1, stream.size(), fp);
+      stats.storedBytes += stream.size();
+    }
+    return true;
+  }
+
+
+
+  //reads the payload of a patch and decodes it to raw vertices
+  static bool ReadPayload(FILE* fp, glm::uint encoding, glm::vec3 const & bbmin, glm::vec3 const & bbmax, std::vector<Vertex> & vertices)
+  {
+    bool half = Terrain::Rlod::IsHalfEncoding(encoding);
+    size_t elementSize = half ? sizeof(glm::half) : sizeof(Vertex);
+
+    glm::uint count;
+    fread(&count, sizeof(glm::uint), 1, fp);
+    std::vector<unsigned char> bytes(count * elementSize);
+
+    if (Terrain::Rlod::IsDeflatedEncoding(encoding)) {
+      glm::uint zsize;
+      fread(&zsize, sizeof(glm::uint), 1, fp);
+      std::vector<unsigned char> zbytes(zsize);
+      fread(zbytes.data(), 1, zsize, fp);
+
+      if (!InflatePayload(zbytes, bytes))
+        return false;
+    }
+    else {
+      fread(bytes.data(), 1, bytes.size(), fp);
+    }
+
+    if (half) {
+      //positions relative to the patch bounds, normals mapped to [0, 1]
+      glm::vec3 extent = bbmax - bbmin;
+      glm::detail::hdata const * q = reinterpret_cast<glm::detail::hdata const *>(bytes.data());
+      vertices.resize(count / 6);
+      for (size_t i=0; i < vertices.size(); ++i, q += 6) {
+        vertices[i].p = bbmin + extent * glm::vec3(glm::detail::toFloat32(q[0]), glm::detail::toFloat32(q[1]), glm::detail::toFloat32(q[2]));
+        vertices[i].n = glm::vec3(glm::detail::toFloat32(q[3]), glm::detail::toFloat32(q[4]), glm::detail::toFloat32(q[5])) * 2.f - 1.f;
+      }
+    }
+    else {
+      vertices.resize(count);
+      if (count > 0)
+        memcpy(vertices.data(), bytes.data(), bytes.size());
+    }
+    return true;
+  }
+
+
+
+  //encodes the vertices of a patch and writes the payload
+  static bool WritePayload(FILE* fp, glm::uint encoding, int level, glm::vec3 const & bbmin, glm::vec3 const & bbmax,
+    std::vector<Vertex> const & vertices, ConvertStats & stats)
+  {
+    std::vector<unsigned char> payload;
+    if (!EncodePayload(vertices, encoding, level, bbmin, bbmax, payload))
+      return false;
+
+    fwrite(payload.data(), 1, payload.size(), fp);
+    stats.rawBytes += vertices.size() * sizeof(Vertex);
+    stats.storedBytes += payload.size() - (Terrain::Rlod::IsDeflatedEncoding(encoding) ? 2 : 1) * sizeof(glm::uint);
+    return true;
+  }
+
+
+
+  static bool ConvertHierarchy(FILE* in, FILE* out, glm::uint inEncoding, glm::uint outEncoding, int level,
+    DeltaContext inDelta, DeltaContext outDelta, ConvertStats & stats)
+  {
+    //label, bounds and error are copied
+    glm::uint label;
+    glm::vec3 bbmin, bbmax;
+    float error;
+    fread(&label, sizeof(glm::uint), 1, in);
+    fread(&bbmin.x, sizeof(glm::vec3), 1, in);
+    fread(&bbmax.x, sizeof(glm::vec3), 1, in);
+    fread(&error, sizeof(float), 1, in);
+    fwrite(&label, sizeof(glm::uint), 1, out);
+    fwrite(&bbmin.x, sizeof(glm::vec3), 1, out);
+    fwrite(&bbmax.x, sizeof(glm::vec3), 1, out);
+    fwrite(&error, sizeof(float), 1, out);
+
+    //childs are predicted from the heights of this patch
+    std::vector<Vertex> vertices;
+    std::vector<int> inHeights, outHeights;
+    inDelta.childIndex = outDelta.childIndex = (label-1) & 0x03;
+
+    bool success = Terrain::Rlod::IsDeltaEncoding(inEncoding) ?
+      ReadDeltaPayload(in, inEncoding, bbmin, bbmax, inDelta, vertices, inHeights) :
+      ReadPayload(in, inEncoding, bbmin, bbmax, vertices);
+    if (success) {
+      success = Terrain::Rlod::IsDeltaEncoding(outEncoding) ?
+        WriteDeltaPayload(out, outEncoding, level, bbmin, bbmax, outDelta, vertices, outHeights, stats) :
+        WritePayload(out, outEncoding, level, bbmin, bbmax, vertices, stats);
+    }
+    if (!success)
+      return false;
+    ++stats.patches;
+    inDelta.parentHeights = &inHeights;
+    outDelta.parentHeights = &outHeights;
+
+    glm::uint cmask;
+    fread(&cmask, sizeof(glm::uint), 1, in);
+    fwrite(&cmask, sizeof(glm::uint), 1, out);
+
+    for (glm::uint i=0; i < 4; ++i) {
+      if ((cmask & (1 << i)) && !ConvertHierarchy(in, out, inEncoding, outEncoding, level, inDelta, outDelta, stats))
+        return false;
+    }
+
+    if (ferror(in) != 0 || ferror(out) != 0) {
+      std::cerr << "failed to convert patch hierarchy!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+
+
+  int RlodConvert(int argc, char* argv[])
+  {
+    glm::uint outEncoding;
+    if (argc < 3 || !ParseEncoding(argv[2], outEncoding)) {
+      std::cerr << "usage: rlod-convert <input.rlod> <output.rlod> <raw|half|deflate-raw|deflate-half|delta|deflate-delta> [deflate level] [quantisation step]" << std::endl;
+      return 1;
+    }
+    int level = (argc > 3) ? atoi(argv[3]) : Z_DEFAULT_COMPRESSION;
+    float quantStep = (argc > 4) ? static_cast<float>(atof(argv[4])) : 0.f;
+
+    FILE* in = nullptr;
+    if (fopen_s(&in, argv[0], "rb") != 0 || in == nullptr) {
+      std::cerr << "failed to open terrain file " << argv[0] << "!" << std::endl;
+      return 1;
+    }
+
+    char sig[4];
+    glm::uint inEncoding;
+    fread(sig, 1, 4, in);
+    fread(&inEncoding, sizeof(glm::uint), 1, in);
+    glm::uint indexFlag = inEncoding & Terrain::Rlod::TriangleListFlag;
+    inEncoding &= Terrain::Rlod::EncodingMask;
+    if (memcmp(sig, Terrain::Rlod::MAGIC, 4) != 0 || !Terrain::Rlod::IsKnownEncoding(inEncoding)) {
+      fclose(in);
+      std::cerr << "terrain file is not a raster-lod!" << std::endl;
+      return 1;
+    }
+
+    FILE* out = nullptr;
+    if (fopen_s(&out, argv[1], "wb") != 0 || out == nullptr) {
+      fclose(in);
+      std::cerr << "failed to create terrain file " << argv[1] << "!" << std::endl;
+      return 1;
+    }
+    //optimized triangle lists stay optimized
+    glm::uint compressFlag = outEncoding | indexFlag;
+    fwrite(Terrain::Rlod::MAGIC, 1, 4, out);
+    fwrite(&compressFlag, sizeof(glm::uint), 1, out);
+
+    //extent, patch size and tessellation levels are copied
+    float extent[4];
+    glm::uint patchSize, tessLevels;
+    fread(extent, sizeof(float), 4, in);
+    fread(&patchSize, sizeof(glm::uint), 1, in);
+    fread(&tessLevels, sizeof(glm::uint), 1, in);
+    fwrite(extent, sizeof(float), 4, out);
+    fwrite(&patchSize, sizeof(glm::uint), 1, out);
+    fwrite(&tessLevels, sizeof(glm::uint), 1, out);
+
+    //the stitching index buffers are copied as well
+    std::vector<glm::uint> indices;
+    for (glm::uint i=0; i < tessLevels*tessLevels*4; ++i) {
+      glm::uint count;
+      fread(&count, sizeof(glm::uint), 1, in);
+      indices.resize(count);
+      fread(indices.data(), sizeof(glm::uint), count, in);
+      fwrite(&count, sizeof(glm::uint), 1, out);
+      fwrite(indices.data(), sizeof(glm::uint), count, out);
+    }
+
+    //quantisation of delta coded heights
+    DeltaContext inDelta, outDelta;
+    inDelta.parentHeights = outDelta.parentHeights = nullptr;
+    inDelta.childIndex = outDelta.childIndex = 0;
+    if (Terrain::Rlod::IsDeltaEncoding(inEncoding)) {
+      float quantisation[2];
+      fread(quantisation, sizeof(float), 2, in);
+      inDelta.codec = Terrain::CHeightDeltaCodec(patchSize, quantisation[0], quantisation[1]);
+    }
+    if (Terrain::Rlod::IsDeltaEncoding(outEncoding)) {
+      if (patchSize % 2 != 0) {
+        fclose(in);
+        fclose(out);
+        std::cerr << "delta coding needs an even patch size!" << std::endl;
+        return 1;
+      }
+
+      //the bounds of the root patch give the height range, by default it is quantised to 16 bits
+      glm::vec3 rootBounds[2];
+      long long hierarchy = _ftelli64(in);
+      _fseeki64(in, sizeof(glm::uint), SEEK_CUR);
+      fread(rootBounds, sizeof(glm::vec3), 2, in);
+      _fseeki64(in, hierarchy, SEEK_SET);
+      if (quantStep <= 0.f)
+        quantStep = glm::max(rootBounds[1].z - rootBounds[0].z, 1e-6f) / 65535.f;
+
+      float quantisation[2] = { quantStep, rootBounds[0].z };
+      fwrite(quantisation, sizeof(float), 2, out);
+      outDelta.codec = Terrain::CHeightDeltaCodec(patchSize, quantisation[0], quantisation[1]);
+    }
+
+    ConvertStats stats;
+    bool success = ConvertHierarchy(in, out, inEncoding, outEncoding, level, inDelta, outDelta, stats);
+    fclose(in);
+    fclose(out);
+    if (!success)
+      return 1;
+
+    std::cout << "converted " << stats.patches << " patches from " << EncodingName(inEncoding) << " to " << EncodingName(outEncoding)
+      << ": " << stats.rawBytes << " raw payload bytes stored in " << stats.storedBytes << " bytes (ratio "
+      << std::fixed << std::setprecision(2) << (stats.storedBytes > 0 ? double(stats.rawBytes) / stats.storedBytes : 0.0) << ")!" << std::endl;
+    return 0;
+  }
+
+
+
+  //sums up the raw payload sizes of the patch and its childs
+  static size_t GetRawPayloadSize(Terrain::CRasterTerrainModel::Patch const * patch)
+  {
+    size_t size = patch->vbuf.size() * sizeof(Terrain::CRasterTerrainModel::Vertex);
+    for (glm::uint i=0; i < 4; ++i)
+      if (patch->childs[i])
+        size += GetRawPayloadSize(patch->childs[i]);
+    return size;
+  }
+
+
+
+  int RlodBench(int argc, char* argv[])
+  {
+    static const int RUNS = 3;
+
+    if (argc < 1) {
+      std::cerr << "usage: rlod-bench <file.rlod> [file.rlod ...]" << std::endl;
+      return 1;
+    }
+
+    struct Result {
+      std::string file;
+      glm::uint encoding;
+      long long fileSize;
+      size_t rawSize;
+      double loadTime;      //best of all runs (ms)
+    };
+    std::vector<Result> results;
+
+    for (int i=0; i < argc; ++i) {
+      FILE* fp = nullptr;
+      if (fopen_s(&fp, argv[i], "rb") != 0 || fp == nullptr) {
+        std::cerr << "failed to open terrain file " << argv[i] << "!" << std::endl;
+        return 1;
+      }
+
+      Result result;
+      char sig[4];
+      result.file = argv[i];
+      fread(sig, 1, 4, fp);
+      fread(&result.encoding, sizeof(glm::uint), 1, fp);
+      result.encoding &= Terrain::Rlod::EncodingMask;
+      _fseeki64(fp, 0, SEEK_END);
+      result.fileSize = _ftelli64(fp);
+      fclose(fp);
+
+      //the first run warms the file cache, so the numbers are comparable between the files
+      result.loadTime = 0.0;
+      result.rawSize = 0;
+      for (int run=0; run <= RUNS; ++run) {
+        Terrain::CRasterTerrainModel model;
+        model.SetPayloadFormat(Terrain::CRasterTerrainModel::FloatPayload);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!model.Init(argv[i]))
+          return 1;
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double time = std::chrono::duration<double, std::milli>(end - start).count();
+        if (run == 1 || (run > 1 && time < result.loadTime))
+          result.loadTime = time;
+        result.rawSize = GetRawPayloadSize(model.GetRoot());
+      }
+      results.push_back(result);
+    }
+
+    std::cout << std::endl << std::left
+      << std::setw(32) << "file" << std::setw(14) << "encoding"
+      << std::right << std::setw(12) << "size [MB]" << std::setw(10) << "ratio"
+      << std::setw(12) << "load [ms]" << std::setw(14) << "file [MB/s]" << std::setw(14) << "raw [MB/s]" << std::endl;
+
+    for (auto iter = results.begin(); iter != results.end(); ++iter) {
+      double fileMB = iter->fileSize / (1024.0 * 1024.0);
+      double rawMB = iter->rawSize / (1024.0 * 1024.0);
+      double seconds = glm::max(iter->loadTime, 0.001) / 1000.0;
+
+      std::cout << std::left << std::setw(32) << iter->file << std::setw(14) << EncodingName(iter->encoding) << std::right << std::fixed
+        << std::setprecision(2) << std::setw(12) << fileMB
+        << std::setw(10) << (iter->fileSize > 0 ? double(iter->rawSize) / iter->fileSize : 0.0)
+        << std::setprecision(1) << std::setw(12) << iter->loadTime
+        << std::setw(14) << fileMB / seconds << std::setw(14) << rawMB / seconds << std::endl;
+    }
+    return 0;
+  }
+
+} //namespace Tools
@@ -0,0 +1,26 @@
+#pragma once
+
+
+namespace Tools {
+
+  //converts a raster-lod file to another payload encoding
+  //usage: rlod-convert <input.rlod> <output.rlod> <raw|half|deflate-raw|deflate-half|delta|deflate-delta> [deflate level] [quantisation step]
+  int RlodConvert(int argc, char* argv[]);
+
+  //loads raster-lod files with the terrain loader and prints size, compression ratio and load throughput
+  //usage: rlod-bench <file.rlod> [file.rlod ...]
+  //
+  //example dataset: "generate example.rlod" (seed 1, depth 6, 4097 x 4097 samples, 5461 patches of 64 x 64 quads), converted
+  //with rlod-convert at the default deflate level. best of 3 warm cache loads on a single core (the inflate pool has one thread),
+  //the ratio is the raw vertex payload over the file size:
+  //
+  //  encoding        size [MB]   ratio   load [ms]   file [MB/s]   raw [MB/s]
+  //  raw                546.47    0.97      2835.4         192.7        186.3
+  //  half               282.42    1.87      3464.3          81.5        152.4
+  //  deflate-raw        365.32    1.45      6779.8          53.9         77.9
+  //  deflate-half       216.39    2.44      6040.7          35.8         87.4
+  //  delta               40.64   12.99      3175.7          12.8        166.3
+  //  deflate-delta       31.20   16.92      3282.9           9.5        160.9
+  int RlodBench(int argc, char* argv[]);
+
+} //namespace Tools
@@ -0,0 +1,121 @@
+#include "TextureTools.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "GLTexture.h"
+#include "PngReader.h"
+
+
+namespace Tools {
+
+  int PngBench(int argc, char* argv[])
+  {
+    static const int RUNS = 5;
+
+    if (argc < 1) {
+      std::cerr << "usage: pngbench <file.png> [file.png ...]" << std::endl;
+      return 1;
+    }
+
+    struct Result {
+      std::string file;
+      int width;
+      int height;
+      size_t fileSize;
+      size_t pixelSize;
+      double streamTime;    //best of all runs (ms)
+      double mappedTime;
+    };
+    std::vector<Result> results;
+
+    for (int i=0; i < argc; ++i) {
+      Result result;
+      result.file = argv[i];
+      result.streamTime = 0.0;
+      result.mappedTime = 0.0;
+
+      //the first run warms the file cache, so both readers read the file from memory
+      std::vector<unsigned char> streamData;
+      std::vector<unsigned char> mappedData;
+      for (int run=0; run <= RUNS; ++run) {
+        bool hasAlpha;
+        GLUtils::Format format;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!GLUtils::LoadPngImage(argv[i], result.width, result.height, hasAlpha, format, streamData)) {
+          std::cerr << "failed to decode " << argv[i] << "!" << std::endl;
+          return 1;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double, std::milli>(end - start).count();
+        if (run == 1 || (run > 1 && time < result.streamTime))
+          result.streamTime = time;
+
+        //the allocation of the destination is timed as well, like the one of the stream reader
+        start = std::chrono::high_resolution_clock::now();
+        GLUtils::CPngReader reader;
+        bool decoded = reader.Open(argv[i]);
+        if (decoded) {
+          mappedData.clear();
+          mappedData.resize(reader.GetImageSize());
+          decoded = reader.Decode(mappedData.data());
+        }
+        reader.Close();
+        end = std::chrono::high_resolution_clock::now();
+        if (!decoded) {
+          std::cerr << "failed to decode " << argv[i] << " from the mapped file!" << std::endl;
+          return 1;
+        }
+        time = std::chrono::duration<double, std::milli>(end - start).count();
+        if (run == 1 || (run > 1 && time < result.mappedTime))
+          result.mappedTime = time;
+      }
+
+      if (streamData.size() != mappedData.size() || memcmp(streamData.data(), mappedData.data(), streamData.size()) != 0) {
+        std::cerr << "the readers decoded different pixels from " << argv[i] << "!" << std::endl;
+        return 1;
+      }
+
+      GLUtils::CMappedFile file;
+      file.Open(argv[i]);
+      result.fileSize = file.GetSize();
+      result.pixelSize = mappedData.size();
+      results.push_back(result);
+    }
+
+    std::cout << std::endl << std::left
+      << std::setw(32) << "file" << std::setw(12) << "size"
+      << std::right << std::setw(12) << "file [MB]" << std::setw(14) << "pixels [MB]"
+      << std::setw(13) << "stream [ms]" << std::setw(13) << "mapped [ms]"
+      << std::setw(16) << "stream [MB/s]" << std::setw(16) << "mapped [MB/s]" << std::setw(10) << "speedup" << std::endl;
+
+    double streamTotal = 0.0, mappedTotal = 0.0, pixelTotal = 0.0;
+    for (auto iter = results.begin(); iter != results.end(); ++iter) {
+      double fileMB = iter->fileSize / (1024.0 * 1024.0);
+      double pixelMB = iter->pixelSize / (1024.0 * 1024.0);
+      double streamSeconds = std::max(iter->streamTime, 0.001) / 1000.0;
+      double mappedSeconds = std::max(iter->mappedTime, 0.001) / 1000.0;
+      streamTotal += streamSeconds;
+      mappedTotal += mappedSeconds;
+      pixelTotal += pixelMB;
+
+      std::string size = std::to_string(iter->width) + " x " + std::to_string(iter->height);
+      std::cout << std::left << std::setw(32) << iter->file << std::setw(12) << size << std::right << std::fixed
+        << std::setprecision(2) << std::setw(12) << fileMB << std::setw(14) << pixelMB
+        << std::setprecision(1) << std::setw(13) << iter->streamTime << std::setw(13) << iter->mappedTime
+        << std::setw(16) << pixelMB / streamSeconds << std::setw(16) << pixelMB / mappedSeconds
+        << std::setprecision(2) << std::setw(10) << streamSeconds / mappedSeconds << std::endl;
+    }
+
+    std::cout << std::left << std::setw(44) << "total" << std::right << std::fixed << std::setprecision(2) << std::setw(26) << pixelTotal
+      << std::setprecision(1) << std::setw(13) << streamTotal * 1000.0 << std::setw(13) << mappedTotal * 1000.0
+      << std::setw(16) << pixelTotal / streamTotal << std::setw(16) << pixelTotal / mappedTotal
+      << std::setprecision(2) << std::setw(10) << streamTotal / mappedTotal << std::endl;
+    return 0;
+  }
+
+} //namespace Tools
@@ -0,0 +1,11 @@
+#pragma once
+
+
+namespace Tools {
+
+  //decodes png files with the stream reader (LoadPngImage) and the mapped reader (CPngReader) and prints the decode
+  //throughput of both in MB of pixels per second. the decoded pixels of both readers are compared
+  //usage: pngbench <file.png> [file.png ...]
+  int PngBench(int argc, char* argv[]);
+
+} //namespace Tools